@@ -61,6 +61,29 @@
  * \defgroup tScript                 t-script
  */
 
+/**
+ * \page page_simulated_channels Simulated channels
+ *
+ * Simulated channels are set up with the environment variable
+ * \c KVASER_CANLIB_SIM, as
+ * \c "<channels>[,bitrate=N][,txqueue=N][,rxqueue=N][,errorrate=N][,seed=N]".
+ * They are numbered after the hardware channels and are all connected to
+ * virtual bus 0, see \ref canIOCTL_CONNECT_TO_VIRTUAL_BUS. Frames take the
+ * time they would on a real bus at the set bitrate, at most 8 Mbit/s, and
+ * frames waiting on several channels are sent in arbitration order. Bit
+ * errors are set up with \ref canIOCTL_SIM_SET_ERROR_RATE and
+ * \ref canIOCTL_SIM_INJECT_ERRORS.
+ *
+ * Envvars, see \ref kvScriptEnvvarOpen(), are only available on simulated
+ * channels; on hardware channels the envvar functions return
+ * \ref canERR_NOT_IMPLEMENTED. The envvars are declared with the
+ * environment variable \c KVASER_CANLIB_SIM_ENVVARS as a comma separated
+ * list of \c "<name>:int", \c "<name>:float" and
+ * \c "<name>:string:<size>". Each channel has its own values, which start
+ * out as zero, and \ref canNOTIFY_ENVVAR reports the changes made on the
+ * other handles of a channel.
+ */
+
 #ifndef _CANLIB_H_
 #define _CANLIB_H_
 
@@ -78,6 +101,8 @@ typedef int canHandle;
 /** Handle to an opened circuit, created with \ref canOpenChannel(). */
 typedef canHandle CanHandle;
 
+struct kvEnvvarEvent;
+
 typedef struct canNotifyData {
   void *tag;
   int eventType;
@@ -99,6 +124,10 @@ typedef struct canNotifyData {
       unsigned char rxErrorCounter;
       unsigned long time;
     } status;
+    struct {
+      const struct kvEnvvarEvent *event;  // The envvar and its new value
+      unsigned long time;
+    } envvar;
   } info;
 } canNotifyData;
 
@@ -710,6 +739,172 @@ canStatus CANLIBAPI canAccept (const CanHandle hnd,
                                const long envelope,
                                const unsigned int flag);
 
+/**
+ * \ingroup CAN
+ *
+ * This routine sets the message acceptance filter for one frame format on a
+ * CAN channel, setting both code and mask in one call.
+ *
+ * A received identifier is accepted if (id & \a mask) == (\a code & \a mask),
+ * i.e. a set bit in \a mask means that the bit must match \a code.
+ *
+ * \param[in]  hnd          An open handle to a CAN circuit.
+ * \param[in]  code         The acceptance code to set.
+ * \param[in]  mask         The acceptance mask to set; 0 removes the filter.
+ * \param[in]  is_extended  If non-zero, the filter applies to extended
+ *                          (29-bit) identifiers, otherwise to standard
+ *                          (11-bit) identifiers.
+ *
+ * \return \ref canOK (zero) if success
+ * \return \ref canERR_xxx (negative) if failure
+ *
+ * \sa \ref canAccept(), \ref kvSetFilterIds()
+ */
+canStatus CANLIBAPI canSetAcceptanceFilter (const CanHandle hnd,
+                                            unsigned int code,
+                                            unsigned int mask,
+                                            int is_extended);
+
+/**
+ * \ingroup CAN
+ *
+ * The result of compiling a set of identifiers into an acceptance filter,
+ * see \ref kvFilterCompile().
+ */
+typedef struct kvFilterSet {
+  int           is_extended;     ///< Non-zero for extended identifiers.
+  unsigned int  code;            ///< Acceptance code, see \ref canSetAcceptanceFilter().
+  unsigned int  mask;            ///< Acceptance mask, a set bit must match \a code.
+  unsigned int  nIds;            ///< Number of distinct identifiers in the set.
+  unsigned int  falsePositives;  ///< Identifiers accepted by the filter but not in the set.
+  double        passRatio;       ///< Fraction of the identifier space accepted by the filter.
+} kvFilterSet;
+
+/**
+ * \ingroup CAN
+ *
+ * Compiles a set of identifiers into the code/mask pair that accepts every
+ * identifier in the set and as few other identifiers as possible: the mask
+ * has a bit set for every bit that is equal in all identifiers.
+ *
+ * The expected pass-through ratio, assuming evenly distributed identifiers
+ * on the bus, is returned in \a filter.
+ *
+ * \param[in]  ids          The identifiers to accept. Duplicates are allowed.
+ * \param[in]  count        The number of identifiers in \a ids.
+ * \param[in]  is_extended  Non-zero if \a ids are extended (29-bit) identifiers.
+ * \param[out] filter       The compiled filter.
+ *
+ * \return \ref canOK (zero) if success
+ * \return \ref canERR_PARAM if an identifier is out of range
+ * \return \ref canERR_xxx (negative) if failure
+ *
+ * \sa \ref kvSetFilterIds()
+ */
+canStatus CANLIBAPI kvFilterCompile (const unsigned int *ids,
+                                     unsigned int count,
+                                     int is_extended,
+                                     kvFilterSet *filter);
+
+/**
+ * \ingroup CAN
+ *
+ * Sets up filtering so that only the identifiers in \a ids, of the given
+ * frame format, are received on the handle.
+ *
+ * The identifiers are compiled into the best acceptance filter the channel
+ * supports, which is programmed in one update. Identifiers that pass the
+ * acceptance filter but are not in the set are then dropped in the library,
+ * before they reach \ref canRead() or a notification callback. Error frames
+ * and frames of the other format are not affected.
+ *
+ * \param[in]  hnd          An open handle to a CAN circuit.
+ * \param[in]  ids          The identifiers to receive, or NULL to remove the
+ *                          filter.
+ * \param[in]  count        The number of identifiers in \a ids, 0 to remove
+ *                          the filter.
+ * \param[in]  is_extended  Non-zero if \a ids are extended (29-bit) identifiers.
+ * \param[out] filter       If not NULL, receives the compiled acceptance
+ *                          filter and its expected pass-through ratio.
+ *
+ * \return \ref canOK (zero) if success
+ * \return \ref canERR_xxx (negative) if failure
+ *
+ * \sa \ref kvFilterCompile(), \ref canSetAcceptanceFilter()
+ */
+canStatus CANLIBAPI kvSetFilterIds (const CanHandle hnd,
+                                    const unsigned int *ids,
+                                    unsigned int count,
+                                    int is_extended,
+                                    kvFilterSet *filter);
+
+/**
+ * \ingroup CAN
+ *
+ * Statistics of the filter program on a handle, see
+ * \ref kvGetFilterProgramStats().
+ */
+typedef struct kvFilterProgramStats {
+  uint64_t evaluations;  ///< Frames the program has been run on.
+  uint64_t rejected;     ///< Frames the program rejected.
+  double   rejectRatio;  ///< Rejected frames as a fraction of evaluations.
+  double   evalsPerSec;  ///< Evaluations per second since the program was set.
+  double   avgEvalNs;    ///< Average run time of the program, in ns.
+} kvFilterProgramStats;
+
+/**
+ * \ingroup CAN
+ *
+ * Attaches a filter program to a handle. Received frames for which the
+ * program evaluates to zero are dropped in the library, before they are
+ * copied to the caller of \ref canRead(), \ref canReadWait() and similar,
+ * or passed to a notification callback. Error frames and transmit
+ * acknowledgements are not filtered.
+ *
+ * The program is given as an expression with C operators and precedence
+ * over the fields \c id, \c ext (1 for extended identifiers), \c flags
+ * (\ref canMSG_xxx), \c dlc, \c len (number of data bytes) and
+ * \c data[n] (0 beyond the data length), for example
+ *
+ * \code
+ *   data[0] == 0x12 && (id & 0x700) == 0x100
+ * \endcode
+ *
+ * The expression is compiled into a bytecode that is verified to always
+ * terminate and to stay within the frame. Parentheses nest at most 64 deep,
+ * a deeper '(' is reported as a syntax error.
+ *
+ * \param[in]  hnd       An open handle to a CAN circuit.
+ * \param[in]  expr      The filter expression, or NULL to remove the program.
+ * \param[out] errorPos  If not NULL, receives the offset in \a expr of a
+ *                       syntax error, or -1.
+ *
+ * \return \ref canOK (zero) if success
+ * \return \ref canERR_PARAM if \a expr is not a valid expression
+ * \return \ref canERR_xxx (negative) if failure
+ *
+ * \sa \ref kvGetFilterProgramStats(), \ref kvSetFilterIds()
+ */
+canStatus CANLIBAPI kvSetFilterProgram (const CanHandle hnd,
+                                        const char *expr,
+                                        int *errorPos);
+
+/**
+ * \ingroup CAN
+ *
+ * Gets the statistics of the filter program on a handle, see
+ * \ref kvSetFilterProgram().
+ *
+ * \param[in]  hnd    An open handle to a CAN circuit.
+ * \param[out] stats  Receives the statistics.
+ *
+ * \return \ref canOK (zero) if success
+ * \return \ref canERR_PARAM if there is no filter program on \a hnd
+ * \return \ref canERR_xxx (negative) if failure
+ */
+canStatus CANLIBAPI kvGetFilterProgramStats (const CanHandle hnd,
+                                             kvFilterProgramStats *stats);
+
 /**
  * \ingroup CAN
  *
@@ -1031,6 +1226,10 @@ canStatus CANLIBAPI canReadSpecific (const CanHandle hnd, long id, void * msg,
  * Waits until the receive buffer contains at least one message or a timeout
  * occurs.
  *
+ * The filters set with \ref kvSetFilterIds() and \ref kvSetFilterProgram()
+ * are applied when a message is read, so this can return \ref canOK for a
+ * message that the next read then drops.
+ *
  * If you are using the same channel via multiple handles, note that the
  * default behaviour is that the different handles will "hear" each other just as
  * if each handle referred to a channel of its own. If you open, say, channel 0
@@ -1063,6 +1262,10 @@ canStatus CANLIBAPI canReadSync (const CanHandle hnd, unsigned long timeout);
  * Waits until the receive queue contains a message with the specified id, or a
  * timeout occurs..
  *
+ * The filters set with \ref kvSetFilterIds() and \ref kvSetFilterProgram()
+ * are applied when a message is read, so this can return \ref canOK for a
+ * message that the next read then drops.
+ *
  * If you are using the same channel via multiple handles, note that the
  * default behaviour is that the different handles will "hear" each other just as
  * if each handle referred to a channel of its own. If you open, say, channel 0
@@ -1147,6 +1350,16 @@ canStatus CANLIBAPI canReadSpecificSkip (const CanHandle hnd,
  *
  * This function associates a callback function with the CAN circuit.
  *
+ * With \ref canNOTIFY_ENVVAR, the callback is called with \ref canEVENT_ENVVAR
+ * when an envvar that \a hnd has open with \ref kvScriptEnvvarOpen() is
+ * changed. \a info.envvar.event points to a \ref kvEnvvarEvent with its
+ * \ref kvEnvHandle and new value, valid until the callback returns. An
+ * envvar changed several times before the callback runs is reported once,
+ * with the value it has then.
+ * Only simulated channels report envvar changes, see
+ * \ref page_simulated_channels; otherwise \ref canNOTIFY_ENVVAR is
+ * ignored.
+ *
  * \param[in] hnd          A handle to an open CAN circuit.
  * \param[in] callback     Handle to callback routine.
  * \param[in] notifyFlags  The events specified with \ref canNOTIFY_xxx, for
@@ -1402,6 +1615,41 @@ canStatus CANLIBAPI canReadTimer (const CanHandle hnd, unsigned long *time);
  */
 CanHandle CANLIBAPI canOpenChannel (int channel, int flags);
 
+/**
+ * \ingroup CAN
+ *
+ * Opens a number of CAN channels (circuits) in one call and returns a handle
+ * for each of them. The result is the same as calling \ref canOpenChannel()
+ * once per channel, but the hardware is only enumerated once and the
+ * channels are opened in parallel, so that slow round-trips to different
+ * devices overlap instead of adding up.
+ *
+ * The call either opens all channels or none of them. If any channel fails
+ * to open, the channels that were opened are closed again, and all of
+ * \a out is set to \ref canINVALID_HANDLE. \a status then tells which
+ * channels failed: \a status[i] is \ref canOK for a channel that had no
+ * problem of its own, whether or not it was closed again, and the
+ * \ref canERR_xxx code for a channel that failed. If the call fails before
+ * any channel is tried, e.g. with \ref canERR_NOMEM, all entries hold that
+ * code.
+ *
+ * \param[in]  channels  An array of \a n channel numbers.
+ * \param[in]  n         The number of channels to open.
+ * \param[in]  flags     A combination of \ref canOPEN_xxx flags, used for all
+ *                       channels.
+ * \param[out] out       An array of \a n handles, one for each entry in
+ *                       \a channels.
+ * \param[out] status    An array of \a n results, one for each entry in
+ *                       \a channels, or \c NULL.
+ *
+ * \return \ref canOK (zero) if success
+ * \return \ref canERR_xxx (negative) if failure; the first error found
+ *
+ * \sa \ref canOpenChannel(), \ref canClose()
+ */
+canStatus CANLIBAPI canOpenChannels (const int *channels, int n, int flags,
+                                     canHandle *out, canStatus *status);
+
 /**
  * \ingroup General
  *
@@ -2640,8 +2888,99 @@ canStatus CANLIBAPI canGetChannelData (int channel,
    * This ioctl resets overrun count and flags, \sa \ref canReadStatus \sa \ref canGetBusStatistics
    */
 #  define canIOCTL_RESET_OVERRUN_COUNT                          44
+
+  /**
+   * This define is used in \ref canIoCtl(), \a buf mentioned below refers to this
+   * functions argument.
+   *
+   * \a buf points to a 32-bit unsigned integer. A non-zero value starts a
+   * background correlation of the device timer against the host clocks, zero
+   * stops it. See \ref kvGetClockCorrelation().
+   */
+#  define canIOCTL_SET_CLOCK_CORRELATION                        45
+
+  /**
+   * This define is used in \ref canIoCtl(), \a buf mentioned below refers to this
+   * functions argument.
+   *
+   * \a buf points to a 32-bit unsigned integer that selects the clock used
+   * for timestamps returned by the read functions, notifications,
+   * \ref canReadTimer(), \ref kvReadTimer() and \ref kvReadTimer64(), one of
+   * \ref canTIMESTAMP_CLOCK_xxx. Host clocks start the background
+   * correlation. Timestamps are still scaled to the resolution set with
+   * \ref canIOCTL_SET_TIMER_SCALE. Updates of the correlation never move
+   * them backwards; a step of the wall clock may, with
+   * \ref canTIMESTAMP_CLOCK_REALTIME.
+   */
+#  define canIOCTL_SET_TIMESTAMP_CLOCK                          46
+
+  /**
+   * This define is used in \ref canIoCtl(), \a buf mentioned below refers to this
+   * functions argument.
+   *
+   * \a buf points to a 32-bit unsigned integer that receives the current
+   * \ref canTIMESTAMP_CLOCK_xxx.
+   */
+#  define canIOCTL_GET_TIMESTAMP_CLOCK                          47
+
+  /**
+   * This define is used in \ref canIoCtl(), \a buf mentioned below refers to this
+   * functions argument.
+   *
+   * \a buf points to a 32-bit unsigned integer that turns library-wide API
+   * statistics on (1) or off (0), see \ref canGetStats(). Statistics can
+   * also be turned on by setting the environment variable
+   * \c KVASER_CANLIB_STATS, in which case they are printed to stderr by
+   * \ref canUnloadLibrary().
+   */
+#  define canIOCTL_SET_API_STATS                                48
+
+  /**
+   * This define is used in \ref canIoCtl(), \a buf mentioned below refers to this
+   * functions argument.
+   *
+   * Clears the library-wide API statistics; \a buf is not used.
+   */
+#  define canIOCTL_RESET_API_STATS                              49
+
+  /**
+   * This define is used in \ref canIoCtl(), \a buf mentioned below refers to this
+   * functions argument.
+   *
+   * \a buf points to a 32-bit unsigned integer with the number of frames
+   * per million, 0..1000000, that are destroyed by a bit error when sent on
+   * a simulated channel. The frames are sent again as on a real bus, and the
+   * error counters of the channels on the bus are updated. Only simulated
+   * channels support this, see \ref page_simulated_channels.
+   */
+#  define canIOCTL_SIM_SET_ERROR_RATE                           50
+
+  /**
+   * This define is used in \ref canIoCtl(), \a buf mentioned below refers to this
+   * functions argument.
+   *
+   * \a buf points to a 32-bit unsigned integer with the number of frames,
+   * sent from this simulated channel from now on, that are destroyed by a
+   * bit error. Sending a frame 32 times in a row this way takes the channel
+   * bus off. Only simulated channels support this, see
+   * \ref page_simulated_channels.
+   */
+#  define canIOCTL_SIM_INJECT_ERRORS                            51
  /** @} */
 
+/**
+ * \name canTIMESTAMP_CLOCK_xxx
+ * \anchor canTIMESTAMP_CLOCK_xxx
+ *
+ * These defines are used with \ref canIOCTL_SET_TIMESTAMP_CLOCK.
+ *
+ * @{
+ */
+#define canTIMESTAMP_CLOCK_DEVICE     0  ///< The device's own timer (default)
+#define canTIMESTAMP_CLOCK_MONOTONIC  1  ///< The host's CLOCK_MONOTONIC
+#define canTIMESTAMP_CLOCK_REALTIME   2  ///< The host's CLOCK_REALTIME
+/** @} */
+
 /** Used in \ref canIOCTL_SET_USER_IOPORT and \ref canIOCTL_GET_USER_IOPORT. */
 typedef struct {
   unsigned int portNo;     ///< Port number used in e.g. \ref canIOCTL_SET_USER_IOPORT
@@ -2725,6 +3064,14 @@ canStatus CANLIBAPI canObjBufFreeAll (const CanHandle hnd);
  * Allocates an object buffer associated with a handle to a CAN
  * circuit.
  *
+ * If the device has no object buffers, the library provides them in
+ * software, with indices from \ref kvOBJBUF_SOFTWARE_INDEX. Periodic
+ * transmits and bursts are then sent from a library thread, and
+ * auto-responses are sent when the request is read from the handle with
+ * \ref canRead() and friends or by the notification dispatcher, so the
+ * handle must be read for them to work. See \ref kvObjBufGetStats() for
+ * the timing that results.
+ *
  * \param[in] hnd   An open handle to a CAN circuit.
  * \param[in] type  The type of the buffer. Must be one of \ref canOBJBUF_TYPE_xxx
  *
@@ -2748,6 +3095,14 @@ canStatus CANLIBAPI canObjBufAllocate (const CanHandle hnd, int type);
 #define canOBJBUF_TYPE_PERIODIC_TX              0x02 ///< The buffer is an auto-transmit buffer.
  /** @} */
 
+/**
+ * \ingroup ObjectBuffers
+ *
+ * Object buffers with this index and above are run by the library, see
+ * \ref canObjBufAllocate().
+ */
+#define kvOBJBUF_SOFTWARE_INDEX                 256
+
 /**
  * \ingroup ObjectBuffers
  *
@@ -2969,6 +3324,93 @@ canStatus CANLIBAPI canObjBufEnable (const CanHandle hnd, int idx);
  */
 canStatus CANLIBAPI canObjBufDisable (const CanHandle hnd, int idx);
 
+/**
+ * \ingroup ObjectBuffers
+ *
+ * Timing of an object buffer run by the library, see
+ * \ref kvObjBufGetStats().
+ */
+typedef struct kvObjBufStats {
+  uint64_t sent;           ///< Frames sent from the buffer.
+  uint64_t responses;      ///< Auto-responses among \a sent.
+  uint64_t txErrors;       ///< Frames that could not be queued for transmission.
+  double   avgJitterUs;    ///< Mean delay of periodic transmits after their scheduled time, in us.
+  double   maxJitterUs;    ///< Longest such delay, in us.
+  double   avgResponseUs;  ///< Mean time from reading a request to queuing the response, in us.
+  double   maxResponseUs;  ///< Longest such time, in us.
+} kvObjBufStats;
+
+/**
+ * \ingroup ObjectBuffers
+ *
+ * Gets transmit counts and timing of a software object buffer, i.e. one
+ * with an index from \ref kvOBJBUF_SOFTWARE_INDEX. Large jitter or
+ * response times mean that the application needs a device with object
+ * buffers in hardware.
+ *
+ * \param[in]  hnd    An open handle to a CAN circuit.
+ * \param[in]  idx    The index of the object buffer.
+ * \param[out] stats  The statistics.
+ *
+ * \return \ref canOK (zero) if success
+ * \return \ref canERR_NOT_SUPPORTED if \a idx is a buffer in the device
+ * \return \ref canERR_xxx (negative) if failure
+ */
+canStatus CANLIBAPI kvObjBufGetStats (const CanHandle hnd, int idx,
+                                      kvObjBufStats *stats);
+
+/**
+ * \ingroup ObjectBuffers
+ *
+ * Setup of one object buffer, see \ref canObjBufConfigure().
+ */
+typedef struct canObjBufSpec {
+  int           type;      ///< \ref canOBJBUF_TYPE_xxx
+  long          id;        ///< Identifier of the message in the buffer.
+  unsigned int  dlc;       ///< Length of the message, as in \ref canObjBufWrite().
+  unsigned int  flags;     ///< \ref canMSG_xxx and \ref canFDMSG_xxx flags of the message.
+  unsigned char data[64];  ///< Message data.
+  unsigned int  period;    ///< Periodic buffers: period in us, or 0 to not set it.
+  unsigned int  msgCount;  ///< Periodic buffers: message count, or 0 to not set it.
+  unsigned int  code;      ///< Auto-response buffers: acceptance code.
+  unsigned int  mask;      ///< Auto-response buffers: acceptance mask.
+  unsigned int  bufFlags;  ///< Auto-response buffers: \ref canOBJBUF_AUTO_RESPONSE_xxx
+  int           enable;    ///< Non-zero to enable the buffer.
+} canObjBufSpec;
+
+/**
+ * \ingroup ObjectBuffers
+ *
+ * Allocates, writes, sets up and enables a number of object buffers in one
+ * call. All specifications are checked before anything is allocated, and
+ * the buffers are enabled only when all of them have been set up, the
+ * auto-response buffers before the periodic ones. If any step fails, the
+ * buffers allocated by the call are disabled and freed again, so that
+ * either all or none of them exist afterwards. Only when enabling a
+ * periodic buffer fails may the periodic buffers enabled before it have
+ * sent frames.
+ *
+ * A zero \a period, \a msgCount, \a code and \a mask, or \a bufFlags
+ * leaves the value a buffer has after \ref canObjBufAllocate(), and costs
+ * no driver call.
+ *
+ * \param[in]  hnd      An open handle to a CAN circuit.
+ * \param[in]  specs    The buffers to set up.
+ * \param[in]  n        The number of entries in \a specs.
+ * \param[out] indices  Receives the index of each buffer, -1 on failure.
+ *
+ * \return \ref canOK (zero) if success
+ * \return \ref canERR_PARAM if a specification is invalid
+ * \return \ref canERR_NOT_SUPPORTED if a specification asks for
+ *         \ref canMSG_SINGLE_SHOT and the channel cannot send single shot
+ * \return \ref canERR_xxx (negative) if failure
+ *
+ * \sa \ref canObjBufAllocate(), \ref canObjBufWrite()
+ */
+canStatus CANLIBAPI canObjBufConfigure (const CanHandle hnd,
+                                        const canObjBufSpec *specs, int n,
+                                        int *indices);
+
 /**
  * \ingroup ObjectBuffers
  *
@@ -3318,107 +3760,426 @@ canStatus CANLIBAPI canGetBusStatistics (const CanHandle hnd,
                                          canBusStatistics *stat,
                                          size_t bufsiz);
 
+/**
+ * \ingroup CAN
+ *
+ * One sample of the bus statistics sampler, see \ref kvBusStatsStart().
+ * The counters are the changes since the previous sample.
+ */
+typedef struct kvBusStatsSample {
+  int64_t      timeUs;      ///< CLOCK_MONOTONIC time of the sample, in us.
+  unsigned int intervalUs;  ///< Time since the previous sample, in us.
+  unsigned int stdData;     ///< Standard data frames received in the interval.
+  unsigned int stdRemote;   ///< Standard remote frames received in the interval.
+  unsigned int extData;     ///< Extended data frames received in the interval.
+  unsigned int extRemote;   ///< Extended remote frames received in the interval.
+  unsigned int errFrame;    ///< Error frames in the interval.
+  unsigned int overruns;    ///< Overruns in the interval.
+  unsigned int busLoad;     ///< Bus load, 0 - 10000 for 0.00% - 100.00%.
+} kvBusStatsSample;
 
 /**
  * \ingroup CAN
  *
- * \source_cs       <b>static Canlib.canStatus canGetHandleData(int hnd, int item, out object buffer);</b>
+ * Rates and bus load distribution over a window of samples, see
+ * \ref kvBusStatsGetSummary(). Bus loads are 0 - 10000 for
+ * 0.00% - 100.00%.
+ */
+typedef struct kvBusStatsSummary {
+  unsigned int nSamples;         ///< Number of samples in the window.
+  double       spanSec;          ///< Time covered by the samples, in s.
+  double       framesPerSec;     ///< Data and remote frames per second.
+  double       errFramesPerSec;  ///< Error frames per second.
+  double       overrunsPerSec;   ///< Overruns per second.
+  unsigned int busLoadMean;      ///< Mean bus load.
+  unsigned int busLoadMin;       ///< Lowest bus load.
+  unsigned int busLoadP50;       ///< Median bus load.
+  unsigned int busLoadP90;       ///< 90th percentile bus load.
+  unsigned int busLoadP99;       ///< 99th percentile bus load.
+  unsigned int busLoadMax;       ///< Highest bus load.
+} kvBusStatsSummary;
+
+/**
+ * \ingroup CAN
  *
- * \source_delphi   <b>function canGetHandleData(handle: canHandle; item: Integer; var Buffer; bufsize: Cardinal): canStatus;     </b>
- * \source_end
+ * Starts a background sampler of the bus statistics on a handle. Every
+ * \a intervalMs the sampler requests and reads the statistics, as
+ * \ref canRequestBusStatistics() and \ref canGetBusStatistics() do, and
+ * stores the changes since the previous sample in a ring of the last
+ * \a depth samples.
  *
- * \note This function can be used to retrieve certain pieces of information about an open handle to a CANlib channel.
+ * Readers get samples and summaries from the ring without locking and
+ * without any I/O to the device, so any number of consumers can follow
+ * the bus load at a high rate.
  *
- * \param[in]  hnd      An open handle to a CAN channel.
- * \param[in]  item     This parameter specifies what data to obtain for the specified handle. The value is one of the constants \ref canCHANNELDATA_xxx
- * \param[out] buffer   The address of a buffer which is to receive the data.
- * \param[in]  bufsize  The size of the buffer to which the buffer parameter points.
+ * Starting a sampler that is already running changes its interval and
+ * depth and clears the ring; this must not be done while other threads
+ * read from it.
+ *
+ * \param[in] hnd         An open handle to a CAN channel.
+ * \param[in] intervalMs  Time between samples in ms, at least 1.
+ * \param[in] depth       Number of samples kept, at least 2.
  *
  * \return \ref canOK (zero) if success
  * \return \ref canERR_xxx (negative) if failure
  *
- * \sa \ref canGetChannelData()
+ * \sa \ref kvBusStatsStop(), \ref kvBusStatsGetSamples(),
+ *     \ref kvBusStatsGetSummary()
  */
-canStatus CANLIBAPI canGetHandleData (const CanHandle hnd,
-                                      int item,
-                                      void *buffer,
-                                      size_t bufsize);
-
-/** Used for time domain handling. */
-typedef void *kvTimeDomain;
-
-/** Contains status codes according to \ref canSTAT_xxx. */
-typedef canStatus kvStatus;
+canStatus CANLIBAPI kvBusStatsStart (const CanHandle hnd,
+                                     unsigned int intervalMs,
+                                     unsigned int depth);
 
 /**
+ * \ingroup CAN
  *
- * Used for time domain handling.
+ * Stops the bus statistics sampler on a handle. The samples already taken
+ * can still be read. The sampler is stopped by \ref canClose().
+ *
+ * \param[in] hnd  An open handle to a CAN channel.
+ *
+ * \return \ref canOK (zero) if success
+ * \return \ref canERR_xxx (negative) if failure
+ *
+ * \sa \ref kvBusStatsStart()
  */
-typedef struct kvTimeDomainData_s {
-  int nMagiSyncGroups;        ///< number of MagiSync&tm; groups
-  int nMagiSyncedMembers;     ///< number of MagiSync&tm; members
-  int nNonMagiSyncCards;      ///< number of non MagiSync&tm; interfaces
-  int nNonMagiSyncedMembers;  ///< number of non MagiSync&tm; members
-} kvTimeDomainData;
+canStatus CANLIBAPI kvBusStatsStop (const CanHandle hnd);
 
 /**
- * \ingroup TimeDomainHandling
- *
- * \source_cs       <b>static Canlib.canStatus kvTimeDomainCreate(out object domain);</b>
+ * \ingroup CAN
  *
- * \source_delphi   <b>function kvTimeDomainCreate(var domain: kvTimeDomain): kvStatus;     </b>
- * \source_end
+ * Gets the most recent samples of the bus statistics sampler, oldest
+ * first.
  *
- * This routine creates an empty time domain.
+ * \param[in]     hnd      An open handle to a CAN channel.
+ * \param[out]    samples  A buffer that receives the samples.
+ * \param[in,out] count    The number of entries in \a samples on entry, the
+ *                         number of samples returned on exit.
  *
- * The variable is set by this function and then used in later calls to
- * other functions using a \ref kvTimeDomain.
+ * \return \ref canOK (zero) if success
+ * \return \ref canERR_PARAM if no sampler has been started on \a hnd
+ * \return \ref canERR_xxx (negative) if failure
  *
- * Time domains created by \ref kvTimeDomainCreate() can be destroyed with a
- * call to \ref kvTimeDomainDelete().
+ * \sa \ref kvBusStatsStart(), \ref kvBusStatsGetSummary()
+ */
+canStatus CANLIBAPI kvBusStatsGetSamples (const CanHandle hnd,
+                                          kvBusStatsSample *samples,
+                                          unsigned int *count);
+
+/**
+ * \ingroup CAN
  *
- * \note A time domain is a set of channels with a common time base.
+ * Gets rates and the bus load distribution over the samples taken in the
+ * last \a windowMs milliseconds.
  *
- * \param[out] domain  A pointer to a caller allocated, opaque variable of type
- *                     \ref kvTimeDomain that holds data to identify a particlar
- *                     time domain.
+ * \param[in]  hnd       An open handle to a CAN channel.
+ * \param[in]  windowMs  The length of the window in ms, 0 for all samples
+ *                       in the ring.
+ * \param[out] summary   Receives the summary.
  *
  * \return \ref canOK (zero) if success
+ * \return \ref canERR_PARAM if no sampler has been started on \a hnd
  * \return \ref canERR_xxx (negative) if failure
  *
- * \sa \ref page_code_snippets_examples
- * \sa \ref kvTimeDomainDelete()
+ * \sa \ref kvBusStatsStart(), \ref kvBusStatsGetSamples()
  */
-kvStatus CANLIBAPI kvTimeDomainCreate (kvTimeDomain *domain);
+canStatus CANLIBAPI kvBusStatsGetSummary (const CanHandle hnd,
+                                          unsigned int windowMs,
+                                          kvBusStatsSummary *summary);
 
 /**
- * \ingroup TimeDomainHandling
- *
- * \source_cs       <b>static Canlib.canStatus kvTimeDomainDelete(object domain);</b>
+ * \ingroup CAN
  *
- * \source_delphi   <b>function kvTimeDomainDelete(domain: kvTimeDomain): kvStatus;     </b>
- * \source_end
+ * Traffic statistics of one identifier, see \ref kvIdStatsGet(). Times are
+ * in microseconds, in the same timebase as message timestamps.
+ */
+typedef struct kvIdStats {
+  unsigned int id;                 ///< The identifier.
+  unsigned int flags;              ///< \ref canMSG_STD or \ref canMSG_EXT.
+  uint64_t     count;              ///< Number of frames received.
+  uint64_t     lastSeenUs;         ///< Timestamp of the latest frame.
+  double       meanPeriodUs;       ///< Mean time between frames.
+  double       minPeriodUs;        ///< Shortest time between frames.
+  double       maxPeriodUs;        ///< Longest time between frames.
+  double       stddevPeriodUs;     ///< Standard deviation of the time between frames.
+  uint64_t     payloadChanges;     ///< Frames with a payload different from the previous frame.
+  double       payloadChangeRate;  ///< Payload changes as a fraction of frames after the first.
+  unsigned int dlcCount[16];       ///< Number of frames per DLC code.
+} kvIdStats;
+
+/**
+ * \ingroup CAN
  *
- * This is a cleanup routine that deletes all members of a domain and then
- * deletes the domain itself.
+ * Turns per-identifier traffic statistics on or off for a handle. While on,
+ * every frame read with \ref canRead(), \ref canReadWait() and similar
+ * updates count, period, jitter, payload change and DLC statistics for its
+ * identifier. Turning statistics on when they are already on, or turning
+ * them off, clears them. A frame is counted in the period statistics only
+ * if its timestamp is not earlier than that of the previous frame with the
+ * same identifier.
  *
- * \note A time domain is a set of channels with a common time base.
+ * Frames dropped by \ref kvSetFilterIds() or \ref kvSetFilterProgram() are
+ * not counted, nor are error frames and transmit acknowledgements.
  *
- * \param[in] domain  An opaque variable set by \ref kvTimeDomainCreate() that
- *                    identifies the domain to be deleted.
+ * \param[in] hnd     An open handle to a CAN channel.
+ * \param[in] enable  Non-zero to turn statistics on, zero to turn them off.
  *
  * \return \ref canOK (zero) if success
  * \return \ref canERR_xxx (negative) if failure
  *
- * \sa \ref page_code_snippets_examples
- * \sa \ref kvTimeDomainCreate()
+ * \sa \ref kvIdStatsGet(), \ref kvIdStatsGetId()
  */
-kvStatus CANLIBAPI kvTimeDomainDelete (kvTimeDomain domain);
+canStatus CANLIBAPI kvIdStatsEnable (const CanHandle hnd, int enable);
 
 /**
- * \ingroup TimeDomainHandling
+ * \ingroup CAN
  *
- * \source_cs       <b>static Canlib.canStatus kvTimeDomainResetTime(object domain);</b>
+ * Gets a snapshot of the statistics of all identifiers seen, standard
+ * identifiers first, each in ascending order.
+ *
+ * \param[in]     hnd    An open handle to a CAN channel.
+ * \param[out]    stats  A buffer that receives the statistics.
+ * \param[in,out] count  The number of entries in \a stats on entry, the
+ *                       number of entries returned on exit.
+ * \param[out]    total  If not NULL, receives the number of identifiers
+ *                       seen, which may be larger than \a count.
+ *
+ * \return \ref canOK (zero) if success
+ * \return \ref canERR_PARAM if statistics are not on for \a hnd
+ * \return \ref canERR_xxx (negative) if failure
+ *
+ * \sa \ref kvIdStatsEnable(), \ref kvIdStatsGetId()
+ */
+canStatus CANLIBAPI kvIdStatsGet (const CanHandle hnd,
+                                  kvIdStats *stats,
+                                  unsigned int *count,
+                                  unsigned int *total);
+
+/**
+ * \ingroup CAN
+ *
+ * Gets the statistics of one identifier.
+ *
+ * \param[in]  hnd    An open handle to a CAN channel.
+ * \param[in]  id     The identifier.
+ * \param[in]  flags  \ref canMSG_EXT for an extended identifier, otherwise
+ *                    \ref canMSG_STD.
+ * \param[out] stats  Receives the statistics.
+ *
+ * \return \ref canOK (zero) if success
+ * \return \ref canERR_NOTFOUND if the identifier has not been seen
+ * \return \ref canERR_xxx (negative) if failure
+ *
+ * \sa \ref kvIdStatsEnable(), \ref kvIdStatsGet()
+ */
+canStatus CANLIBAPI kvIdStatsGetId (const CanHandle hnd,
+                                    unsigned int id,
+                                    unsigned int flags,
+                                    kvIdStats *stats);
+
+/**
+ * \ingroup General
+ *
+ * Call statistics of one API function, see \ref canGetStats(). The
+ * latency percentiles come from a histogram with 12.5% resolution.
+ */
+typedef struct kvApiStats {
+  char     name[32];   ///< Function name, or "ioctl" for all driver calls.
+  uint64_t calls;      ///< Number of calls.
+  uint64_t ioctls;     ///< Driver calls made during the calls.
+  uint64_t totalNs;    ///< Total time in the function, in ns.
+  uint64_t driverNs;   ///< Part of \a totalNs spent in driver calls, in ns.
+  uint64_t maxNs;      ///< Longest call, in ns.
+  uint64_t p50Ns;      ///< Median call time, in ns.
+  uint64_t p90Ns;      ///< 90th percentile call time, in ns.
+  uint64_t p99Ns;      ///< 99th percentile call time, in ns.
+  uint64_t p999Ns;     ///< 99.9th percentile call time, in ns.
+} kvApiStats;
+
+/**
+ * \ingroup General
+ *
+ * Gets the library-wide API statistics, turned on with
+ * \ref canIOCTL_SET_API_STATS or the environment variable
+ * \c KVASER_CANLIB_STATS. There is one entry for each instrumented
+ * function that has been called, and a last entry named "ioctl" that
+ * covers all driver calls.
+ *
+ * Counters are kept per thread, so recording a call takes no locks. When
+ * statistics are off the cost is a single test per call.
+ *
+ * \param[out]    stats  A buffer that receives the statistics.
+ * \param[in,out] count  The number of entries in \a stats on entry, the
+ *                       number of entries returned on exit.
+ *
+ * \return \ref canOK (zero) if success
+ * \return \ref canERR_xxx (negative) if failure
+ *
+ * \sa \ref canDumpStats(), \ref canIOCTL_RESET_API_STATS
+ */
+canStatus CANLIBAPI canGetStats (kvApiStats *stats, unsigned int *count);
+
+/**
+ * \ingroup General
+ *
+ * Prints the library-wide API statistics as a table to stderr, see
+ * \ref canGetStats().
+ *
+ * \return \ref canOK (zero) if success
+ * \return \ref canERR_xxx (negative) if failure
+ */
+canStatus CANLIBAPI canDumpStats (void);
+
+/**
+ * \ingroup General
+ *
+ * Writes the flight recorder to a file. The library keeps the last 1024
+ * events of each thread that has called it: API calls, failed driver
+ * calls, chip state changes and transmit and receive overflows. Repeated
+ * calls of the same function are folded into one event with a count and
+ * the time of the first call; the next event ends the run. Recording is
+ * always on, unless the environment variable \c KVASER_CANLIB_FLIGHTREC
+ * is set to "0".
+ *
+ * The output is text, one event per line starting with a CLOCK_MONOTONIC
+ * time in seconds, grouped by thread.
+ *
+ * \param[in] filename  The file to write, or NULL for stderr.
+ *
+ * \return \ref canOK (zero) if success
+ * \return \ref canERR_xxx (negative) if failure
+ *
+ * \sa \ref kvFlightRecorderSetDump()
+ */
+canStatus CANLIBAPI kvFlightRecorderDump (const char *filename);
+
+/**
+ * \ingroup General
+ *
+ * Sets up dumps of the flight recorder from signal handlers, see
+ * \ref kvFlightRecorderDump(). The dump is async-signal-safe.
+ *
+ * Setting \c KVASER_CANLIB_FLIGHTREC to a file name in the environment
+ * turns on the crash dump to that file when the library is initialized.
+ * \ref canUnloadLibrary() puts back the handlers that were replaced.
+ *
+ * \param[in] filename    The file to write, or NULL for stderr.
+ * \param[in] dumpSignal  A signal, e.g. SIGUSR2, that dumps the recorder
+ *                        and lets the process continue, or 0 for none.
+ * \param[in] onCrash     If non-zero, SIGSEGV, SIGBUS, SIGFPE, SIGILL and
+ *                        SIGABRT dump the recorder before they are passed
+ *                        on to the handlers installed before this call.
+ *
+ * \return \ref canOK (zero) if success
+ * \return \ref canERR_xxx (negative) if failure
+ */
+canStatus CANLIBAPI kvFlightRecorderSetDump (const char *filename,
+                                             int dumpSignal, int onCrash);
+
+
+/**
+ * \ingroup CAN
+ *
+ * \source_cs       <b>static Canlib.canStatus canGetHandleData(int hnd, int item, out object buffer);</b>
+ *
+ * \source_delphi   <b>function canGetHandleData(handle: canHandle; item: Integer; var Buffer; bufsize: Cardinal): canStatus;     </b>
+ * \source_end
+ *
+ * \note This function can be used to retrieve certain pieces of information about an open handle to a CANlib channel.
+ *
+ * \param[in]  hnd      An open handle to a CAN channel.
+ * \param[in]  item     This parameter specifies what data to obtain for the specified handle. The value is one of the constants \ref canCHANNELDATA_xxx
+ * \param[out] buffer   The address of a buffer which is to receive the data.
+ * \param[in]  bufsize  The size of the buffer to which the buffer parameter points.
+ *
+ * \return \ref canOK (zero) if success
+ * \return \ref canERR_xxx (negative) if failure
+ *
+ * \sa \ref canGetChannelData()
+ */
+canStatus CANLIBAPI canGetHandleData (const CanHandle hnd,
+                                      int item,
+                                      void *buffer,
+                                      size_t bufsize);
+
+/** Used for time domain handling. */
+typedef void *kvTimeDomain;
+
+/** Contains status codes according to \ref canSTAT_xxx. */
+typedef canStatus kvStatus;
+
+/**
+ *
+ * Used for time domain handling.
+ */
+typedef struct kvTimeDomainData_s {
+  int nMagiSyncGroups;        ///< number of MagiSync&tm; groups
+  int nMagiSyncedMembers;     ///< number of MagiSync&tm; members
+  int nNonMagiSyncCards;      ///< number of non MagiSync&tm; interfaces
+  int nNonMagiSyncedMembers;  ///< number of non MagiSync&tm; members
+  int nSoftSyncedMembers;     ///< number of members with a valid clock fit
+  double maxDriftPpm;         ///< largest estimated clock drift among members, in ppm
+  double maxResidualUs;       ///< largest RMS clock fit residual among members, in us
+} kvTimeDomainData;
+
+/**
+ * \ingroup TimeDomainHandling
+ *
+ * \source_cs       <b>static Canlib.canStatus kvTimeDomainCreate(out object domain);</b>
+ *
+ * \source_delphi   <b>function kvTimeDomainCreate(var domain: kvTimeDomain): kvStatus;     </b>
+ * \source_end
+ *
+ * This routine creates an empty time domain.
+ *
+ * The variable is set by this function and then used in later calls to
+ * other functions using a \ref kvTimeDomain.
+ *
+ * Time domains created by \ref kvTimeDomainCreate() can be destroyed with a
+ * call to \ref kvTimeDomainDelete().
+ *
+ * \note A time domain is a set of channels with a common time base.
+ *
+ * \param[out] domain  A pointer to a caller allocated, opaque variable of type
+ *                     \ref kvTimeDomain that holds data to identify a particlar
+ *                     time domain.
+ *
+ * \return \ref canOK (zero) if success
+ * \return \ref canERR_xxx (negative) if failure
+ *
+ * \sa \ref page_code_snippets_examples
+ * \sa \ref kvTimeDomainDelete()
+ */
+kvStatus CANLIBAPI kvTimeDomainCreate (kvTimeDomain *domain);
+
+/**
+ * \ingroup TimeDomainHandling
+ *
+ * \source_cs       <b>static Canlib.canStatus kvTimeDomainDelete(object domain);</b>
+ *
+ * \source_delphi   <b>function kvTimeDomainDelete(domain: kvTimeDomain): kvStatus;     </b>
+ * \source_end
+ *
+ * This is a cleanup routine that deletes all members of a domain and then
+ * deletes the domain itself.
+ *
+ * \note A time domain is a set of channels with a common time base.
+ *
+ * \param[in] domain  An opaque variable set by \ref kvTimeDomainCreate() that
+ *                    identifies the domain to be deleted.
+ *
+ * \return \ref canOK (zero) if success
+ * \return \ref canERR_xxx (negative) if failure
+ *
+ * \sa \ref page_code_snippets_examples
+ * \sa \ref kvTimeDomainCreate()
+ */
+kvStatus CANLIBAPI kvTimeDomainDelete (kvTimeDomain domain);
+
+/**
+ * \ingroup TimeDomainHandling
+ *
+ * \source_cs       <b>static Canlib.canStatus kvTimeDomainResetTime(object domain);</b>
  *
  * \source_delphi   <b>function kvTimeDomainResetTime(domain: kvTimeDomain): kvStatus;     </b>
  * \source_end
@@ -3429,6 +4190,12 @@ kvStatus CANLIBAPI kvTimeDomainDelete (kvTimeDomain domain);
  * running have no offset at all any longer. The same applies for channels that
  * reside on the same physical interface.
  *
+ * \note On Linux, there is no MagiSync&tm;. The device timer of each member is
+ * instead sampled against the host clock and its offset and drift are
+ * estimated. Timestamps from \ref canRead() and friends, notifications and
+ * \ref kvReadTimer64() for members are corrected to a common timebase that
+ * starts at zero when the domain is created or reset.
+ *
  * \note A time domain is a set of channels with a common time base.
  *
  * \param[in] domain  An opaque variable set by \ref kvTimeDomainCreate() that
@@ -3452,6 +4219,9 @@ kvStatus CANLIBAPI kvTimeDomainResetTime (kvTimeDomain domain);
  *
  * This routine collects some data on a time domain.
  *
+ * The first four members of \ref kvTimeDomainData are always filled in. If
+ * \a bufsiz is large enough, the software clock sync state is also reported.
+ *
  * \note A time domain is a set of channels with a common time base.
  *
  * \param[in]  domain  An opaque variable set by \ref kvTimeDomainCreate() that
@@ -3519,6 +4289,75 @@ kvStatus CANLIBAPI kvTimeDomainAddHandle(kvTimeDomain domain,
 kvStatus CANLIBAPI kvTimeDomainRemoveHandle (kvTimeDomain domain,
                                              const CanHandle hnd);
 
+/**
+ * \ingroup TimeDomainHandling
+ *
+ * The state of the correlation between the device timer of a handle and
+ * the host clock, see \ref kvGetClockCorrelation().
+ *
+ * The fit maps device time to host time as
+ * host_us = offsetUs + (1 + driftPpm / 1e6) * device_us.
+ */
+typedef struct kvClockCorrelation {
+  int          valid;             ///< Non-zero when there are enough samples for a fit.
+  unsigned int nSamples;          ///< Number of samples in the fit window.
+  unsigned int nRejected;         ///< Samples dropped because of long round-trip.
+  double       driftPpm;          ///< Host clock rate relative to the device timer, in ppm.
+  double       offsetUs;          ///< CLOCK_MONOTONIC time at device time zero, in us.
+  double       rmsResidualUs;     ///< RMS fit residual, in us.
+  double       maxResidualUs;     ///< Largest fit residual in the window, in us.
+  double       minRttUs;          ///< Shortest timer read round-trip, in us.
+  int64_t      realtimeOffsetUs;  ///< CLOCK_REALTIME minus CLOCK_MONOTONIC, in us.
+} kvClockCorrelation;
+
+/**
+ * \ingroup TimeDomainHandling
+ *
+ * Gets the state of the background correlation between the device timer
+ * and the host clock. The correlation runs for handles in a time domain,
+ * handles that use a host clock for timestamps and handles where it is
+ * turned on with \ref canIOCTL_SET_CLOCK_CORRELATION.
+ *
+ * The device timer is read several times per sample and each read is
+ * bracketed by host clock reads; the read with the shortest round-trip is
+ * used. A least-squares fit over the recent samples gives offset and drift.
+ *
+ * \param[in]  hnd     A handle to an open channel.
+ * \param[out] data    The correlation state, see \ref kvClockCorrelation.
+ * \param[in]  bufsiz  The size in bytes of \a data.
+ *
+ * \return \ref canOK (zero) if success
+ * \return \ref canERR_PARAM if the correlation is not running for \a hnd
+ * \return \ref canERR_xxx (negative) if failure
+ *
+ * \sa \ref kvGetClockResiduals(), \ref canIOCTL_SET_CLOCK_CORRELATION
+ */
+kvStatus CANLIBAPI kvGetClockCorrelation (const CanHandle hnd,
+                                          kvClockCorrelation *data,
+                                          size_t bufsiz);
+
+/**
+ * \ingroup TimeDomainHandling
+ *
+ * Gets the fit residuals, host time minus fitted time in microseconds, of
+ * the samples in the correlation window, oldest first. Use it to check the
+ * quality of the clock correlation.
+ *
+ * \param[in]     hnd        A handle to an open channel.
+ * \param[out]    residuals  A buffer that receives the residuals.
+ * \param[in,out] count      The number of entries in \a residuals on entry,
+ *                           the number of residuals returned on exit.
+ *
+ * \return \ref canOK (zero) if success
+ * \return \ref canERR_PARAM if the correlation is not running for \a hnd
+ * \return \ref canERR_xxx (negative) if failure
+ *
+ * \sa \ref kvGetClockCorrelation()
+ */
+kvStatus CANLIBAPI kvGetClockResiduals (const CanHandle hnd,
+                                        double *residuals,
+                                        unsigned int *count);
+
 /**
  * \ref kvCallback_t is used by the function \ref kvSetNotifyCallback()
  *
@@ -3571,6 +4410,168 @@ kvStatus CANLIBAPI kvSetNotifyCallback (const CanHandle hnd,
                                         void* context,
                                         unsigned int notifyFlags);
 
+/**
+ * \ingroup General
+ *
+ * A CAN frame delivered by a \ref kvFrameCallback_t notification. It holds the
+ * same information that \ref canRead() would return for the frame, so the
+ * callback does not have to read it again.
+ */
+typedef struct kvNotifyFrame {
+  long          id;        ///< The identifier of the frame.
+  unsigned int  dlc;       ///< The DLC of the frame, as returned by \ref canRead().
+  unsigned int  flags;     ///< A combination of \ref canMSG_xxx and \ref canMSGERR_xxx flags.
+  unsigned long time;      ///< The timestamp of the frame.
+  unsigned int  event;     ///< \ref canNOTIFY_RX, \ref canNOTIFY_TX or \ref canNOTIFY_ERROR.
+  unsigned char data[64];  ///< The payload of the frame.
+} kvNotifyFrame;
+
+/**
+ * \ref kvFrameCallback_t is used by the function \ref kvSetNotifyFrameCallback()
+ *
+ * The callback function is called with the following arguments:
+ * \li hnd - the handle of the CAN channel where the frames were seen.
+ * \li context - the context pointer you passed to \ref kvSetNotifyFrameCallback().
+ * \li frames - an array of decoded frames, in the order they were received.
+ *     The array is only valid during the call.
+ * \li count - the number of frames in the array, at least one.
+ */
+typedef void (CANLIBAPI *kvFrameCallback_t) (CanHandle hnd, void* context,
+                                             const kvNotifyFrame *frames,
+                                             unsigned int count);
+
+/**
+ * \ingroup General
+ *
+ * The \ref kvSetNotifyFrameCallback() function registers a callback function
+ * which is called with the decoded frames, including the payload, when frames
+ * are received, transmitted or when error frames occur.
+ *
+ * The frames available when the notification thread wakes up are passed to
+ * the callback in batches of at most \a maxBatch frames. A \a maxBatch of 1
+ * gives one call per frame.
+ *
+ * The frame callback replaces any callback set with \ref canSetNotify() or
+ * \ref kvSetNotifyCallback() for the handle, and vice versa. To remove the
+ * callback, call \ref kvSetNotifyFrameCallback() with a \c NULL pointer in the
+ * callback argument.
+ *
+ * \note The callback function is called in the context of a thread created
+ * by CANLIB. You should take precaution not to do any time consuming tasks in
+ * the callback.
+ *
+ * \param[in] hnd          An open handle to a CAN channel.
+ * \param[in] callback     A pointer to a callback function of type
+ *                         \ref kvFrameCallback_t
+ * \param[in] context      A pointer to arbitrary user-defined context data which
+ *                         is passed to the callback function.
+ * \param[in] notifyFlags  One or more of \ref canNOTIFY_RX, \ref canNOTIFY_TX
+ *                         and \ref canNOTIFY_ERROR.
+ * \param[in] maxBatch     The max number of frames passed in one call, or
+ *                         zero for the default (64).
+ *
+ * \return \ref canOK (zero) if success
+ * \return \ref canERR_xxx (negative) if failure
+ *
+ * \sa \ref kvSetNotifyCallback(), \ref canSetNotify()
+ */
+kvStatus CANLIBAPI kvSetNotifyFrameCallback (const CanHandle hnd,
+                                             kvFrameCallback_t callback,
+                                             void* context,
+                                             unsigned int notifyFlags,
+                                             unsigned int maxBatch);
+
+/**
+ * \ingroup General
+ *
+ * Attributes for the threads that CANLIB creates internally, e.g. the thread
+ * that calls notification callbacks. Used with \ref kvSetThreadConfig().
+ *
+ * A zeroed struct gives the default behaviour.
+ */
+typedef struct kvThreadConfig {
+  int       schedPriority;  ///< SCHED_FIFO priority (1-99), or 0 for the default policy.
+  uint64_t  cpuMask;        ///< CPU affinity, bit n is CPU n, or 0 for the process affinity at \ref canInitializeLibrary().
+  size_t    stackSize;      ///< Thread stack size in bytes, or 0 for the default.
+  int       lockMemory;     ///< Non-zero to lock all process memory with mlockall().
+  size_t    prefaultStack;  ///< Bytes of stack each thread touches when it starts.
+} kvThreadConfig;
+
+/**
+ * \ingroup General
+ *
+ * Sets the attributes used for threads created by CANLIB. Use this to give
+ * the notification thread real-time priority and pin it to a CPU, so that
+ * callbacks are dispatched with bounded latency.
+ *
+ * Priority and affinity are applied at once to running library threads as
+ * well as to threads created later. Stack size and prefaulting only apply to
+ * threads created later, so call this before setting up notifications.
+ * Memory locking affects the whole process.
+ *
+ * \note Real-time priority and memory locking usually require privileges,
+ * e.g. CAP_SYS_NICE and CAP_IPC_LOCK, or suitable rlimits.
+ *
+ * \param[in] config  The thread attributes, see \ref kvThreadConfig.
+ *
+ * \return \ref canOK (zero) if success
+ * \return \ref canERR_xxx (negative) if failure
+ *
+ * \sa \ref kvGetThreadConfig(), \ref kvNotifyLatencyTest()
+ */
+kvStatus CANLIBAPI kvSetThreadConfig (const kvThreadConfig *config);
+
+/**
+ * \ingroup General
+ *
+ * Gets the attributes used for threads created by CANLIB.
+ *
+ * \param[out] config  The thread attributes, see \ref kvThreadConfig.
+ *
+ * \return \ref canOK (zero) if success
+ * \return \ref canERR_xxx (negative) if failure
+ *
+ * \sa \ref kvSetThreadConfig()
+ */
+kvStatus CANLIBAPI kvGetThreadConfig (kvThreadConfig *config);
+
+/**
+ * \ingroup General
+ *
+ * Result of \ref kvNotifyLatencyTest(). All times are in nanoseconds.
+ */
+typedef struct kvLatencyStats {
+  unsigned int samples;  ///< Number of samples taken.
+  uint64_t     min;      ///< Shortest latency.
+  uint64_t     p50;      ///< Median latency.
+  uint64_t     p90;      ///< 90th percentile.
+  uint64_t     p99;      ///< 99th percentile.
+  uint64_t     p999;     ///< 99.9th percentile.
+  uint64_t     max;      ///< Longest latency.
+} kvLatencyStats;
+
+/**
+ * \ingroup General
+ *
+ * Measures the latency from an event becoming ready until its notification
+ * callback is called, using the current \ref kvThreadConfig. The test
+ * posts \a samples events through the same dispatcher, decoding and
+ * callback path as received frames, waiting \a intervalUs microseconds between them,
+ * and reports the latency percentiles. No CAN hardware is needed.
+ *
+ * \param[in]  samples     The number of events to post.
+ * \param[in]  intervalUs  Delay between events in microseconds.
+ * \param[out] stats       The measured latency, see \ref kvLatencyStats.
+ *
+ * \return \ref canOK (zero) if success
+ * \return \ref canERR_xxx (negative) if failure
+ *
+ * \sa \ref kvSetThreadConfig()
+ */
+kvStatus CANLIBAPI kvNotifyLatencyTest (unsigned int samples,
+                                        unsigned int intervalUs,
+                                        kvLatencyStats *stats);
+
 /**
  * \ingroup General
  *
@@ -3784,7 +4785,8 @@ kvStatus CANLIBAPI kvScriptSendEvent (const CanHandle hnd,
  *                         size of the envvar in bytes.
  *
  * \linux_start
- * \note Currently not implemented in Linux.
+ * \note Envvars are only available on simulated channels, see
+ * \ref page_simulated_channels.
  * \linux_end
  *
  * \return A \ref kvEnvHandle handle (positive) to an envvar if success
@@ -3808,10 +4810,6 @@ kvEnvHandle CANLIBAPI kvScriptEnvvarOpen (const CanHandle hnd,
  *
  * The \ref kvScriptEnvvarClose() function closes an open envvar.
  *
- * \linux_start
- * \note Currently not implemented in Linux.
- * \linux_end
- *
  * \param[in] eHnd  An open handle to an envvar.
  *
  * \return \ref canOK (zero) if success
@@ -3831,10 +4829,6 @@ kvStatus CANLIBAPI kvScriptEnvvarClose (kvEnvHandle eHnd);
  *
  * The \ref kvScriptEnvvarSetInt() sets the value of an \c int envvar.
  *
- * \linux_start
- * \note Currently not implemented in Linux.
- * \linux_end
- *
  * \param[in] eHnd  An open handle to an envvar.
  * \param[in] val   The new value.
  *
@@ -3857,10 +4851,6 @@ kvStatus CANLIBAPI kvScriptEnvvarSetInt (kvEnvHandle eHnd, int val);
  *
  * The \ref kvScriptEnvvarGetInt() function retrieves the value of an \c int envvar.
  *
- * \linux_start
- * \note Currently not implemented in Linux.
- * \linux_end
- *
  * \param[in]  eHnd An open handle to an envvar.
  * \param[out] val  The current value.
  *
@@ -3884,10 +4874,6 @@ kvStatus CANLIBAPI kvScriptEnvvarGetInt (kvEnvHandle eHnd, int *val);
  *
  * The \ref kvScriptEnvvarSetFloat() sets the value of a \c float envvar.
  *
- * \linux_start
- * \note Currently not implemented in Linux.
- * \linux_end
- *
  * \param[in] eHnd  An open handle to an envvar.
  * \param[in] val   The new value.
  *
@@ -3910,10 +4896,6 @@ kvStatus CANLIBAPI kvScriptEnvvarSetFloat (kvEnvHandle eHnd, float val);
  *
  * The \ref kvScriptEnvvarGetFloat() function retrieves the value of a \c float envvar.
  *
- * \linux_start
- * \note Currently not implemented in Linux.
- * \linux_end
- *
  * \param[in]  eHnd  An open handle to an envvar.
  * \param[out] val   A pointer to a \c float where the retrieved result should be
  *                   stored.
@@ -3937,10 +4919,6 @@ kvStatus CANLIBAPI kvScriptEnvvarGetFloat (kvEnvHandle eHnd, float *val);
  *
  * The \ref kvScriptEnvvarSetData() function sets a range of data bytes in an envvar.
  *
- * \linux_start
- * \note Currently not implemented in Linux.
- * \linux_end
- *
  * \param[in] eHnd         An open handle to an envvar.
  * \param[in] buf          A pointer to a data area with the new values.
  * \param[in] start_index  The start index of the envvar's data range that we
@@ -3970,10 +4948,6 @@ kvStatus CANLIBAPI kvScriptEnvvarSetData (kvEnvHandle eHnd,
  *
  * The \ref kvScriptEnvvarGetData() function retrieves a range of data bytes from an envvar.
  *
- * \linux_start
- * \note Currently not implemented in Linux.
- * \linux_end
- *
  * \param[in]  eHnd         An open handle to an envvar.
  * \param[out] buf          A pointer to a data area where the retrieved data
  *                          range should be stored.
@@ -3992,6 +4966,95 @@ kvStatus CANLIBAPI kvScriptEnvvarGetData (kvEnvHandle eHnd,
                                           int start_index,
                                           int data_len);
 
+/**
+ * \ingroup tScript
+ *
+ * A changed envvar, in \a info.envvar.event of the \ref canNotifyData of a
+ * \ref canEVENT_ENVVAR callback. The event and \a value are only valid
+ * until the callback returns.
+ */
+typedef struct kvEnvvarEvent {
+  kvEnvHandle envHandle;    ///< The envvar, as from \ref kvScriptEnvvarOpen().
+  int         type;         ///< \ref kvENVVAR_TYPE_xxx
+  int         len;          ///< The size of the envvar in bytes.
+  const void  *value;       ///< The new value, \a len bytes.
+} kvEnvvarEvent;
+
+/**
+ * \ingroup tScript
+ *
+ * One envvar access in \ref kvScriptEnvvarGetBatch() or
+ * \ref kvScriptEnvvarSetBatch(), as the arguments of
+ * \ref kvScriptEnvvarGetData().
+ */
+typedef struct kvEnvvarIo {
+  kvEnvHandle eHnd;         ///< An open envvar on the handle of the batch.
+  void        *buf;         ///< Data to write, or room for the data read.
+  int         start_index;  ///< First byte of the envvar to access.
+  int         data_len;     ///< Number of bytes.
+} kvEnvvarIo;
+
+/**
+ * \ingroup tScript
+ *
+ * Reads many envvars on one channel, with as few driver transactions as
+ * the envvars fit in. Writes kept by \ref kvScriptEnvvarSetCache() to any
+ * of them are sent first.
+ *
+ * \param[in]     hnd  An open handle to a CAN channel.
+ * \param[in,out] io   The envvars to read, and where.
+ * \param[in]     n    The number of elements in \a io.
+ *
+ * \return \ref canOK (zero) if success
+ * \return \ref canERR_xxx (negative) if failure
+ */
+kvStatus CANLIBAPI kvScriptEnvvarGetBatch (const CanHandle hnd,
+                                           kvEnvvarIo *io, int n);
+
+/**
+ * \ingroup tScript
+ *
+ * Writes many envvars on one channel, with as few driver transactions as
+ * the envvars fit in, or into the cache if it is on.
+ *
+ * \param[in] hnd  An open handle to a CAN channel.
+ * \param[in] io   The envvars to write, and their data.
+ * \param[in] n    The number of elements in \a io.
+ *
+ * \return \ref canOK (zero) if success
+ * \return \ref canERR_xxx (negative) if failure
+ */
+kvStatus CANLIBAPI kvScriptEnvvarSetBatch (const CanHandle hnd,
+                                           const kvEnvvarIo *io, int n);
+
+/**
+ * \ingroup tScript
+ *
+ * Turns the envvar write cache of a channel on or off. With the cache on,
+ * writes are kept on the host, later writes to the same envvar replace
+ * earlier ones, and \ref kvScriptEnvvarFlush() sends them all in one
+ * batch, e.g. once per test cycle. Turning the cache off flushes it.
+ *
+ * \param[in] hnd  An open handle to a CAN channel.
+ * \param[in] on   Non-zero to keep writes until the next flush.
+ *
+ * \return \ref canOK (zero) if success
+ * \return \ref canERR_xxx (negative) if failure
+ */
+kvStatus CANLIBAPI kvScriptEnvvarSetCache (const CanHandle hnd, int on);
+
+/**
+ * \ingroup tScript
+ *
+ * Sends the envvar writes kept by \ref kvScriptEnvvarSetCache().
+ *
+ * \param[in] hnd  An open handle to a CAN channel.
+ *
+ * \return \ref canOK (zero) if success
+ * \return \ref canERR_xxx (negative) if failure
+ */
+kvStatus CANLIBAPI kvScriptEnvvarFlush (const CanHandle hnd);
+
 /**
  * \ingroup tScript
  *
@@ -4050,6 +5113,29 @@ kvStatus CANLIBAPI kvScriptLoadFile (const CanHandle hnd,
                                      int slotNo,
                                      char *filePathOnPC);
 
+/**
+ * \ingroup tScript
+ *
+ * The \ref kvScriptLoadBuffer() function loads a compiled script (.txe)
+ * from memory into a script slot on the device. Read the file once, and
+ * the same image can be loaded into any number of channels, also from
+ * several threads at a time.
+ *
+ * \param[in] hnd     An open handle to a CAN channel.
+ * \param[in] slotNo  The slot where to load the script.
+ * \param[in] image   The contents of the .txe file.
+ * \param[in] len     The size of \a image.
+ *
+ * \return \ref canOK (zero) if success
+ * \return \ref canERR_xxx (negative) if failure
+ *
+ * \sa \ref kvScriptLoadFile(), \ref kvScriptStart()
+ */
+kvStatus CANLIBAPI kvScriptLoadBuffer (const CanHandle hnd,
+                                       int slotNo,
+                                       const void *image,
+                                       unsigned int len);
+
 
 
 /**
@@ -4145,6 +5231,77 @@ kvStatus CANLIBAPI kvFileCopyFromDevice (const CanHandle hnd,
                                          char *deviceFileName,
                                          char *hostFileName);
 
+ /**
+  * \name kvFILE_COPY_xxx
+  * \anchor kvFILE_COPY_xxx
+  *
+  * Used in \ref kvFileCopyToDeviceEx() and \ref kvFileCopyFromDeviceEx().
+  *
+  * @{
+  */
+#define kvFILE_COPY_RESUME  0x01 ///< Verify the host file as the start of the device file and append the rest; the device file is still read from the start.
+#define kvFILE_COPY_VERIFY  0x02 ///< Read the copy back and fail with \ref canERR_CRC if its CRC-32 differs.
+#define kvFILE_COPY_RETRY   0x04 ///< Read the device file again, up to three times, after a timeout.
+ /** @} */
+
+/**
+ * \ingroup tScript
+ *
+ * Like \ref kvFileCopyToDevice(), with \ref kvFILE_COPY_VERIFY and the
+ * CRC-32 of the file.
+ *
+ * \param[in]  hnd             An open handle to a CAN channel.
+ * \param[in]  hostFileName    The host file name.
+ * \param[in]  deviceFileName  The target device file name.
+ * \param[in]  flags           \ref kvFILE_COPY_VERIFY or 0.
+ * \param[out] crc             The CRC-32 of the file as sent, or \c NULL.
+ *
+ * \return \ref canOK (zero) if success
+ * \return \ref canERR_CRC if the copy on the device differs
+ * \return \ref canERR_xxx (negative) if failure
+ */
+kvStatus CANLIBAPI kvFileCopyToDeviceEx (const CanHandle hnd,
+                                         char *hostFileName,
+                                         char *deviceFileName,
+                                         unsigned int flags, uint32_t *crc);
+
+/**
+ * \ingroup tScript
+ *
+ * Like \ref kvFileCopyFromDevice(), with \ref kvFILE_COPY_xxx flags and
+ * the CRC-32 of the file.
+ *
+ * The device can not seek, so every read of the device file starts at its
+ * first byte. \ref kvFILE_COPY_RESUME only saves writing the part of the
+ * host file that is already there: those bytes are read from the device
+ * again and only used for the CRC-32.
+ *
+ * With \ref kvFILE_COPY_RETRY, a read that times out is started over after
+ * a short pause, up to three times, keeping what has already been written
+ * to the host file. Other failures, e.g. a device that is gone, end the
+ * copy at once.
+ *
+ * A copy that kept bytes from an earlier attempt or from the host file is
+ * always checked against the CRC-32 of the device file, as with
+ * \ref kvFILE_COPY_VERIFY.
+ *
+ * \param[in]  hnd             An open handle to a CAN channel.
+ * \param[in]  deviceFileName  The device file name.
+ * \param[in]  hostFileName    The target host file name.
+ * \param[in]  flags           \ref kvFILE_COPY_xxx
+ * \param[out] crc             The CRC-32 of the device file, or \c NULL.
+ *
+ * \return \ref canOK (zero) if success
+ * \return \ref canERR_CRC if the host file differs from the device file
+ * \return \ref canERR_HOST_FILE if a resumed host file is longer than the
+ *         device file
+ * \return \ref canERR_xxx (negative) if failure
+ */
+kvStatus CANLIBAPI kvFileCopyFromDeviceEx (const CanHandle hnd,
+                                           char *deviceFileName,
+                                           char *hostFileName,
+                                           unsigned int flags, uint32_t *crc);
+
 /**
  * \ingroup tScript
  *
@@ -4172,6 +5329,173 @@ kvStatus CANLIBAPI kvFileCopyFromDevice (const CanHandle hnd,
  */
 kvStatus CANLIBAPI kvFileDelete (const CanHandle hnd, char *deviceFileName);
 
+/**
+ * \ingroup tScript
+ *
+ * Takes the next piece of a file read with \ref kvFileReadStream(). \a data
+ * is only valid during the call. Return non-zero to cancel the transfer.
+ */
+typedef int (CANLIBAPI *kvFileReadCallback) (CanHandle hnd, const void *data,
+                                             unsigned int len, void *context);
+
+/**
+ * \ingroup tScript
+ *
+ * Gives the next piece of a file written with \ref kvFileWriteStream(), at
+ * most \a size bytes into \a buffer. Set \a *len to 0 at the end of the
+ * file. Return non-zero to cancel the transfer.
+ */
+typedef int (CANLIBAPI *kvFileWriteCallback) (CanHandle hnd, void *buffer,
+                                              unsigned int size,
+                                              unsigned int *len,
+                                              void *context);
+
+/**
+ * \ingroup tScript
+ *
+ * Reads a file on the device and hands its contents to \a callback, without
+ * a host file in between. The callback is called from a library thread,
+ * in order, while the next piece is read from the device.
+ *
+ * \param[in] hnd             An open handle to a CAN channel.
+ * \param[in] deviceFileName  The device file name; a pointer to a \c NULL
+ *                            terminated array of chars.
+ * \param[in] callback        Takes the data.
+ * \param[in] context         Passed on to \a callback.
+ *
+ * \return \ref canOK (zero) if success
+ * \return \ref canERR_INTERRUPTED if \a callback cancelled the transfer
+ * \return \ref canERR_xxx (negative) if failure
+ *
+ * \sa \ref kvFileReadMemory(), \ref kvFileCopyFromDevice()
+ */
+kvStatus CANLIBAPI kvFileReadStream (const CanHandle hnd, char *deviceFileName,
+                                     kvFileReadCallback callback,
+                                     void *context);
+
+/**
+ * \ingroup tScript
+ *
+ * Writes a file on the device with contents from \a callback. The callback
+ * is called from a library thread, ahead of what is written to the device.
+ *
+ * \param[in] hnd             An open handle to a CAN channel.
+ * \param[in] deviceFileName  The device file name; a pointer to a \c NULL
+ *                            terminated array of chars.
+ * \param[in] callback        Gives the data.
+ * \param[in] context         Passed on to \a callback.
+ *
+ * \return \ref canOK (zero) if success
+ * \return \ref canERR_INTERRUPTED if \a callback cancelled the transfer
+ * \return \ref canERR_xxx (negative) if failure
+ *
+ * \sa \ref kvFileWriteMemory(), \ref kvFileCopyToDevice()
+ */
+kvStatus CANLIBAPI kvFileWriteStream (const CanHandle hnd, char *deviceFileName,
+                                      kvFileWriteCallback callback,
+                                      void *context);
+
+/**
+ * \ingroup tScript
+ *
+ * Reads a file on the device into \a buffer.
+ *
+ * \param[in]  hnd             An open handle to a CAN channel.
+ * \param[in]  deviceFileName  The device file name; a pointer to a \c NULL
+ *                             terminated array of chars.
+ * \param[out] buffer          Receives the file.
+ * \param[in]  size            The size of \a buffer.
+ * \param[out] len             The size of the file.
+ *
+ * \return \ref canOK (zero) if success
+ * \return \ref canERR_NOMEM if the file is larger than \a buffer; \a buffer
+ *         then holds the first \a size bytes
+ * \return \ref canERR_xxx (negative) if failure
+ *
+ * \sa \ref kvFileReadStream()
+ */
+kvStatus CANLIBAPI kvFileReadMemory (const CanHandle hnd, char *deviceFileName,
+                                     void *buffer, unsigned int size,
+                                     unsigned int *len);
+
+/**
+ * \ingroup tScript
+ *
+ * Writes a file on the device with the contents of \a buffer.
+ *
+ * \param[in] hnd             An open handle to a CAN channel.
+ * \param[in] deviceFileName  The device file name; a pointer to a \c NULL
+ *                            terminated array of chars.
+ * \param[in] buffer          The file contents.
+ * \param[in] len             The size of the file.
+ *
+ * \return \ref canOK (zero) if success
+ * \return \ref canERR_xxx (negative) if failure
+ *
+ * \sa \ref kvFileWriteStream()
+ */
+kvStatus CANLIBAPI kvFileWriteMemory (const CanHandle hnd, char *deviceFileName,
+                                      const void *buffer, unsigned int len);
+
+/**
+ * \ingroup tScript
+ *
+ * Progress of a file transfer, see \ref kvFileSetProgressCallback().
+ */
+typedef struct kvFileProgress {
+  uint64_t bytesDone;    ///< Bytes moved to or from the device so far.
+  uint64_t bytesTotal;   ///< Size of the transfer, or 0 if not known.
+  double   elapsedS;     ///< Time since the transfer started, in seconds.
+  double   bytesPerSec;  ///< Mean rate so far.
+} kvFileProgress;
+
+/**
+ * \ingroup tScript
+ *
+ * Called from \ref kvFileCopyToDevice(), \ref kvFileCopyFromDevice() and the
+ * stream and memory variants, in the calling thread, each time a chunk of
+ * the file has been moved.
+ * Return non-zero to cancel the transfer.
+ */
+typedef int (CANLIBAPI *kvFileProgressCallback) (CanHandle hnd,
+                                                 const kvFileProgress *progress,
+                                                 void *context);
+
+/**
+ * \ingroup tScript
+ *
+ * Sets a function to call as file transfers on the handle proceed. The
+ * transfer is cancelled with \ref canERR_INTERRUPTED if it returns non-zero.
+ *
+ * \param[in] hnd       An open handle to a CAN channel.
+ * \param[in] callback  The function, or \c NULL to remove it.
+ * \param[in] context   Passed on to \a callback.
+ *
+ * \return \ref canOK (zero) if success
+ * \return \ref canERR_xxx (negative) if failure
+ *
+ * \sa \ref kvFileGetTransferStats()
+ */
+kvStatus CANLIBAPI kvFileSetProgressCallback (const CanHandle hnd,
+                                              kvFileProgressCallback callback,
+                                              void *context);
+
+/**
+ * \ingroup tScript
+ *
+ * Gets the progress of the last, or current, file transfer on the handle.
+ *
+ * \param[in]  hnd       An open handle to a CAN channel.
+ * \param[out] progress  Bytes moved, elapsed time and rate.
+ *
+ * \return \ref canOK (zero) if success
+ * \return \ref canERR_xxx (negative) if failure
+ *
+ * \sa \ref kvFileSetProgressCallback()
+ */
+kvStatus CANLIBAPI kvFileGetTransferStats (const CanHandle hnd,
+                                           kvFileProgress *progress);
+
 /**
  * \ingroup tScript
  *
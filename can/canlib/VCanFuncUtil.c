@@ -51,12 +51,39 @@
 **/
 
 /*  Utility functions for Kvaser Linux Canlib VCan layer */
+#define _GNU_SOURCE // This is required for pthread affinity support
 
 #include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <alloca.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 #include "VCanFuncUtil.h"
+#include "flightrec.h"
 
-canStatus errnoToCanStatus (int error)
+// A running library thread, settings are applied to all of them
+typedef struct ThreadStart {
+  void               *(*start)(void *);
+  void               *arg;
+  size_t             prefault;
+  pthread_t          thread;
+  struct ThreadStart *next;
+} ThreadStart;
+
+static pthread_mutex_t threadMutex = PTHREAD_MUTEX_INITIALIZER;
+static kvThreadConfig  threadConfig;
+static ThreadStart     *libThreads = NULL;
+
+// The affinity the process had when the library was initialized, e.g. from
+// taskset or a cgroup, used when no cpu mask is configured
+static pthread_once_t  inheritedOnce = PTHREAD_ONCE_INIT;
+static cpu_set_t       inheritedCpus;
+
+static canStatus errnoStatus (int error)
 {
   switch (error) {
   case 0:
@@ -76,6 +103,7 @@ canStatus errnoToCanStatus (int error)
   case EBADMSG:
     return canERR_PARAM;      // Used?
   case EACCES:
+  case EPERM:
     return canERR_NO_ACCESS;
   case ETIMEDOUT:
     return canERR_TIMEOUT;
@@ -85,3 +113,252 @@ canStatus errnoToCanStatus (int error)
     return canERR_INTERNAL;   // Not so good
   }
 }
+
+canStatus errnoToCanStatus (int error)
+{
+  canStatus stat = errnoStatus(error);
+
+  // An empty queue or a timeout is an answer, not a failure
+  if (error != 0 && error != EAGAIN && error != ETIMEDOUT) {
+    flightRecEvent(FLIGHTREC_IOCTL_ERROR, 0, -1, (uint32_t)error, (uint32_t)stat);
+  }
+
+  return stat;
+}
+
+
+//======================================================================
+// Fill in cpu set from affinity mask
+//======================================================================
+static void maskToCpuSet (uint64_t mask, cpu_set_t *cpus)
+{
+  int i;
+
+  CPU_ZERO(cpus);
+  for (i = 0; i < 64; i++) {
+    if (mask & ((uint64_t)1 << i)) {
+      CPU_SET(i, cpus);
+    }
+  }
+}
+
+static void saveInheritedCpus (void)
+{
+  if (sched_getaffinity(0, sizeof(inheritedCpus), &inheritedCpus) != 0) {
+    int i;
+
+    CPU_ZERO(&inheritedCpus);
+    for (i = 0; i < CPU_SETSIZE; i++) {
+      CPU_SET(i, &inheritedCpus);
+    }
+  }
+}
+
+//======================================================================
+// vCanThreadInit, remembers the affinity the library threads start from
+//======================================================================
+void vCanThreadInit (void)
+{
+  pthread_once(&inheritedOnce, saveInheritedCpus);
+}
+
+//======================================================================
+// Apply priority and affinity to a running thread
+//======================================================================
+static int applyThreadConfig (pthread_t thread, const kvThreadConfig *config)
+{
+  struct sched_param param;
+  cpu_set_t          cpus;
+  int                ret;
+
+  memset(&param, 0, sizeof(param));
+  param.sched_priority = config->schedPriority;
+  ret = pthread_setschedparam(thread,
+                              config->schedPriority ? SCHED_FIFO : SCHED_OTHER,
+                              &param);
+  if (ret != 0) {
+    return ret;
+  }
+
+  if (config->cpuMask) {
+    maskToCpuSet(config->cpuMask, &cpus);
+  } else {
+    vCanThreadInit();
+    cpus = inheritedCpus;
+  }
+
+  return pthread_setaffinity_np(thread, sizeof(cpus), &cpus);
+}
+
+//======================================================================
+// Set attributes and memory locking used for library threads
+//======================================================================
+canStatus vCanSetThreadConfig (const kvThreadConfig *config)
+{
+  ThreadStart *t, *u;
+  int         ret;
+
+  if (config->schedPriority < 0 ||
+      (config->schedPriority > 0 &&
+       (config->schedPriority < sched_get_priority_min(SCHED_FIFO) ||
+        config->schedPriority > sched_get_priority_max(SCHED_FIFO)))) {
+    return canERR_PARAM;
+  }
+
+  if (config->stackSize && config->stackSize < (size_t)PTHREAD_STACK_MIN) {
+    return canERR_PARAM;
+  }
+
+  pthread_mutex_lock(&threadMutex);
+
+  // Stack size and prefaulting only apply to new threads
+  for (t = libThreads; t != NULL; t = t->next) {
+    ret = applyThreadConfig(t->thread, config);
+    if (ret != 0) {
+      // Put the threads that were changed back as they were
+      for (u = libThreads; u != t; u = u->next) {
+        applyThreadConfig(u->thread, &threadConfig);
+      }
+      pthread_mutex_unlock(&threadMutex);
+      return errnoToCanStatus(ret);
+    }
+  }
+
+  if (config->lockMemory && !threadConfig.lockMemory) {
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+      ret = errno;
+      for (t = libThreads; t != NULL; t = t->next) {
+        applyThreadConfig(t->thread, &threadConfig);
+      }
+      pthread_mutex_unlock(&threadMutex);
+      return errnoToCanStatus(ret);
+    }
+  } else if (!config->lockMemory && threadConfig.lockMemory) {
+    munlockall();
+  }
+
+  threadConfig = *config;
+
+  pthread_mutex_unlock(&threadMutex);
+
+  return canOK;
+}
+
+//======================================================================
+// Get attributes used for library threads
+//======================================================================
+void vCanGetThreadConfig (kvThreadConfig *config)
+{
+  pthread_mutex_lock(&threadMutex);
+  *config = threadConfig;
+  pthread_mutex_unlock(&threadMutex);
+}
+
+//======================================================================
+// Touch the stack below the caller, one byte per page, so that the thread
+// does not take page faults there later. Not inlined, so that the area is
+// given back before the caller goes on to use it.
+//======================================================================
+static __attribute__((noinline)) void prefaultStack (size_t size)
+{
+  volatile unsigned char *stack = alloca(size);
+  size_t                 page = (size_t)sysconf(_SC_PAGESIZE);
+  size_t                 i;
+
+  for (i = 0; i < size; i += page) {
+    stack[i] = 0;
+  }
+  stack[size - 1] = 0;
+  __asm__ volatile ("" : : "r" (stack) : "memory");
+}
+
+//======================================================================
+// Start routine wrapper for library threads
+//======================================================================
+static void *threadStart (void *arg)
+{
+  ThreadStart   *start = arg;
+  ThreadStart   **p;
+  void          *ret;
+
+  pthread_mutex_lock(&threadMutex);
+  start->thread = pthread_self();
+  start->next   = libThreads;
+  libThreads    = start;
+  pthread_mutex_unlock(&threadMutex);
+
+  if (start->prefault) {
+    prefaultStack(start->prefault);
+  }
+
+  ret = start->start(start->arg);
+
+  pthread_mutex_lock(&threadMutex);
+  for (p = &libThreads; *p != NULL; p = &(*p)->next) {
+    if (*p == start) {
+      *p = start->next;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&threadMutex);
+  free(start);
+
+  return ret;
+}
+
+//======================================================================
+// Create a library thread using the configured attributes
+//======================================================================
+int vCanCreateThread (pthread_t *thread, void *(*start)(void *), void *arg)
+{
+  pthread_attr_t     attr;
+  struct sched_param param;
+  cpu_set_t          cpus;
+  kvThreadConfig     config;
+  ThreadStart        *ts;
+  size_t             stackSize;
+  int                ret;
+
+  ts = malloc(sizeof(ThreadStart));
+  if (ts == NULL) {
+    return ENOMEM;
+  }
+  vCanGetThreadConfig(&config);
+
+  ts->start    = start;
+  ts->arg      = arg;
+  ts->prefault = config.prefaultStack;
+
+  pthread_attr_init(&attr);
+
+  if (config.stackSize) {
+    pthread_attr_setstacksize(&attr, config.stackSize);
+  }
+  if (config.prefaultStack) {
+    // Leave room for the thread's own use of the stack
+    pthread_attr_getstacksize(&attr, &stackSize);
+    if (ts->prefault > stackSize / 2) {
+      ts->prefault = stackSize / 2;
+    }
+  }
+  if (config.schedPriority) {
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = config.schedPriority;
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+    pthread_attr_setschedparam(&attr, &param);
+  }
+  if (config.cpuMask) {
+    maskToCpuSet(config.cpuMask, &cpus);
+    pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+  }
+
+  ret = pthread_create(thread, &attr, threadStart, ts);
+  pthread_attr_destroy(&attr);
+
+  if (ret != 0) {
+    free(ts);
+  }
+
+  return ret;
+}
@@ -55,8 +55,16 @@
 #ifndef VCANFUNCUTIL_H
 #define VCANFUNCUTIL_H
 
+#include <pthread.h>
+
 #include "canstat.h"
+#include "canlib.h"
 
 canStatus errnoToCanStatus (int error);
 
+void vCanThreadInit (void);
+canStatus vCanSetThreadConfig (const kvThreadConfig *config);
+void vCanGetThreadConfig (kvThreadConfig *config);
+int vCanCreateThread (pthread_t *thread, void *(*start)(void *), void *arg);
+
 #endif  /* VCANFUNCUTIL_H */
@@ -73,12 +73,18 @@
 #include <signal.h>
 #include <pthread.h>
 #include <string.h>
+#include <time.h>
 #include <sys/stat.h>
 
 #include "VCanMemoFunctions.h"
 #include "VCanScriptFunctions.h"
+#include "VCanNotifyFunctions.h"
 #include "VCanFunctions.h"
 #include "VCanFuncUtil.h"
+#include "apistats.h"
+#define TRACE_DEFINE_SEMAPHORES
+#include "trace.h"
+#include "flightrec.h"
 #include "debug.h"
 
 
@@ -131,6 +137,10 @@ static pthread_mutex_t handleMutex = PTHREAD_RECURSIVE_MUTEX_INITIALIZER;
 #endif
 
 static uint32_t get_capabilities (uint32_t cap);
+static void vCanDecodeMsg (HandleData *hData, VCAN_EVENT *msg,
+                           long *id,
+                           void *msgPtr, unsigned int *dlc,
+                           unsigned int *flag, unsigned long *time);
 
 #define ERROR_WHEN_NEQ 0
 #define ERROR_WHEN_LT  1
@@ -166,6 +176,8 @@ HandleData * findHandle (CanHandle hnd)
   }
   pthread_mutex_unlock(&handleMutex);
 
+  CANLIB_PROBE2(find_handle, hnd, found != NULL);
+
   return found;
 }
 
@@ -267,7 +279,7 @@ static canStatus kCanSetOpenMode (HandleData *hData)
   open_data.mode = hData->openMode;
   open_data.action = CAN_MODE_SET;
 
-  ret = ioctl(hData->fd, KCAN_IOCTL_OPEN_MODE, &open_data);
+  ret = vCanIoctl(hData->fd, KCAN_IOCTL_OPEN_MODE, &open_data);
   if (ret != 0) {
     DEBUGPRINT((TXT("kCanSetOpenMode failed!\n")));
     return errnoToCanStatus(errno);
@@ -282,6 +294,142 @@ static canStatus kCanSetOpenMode (HandleData *hData)
   return canOK;
 }
 
+//======================================================================
+// Convert device ticks to the time resolution of the handle
+//======================================================================
+static uint64_t vCanTimestampUs (HandleData *hData, uint64_t ticks)
+{
+  // VCAN uses 10 us ticks
+  uint64_t time = ticks * 10;
+
+  if (hData->clockSync.users) {
+    time = clockSyncConvert(&hData->clockSync, time);
+  }
+
+  return time;
+}
+
+uint64_t vCanTimestamp (HandleData *hData, uint64_t ticks)
+{
+  return vCanTimestampUs(hData, ticks) / hData->timerResolution;
+}
+
+//======================================================================
+// canMSG_xxx flags of a received message
+//======================================================================
+static unsigned int vCanMsgFlags (VCAN_EVENT *msg)
+{
+  unsigned int flags;
+
+  if (msg->tagData.msg.id & EXT_MSG) {
+    flags = canMSG_EXT;
+  } else {
+    flags = canMSG_STD;
+  }
+  if (msg->tagData.msg.flags & VCAN_MSG_FLAG_ERROR_FRAME)
+    flags = canMSG_ERROR_FRAME;
+  if (msg->tagData.msg.flags & VCAN_MSG_FLAG_FDF)
+    flags |= canFDMSG_FDF;
+  if (msg->tagData.msg.flags & VCAN_MSG_FLAG_BRS)
+    flags |= canFDMSG_BRS;
+  if (msg->tagData.msg.flags & VCAN_MSG_FLAG_ESI)
+    flags |= canFDMSG_ESI;
+  if (msg->tagData.msg.flags & VCAN_MSG_FLAG_OVERRUN)
+    flags |= canMSGERR_HW_OVERRUN | canMSGERR_SW_OVERRUN;
+  if (msg->tagData.msg.flags & VCAN_MSG_FLAG_REMOTE_FRAME)
+    flags |= canMSG_RTR;
+  if (msg->tagData.msg.flags & VCAN_MSG_FLAG_TX_START)
+    flags |= canMSG_TXRQ;
+
+  if (msg->tagData.msg.flags & VCAN_MSG_FLAG_SSM_NACK) {
+    flags |= canMSG_TXNACK;
+  } else if (msg->tagData.msg.flags & VCAN_MSG_FLAG_SSM_NACK_ABL) {
+    flags |= canMSG_TXNACK;
+    flags |= canMSG_ABL;
+  } else {
+    if (msg->tagData.msg.flags & VCAN_MSG_FLAG_TXACK) {
+      flags |= canMSG_TXACK;
+    }
+  }
+
+  return flags;
+}
+
+//======================================================================
+// Number of data bytes in a received message
+//======================================================================
+static int vCanMsgLength (VCAN_EVENT *msg, unsigned int flags)
+{
+  if (flags & canFDMSG_FDF) {
+    return dlc_dlc_to_bytes_fd (msg->tagData.msg.dlc);
+  } else {
+    return dlc_dlc_to_bytes_classic (msg->tagData.msg.dlc);
+  }
+}
+
+//======================================================================
+// Returns non-zero if a received message passes the id filter and the
+// filter program
+//======================================================================
+static int vCanAcceptMsg (HandleData *hData, VCAN_EVENT *msg)
+{
+  FilterFrame frame;
+  int         accept;
+
+  if (msg->tagData.msg.flags & (VCAN_MSG_FLAG_ERROR_FRAME | VCAN_MSG_FLAG_TXACK)) {
+    return 1;
+  }
+
+  frame.id  = msg->tagData.msg.id & ~EXT_MSG;
+  frame.ext = (msg->tagData.msg.id & EXT_MSG) != 0;
+
+  // Called from both the read path and the dispatcher
+  pthread_rwlock_rdlock(&hData->filterLock);
+  accept = idFilterAccept(&hData->idFilter, frame.id, frame.ext);
+  if (accept && hData->filterProg != NULL) {
+    frame.flags = vCanMsgFlags(msg);
+    frame.len   = vCanMsgLength(msg, frame.flags);
+    frame.dlc   = (hData->acceptLargeDlc && !(frame.flags & canFDMSG_FDF)) ?
+                  msg->tagData.msg.dlc : frame.len;
+    frame.data  = msg->tagData.msg.data;
+    accept      = filterProgAccept(hData->filterProg, &frame);
+  }
+  pthread_rwlock_unlock(&hData->filterLock);
+
+  return accept;
+}
+
+//======================================================================
+// Software auto-response buffers see every frame received on the channel.
+// A frame reaches both the notify and the read path, so it is answered
+// from the notify path while that gets RX events, else from the read path.
+//======================================================================
+static void vCanAutoResponse (HandleData *hData, VCAN_EVENT *msg, int fromNotify)
+{
+  SwObjBufs *sw = __atomic_load_n(&hData->swObjBufs, __ATOMIC_ACQUIRE);
+  int       onNotify;
+
+  if (!sw || !__atomic_load_n(&sw->nResponders, __ATOMIC_RELAXED)) {
+    return;
+  }
+  onNotify = (__atomic_load_n(&hData->notifyFlags, __ATOMIC_RELAXED) &
+              canNOTIFY_RX) != 0;
+  if (onNotify == fromNotify &&
+      !(msg->tagData.msg.flags & (VCAN_MSG_FLAG_ERROR_FRAME | VCAN_MSG_FLAG_TXACK |
+                                  VCAN_MSG_FLAG_TX_START))) {
+    swObjBufReceived(sw, msg->tagData.msg.id & ~EXT_MSG, vCanMsgFlags(msg));
+  }
+}
+
+static void notifyCall (HandleData *hData, unsigned int cb2_notify)
+{
+  if (hData->callback) {
+    hData->callback(&hData->notifyData);
+  } else if (hData->callback2) {
+    hData->callback2(hData->handle, hData->notifyData.tag, cb2_notify);
+  }
+}
+
 static void notify (HandleData *hData, VCAN_EVENT *msg)
 {
   canNotifyData *notifyData = &hData->notifyData;
@@ -293,13 +441,13 @@ static void notify (HandleData *hData, VCAN_EVENT *msg)
     notifyData->info.status.busStatus      = chipState->busStatus;
     notifyData->info.status.txErrorCounter = chipState->txErrorCounter;
     notifyData->info.status.rxErrorCounter = chipState->rxErrorCounter;
-    notifyData->info.status.time           = (msg->timeStamp * 10UL) / (hData->timerResolution);
+    notifyData->info.status.time           = vCanTimestamp(hData, msg->timeStamp);
     cb2_notify                             = canNOTIFY_STATUS;
   } else if (msg->tag == V_RECEIVE_MSG) {
     if (msg->tagData.msg.flags & VCAN_MSG_FLAG_ERROR_FRAME) {
       if (hData->notifyFlags & canNOTIFY_ERROR) {
         notifyData->eventType        = canEVENT_ERROR;
-        notifyData->info.busErr.time = (msg->timeStamp * 10UL) / (hData->timerResolution);
+        notifyData->info.busErr.time = vCanTimestamp(hData, msg->timeStamp);
         cb2_notify                   = canNOTIFY_ERROR;
       } else {
         return;
@@ -308,16 +456,16 @@ static void notify (HandleData *hData, VCAN_EVENT *msg)
       if (hData->notifyFlags & canNOTIFY_TX) {
         notifyData->eventType    = canEVENT_TX;
         notifyData->info.tx.id   = msg->tagData.msg.id & ~EXT_MSG;
-        notifyData->info.tx.time = (msg->timeStamp * 10UL) / (hData->timerResolution);
+        notifyData->info.tx.time = vCanTimestamp(hData, msg->timeStamp);
         cb2_notify               = canNOTIFY_TX;
       } else {
         return;
       }
     } else {
-      if (hData->notifyFlags & canNOTIFY_RX) {
+      if ((hData->notifyFlags & canNOTIFY_RX) && vCanAcceptMsg(hData, msg)) {
         notifyData->eventType    = canEVENT_RX;
         notifyData->info.rx.id   = msg->tagData.msg.id & ~EXT_MSG;
-        notifyData->info.rx.time = (msg->timeStamp * 10UL) / (hData->timerResolution);
+        notifyData->info.rx.time = vCanTimestamp(hData, msg->timeStamp);
         cb2_notify               = canNOTIFY_RX;
       } else {
         return;
@@ -327,85 +475,193 @@ static void notify (HandleData *hData, VCAN_EVENT *msg)
     return;
   }
 
-  if (hData->callback) {
-    hData->callback(notifyData);
-  } else if (hData->callback2) {
-    hData->callback2(hData->handle, notifyData->tag, cb2_notify);
+  notifyCall(hData, cb2_notify);
+}
+
+//======================================================================
+// Report a changed envvar, called from the dispatcher. Only envvars
+// this handle has open are reported.
+//======================================================================
+void vCanNotifyEnvvar (HandleData *hData, uint32_t id, uint64_t ticks)
+{
+  canNotifyData       *notifyData = &hData->notifyData;
+  const kvEnvvarEvent *event;
+
+  if (!(hData->notifyFlags & canNOTIFY_ENVVAR)) {
+    return;
+  }
+  if (envvarChanged(hData, id, &event) != canOK) {
+    return;
+  }
+
+  notifyData->eventType         = canEVENT_ENVVAR;
+  notifyData->info.envvar.event = event;
+  notifyData->info.envvar.time  = vCanTimestamp(hData, ticks);
+  notifyCall(hData, canNOTIFY_ENVVAR);
+}
+
+//======================================================================
+// Decode a message for a frame callback, returns number of frames added
+//======================================================================
+static unsigned int notifyFrame (HandleData *hData, VCAN_EVENT *msg,
+                                 kvNotifyFrame *frame)
+{
+  unsigned int event;
+
+  if (msg->tag != V_RECEIVE_MSG) {
+    return 0;
   }
+
+  if (msg->tagData.msg.flags & VCAN_MSG_FLAG_ERROR_FRAME) {
+    event = canNOTIFY_ERROR;
+  } else if (msg->tagData.msg.flags & VCAN_MSG_FLAG_TXACK) {
+    event = canNOTIFY_TX;
+  } else {
+    event = canNOTIFY_RX;
+  }
+  if (!(hData->notifyFlags & event) || !vCanAcceptMsg(hData, msg)) {
+    return 0;
+  }
+
+  frame->event = event;
+  vCanDecodeMsg(hData, msg, &frame->id, frame->data, &frame->dlc,
+                &frame->flags, &frame->time);
+
+  return 1;
 }
 
+// Max number of events read from a notification fd per wakeup, so that a
+// busy channel cannot starve the others.
+#define NOTIFY_MAX_BATCH 64
+
 //======================================================================
-// Notification thread
+// Dispatch events to the callbacks of a handle, fetch returns non-zero
+// when there are no more events to read
 //======================================================================
-static void *vCanNotifyThread (void *arg)
+void vCanNotifyEvents (HandleData *hData, vCanNotifyFetchFn fetch)
 {
   VCAN_EVENT   msg;
-  HandleData  *hData = (HandleData *)arg;
-  int          ret;
+  int          i;
+  unsigned int n = 0;
+  int64_t      start = TRACE_START(notify_dispatch);
 
-  while (1) {
-    pthread_testcancel();
+  for (i = 0; i < NOTIFY_MAX_BATCH && hData->notifyFd != canINVALID_HANDLE; i++) {
+    if (fetch(hData, &msg) != 0) {
+      break;
+    }
 
-    ret = ioctl(hData->notifyFd, VCAN_IOC_RECVMSG, &msg);
-    
-    if (ret == 0) {
-      notify(hData, &msg);
-    } else { 
-      if (errno != EAGAIN) {
-        pthread_exit(0); // When this thread is cancelled, ioctl will be interrupted by a signal.
+    if (msg.tag == V_RECEIVE_MSG) {
+      vCanAutoResponse(hData, &msg, 1);
+    } else if (msg.tag == V_CHIP_STATE) {
+      flightRecEvent(FLIGHTREC_STATUS, msg.tagData.chipState.busStatus,
+                     hData->handle, msg.tagData.chipState.txErrorCounter,
+                     msg.tagData.chipState.rxErrorCounter);
+    }
+
+    if (hData->frameCallback) {
+      n += notifyFrame(hData, &msg, &hData->notifyFrames[n]);
+      if (n == hData->notifyFramesMax) {
+        hData->frameCallback(hData->handle, hData->notifyData.tag,
+                             hData->notifyFrames, n);
+        n = 0;
       }
+    } else {
+      notify(hData, &msg);
     }
   }
+
+  if (n && hData->frameCallback) {
+    hData->frameCallback(hData->handle, hData->notifyData.tag,
+                         hData->notifyFrames, n);
+  }
+
+  CANLIB_PROBE3(notify_dispatch, hData->handle, i, traceSinceNs(start));
+}
+
+//======================================================================
+// Fetch an event from the notification fd
+//======================================================================
+static int vCanNotifyFetch (HandleData *hData, VCAN_EVENT *msg)
+{
+  int ret;
+
+  ret = vCanIoctl(hData->notifyFd, VCAN_IOC_RECVMSG, msg);
+  if (ret != 0 && errno != EAGAIN) {
+    DEBUGPRINT((TXT("vCanNotifyRead failed (%d)\n"), errno));
+  }
+
+  return ret;
+}
+
+//======================================================================
+// Read events from notification fd, called from the dispatcher
+//======================================================================
+static void vCanNotifyRead (HandleData *hData)
+{
+  vCanNotifyEvents(hData, vCanNotifyFetch);
 }
 
 
 //======================================================================
-// vCanSetNotify
+// Set up notification, called with the dispatcher locked
 //======================================================================
-static canStatus vCanSetNotify (HandleData *hData,
-                                void (*callback) (canNotifyData *),
-                                kvCallback_t callback2,
-                                unsigned int notifyFlags)
+static canStatus vCanSetNotifyInternal (HandleData *hData,
+                                        void (*callback) (canNotifyData *),
+                                        kvCallback_t callback2,
+                                        kvFrameCallback_t frameCallback,
+                                        unsigned int notifyFlags)
 {
   int           ret;
   VCanMsgFilter filter;
   unsigned char transId;
   VCanRead      read;
+  canStatus     stat = canERR_NOTFOUND;
+
+  if (notifyFlags == 0 ||
+      (callback == NULL && callback2 == NULL && frameCallback == NULL)) {
+    // We want to shut off notification, close file and clear callback
+    if (hData->notifyFd != canINVALID_HANDLE) {
+      vCanNotifyUnregister(hData);
+      close(hData->notifyFd);
+      hData->notifyFd = canINVALID_HANDLE;
+    }
+    hData->callback      = NULL;
+    hData->callback2     = NULL;
+    hData->frameCallback = NULL;
+    hData->notifyFlags   = 0;
+    return canOK;
+  }
 
   if (hData->notifyFd == canINVALID_HANDLE) {
     // Open an fd to read events from
-    hData->notifyFd = open(hData->deviceName, O_RDONLY);
+    hData->notifyFd = open(hData->deviceName, O_RDONLY | O_NONBLOCK);
 
     if (hData->notifyFd == canINVALID_HANDLE) {
       goto error_open;
     }
 
     //notiFd must have same transId as fd, otherwise canNOTIFY_TX won't work
-    ret = ioctl(hData->fd, VCAN_IOC_GET_TRANSID, &transId);
+    ret = vCanIoctl(hData->fd, VCAN_IOC_GET_TRANSID, &transId);
     if (ret != 0) {
       goto error_ioc;
     }
 
-    ret = ioctl(hData->notifyFd, VCAN_IOC_SET_TRANSID, &transId);
+    ret = vCanIoctl(hData->notifyFd, VCAN_IOC_SET_TRANSID, &transId);
     if (ret != 0) {
       goto error_ioc;
     }
 
-    read.timeout = 50;
-    ret = ioctl(hData->notifyFd, VCAN_IOC_SET_READ, &read);
+    // The dispatcher only reads when the fd is ready, so never block.
+    read.timeout = 0;
+    ret = vCanIoctl(hData->notifyFd, VCAN_IOC_SET_READ, &read);
     if (ret != 0) {
       goto error_ioc;
     }
 
-    ret = ioctl(hData->notifyFd, VCAN_IOC_BUS_ON, NULL);
+    ret = vCanIoctl(hData->notifyFd, VCAN_IOC_BUS_ON, NULL);
     if (ret != 0) {
       goto error_ioc;
     }
-  } else { //must kill thread in order to set new params.
-    pthread_cancel(hData->notifyThread);
-    
-    // Wait for thread to finish
-    pthread_join(hData->notifyThread, NULL);
   }
 
   hData->notifyFlags = notifyFlags;
@@ -424,41 +680,139 @@ static canStatus vCanSetNotify (HandleData *hData,
     filter.eventMask |= V_CHIP_STATE;
   }
 
-  ret = ioctl(hData->notifyFd, VCAN_IOC_SET_MSG_FILTER, &filter);
+  ret = vCanIoctl(hData->notifyFd, VCAN_IOC_SET_MSG_FILTER, &filter);
   if (ret != 0) {
     goto error_ioc;
   }
 
   if (notifyFlags & canNOTIFY_TX) {
     int par = 1;
-    ret = ioctl(hData->notifyFd, VCAN_IOC_SET_TXACK, &par);
+    ret = vCanIoctl(hData->notifyFd, VCAN_IOC_SET_TXACK, &par);
     if (ret != 0) {
       goto error_ioc;
     }
   }
 
-  ret = ioctl(hData->fd, VCAN_IOC_FLUSH_RCVBUFFER, NULL);
+  ret = vCanIoctl(hData->fd, VCAN_IOC_FLUSH_RCVBUFFER, NULL);
   if (ret != 0) {
     goto error_ioc;
   }
-  
-  ret = pthread_create(&hData->notifyThread, NULL, vCanNotifyThread, hData);
-  if (ret != 0) {
-    goto error_ioc;
+
+  hData->callback      = callback;
+  hData->callback2     = callback2;
+  hData->frameCallback = frameCallback;
+
+  if (hData->notifyEntry == NULL) {
+    stat = vCanNotifyRegister(hData, hData->notifyFd, vCanNotifyRead);
+    if (stat != canOK) {
+      goto error_ioc;
+    }
   }
 
-  hData->callback  = callback;
-  hData->callback2 = callback2;
   return canOK;
 
 error_ioc:
+  vCanNotifyUnregister(hData);
   close(hData->notifyFd);
-  hData->notifyFd = canINVALID_HANDLE;
+  hData->notifyFd  = canINVALID_HANDLE;
+  hData->notifyFlags   = 0;
+  hData->callback      = NULL;
+  hData->callback2     = NULL;
+  hData->frameCallback = NULL;
  error_open:
-  return canERR_NOTFOUND;
+  return stat;
 }
 
 
+//======================================================================
+// Set up notification through a backend specific setup function, takes
+// care of the dispatcher lock and the frame callback batch buffer
+//======================================================================
+canStatus vCanSetNotifyWith (HandleData *hData, vCanNotifySetupFn setup,
+                             void (*callback) (canNotifyData *),
+                             kvCallback_t callback2,
+                             kvFrameCallback_t frameCallback,
+                             unsigned int notifyFlags,
+                             unsigned int maxBatch)
+{
+  kvNotifyFrame *frames;
+  canStatus     stat;
+
+  if (frameCallback == NULL || notifyFlags == 0) {
+    frameCallback = NULL;
+  } else if (maxBatch == 0 || maxBatch > NOTIFY_MAX_BATCH) {
+    maxBatch = NOTIFY_MAX_BATCH;
+  }
+
+  vCanNotifyLock();
+
+  if (frameCallback) {
+    if (maxBatch > hData->notifyFramesMax) {
+      frames = realloc(hData->notifyFrames, maxBatch * sizeof(kvNotifyFrame));
+      if (frames == NULL) {
+        vCanNotifyUnlock();
+        return canERR_NOMEM;
+      }
+      hData->notifyFrames = frames;
+    }
+    hData->notifyFramesMax = maxBatch;
+  }
+
+  stat = setup(hData, callback, callback2, frameCallback, notifyFlags);
+  if (hData->frameCallback == NULL) {
+    free(hData->notifyFrames);
+    hData->notifyFrames    = NULL;
+    hData->notifyFramesMax = 0;
+  }
+
+  vCanNotifyUnlock();
+
+  return stat;
+}
+
+
+//======================================================================
+// vCanSetNotify
+//======================================================================
+static canStatus vCanSetNotify (HandleData *hData,
+                                void (*callback) (canNotifyData *),
+                                kvCallback_t callback2,
+                                unsigned int notifyFlags)
+{
+  return vCanSetNotifyWith(hData, vCanSetNotifyInternal, callback, callback2,
+                           NULL, notifyFlags, 0);
+}
+
+
+//======================================================================
+// vCanSetNotifyFrame
+//======================================================================
+static canStatus vCanSetNotifyFrame (HandleData *hData,
+                                     kvFrameCallback_t callback,
+                                     unsigned int notifyFlags,
+                                     unsigned int maxBatch)
+{
+  if (callback == NULL || notifyFlags == 0) {
+    return vCanSetNotify(hData, NULL, NULL, 0);
+  }
+
+  return vCanSetNotifyWith(hData, vCanSetNotifyInternal, NULL, NULL, callback,
+                           notifyFlags, maxBatch);
+}
+
+
+//======================================================================
+// vCanCloseChannel
+//======================================================================
+static canStatus vCanCloseChannel (HandleData *hData)
+{
+  if (close(hData->fd) != 0) {
+    return canERR_INVHANDLE;
+  }
+
+  return canOK;
+}
+
 //======================================================================
 // vCanOpenChannel
 //======================================================================
@@ -474,10 +828,10 @@ static canStatus vCanOpenChannel (HandleData *hData)
   }
 
   if (hData->wantExclusive) {
-    ret = ioctl(hData->fd, VCAN_IOC_OPEN_EXCL, &hData->channelNr);
+    ret = vCanIoctl(hData->fd, VCAN_IOC_OPEN_EXCL, &hData->channelNr);
   }
   else {
-    ret = ioctl(hData->fd, VCAN_IOC_OPEN_CHAN, &hData->channelNr);
+    ret = vCanIoctl(hData->fd, VCAN_IOC_OPEN_CHAN, &hData->channelNr);
   }
 
   if (ret) {
@@ -491,7 +845,7 @@ static canStatus vCanOpenChannel (HandleData *hData)
     return canERR_NOCHANNELS;
   }
 
-  ret = ioctl(hData->fd, VCAN_IOC_GET_CHAN_CAP, &capability);
+  ret = vCanIoctl(hData->fd, VCAN_IOC_GET_CHAN_CAP, &capability);
   if (ret) {
     close(hData->fd);
     return canERR_NOTFOUND;
@@ -517,7 +871,7 @@ static canStatus vCanOpenChannel (HandleData *hData)
   memset(&filter, 0, sizeof(VCanMsgFilter));
   // Read only CAN messages
   filter.eventMask = V_RECEIVE_MSG | V_TRANSMIT_MSG;
-  ret = ioctl(hData->fd, VCAN_IOC_SET_MSG_FILTER, &filter);
+  ret = vCanIoctl(hData->fd, VCAN_IOC_SET_MSG_FILTER, &filter);
 
   hData->timerScale = 1.0 / DEFAULT_TIMER_FACTOR;
   hData->timerResolution = (unsigned int)(10.0 / hData->timerScale);
@@ -531,7 +885,7 @@ static canStatus vCanOpenChannel (HandleData *hData)
 static canStatus vCanBusOn (HandleData *hData)
 {
   int ret;
-  ret = ioctl(hData->fd, VCAN_IOC_BUS_ON, NULL);
+  ret = vCanIoctl(hData->fd, VCAN_IOC_BUS_ON, NULL);
   if (ret != 0) {
     return errnoToCanStatus(errno);
   }
@@ -547,7 +901,7 @@ static canStatus vCanBusOff (HandleData *hData)
 {
   int ret;
 
-  ret = ioctl(hData->fd, VCAN_IOC_BUS_OFF, NULL);
+  ret = vCanIoctl(hData->fd, VCAN_IOC_BUS_OFF, NULL);
   if (ret != 0) {
     return canERR_INVHANDLE;
   }
@@ -586,7 +940,7 @@ static canStatus vCanSetBusParams (HandleData *hData,
   busParams.tseg1_brs = tseg1_brs;
   busParams.tseg2_brs = tseg2_brs;
 
-  ret = ioctl(hData->fd, VCAN_IOC_SET_BITRATE, &busParams);
+  ret = vCanIoctl(hData->fd, VCAN_IOC_SET_BITRATE, &busParams);
 
   if (ret != 0) {
     return errnoToCanStatus(errno);
@@ -614,7 +968,7 @@ static canStatus vCanGetBusParams(HandleData *hData,
   VCanBusParams busParams;
   int ret;
 
-  ret = ioctl(hData->fd, VCAN_IOC_GET_BITRATE, &busParams);
+  ret = vCanIoctl(hData->fd, VCAN_IOC_GET_BITRATE, &busParams);
 
   if (ret != 0) {
     return errnoToCanStatus(errno);
@@ -641,7 +995,7 @@ static canStatus vCanGetBusParams(HandleData *hData,
 //======================================================================
 static canStatus vCanReqBusStats(HandleData *hData)
 {
-  if (ioctl(hData->fd, VCAN_IOC_REQ_BUS_STATS, NULL)) {
+  if (vCanIoctl(hData->fd, VCAN_IOC_REQ_BUS_STATS, NULL)) {
     return errnoToCanStatus(errno);
   }
   return canOK;
@@ -654,7 +1008,7 @@ static canStatus vCanGetBusStats(HandleData *hData, canBusStatistics *stat)
 {
   VCanBusStatistics tstat;
   memset(stat, 0, sizeof(canBusStatistics));
-  if (ioctl(hData->fd, VCAN_IOC_GET_BUS_STATS, &tstat)) {
+  if (vCanIoctl(hData->fd, VCAN_IOC_GET_BUS_STATS, &tstat)) {
     return errnoToCanStatus(errno);
   }
 
@@ -671,87 +1025,142 @@ static canStatus vCanGetBusStats(HandleData *hData, canBusStatistics *stat)
 }
 
 
+//======================================================================
+// Decode a received message
+//======================================================================
+static void vCanDecodeMsg (HandleData *hData, VCAN_EVENT *msg,
+                           long *id,
+                           void *msgPtr, unsigned int *dlc,
+                           unsigned int *flag, unsigned long *time)
+{
+  int i;
+  unsigned int flags;
+  int count = 0;
+
+  flags = vCanMsgFlags(msg);
+  count = vCanMsgLength(msg, flags);
+
+
+  // Copy data
+  if (msgPtr) {
+    for (i = 0; i < count; i++)
+      ((unsigned char *)msgPtr)[i] = msg->tagData.msg.data[i];
+  }
+
+  // MSb is extended flag
+  if (id)   *id   = msg->tagData.msg.id & ~EXT_MSG;
+  if (dlc) {
+    if (hData->acceptLargeDlc && !(flags & canFDMSG_FDF)) {
+      *dlc = msg->tagData.msg.dlc;
+    }
+    else {
+      *dlc  = count;
+    }
+  }
+  if (time) *time = vCanTimestamp(hData, msg->timeStamp);
+  if (flag) *flag = flags;
+}
+
+
+//======================================================================
+// Hand a message read from the device to the caller, returns zero if it
+// was dropped by the filters and the next one should be read instead
+//======================================================================
+int vCanReceivedMsg (HandleData *hData, VCAN_EVENT *msg,
+                     long *id, void *msgPtr, unsigned int *dlc,
+                     unsigned int *flag, unsigned long *time)
+{
+  IdStats *idStats;
+
+  if (msg->tag != V_RECEIVE_MSG) {
+    return 0;
+  }
+
+  vCanAutoResponse(hData, msg, 0);
+  if (!vCanAcceptMsg(hData, msg)) {
+    return 0;
+  }
+
+  idStats = __atomic_load_n(&hData->idStats, __ATOMIC_ACQUIRE);
+  if (idStats && __atomic_load_n(&idStats->enabled, __ATOMIC_RELAXED) &&
+      !(msg->tagData.msg.flags & (VCAN_MSG_FLAG_ERROR_FRAME | VCAN_MSG_FLAG_TXACK))) {
+    idStatsUpdate(idStats, msg->tagData.msg.id & ~EXT_MSG,
+                  (msg->tagData.msg.id & EXT_MSG) != 0,
+                  vCanTimestampUs(hData, msg->timeStamp),
+                  msg->tagData.msg.dlc, msg->tagData.msg.data,
+                  vCanMsgLength(msg, vCanMsgFlags(msg)));
+  }
+  if (msg->tagData.msg.flags & VCAN_MSG_FLAG_OVERRUN) {
+    flightRecEvent(FLIGHTREC_RX_OVERRUN, 0, hData->handle,
+                   msg->tagData.msg.id & ~EXT_MSG, 0);
+  }
+  vCanDecodeMsg(hData, msg, id, msgPtr, dlc, flag, time);
+
+  return 1;
+}
+
+
+//======================================================================
+// Read deadlines, in ms on CLOCK_MONOTONIC; 0 is none
+//======================================================================
+static int64_t readNowMs (void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int64_t readDeadline (unsigned long timeout)
+{
+  if (timeout == 0 || timeout >= 0xFFFFFFFF) {
+    return 0;
+  }
+  return readNowMs() + (int64_t)timeout;
+}
+
+static long readRemaining (int64_t deadline)
+{
+  int64_t left = deadline - readNowMs();
+
+  return (left > 0) ? (long)left : 0;
+}
+
 //======================================================================
 // vCanReadInternal
+// A read with a timeout set by VCAN_IOC_SET_READ passes the deadline,
+// so that frames dropped by the filters do not restart the wait.
 //======================================================================
 static canStatus vCanReadInternal (HandleData *hData, unsigned int iotcl_cmd,
-                                   long *id,
+                                   int64_t deadline, long *id,
                                    void *msgPtr, unsigned int *dlc,
                                    unsigned int *flag, unsigned long *time)
 {
-  int i;
   int ret;
   VCAN_EVENT msg;
+  VCanRead read;
+  int64_t start = TRACE_START(read_return);
+
+  CANLIB_PROBE2(read_entry, hData->handle, iotcl_cmd);
 
   while (1) {
-    ret = ioctl(hData->fd, iotcl_cmd, &msg);
+    ret = vCanIoctl(hData->fd, iotcl_cmd, &msg);
     if (ret != 0) {
-      return errnoToCanStatus(errno);
+      canStatus stat = errnoToCanStatus(errno);
+      CANLIB_PROBE6(read_return, hData->handle, stat, 0, 0, 0,
+                    traceSinceNs(start));
+      return stat;
     }
-    // Receive CAN message
-    if (msg.tag == V_RECEIVE_MSG) {
-      unsigned int flags;
-      int count = 0;
-
-      if (msg.tagData.msg.id & EXT_MSG) {
-        flags = canMSG_EXT;
-      } else {
-        flags = canMSG_STD;
-      }
-      if (msg.tagData.msg.flags & VCAN_MSG_FLAG_ERROR_FRAME)
-        flags = canMSG_ERROR_FRAME;
-      if (msg.tagData.msg.flags & VCAN_MSG_FLAG_FDF)
-        flags |= canFDMSG_FDF;
-      if (msg.tagData.msg.flags & VCAN_MSG_FLAG_BRS)
-        flags |= canFDMSG_BRS;
-      if (msg.tagData.msg.flags & VCAN_MSG_FLAG_ESI)
-        flags |= canFDMSG_ESI;
-      if (msg.tagData.msg.flags & VCAN_MSG_FLAG_OVERRUN)
-        flags |= canMSGERR_HW_OVERRUN | canMSGERR_SW_OVERRUN;
-      if (msg.tagData.msg.flags & VCAN_MSG_FLAG_REMOTE_FRAME)
-        flags |= canMSG_RTR;
-      if (msg.tagData.msg.flags & VCAN_MSG_FLAG_TX_START)
-        flags |= canMSG_TXRQ;
-
-      if (flags & canFDMSG_FDF) {
-        count = dlc_dlc_to_bytes_fd (msg.tagData.msg.dlc);
-      } else {
-        count = dlc_dlc_to_bytes_classic (msg.tagData.msg.dlc);
-      }
-
-      if (msg.tagData.msg.flags & VCAN_MSG_FLAG_SSM_NACK) {
-        flags |= canMSG_TXNACK;
-      } else if (msg.tagData.msg.flags & VCAN_MSG_FLAG_SSM_NACK_ABL) {
-        flags |= canMSG_TXNACK;
-        flags |= canMSG_ABL;
-      } else {
-        if (msg.tagData.msg.flags & VCAN_MSG_FLAG_TXACK) {
-          flags |= canMSG_TXACK;
-        }
-      }
-
-
-      // Copy data
-      if (msgPtr) {
-        for (i = 0; i < count; i++)
-          ((unsigned char *)msgPtr)[i] = msg.tagData.msg.data[i];
-      }
-
-      // MSb is extended flag
-      if (id)   *id   = msg.tagData.msg.id & ~EXT_MSG;
-      if (dlc) {
-        if (hData->acceptLargeDlc && !(flags & canFDMSG_FDF)) {
-          *dlc = msg.tagData.msg.dlc;
-        }
-        else {
-          *dlc  = count;
-        }
-      }
-      if (time) *time = (msg.timeStamp * 10UL) / (hData->timerResolution) ;
-      if (flag) *flag = flags;
-
+    if (vCanReceivedMsg(hData, &msg, id, msgPtr, dlc, flag, time)) {
+      CANLIB_PROBE6(read_return, hData->handle, canOK,
+                    msg.tagData.msg.id & ~EXT_MSG, msg.tagData.msg.dlc,
+                    vCanMsgFlags(&msg), traceSinceNs(start));
       break;
     }
+    if (deadline) {
+      read.timeout = readRemaining(deadline);
+      vCanIoctl(hData->fd, VCAN_IOC_SET_READ, &read);
+    }
   }
 
   return canOK;
@@ -771,8 +1180,9 @@ static canStatus vCanRead (HandleData    *hData,
   VCanRead read;
 
   read.timeout = 0;
-  ioctl(hData->fd, VCAN_IOC_SET_READ, &read);
-  return vCanReadInternal(hData, VCAN_IOC_RECVMSG, id, msgPtr, dlc, flag, time);
+  vCanIoctl(hData->fd, VCAN_IOC_SET_READ, &read);
+  return vCanReadInternal(hData, VCAN_IOC_RECVMSG, 0, id, msgPtr, dlc, flag,
+                          time);
 }
 
 //======================================================================
@@ -783,7 +1193,7 @@ static canStatus vCanReadSync (HandleData    *hData,
 {
   int ret;
 
-  ret = ioctl(hData->fd, VCAN_IOC_RECVMSG_SYNC, &timeout);
+  ret = vCanIoctl(hData->fd, VCAN_IOC_RECVMSG_SYNC, &timeout);
   if (ret != 0) {
     return errnoToCanStatus(errno);
   }
@@ -807,9 +1217,10 @@ static canStatus vCanReadSpecific (HandleData    *hData,
   cmd.id      = id;
   cmd.timeout = 0;
 
-  ioctl(hData->fd, VCAN_IOC_SET_READ_SPECIFIC, &cmd);
+  vCanIoctl(hData->fd, VCAN_IOC_SET_READ_SPECIFIC, &cmd);
 
-  return vCanReadInternal(hData, VCAN_IOC_RECVMSG_SPECIFIC, NULL, msgPtr, dlc, flag, time);
+  return vCanReadInternal(hData, VCAN_IOC_RECVMSG_SPECIFIC, 0, NULL, msgPtr,
+                          dlc, flag, time);
 }
 
 //======================================================================
@@ -828,9 +1239,10 @@ static canStatus vCanReadSpecificSkip (HandleData    *hData,
   cmd.id      = id;
   cmd.timeout = 0;
 
-  ioctl(hData->fd, VCAN_IOC_SET_READ_SPECIFIC, &cmd);
+  vCanIoctl(hData->fd, VCAN_IOC_SET_READ_SPECIFIC, &cmd);
 
-  return vCanReadInternal(hData, VCAN_IOC_RECVMSG_SPECIFIC, NULL, msgPtr, dlc, flag, time);
+  return vCanReadInternal(hData, VCAN_IOC_RECVMSG_SPECIFIC, 0, NULL, msgPtr,
+                          dlc, flag, time);
 }
 
 //======================================================================
@@ -840,15 +1252,23 @@ static canStatus vCanReadSyncSpecific (HandleData    *hData,
                                        long          id,
                                        unsigned long timeout)
 {
- VCanReadSpecific cmd;
+  VCanReadSpecific cmd;
+  VCAN_EVENT       msg;
+  int              ret;
 
   cmd.skip    = READ_SPECIFIC_NO_SKIP;
   cmd.id      = id;
   cmd.timeout = timeout;
 
-  ioctl(hData->fd, VCAN_IOC_SET_READ_SPECIFIC, &cmd);
+  vCanIoctl(hData->fd, VCAN_IOC_SET_READ_SPECIFIC, &cmd);
+
+  // Like vCanReadSync, the message is left in the queue and not filtered
+  ret = vCanIoctl(hData->fd, VCAN_IOC_RECVMSG_SPECIFIC, &msg);
+  if (ret != 0) {
+    return errnoToCanStatus(errno);
+  }
 
-  return vCanReadInternal(hData, VCAN_IOC_RECVMSG_SPECIFIC, NULL, NULL, NULL, NULL, NULL);
+  return canOK;
 }
 
 //======================================================================
@@ -865,8 +1285,10 @@ static canStatus vCanReadWait (HandleData    *hData,
   VCanRead read;
   
   read.timeout = timeout;
-  ioctl(hData->fd, VCAN_IOC_SET_READ, &read);
-  return vCanReadInternal(hData, VCAN_IOC_RECVMSG, id, msgPtr, dlc, flag, time);
+  vCanIoctl(hData->fd, VCAN_IOC_SET_READ, &read);
+  return vCanReadInternal(hData, VCAN_IOC_RECVMSG,
+                          readDeadline((unsigned long)timeout), id, msgPtr,
+                          dlc, flag, time);
 }
 
 
@@ -889,7 +1311,7 @@ static canStatus vCanSetBusOutputControl (HandleData *hData,
   default:
     return canERR_PARAM;
   }
-  ret = ioctl(hData->fd, VCAN_IOC_SET_OUTPUT_MODE, &silent);
+  ret = vCanIoctl(hData->fd, VCAN_IOC_SET_OUTPUT_MODE, &silent);
 
   if (ret != 0) {
     return errnoToCanStatus(errno);
@@ -908,7 +1330,7 @@ static canStatus vCanGetBusOutputControl (HandleData *hData,
   int silent;
   int ret;
 
-  ret = ioctl(hData->fd, VCAN_IOC_GET_OUTPUT_MODE, &silent);
+  ret = vCanIoctl(hData->fd, VCAN_IOC_GET_OUTPUT_MODE, &silent);
 
   if (ret != 0) {
     return errnoToCanStatus(errno);
@@ -936,7 +1358,7 @@ static canStatus vCanSetDeviceMode (HandleData *hData,
 {
   int ret;
 
-  ret = ioctl(hData->fd, VCAN_IOC_SET_DEVICE_MODE, &mode);
+  ret = vCanIoctl(hData->fd, VCAN_IOC_SET_DEVICE_MODE, &mode);
   DEBUGPRINT((TXT("VCAN_IOC_SET_DEVICE_MODE 0x%x, ret %d\n"), mode, ret));
   if (ret != 0) {
     return errnoToCanStatus(errno);
@@ -955,7 +1377,7 @@ static canStatus vCanGetDeviceMode (HandleData *hData,
   int ret;
   int devicemode;
 
-  ret = ioctl(hData->fd, VCAN_IOC_GET_DEVICE_MODE, &devicemode);
+  ret = vCanIoctl(hData->fd, VCAN_IOC_GET_DEVICE_MODE, &devicemode);
   DEBUGPRINT((TXT("VCAN_IOC_GET_DEVICE_MODE 0x%x, ret %d\n"), devicemode, ret));
   if (ret != 0) {
     return errnoToCanStatus(errno);
@@ -971,7 +1393,7 @@ static canStatus vCanFileGetCount(HandleData *hData, int *count)
 {
   int ret = 0;
 
-  ret = ioctl(hData->fd, VCAN_IOC_FILE_GET_COUNT, count);
+  ret = vCanIoctl(hData->fd, VCAN_IOC_FILE_GET_COUNT, count);
   if (ret != 0) {
     return errnoToCanStatus(errno);
   }
@@ -990,7 +1412,7 @@ static canStatus vCanFileGetName(HandleData *hData, int fileNo, char *name, int
   fileGetName.fileNo = fileNo;
   fileGetName.name = name;
   fileGetName.namelen = namelen;
-  ret = ioctl(hData->fd, VCAN_IOC_FILE_GET_NAME, &fileGetName);
+  ret = vCanIoctl(hData->fd, VCAN_IOC_FILE_GET_NAME, &fileGetName);
   if (ret != 0) {
     return errnoToCanStatus(errno);
   }
@@ -1009,18 +1431,42 @@ static canStatus vCanFileDelete(HandleData *hData, char *deviceFileName)
 // vCanFileCopyToDevice
 //======================================================================
 static canStatus vCanFileCopyToDevice(HandleData *hData, char *hostFileName,
-                                      char *deviceFileName)
+                                      char *deviceFileName,
+                                      unsigned int flags, uint32_t *crc)
 {
-  return vCanMemo_file_copy_to_device(hData, hostFileName, deviceFileName);
+  return vCanMemo_file_copy_to_device(hData, hostFileName, deviceFileName,
+                                      flags, crc);
 }
 
 //======================================================================
 // vCanFileCopyFromDevice
 //======================================================================
 static canStatus vCanFileCopyFromDevice(HandleData *hData, char *deviceFileName,
-                                        char *hostFileName)
+                                        char *hostFileName,
+                                        unsigned int flags, uint32_t *crc)
 {
-  return vCanMemo_file_copy_from_device(hData, deviceFileName, hostFileName);
+  return vCanMemo_file_copy_from_device(hData, deviceFileName, hostFileName,
+                                        flags, crc);
+}
+
+//======================================================================
+// vCanFileReadStream
+//======================================================================
+static canStatus vCanFileReadStream(HandleData *hData, char *deviceFileName,
+                                    kvFileReadCallback callback, void *context)
+{
+  return vCanMemo_file_read_stream(hData, deviceFileName, callback, context);
+}
+
+//======================================================================
+// vCanFileWriteStream
+//======================================================================
+static canStatus vCanFileWriteStream(HandleData *hData, char *deviceFileName,
+                                     kvFileWriteCallback callback,
+                                     void *context, uint64_t total)
+{
+  return vCanMemo_file_write_stream(hData, deviceFileName, callback, context,
+                                    total);
 }
 
 //======================================================================
@@ -1048,6 +1494,15 @@ static canStatus vCanScriptLoadFile(HandleData *hData, int slotNo,
   return vCanScript_load_file(hData, slotNo, hostFileName);
 }
 
+//======================================================================
+// vCanScriptLoadBuffer
+//======================================================================
+static canStatus vCanScriptLoadBuffer(HandleData *hData, int slotNo,
+                                      const void *image, unsigned int len)
+{
+  return vCanScript_load_buffer(hData, slotNo, image, len);
+}
+
 //======================================================================
 // vCanScriptUnLoad
 //======================================================================
@@ -1057,59 +1512,113 @@ static canStatus vCanScriptUnload(HandleData *hData, int slotNo)
 }
 
 //======================================================================
-// vCanAccept
+// vCanEnvvarInfo
 //======================================================================
-static canStatus vCanAccept(HandleData *hData,
-                            const long envelope,
-                            const unsigned int flag)
+static canStatus vCanEnvvarInfo(HandleData *hData, const char *name,
+                                uint32_t *id, int *type, int *size)
+{
+  return vCanScript_envvar_info(hData, name, id, type, size);
+}
+
+//======================================================================
+// vCanEnvvarTransfer
+//======================================================================
+static canStatus vCanEnvvarTransfer(HandleData *hData, int set,
+                                    EnvvarXfer *xfer, int n)
+{
+  return vCanScript_envvar_transfer(hData, set, xfer, n);
+}
+
+//======================================================================
+// Set the acceptance filter of the driver
+//
+// The filter of hData->fd is only changed here and in vCanOpen, so it is
+// built from the code and mask kept in hData; an update is one ioctl.
+//======================================================================
+static canStatus vCanSetMsgFilter(HandleData *hData,
+                                  const unsigned int code[2],
+                                  const unsigned int mask[2])
 {
   VCanMsgFilter filter;
   int ret;
 
-  ret = ioctl(hData->fd, VCAN_IOC_GET_MSG_FILTER, &filter);
+  memset(&filter, 0, sizeof(VCanMsgFilter));
+  filter.eventMask = V_RECEIVE_MSG | V_TRANSMIT_MSG;
+  filter.stdId     = code[0] & 0xFFFF;   //from windows
+  filter.stdMask   = mask[0] & 0xFFFF;
+  filter.extId     = code[1] & ((1 << 29) - 1);
+  filter.extMask   = mask[1] & ((1 << 29) - 1);
+  ret = vCanIoctl(hData->fd, VCAN_IOC_SET_MSG_FILTER, &filter);
   if (ret != 0) {
     return errnoToCanStatus(errno);
   }
+  memcpy(hData->acceptCode, code, sizeof(hData->acceptCode));
+  memcpy(hData->acceptMask, mask, sizeof(hData->acceptMask));
+
+  return canOK;
+}
+
+//======================================================================
+// vCanAccept
+//======================================================================
+static canStatus vCanAccept(HandleData *hData,
+                            const long envelope,
+                            const unsigned int flag)
+{
+  unsigned int code[2], mask[2];
+
+  memcpy(code, hData->acceptCode, sizeof(code));
+  memcpy(mask, hData->acceptMask, sizeof(mask));
 
   switch (flag) {
   case canFILTER_SET_CODE_STD:
-    filter.stdId   = envelope & 0xFFFF; //from windows
+    code[0] = envelope;
     break;
   case canFILTER_SET_MASK_STD:
-    filter.stdMask = envelope & 0xFFFF;  //from windows
+    mask[0] = envelope;
     break;
   case canFILTER_SET_CODE_EXT:
-    filter.extId   = envelope & ((1 << 29) - 1);
+    code[1] = envelope;
     break;
   case canFILTER_SET_MASK_EXT:
-    filter.extMask = envelope & ((1 << 29) - 1);
+    mask[1] = envelope;
     break;
   default:
     return canERR_PARAM;
   }
-  ret = ioctl(hData->fd, VCAN_IOC_SET_MSG_FILTER, &filter);
-  if (ret != 0) {
-    return errnoToCanStatus(errno);
-  }
 
-  return canOK;
+  return vCanSetMsgFilter(hData, code, mask);
 }
 
-
 //======================================================================
-// vCanWriteInternal
+// vCanSetAcceptanceFilter
 //======================================================================
-static canStatus vCanWriteInternal(HandleData *hData, long id, void *msgPtr,
-                                   unsigned int dlc, unsigned int flag)
+static canStatus vCanSetAcceptanceFilter(HandleData *hData,
+                                         unsigned int code,
+                                         unsigned int mask,
+                                         int is_extended)
 {
-  CAN_MSG msg;
+  unsigned int codes[2], masks[2];
 
-  int ret;
+  memcpy(codes, hData->acceptCode, sizeof(codes));
+  memcpy(masks, hData->acceptMask, sizeof(masks));
+  codes[is_extended != 0] = code;
+  masks[is_extended != 0] = mask;
+
+  return vCanSetMsgFilter(hData, codes, masks);
+}
+
+//======================================================================
+// Check the arguments of a write and build the message to send
+//======================================================================
+canStatus vCanEncodeMsg (HandleData *hData, long id, void *msgPtr,
+                         unsigned int dlc, unsigned int flag, CAN_MSG *msg)
+{
   unsigned char sendExtended;
   unsigned int nbytes;
   unsigned int dlcFD;
 
-  msg.flags = 0;
+  msg->flags = 0;
 
   if      (flag & canMSG_STD) sendExtended = 0;
   else if (flag & canMSG_EXT) sendExtended = 1;
@@ -1120,13 +1629,13 @@ static canStatus vCanWriteInternal(HandleData *hData, long id, void *msgPtr,
       DEBUGPRINT((TXT("canERR_PARAM on line %d\n"), __LINE__));  // Was 3,
       return canERR_PARAM;
     }
-    msg.id = (id | EXT_MSG);
+    msg->id = (id | EXT_MSG);
   } else {
     if (id >= (1 << 11)) {
       DEBUGPRINT((TXT("canERR_PARAM on line %d\n"), __LINE__));  // Was 3,
       return canERR_PARAM;
     }
-    msg.id = id;
+    msg->id = id;
   }
   
   if (!dlc_is_dlc_ok (hData->acceptLargeDlc, (flag & canFDMSG_FDF), dlc)) {
@@ -1135,7 +1644,7 @@ static canStatus vCanWriteInternal(HandleData *hData, long id, void *msgPtr,
   
   if (flag & canFDMSG_FDF) {
     if (hData->openMode) {
-      msg.flags |= VCAN_MSG_FLAG_FDF;
+      msg->flags |= VCAN_MSG_FLAG_FDF;
     } else {
       return canERR_PARAM;
     }
@@ -1144,7 +1653,7 @@ static canStatus vCanWriteInternal(HandleData *hData, long id, void *msgPtr,
       return canERR_PARAM;
     }
 
-    if (flag & canFDMSG_BRS)  msg.flags |= VCAN_MSG_FLAG_BRS;
+    if (flag & canFDMSG_BRS)  msg->flags |= VCAN_MSG_FLAG_BRS;
 
     dlcFD  = dlc_bytes_to_dlc_fd (dlc);
     nbytes = dlc_dlc_to_bytes_fd (dlcFD);
@@ -1154,7 +1663,7 @@ static canStatus vCanWriteInternal(HandleData *hData, long id, void *msgPtr,
       return canERR_PARAM;
     }
 
-    if (flag & canMSG_RTR) msg.flags |= VCAN_MSG_FLAG_REMOTE_FRAME;
+    if (flag & canMSG_RTR) msg->flags |= VCAN_MSG_FLAG_REMOTE_FRAME;
 
     nbytes = dlc > 8 ? 8   : dlc;
     dlcFD  = dlc > 15 ? 15 : dlc;
@@ -1170,19 +1679,42 @@ static canStatus vCanWriteInternal(HandleData *hData, long id, void *msgPtr,
       return canERR_NOT_SUPPORTED;
     }
     else {
-      msg.flags |= VCAN_MSG_FLAG_SINGLE_SHOT;
+      msg->flags |= VCAN_MSG_FLAG_SINGLE_SHOT;
     }
   }
 
-  msg.length = dlcFD;
+  msg->length = dlcFD;
 
-  if (flag & canMSG_ERROR_FRAME) msg.flags |= VCAN_MSG_FLAG_ERROR_FRAME;
+  if (flag & canMSG_ERROR_FRAME) msg->flags |= VCAN_MSG_FLAG_ERROR_FRAME;
 
   if (msgPtr) {
-    memcpy(msg.data, msgPtr, nbytes);
+    memcpy(msg->data, msgPtr, nbytes);
+  }
+
+  return canOK;
+}
+
+
+//======================================================================
+// vCanWriteInternal
+//======================================================================
+static canStatus vCanWriteInternal(HandleData *hData, long id, void *msgPtr,
+                                   unsigned int dlc, unsigned int flag)
+{
+  CAN_MSG msg;
+
+  int ret;
+  canStatus stat;
+  int64_t start;
+
+  stat = vCanEncodeMsg(hData, id, msgPtr, dlc, flag, &msg);
+  if (stat != canOK) {
+    return stat;
   }
 
-  ret = ioctl(hData->fd, VCAN_IOC_SENDMSG, &msg);
+  CANLIB_PROBE4(write_entry, hData->handle, id, dlc, flag);
+  start = TRACE_START(write_return);
+  ret = vCanIoctl(hData->fd, VCAN_IOC_SENDMSG, &msg);
 
 #if DEBUG
   if (ret == 0) {
@@ -1198,9 +1730,18 @@ static canStatus vCanWriteInternal(HandleData *hData, long id, void *msgPtr,
   }
 #endif
 
-  if      (ret   == 0)       return canOK;
-  else if (errno == EAGAIN)  return canERR_TXBUFOFL;
-  else                       return errnoToCanStatus(errno);
+  if (ret == 0) {
+    stat = canOK;
+  } else if (errno == EAGAIN) {
+    CANLIB_PROBE3(tx_overflow, hData->handle, id, dlc);
+    flightRecEvent(FLIGHTREC_TX_OVERFLOW, 0, hData->handle, (uint32_t)id, 0);
+    stat = canERR_TXBUFOFL;
+  } else {
+    stat = errnoToCanStatus(errno);
+  }
+  CANLIB_PROBE4(write_return, hData->handle, stat, id, traceSinceNs(start));
+
+  return stat;
 }
 
 
@@ -1220,7 +1761,7 @@ static canStatus vCanWrite (HandleData *hData, long id, void *msgPtr,
 static canStatus vCanWriteSync (HandleData *hData, unsigned long timeout)
 {
   int ret;
-  ret = ioctl(hData->fd, VCAN_IOC_WAIT_EMPTY, &timeout);
+  ret = vCanIoctl(hData->fd, VCAN_IOC_WAIT_EMPTY, &timeout);
 
   if      (ret   == 0)       return canOK;
   else if (errno == EAGAIN)  return canERR_TIMEOUT;
@@ -1256,10 +1797,25 @@ static canStatus vKvReadTimer64 (HandleData *hData, uint64_t *time)
     return canERR_PARAM;
   }
 
-  if (ioctl(hData->fd, VCAN_IOC_READ_TIMER, &tmpTime)) {
+  if (vCanIoctl(hData->fd, VCAN_IOC_READ_TIMER, &tmpTime)) {
+    return errnoToCanStatus(errno);
+  }
+  *time = vCanTimestamp(hData, tmpTime);
+
+  return canOK;
+}
+
+//======================================================================
+// vKvReadTimerRaw
+//======================================================================
+static canStatus vKvReadTimerRaw (HandleData *hData, uint64_t *time)
+{
+  uint64_t tmpTime;
+
+  if (vCanIoctl(hData->fd, VCAN_IOC_READ_TIMER, &tmpTime)) {
     return errnoToCanStatus(errno);
   }
-  *time = (tmpTime * 10UL) / (hData->timerResolution) ;
+  *time = tmpTime * 10;
 
   return canOK;
 }
@@ -1314,17 +1870,17 @@ static canStatus vCanReadErrorCounters (HandleData *hData, unsigned int *txErr,
   VCanOverrun overrun;
 
   if (txErr != NULL) {
-    if (ioctl(hData->fd, VCAN_IOC_GET_TX_ERR, txErr)) {
+    if (vCanIoctl(hData->fd, VCAN_IOC_GET_TX_ERR, txErr)) {
       goto ioc_error;
     }
   }
   if (rxErr != NULL) {
-    if (ioctl(hData->fd, VCAN_IOC_GET_RX_ERR, rxErr)) {
+    if (vCanIoctl(hData->fd, VCAN_IOC_GET_RX_ERR, rxErr)) {
       goto ioc_error;
     }
   }
   if (ovErr != NULL) {
-    if (ioctl(hData->fd, VCAN_IOC_GET_OVER_ERR, &overrun)) {
+    if (vCanIoctl(hData->fd, VCAN_IOC_GET_OVER_ERR, &overrun)) {
       goto ioc_error;
     }
     if (overrun.hw || overrun.sw) {
@@ -1355,7 +1911,7 @@ static canStatus vCanReadStatus (HandleData *hData, unsigned long *flags)
 
   *flags = 0;
   
-  if (ioctl(hData->fd, VCAN_IOC_GET_CHIP_STATE, &chip_status)) {
+  if (vCanIoctl(hData->fd, VCAN_IOC_GET_CHIP_STATE, &chip_status)) {
     goto ioctl_error;
   }
 
@@ -1377,7 +1933,7 @@ static canStatus vCanReadStatus (HandleData *hData, unsigned long *flags)
     *flags |= canSTAT_RXERR;
   }
 
-  if (ioctl(hData->fd, VCAN_IOC_GET_OVER_ERR, &overrun)) {
+  if (vCanIoctl(hData->fd, VCAN_IOC_GET_OVER_ERR, &overrun)) {
     goto ioctl_error;
   }
 
@@ -1389,14 +1945,14 @@ static canStatus vCanReadStatus (HandleData *hData, unsigned long *flags)
     *flags |= canSTAT_HW_OVERRUN;
   }
 
-  if (ioctl(hData->fd, VCAN_IOC_GET_RX_QUEUE_LEVEL, &reply)) {
+  if (vCanIoctl(hData->fd, VCAN_IOC_GET_RX_QUEUE_LEVEL, &reply)) {
     goto ioctl_error;
   }
   if (reply) {
     *flags |= canSTAT_RX_PENDING;
   }
 
-  if (ioctl(hData->fd, VCAN_IOC_GET_TX_QUEUE_LEVEL, &reply)) {
+  if (vCanIoctl(hData->fd, VCAN_IOC_GET_TX_QUEUE_LEVEL, &reply)) {
     goto ioctl_error;
   }
   if (reply) {
@@ -1419,7 +1975,7 @@ static canStatus vKvFlashLeds (HandleData *hData, int action, int timeout)
   buffer.sub_command = action;
   buffer.timeout = timeout;
 
-  if (ioctl(hData->fd, VCAN_IOC_FLASH_LEDS, &buffer)) {
+  if (vCanIoctl(hData->fd, VCAN_IOC_FLASH_LEDS, &buffer)) {
     return errnoToCanStatus(errno);
   }
   return canOK;
@@ -1453,53 +2009,53 @@ static canStatus vCanGetChannelData (char *deviceName, int item,
 
   switch (item) {
   case canCHANNELDATA_CARD_NUMBER:
-    err = ioctl(fd, VCAN_IOC_GET_CARD_NUMBER, buffer);
+    err = vCanIoctl(fd, VCAN_IOC_GET_CARD_NUMBER, buffer);
     break;
 
   case canCHANNELDATA_TRANS_TYPE:
-    err = ioctl(fd, VCAN_IOC_GET_TRANSCEIVER_INFO, buffer);
+    err = vCanIoctl(fd, VCAN_IOC_GET_TRANSCEIVER_INFO, buffer);
     break;
 
   case canCHANNELDATA_CARD_SERIAL_NO:
-    err = ioctl(fd, VCAN_IOC_GET_SERIAL, buffer);
+    err = vCanIoctl(fd, VCAN_IOC_GET_SERIAL, buffer);
     break;
 
   case canCHANNELDATA_CARD_UPC_NO:
-    err = ioctl(fd, VCAN_IOC_GET_EAN, buffer);
+    err = vCanIoctl(fd, VCAN_IOC_GET_EAN, buffer);
     break;
 
   case canCHANNELDATA_DRIVER_NAME:
-    err = ioctl(fd, VCAN_IOC_GET_DRIVER_NAME, buffer);
+    err = vCanIoctl(fd, VCAN_IOC_GET_DRIVER_NAME, buffer);
     break;
 
   case canCHANNELDATA_CARD_FIRMWARE_REV:
-    err = ioctl(fd, VCAN_IOC_GET_FIRMWARE_REV, buffer);
+    err = vCanIoctl(fd, VCAN_IOC_GET_FIRMWARE_REV, buffer);
     break;
 
   case canCHANNELDATA_CARD_HARDWARE_REV:
-    err = ioctl(fd, VCAN_IOC_GET_HARDWARE_REV, buffer);
+    err = vCanIoctl(fd, VCAN_IOC_GET_HARDWARE_REV, buffer);
     break;
 
   case canCHANNELDATA_CHANNEL_CAP:
-    err = ioctl(fd, VCAN_IOC_GET_CHAN_CAP, buffer);
+    err = vCanIoctl(fd, VCAN_IOC_GET_CHAN_CAP, buffer);
     if (!err) {
       *(uint32_t *)buffer = get_capabilities (*(uint32_t *)buffer);
     }
     break;
 
   case canCHANNELDATA_CHANNEL_CAP_MASK:
-    err = ioctl(fd, VCAN_IOC_GET_CHAN_CAP_MASK, buffer);
+    err = vCanIoctl(fd, VCAN_IOC_GET_CHAN_CAP_MASK, buffer);
     if (!err) {
       *(uint32_t *)buffer = get_capabilities (*(uint32_t *)buffer);
     }
     break;
 
   case canCHANNELDATA_CARD_TYPE:
-    err = ioctl(fd, VCAN_IOC_GET_CARD_TYPE, buffer);
+    err = vCanIoctl(fd, VCAN_IOC_GET_CARD_TYPE, buffer);
     break;
 
   case canCHANNELDATA_MAX_BITRATE:
-    err = ioctl(fd, VCAN_IOC_GET_MAX_BITRATE, buffer);
+    err = vCanIoctl(fd, VCAN_IOC_GET_MAX_BITRATE, buffer);
     break;
 
   case canCHANNELDATA_CUST_CHANNEL_NAME:
@@ -1524,7 +2080,7 @@ static canStatus vCanGetChannelData (char *deviceName, int item,
       }
 
       memset(&custChannelName, 0, sizeof(custChannelName));
-      err = ioctl(fd, KCAN_IOCTL_GET_CUST_CHANNEL_NAME, &custChannelName);
+      err = vCanIoctl(fd, KCAN_IOCTL_GET_CUST_CHANNEL_NAME, &custChannelName);
       if (!err) {
         memcpy(buffer, custChannelName.data, maxCopySize);
       }
@@ -1577,7 +2133,7 @@ static canStatus vCanGetChannelData (char *deviceName, int item,
           return canERR_PARAM;
       }
       
-      err = ioctl(fd, KCAN_IOCTL_GET_CARD_INFO_MISC, &miscInfo);
+      err = vCanIoctl(fd, KCAN_IOCTL_GET_CARD_INFO_MISC, &miscInfo);
       if (!err) {
         if (miscInfo.retcode == KCAN_IOCTL_MISC_INFO_RETCODE_SUCCESS){
           switch (item) {
@@ -1646,7 +2202,7 @@ static canStatus vCanIoCtl(HandleData *hData, unsigned int func,
       return canERR_PARAM;
     }
 
-    if (ioctl(hData->fd, VCAN_IOC_GET_RX_QUEUE_LEVEL, buf)) {
+    if (vCanIoctl(hData->fd, VCAN_IOC_GET_RX_QUEUE_LEVEL, buf)) {
       return errnoToCanStatus(errno);
     }
     break;
@@ -1656,19 +2212,19 @@ static canStatus vCanIoCtl(HandleData *hData, unsigned int func,
       return canERR_PARAM;
     }
 
-    if (ioctl(hData->fd, VCAN_IOC_GET_TX_QUEUE_LEVEL, buf)) {
+    if (vCanIoctl(hData->fd, VCAN_IOC_GET_TX_QUEUE_LEVEL, buf)) {
       return errnoToCanStatus(errno);
     }
     break;
   case canIOCTL_FLUSH_RX_BUFFER:
     // Discard the current contents of the RX queue.
-    if (ioctl(hData->fd, VCAN_IOC_FLUSH_RCVBUFFER, buf)) {
+    if (vCanIoctl(hData->fd, VCAN_IOC_FLUSH_RCVBUFFER, buf)) {
       return errnoToCanStatus(errno);
     }
     break;
   case canIOCTL_FLUSH_TX_BUFFER:
     //  Discard the current contents of the TX queue.
-    if (ioctl(hData->fd, VCAN_IOC_FLUSH_SENDBUFFER, buf)) {
+    if (vCanIoctl(hData->fd, VCAN_IOC_FLUSH_SENDBUFFER, buf)) {
       return errnoToCanStatus(errno);
     }
     break;
@@ -1678,7 +2234,7 @@ static canStatus vCanIoCtl(HandleData *hData, unsigned int func,
       return canERR_PARAM;
     }
 
-    if (ioctl(hData->fd, VCAN_IOC_SET_TXACK, buf)) {
+    if (vCanIoctl(hData->fd, VCAN_IOC_SET_TXACK, buf)) {
       return errnoToCanStatus(errno);
     }
     break;
@@ -1688,7 +2244,7 @@ static canStatus vCanIoCtl(HandleData *hData, unsigned int func,
       return canERR_PARAM;
     }
 
-    if (ioctl(hData->fd, VCAN_IOC_GET_TXACK, buf)) {
+    if (vCanIoctl(hData->fd, VCAN_IOC_GET_TXACK, buf)) {
       return errnoToCanStatus(errno);
     }
     break;
@@ -1698,7 +2254,7 @@ static canStatus vCanIoCtl(HandleData *hData, unsigned int func,
       return canERR_PARAM;
     }
 
-    if (ioctl(hData->fd, VCAN_IOC_SET_TXRQ, buf)) {
+    if (vCanIoctl(hData->fd, VCAN_IOC_SET_TXRQ, buf)) {
       return errnoToCanStatus(errno);
     }
     break;
@@ -1708,13 +2264,13 @@ static canStatus vCanIoCtl(HandleData *hData, unsigned int func,
       return canERR_PARAM;
     }
 
-    if (ioctl(hData->fd, VCAN_IOC_SET_TXECHO, buf)) {
+    if (vCanIoctl(hData->fd, VCAN_IOC_SET_TXECHO, buf)) {
       return errnoToCanStatus(errno);
     }
     break;
 
   case canIOCTL_RESET_OVERRUN_COUNT:
-    if (ioctl(hData->fd, VCAN_IOC_RESET_OVERRUN_COUNT, NULL)) {
+    if (vCanIoctl(hData->fd, VCAN_IOC_RESET_OVERRUN_COUNT, NULL)) {
       return errnoToCanStatus(errno);
     }
     break;
@@ -1755,7 +2311,7 @@ static canStatus vCanIoCtl(HandleData *hData, unsigned int func,
         return canERR_PARAM;
       }
 
-      if (ioctl(hData->fd, KCAN_IOCTL_TX_INTERVAL, buf)) {
+      if (vCanIoctl(hData->fd, KCAN_IOCTL_TX_INTERVAL, buf)) {
         return errnoToCanStatus(errno);
       }
       break;
@@ -1765,7 +2321,7 @@ static canStatus vCanIoCtl(HandleData *hData, unsigned int func,
         return canERR_PARAM;
       }
 
-      if (ioctl(hData->fd, KCAN_IOCTL_SET_BRLIMIT, buf)) {
+      if (vCanIoctl(hData->fd, KCAN_IOCTL_SET_BRLIMIT, buf)) {
         return errnoToCanStatus(errno);
       }
 
@@ -1782,7 +2338,11 @@ static canStatus kCanObjbufFreeAll (HandleData *hData)
 {
   int ret;
 
-  ret = ioctl(hData->fd, KCAN_IOCTL_OBJBUF_FREE_ALL, NULL);
+  if (hData->swObjBufs) {
+    return swObjBufFreeAll(hData);
+  }
+
+  ret = vCanIoctl(hData->fd, KCAN_IOCTL_OBJBUF_FREE_ALL, NULL);
   if (ret != 0) {
     return errnoToCanStatus(errno);
   }
@@ -1795,10 +2355,18 @@ static canStatus kCanObjbufAllocate (HandleData *hData, int type, int *number)
   int ret;
   KCanObjbufAdminData ioc;
 
+  if (hData->swObjBufs) {
+    return swObjBufAllocate(hData, type, number);
+  }
+
   ioc.type = type;
 
-  ret = ioctl(hData->fd, KCAN_IOCTL_OBJBUF_ALLOCATE, &ioc);
+  ret = vCanIoctl(hData->fd, KCAN_IOCTL_OBJBUF_ALLOCATE, &ioc);
   if (ret != 0) {
+    // Fall back to buffers in the library if the device has none
+    if (swObjBufNoHardware(errno)) {
+      return swObjBufAllocate(hData, type, number);
+    }
     return errnoToCanStatus(errno);
   }
 
@@ -1813,9 +2381,13 @@ static canStatus kCanObjbufFree (HandleData *hData, int idx)
   int ret;
   KCanObjbufAdminData ioc;
 
+  if (idx >= SWOBJBUF_FIRST) {
+    return swObjBufFree(hData, idx);
+  }
+
   ioc.buffer_number = idx;
 
-  ret = ioctl(hData->fd, KCAN_IOCTL_OBJBUF_FREE, &ioc);
+  ret = vCanIoctl(hData->fd, KCAN_IOCTL_OBJBUF_FREE, &ioc);
   if (ret != 0) {
     return errnoToCanStatus(errno);
   }
@@ -1824,38 +2396,57 @@ static canStatus kCanObjbufFree (HandleData *hData, int idx)
 }
 
 
-static canStatus kCanObjbufWrite (HandleData *hData, int idx, int id, void* msg,
-                                  unsigned int dlc, unsigned int flags)
+//======================================================================
+// Check the dlc and flags of an object buffer frame against the channel
+//======================================================================
+canStatus vCanObjbufCheck (HandleData *hData, unsigned int dlc,
+                           unsigned int flags)
 {
-  int                  retval;
-  KCanObjbufBufferData ioc;
-
-  ioc.flags = 0;
-
   if (!dlc_is_dlc_ok (hData->acceptLargeDlc, (flags & canFDMSG_FDF), dlc)) {
     return canERR_PARAM;
   }
-  
+
   if (flags & canFDMSG_FDF) {
     if (!hData->openMode) {
       return canERR_PARAM;
     }
-    
+
     if (flags & canMSG_RTR) {
       return canERR_PARAM;
     }
+  } else if (flags & canFDMSG_BRS) {
+    return canERR_PARAM;
+  }
+
+  if ((flags & canMSG_SINGLE_SHOT) &&
+      !(hData->capabilities & VCAN_CHANNEL_CAP_SINGLE_SHOT)) {
+    return canERR_NOT_SUPPORTED;
+  }
+
+  return canOK;
+}
+
+static canStatus kCanObjbufWrite (HandleData *hData, int idx, int id, void* msg,
+                                  unsigned int dlc, unsigned int flags)
+{
+  int                  retval;
+  KCanObjbufBufferData ioc;
+  canStatus            stat;
+
+  ioc.flags = 0;
+
+  stat = vCanObjbufCheck(hData, dlc, flags);
+  if (stat != canOK) {
+    return stat;
+  }
 
+  if (flags & canFDMSG_FDF) {
     if (flags & canFDMSG_BRS) {
       ioc.flags |= VCAN_AUTOTX_MSG_FLAG_BRS;
     }
 
     ioc.flags |= VCAN_AUTOTX_MSG_FLAG_FDF;
   } else {
-    if (flags & canFDMSG_BRS)
-    {
-      return canERR_PARAM;
-    }
-    
     if (flags & canMSG_RTR) {
       ioc.flags |= VCAN_AUTOTX_MSG_FLAG_REMOTE_FRAME;
     }
@@ -1866,11 +2457,11 @@ static canStatus kCanObjbufWrite (HandleData *hData, int idx, int id, void* msg,
   }
 
   if (flags & canMSG_SINGLE_SHOT) {
-    if (! (hData->capabilities & VCAN_CHANNEL_CAP_SINGLE_SHOT)) {
-      return canERR_NOT_SUPPORTED;
-    } else {
-      ioc.flags |= VCAN_MSG_FLAG_SINGLE_SHOT;
-    }
+    ioc.flags |= VCAN_MSG_FLAG_SINGLE_SHOT;
+  }
+
+  if (idx >= SWOBJBUF_FIRST) {
+    return swObjBufWrite(hData, idx, id, msg, dlc, flags);
   }
 
   ioc.buffer_number = idx;
@@ -1887,7 +2478,7 @@ static canStatus kCanObjbufWrite (HandleData *hData, int idx, int id, void* msg,
     memcpy(ioc.data, msg, sizeof(ioc.data));
   }
 
-  retval = ioctl(hData->fd, KCAN_IOCTL_OBJBUF_WRITE, &ioc);
+  retval = vCanIoctl(hData->fd, KCAN_IOCTL_OBJBUF_WRITE, &ioc);
 
   if (retval != 0) {
     return errnoToCanStatus(errno);
@@ -1903,11 +2494,15 @@ static canStatus kCanObjbufSetFilter (HandleData *hData, int idx,
   int ret;
   KCanObjbufAdminData ioc;
 
+  if (idx >= SWOBJBUF_FIRST) {
+    return swObjBufSetFilter(hData, idx, code, mask);
+  }
+
   ioc.buffer_number = idx;
   ioc.acc_code      = code;
   ioc.acc_mask      = mask;
 
-  ret = ioctl(hData->fd, KCAN_IOCTL_OBJBUF_SET_FILTER, &ioc);
+  ret = vCanIoctl(hData->fd, KCAN_IOCTL_OBJBUF_SET_FILTER, &ioc);
   if (ret != 0) {
     return errnoToCanStatus(errno);
   }
@@ -1921,10 +2516,14 @@ static canStatus kCanObjbufSetFlags (HandleData *hData, int idx, unsigned int fl
   int ret;
   KCanObjbufAdminData ioc;
 
+  if (idx >= SWOBJBUF_FIRST) {
+    return swObjBufSetFlags(hData, idx, flags);
+  }
+
   ioc.buffer_number = idx;
   ioc.flags         = flags;
 
-  ret = ioctl(hData->fd, KCAN_IOCTL_OBJBUF_SET_FLAGS, &ioc);
+  ret = vCanIoctl(hData->fd, KCAN_IOCTL_OBJBUF_SET_FLAGS, &ioc);
   if (ret != 0) {
     return errnoToCanStatus(errno);
   }
@@ -1938,10 +2537,14 @@ static canStatus kCanObjbufSetPeriod (HandleData *hData, int idx, unsigned int p
   int ret;
   KCanObjbufAdminData ioc;
 
+  if (idx >= SWOBJBUF_FIRST) {
+    return swObjBufSetPeriod(hData, idx, period);
+  }
+
   ioc.buffer_number = idx;
   ioc.period        = period;
 
-  ret = ioctl(hData->fd, KCAN_IOCTL_OBJBUF_SET_PERIOD, &ioc);
+  ret = vCanIoctl(hData->fd, KCAN_IOCTL_OBJBUF_SET_PERIOD, &ioc);
   if (ret != 0) {
     return errnoToCanStatus(errno);
   }
@@ -1955,10 +2558,14 @@ static canStatus kCanObjbufSetMsgCount (HandleData *hData, int idx, unsigned int
   int ret;
   KCanObjbufAdminData ioc;
 
+  if (idx >= SWOBJBUF_FIRST) {
+    return swObjBufSetMsgCount(hData, idx, count);
+  }
+
   ioc.buffer_number = idx;
   ioc.period        = count;
 
-  ret = ioctl(hData->fd, KCAN_IOCTL_OBJBUF_SET_MSG_COUNT, &ioc);
+  ret = vCanIoctl(hData->fd, KCAN_IOCTL_OBJBUF_SET_MSG_COUNT, &ioc);
   if (ret != 0) {
     return errnoToCanStatus(errno);
   }
@@ -1972,10 +2579,14 @@ static canStatus kCanObjbufSendBurst (HandleData *hData, int idx, unsigned int b
   int ret;
   KCanObjbufAdminData ioc;
 
+  if (idx >= SWOBJBUF_FIRST) {
+    return swObjBufSendBurst(hData, idx, burstLen);
+  }
+
   ioc.buffer_number = idx;
   ioc.period        = burstLen;
 
-  ret = ioctl(hData->fd, KCAN_IOCTL_OBJBUF_SEND_BURST, &ioc);
+  ret = vCanIoctl(hData->fd, KCAN_IOCTL_OBJBUF_SEND_BURST, &ioc);
   if (ret != 0) {
     return errnoToCanStatus(errno);
   }
@@ -1989,9 +2600,13 @@ static canStatus kCanObjbufEnable (HandleData *hData, int idx)
   int ret;
   KCanObjbufAdminData ioc;
 
+  if (idx >= SWOBJBUF_FIRST) {
+    return swObjBufEnable(hData, idx);
+  }
+
   ioc.buffer_number = idx;
 
-  ret = ioctl(hData->fd, KCAN_IOCTL_OBJBUF_ENABLE, &ioc);
+  ret = vCanIoctl(hData->fd, KCAN_IOCTL_OBJBUF_ENABLE, &ioc);
   if (ret != 0) {
     return errnoToCanStatus(errno);
   }
@@ -2005,9 +2620,13 @@ static canStatus kCanObjbufDisable (HandleData *hData, int idx)
   int ret;
   KCanObjbufAdminData ioc;
 
+  if (idx >= SWOBJBUF_FIRST) {
+    return swObjBufDisable(hData, idx);
+  }
+
   ioc.buffer_number = idx;
 
-  ret = ioctl(hData->fd, KCAN_IOCTL_OBJBUF_DISABLE, &ioc);
+  ret = vCanIoctl(hData->fd, KCAN_IOCTL_OBJBUF_DISABLE, &ioc);
   if (ret != 0) {
     return errnoToCanStatus(errno);
   }
@@ -2048,7 +2667,7 @@ static int check_args (void*buf, uint32_t buf_len, uint32_t limit, uint32_t meth
 
 static canStatus vCanGetCardInfo (HandleData *hData, VCAN_IOCTL_CARD_INFO *ci)
 {
-  if (ioctl(hData->fd, VCAN_IOCTL_GET_CARD_INFO, ci))
+  if (vCanIoctl(hData->fd, VCAN_IOCTL_GET_CARD_INFO, ci))
     goto ioc_error;
 
   return canOK;
@@ -2059,7 +2678,7 @@ static canStatus vCanGetCardInfo (HandleData *hData, VCAN_IOCTL_CARD_INFO *ci)
 
 static canStatus vCanGetCardInfo2 (HandleData *hData, KCAN_IOCTL_CARD_INFO_2 *ci)
 {
-  if (ioctl(hData->fd, KCAN_IOCTL_GET_CARD_INFO_2, ci))
+  if (vCanIoctl(hData->fd, KCAN_IOCTL_GET_CARD_INFO_2, ci))
     goto ioc_error;
 
   return canOK;
@@ -2071,7 +2690,9 @@ static canStatus vCanGetCardInfo2 (HandleData *hData, KCAN_IOCTL_CARD_INFO_2 *ci
 CANOps vCanOps = {
   // VCan Functions
   .setNotify           = vCanSetNotify,
+  .setNotifyFrame      = vCanSetNotifyFrame,
   .openChannel         = vCanOpenChannel,
+  .closeChannel        = vCanCloseChannel,
   .busOn               = vCanBusOn,
   .busOff              = vCanBusOff,
   .setBusParams        = vCanSetBusParams,
@@ -2093,17 +2714,24 @@ CANOps vCanOps = {
   .kvFileDelete        = vCanFileDelete,
   .kvFileCopyToDevice  = vCanFileCopyToDevice,
   .kvFileCopyFromDevice  = vCanFileCopyFromDevice,
+  .kvFileReadStream    = vCanFileReadStream,
+  .kvFileWriteStream   = vCanFileWriteStream,
   .kvScriptStart       = vCanScriptStart,
   .kvScriptStop        = vCanScriptStop,
   .kvScriptLoadFile    = vCanScriptLoadFile,
+  .kvScriptLoadBuffer  = vCanScriptLoadBuffer,
   .kvScriptUnload      = vCanScriptUnload,
+  .envvarInfo          = vCanEnvvarInfo,
+  .envvarTransfer      = vCanEnvvarTransfer,
   .accept              = vCanAccept,
+  .setAcceptanceFilter = vCanSetAcceptanceFilter,
   .write               = vCanWrite,
   .writeWait           = vCanWriteWait,
   .writeSync           = vCanWriteSync,
   .readTimer           = vCanReadTimer,
   .kvReadTimer         = vKvReadTimer,
   .kvReadTimer64       = vKvReadTimer64,
+  .kvReadTimerRaw      = vKvReadTimerRaw,
   .readErrorCounters   = vCanReadErrorCounters,
   .readStatus          = vCanReadStatus,
   .kvFlashLeds         = vKvFlashLeds,
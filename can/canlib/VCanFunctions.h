@@ -60,3 +60,29 @@ HandleData * findHandle (CanHandle hnd);
 HandleData * removeHandle (CanHandle hnd);
 CanHandle insertHandle (HandleData *hData);
 void foreachHandle (int (*func)(const CanHandle));
+
+// Used by the other backends to behave the same way as the driver backend
+
+typedef canStatus (*vCanNotifySetupFn)(HandleData *hData,
+                                       void (*callback) (canNotifyData *),
+                                       kvCallback_t callback2,
+                                       kvFrameCallback_t frameCallback,
+                                       unsigned int notifyFlags);
+typedef int (*vCanNotifyFetchFn)(HandleData *hData, VCAN_EVENT *msg);
+
+canStatus vCanSetNotifyWith (HandleData *hData, vCanNotifySetupFn setup,
+                             void (*callback) (canNotifyData *),
+                             kvCallback_t callback2,
+                             kvFrameCallback_t frameCallback,
+                             unsigned int notifyFlags,
+                             unsigned int maxBatch);
+void vCanNotifyEvents (HandleData *hData, vCanNotifyFetchFn fetch);
+void vCanNotifyEnvvar (HandleData *hData, uint32_t id, uint64_t ticks);
+uint64_t vCanTimestamp (HandleData *hData, uint64_t ticks);
+int vCanReceivedMsg (HandleData *hData, VCAN_EVENT *msg,
+                     long *id, void *msgPtr, unsigned int *dlc,
+                     unsigned int *flag, unsigned long *time);
+canStatus vCanEncodeMsg (HandleData *hData, long id, void *msgPtr,
+                         unsigned int dlc, unsigned int flag, CAN_MSG *msg);
+canStatus vCanObjbufCheck (HandleData *hData, unsigned int dlc,
+                           unsigned int flags);
@@ -54,10 +54,18 @@
 
 #include <errno.h>
 #include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
 
 #include "VCanMemoFunctions.h"
 #include "VCanFuncUtil.h"
+#include "apistats.h"
+#include "trace.h"
 #include "hydra_host_cmds.h"
 #include "lio_error.h"
 #include "dio_error.h"
@@ -187,7 +195,7 @@ canStatus vCanMemo_file_delete(HandleData *hData, char *deviceFileName)
   info.subcommand = MEMO_SUBCMD_DELETE_FILE;
   info.buflen = CANIO_MAX_FILE_NAME + 2; // 'mode' and '\0';
   info.timeout = 30*1000; // 30s
-  ret = ioctl(hData->fd, KCANY_IOCTL_MEMO_PUT_DATA, &info, sizeof(info));
+  ret = vCanIoctl(hData->fd, KCANY_IOCTL_MEMO_PUT_DATA, &info);
   if (ret != 0) {
     DEBUGPRINT((TXT("vCanFileDelete: Communication error (%d)\n"), ret));
     return errnoToCanStatus(errno);
@@ -200,170 +208,753 @@ canStatus vCanMemo_file_delete(HandleData *hData, char *deviceFileName)
 }
 
 //======================================================================
-// vCanMemo_file_copy_to_device
+// Device file open and close
 //======================================================================
-canStatus vCanMemo_file_copy_to_device(HandleData *hData, char *hostFileName,
-                                      char *deviceFileName)
+static canStatus memoOpen(HandleData *hData, char *deviceFileName,
+                          unsigned char mode)
 {
-  FILE *hFile;
   KCANY_MEMO_INFO info;
-  int status = 0;
-  int ret = 0;
-
-  if (is_filename_invalid(deviceFileName)) {
-    return canERR_PARAM;
-  }
+  canStatus status;
+  int ret;
 
-  hFile = fopen(hostFileName, "rb");
-  if (!hFile) {
-    DEBUGPRINT((TXT("vCanFileCopyToDevice: Could not open the file '%s'\n"), hostFileName));
-    return canERR_HOST_FILE;
-  }
-
-  // Open the file and copy the blocks
   memset(&info, 0, sizeof(info));
-  info.buffer[0] = CANIO_DFS_WRITE;  // 'mode'
+  info.buffer[0] = mode;
   (void) strncpy((char*)&info.buffer[1], deviceFileName, CANIO_MAX_FILE_NAME);
   info.subcommand = MEMO_SUBCMD_OPEN_FILE;
   info.buflen = CANIO_MAX_FILE_NAME + 2;  // 'mode' and '\0';
   info.timeout = 30*1000;  // 30 seconds
-  ret = ioctl(hData->fd, KCANY_IOCTL_MEMO_PUT_DATA, &info, sizeof(info));
+  ret = vCanIoctl(hData->fd, KCANY_IOCTL_MEMO_PUT_DATA, &info);
   if (ret != 0) {
-    DEBUGPRINT((TXT("vCanFileCopyToDevice: (1) Communication error (%d)\n"), ret));
-    fclose(hFile);
+    DEBUGPRINT((TXT("memoOpen: Communication error (%d)\n"), ret));
     return errnoToCanStatus(errno);
   }
-
-  // Check the status
-  if ((status = memoResultToCanStatus(&info)) != canOK) {
-    DEBUGPRINT((TXT("vCanFileCopyToDevice: MEMO_SUBCMD_OPEN_FILE error (%d)\n"), (int)info.buffer[0]));
-    fclose(hFile);
+  status = memoResultToCanStatus(&info);
+  if (status != canOK) {
+    DEBUGPRINT((TXT("memoOpen: MEMO_SUBCMD_OPEN_FILE error (%d)\n"), (int)info.buffer[0]));
     return status;
   }
 
-  while (!status) {
-    size_t bytes;
+  return canOK;
+}
+
+static canStatus memoClose(HandleData *hData)
+{
+  KCANY_MEMO_INFO info;
+  int ret;
 
-    memset(&info, 0, sizeof(info));
-    bytes = fread(&info.buffer[4], 1, 512, hFile);
-    if (bytes == 0) {
-      // No more data to read
-      break;
-    }
-    memcpy(&info.buffer[0],&bytes,sizeof(bytes));
-    info.subcommand = MEMO_SUBCMD_WRITE_FILE;
-    info.buflen = (unsigned int) (bytes+sizeof(bytes));
-    info.timeout = 30*1000; // 2minutes
-    ret = ioctl(hData->fd, KCANY_IOCTL_MEMO_PUT_DATA, &info, sizeof(info));
-    if (ret != 0) {
-      DEBUGPRINT((TXT("vCanFileCopyToDevice: (2) Communication error (%d)\n"), ret));
-      status = errnoToCanStatus(errno);
-    } else {
-      status = memoResultToCanStatus(&info);
-    }
-  }
-  fclose(hFile);
-  if (status != canOK) {
-    return status;
-  }
   memset(&info, 0, sizeof(info));
   info.subcommand = MEMO_SUBCMD_CLOSE_FILE;
   info.timeout = 30*1000; // 30s
-  info.buflen = CANIO_MAX_FILE_NAME;
-  ret = ioctl(hData->fd, KCANY_IOCTL_MEMO_PUT_DATA, &info, sizeof(info));
+  info.buflen = CANIO_MAX_FILE_NAME + 2; // 'mode' and '\0';
+  ret = vCanIoctl(hData->fd, KCANY_IOCTL_MEMO_PUT_DATA, &info);
   if (ret != 0) {
-    DEBUGPRINT((TXT("vCanFileCopyToDevice: (3) Communication error (%d)\n"), ret));
-    status = errnoToCanStatus(errno);
-  } else {
-    status = memoResultToCanStatus(&info);
+    DEBUGPRINT((TXT("memoClose: Communication error (%d)\n"), ret));
+    return errnoToCanStatus(errno);
+  }
+
+  return memoResultToCanStatus(&info);
+}
+
+//======================================================================
+// Transfer pipe
+//
+// The device moves MEMO_BLOCK bytes per request. The blocks are gathered
+// in chunks, and a helper thread does the host side I/O of one chunk while
+// the caller moves the next one to or from the device.
+//======================================================================
+#define MEMO_BLOCK        512
+#define MEMO_CHUNK        (128 * MEMO_BLOCK)
+#define MEMO_PIPE_CHUNKS  4
+
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t  cond;
+  unsigned char   *buf;       // MEMO_PIPE_CHUNKS chunks of MEMO_CHUNK bytes
+  size_t          len[MEMO_PIPE_CHUNKS];
+  unsigned int    head;       // Chunks filled
+  unsigned int    tail;       // Chunks emptied
+  int             eof;        // No more chunks will be filled
+  canStatus       status;     // First error on either side
+  MemoSink        sink;
+  MemoSource      source;
+  void            *ctx;
+  HandleData      *hData;
+  int64_t         startNs;
+  kvFileProgress  progress;
+} MemoPipe;
+
+static int64_t nowNs (void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static canStatus pipeInit(MemoPipe *pipe, HandleData *hData, uint64_t total)
+{
+  memset(pipe, 0, sizeof(*pipe));
+  pipe->buf = malloc(MEMO_PIPE_CHUNKS * MEMO_CHUNK);
+  if (!pipe->buf) {
+    return canERR_NOMEM;
   }
+  pthread_mutex_init(&pipe->lock, NULL);
+  pthread_cond_init(&pipe->cond, NULL);
+  pipe->hData               = hData;
+  pipe->startNs             = nowNs();
+  pipe->progress.bytesTotal = total;
+  pthread_mutex_lock(&hData->fileTransferLock);
+  hData->fileTransfer       = pipe->progress;
+  pthread_mutex_unlock(&hData->fileTransferLock);
+
+  return canOK;
+}
+
+static void pipeDestroy(MemoPipe *pipe)
+{
+  pthread_cond_destroy(&pipe->cond);
+  pthread_mutex_destroy(&pipe->lock);
+  free(pipe->buf);
+}
+
+// Next chunk to fill, NULL if the other side failed
+static unsigned char *pipeEmptyChunk(MemoPipe *pipe)
+{
+  unsigned char *chunk = NULL;
+
+  pthread_mutex_lock(&pipe->lock);
+  while (pipe->head - pipe->tail == MEMO_PIPE_CHUNKS && pipe->status == canOK) {
+    pthread_cond_wait(&pipe->cond, &pipe->lock);
+  }
+  if (pipe->status == canOK) {
+    chunk = pipe->buf + (size_t)(pipe->head % MEMO_PIPE_CHUNKS) * MEMO_CHUNK;
+  }
+  pthread_mutex_unlock(&pipe->lock);
+
+  return chunk;
+}
+
+static void pipeFilled(MemoPipe *pipe, size_t len)
+{
+  pthread_mutex_lock(&pipe->lock);
+  pipe->len[pipe->head % MEMO_PIPE_CHUNKS] = len;
+  pipe->head++;
+  pthread_cond_broadcast(&pipe->cond);
+  pthread_mutex_unlock(&pipe->lock);
+}
+
+// Next chunk to empty, NULL at the end or if the other side failed
+static unsigned char *pipeFullChunk(MemoPipe *pipe, size_t *len)
+{
+  unsigned char *chunk = NULL;
+
+  pthread_mutex_lock(&pipe->lock);
+  while (pipe->head == pipe->tail && !pipe->eof && pipe->status == canOK) {
+    pthread_cond_wait(&pipe->cond, &pipe->lock);
+  }
+  if (pipe->status == canOK && pipe->head != pipe->tail) {
+    chunk = pipe->buf + (size_t)(pipe->tail % MEMO_PIPE_CHUNKS) * MEMO_CHUNK;
+    *len  = pipe->len[pipe->tail % MEMO_PIPE_CHUNKS];
+  }
+  pthread_mutex_unlock(&pipe->lock);
+
+  return chunk;
+}
+
+static void pipeEmptied(MemoPipe *pipe)
+{
+  pthread_mutex_lock(&pipe->lock);
+  pipe->tail++;
+  pthread_cond_broadcast(&pipe->cond);
+  pthread_mutex_unlock(&pipe->lock);
+}
+
+// Ends the filling side, with an error that stops the other side too
+static void pipeFinish(MemoPipe *pipe, canStatus status)
+{
+  pthread_mutex_lock(&pipe->lock);
+  pipe->eof = 1;
+  if (pipe->status == canOK) {
+    pipe->status = status;
+  }
+  pthread_cond_broadcast(&pipe->cond);
+  pthread_mutex_unlock(&pipe->lock);
+}
+
+static canStatus pipeStatus(MemoPipe *pipe)
+{
+  canStatus status;
+
+  pthread_mutex_lock(&pipe->lock);
+  status = pipe->status;
+  pthread_mutex_unlock(&pipe->lock);
+
   return status;
 }
 
+// Adds bytes moved to or from the device and tells the application,
+// which can cancel the transfer
+static canStatus pipeProgress(MemoPipe *pipe, size_t bytes)
+{
+  HandleData     *hData = pipe->hData;
+  kvFileProgress *p = &pipe->progress;
+
+  p->bytesDone  += bytes;
+  p->elapsedS    = (nowNs() - pipe->startNs) / 1e9;
+  p->bytesPerSec = p->elapsedS > 0 ? p->bytesDone / p->elapsedS : 0;
+  pthread_mutex_lock(&hData->fileTransferLock);
+  hData->fileTransfer = *p;
+  pthread_mutex_unlock(&hData->fileTransferLock);
+
+  if (hData->fileProgress &&
+      hData->fileProgress(hData->handle, p, hData->fileProgressContext)) {
+    return canERR_INTERRUPTED;
+  }
+
+  return canOK;
+}
+
+static void *memoSinkThread(void *arg)
+{
+  MemoPipe      *pipe = (MemoPipe *)arg;
+  unsigned char *chunk;
+  size_t        len;
+  canStatus     status;
+
+  while ((chunk = pipeFullChunk(pipe, &len)) != NULL) {
+    status = pipe->sink(pipe->ctx, chunk, len);
+    if (status != canOK) {
+      pipeFinish(pipe, status);
+      break;
+    }
+    pipeEmptied(pipe);
+  }
+
+  return NULL;
+}
+
+static void *memoSourceThread(void *arg)
+{
+  MemoPipe      *pipe = (MemoPipe *)arg;
+  unsigned char *chunk;
+  size_t        len, n;
+  canStatus     status = canOK;
+
+  while ((chunk = pipeEmptyChunk(pipe)) != NULL) {
+    len = 0;
+    do {
+      status = pipe->source(pipe->ctx, chunk + len, MEMO_CHUNK - len, &n);
+      len += n;
+    } while (status == canOK && n > 0 && len < MEMO_CHUNK);
+    if (status != canOK) {
+      break;
+    }
+    if (len > 0) {
+      pipeFilled(pipe, len);
+    }
+    if (len < MEMO_CHUNK) {
+      break;
+    }
+  }
+  pipeFinish(pipe, status);
+
+  return NULL;
+}
+
 //======================================================================
-// vCanMemo_file_copy_from_device
+// vCanMemo_file_read, from the device to a sink
 //======================================================================
-canStatus vCanMemo_file_copy_from_device(HandleData *hData,
-                                         char *deviceFileName,
-                                         char *hostFileName)
+canStatus vCanMemo_file_read(HandleData *hData, char *deviceFileName,
+                             MemoSink sink, void *ctx)
 {
-  FILE *hFile;
   KCANY_MEMO_INFO info;
-  int status = 0;
+  MemoPipe pipe;
+  pthread_t thread;
+  unsigned char *chunk;
+  size_t len;
+  canStatus status;
+  canStatus closeStatus;
   int ret = 0;
+  int done = 0;
   uint32_t bytes = 0;  // Size is specified by FW (src/common/he/hscle/logger_glue.c)
 
   if (is_filename_invalid(deviceFileName)) {
     return canERR_PARAM;
   }
 
-  memset(&info, 0, sizeof(info));
-  info.buffer[0] = CANIO_DFS_READ;
-  (void) strncpy((char*)&info.buffer[1], deviceFileName, CANIO_MAX_FILE_NAME);
-  info.subcommand = MEMO_SUBCMD_OPEN_FILE;
-  info.buflen = CANIO_MAX_FILE_NAME + 2; // 'mode' and '\0';
-  info.timeout = 30*1000; // 30s
-  ret = ioctl(hData->fd, KCANY_IOCTL_MEMO_PUT_DATA, &info, sizeof(info));
-  if (ret != 0) {
-    DEBUGPRINT((TXT("vCanFileCopyFromDevice: Communication error (%d)\n"), ret));
-    return errnoToCanStatus(errno);
-  }
-  status = memoResultToCanStatus(&info);
+  status = memoOpen(hData, deviceFileName, CANIO_DFS_READ);
   if (status != canOK) {
-    DEBUGPRINT((TXT("vCanFileCopyFromDevice: MEMO_SUBCMD_OPEN_FILE error (%d)\n"), (int)info.buffer[0]));
     return status;
-  } else {
-    memcpy(&bytes, &(info.buffer[2]), sizeof(bytes));
   }
 
-  hFile = fopen(hostFileName, "wb");
-  if (!hFile) {
-    DEBUGPRINT((TXT("vCanFileCopyFromDevice: Could not create the file '%s'\n"), hostFileName));
-    if(!status) {
-      status = canERR_HOST_FILE;
-    }
+  // The device does not tell the size up front
+  status = pipeInit(&pipe, hData, 0);
+  if (status != canOK) {
+    memoClose(hData);
+    return status;
+  }
+  pipe.sink = sink;
+  pipe.ctx  = ctx;
+  if (vCanCreateThread(&thread, memoSinkThread, &pipe) != 0) {
+    pipeDestroy(&pipe);
+    memoClose(hData);
+    return canERR_NOMEM;
   }
 
-  // Copy data from memorator to file
-  while (!status && (bytes > 0)) {
-    memset(&info, 0, sizeof(info));
-    info.subcommand = MEMO_SUBCMD_READ_FILE;
-    info.buflen = 1000; // Only using 512 + bytesRead
-    info.timeout = 30*1000; // 60s
-    ret = ioctl(hData->fd, KCANY_IOCTL_MEMO_GET_DATA, &info, sizeof(info));
-    if (ret != 0) {
-      DEBUGPRINT((TXT("vCanFileCopyFromDevice: (2) Communication error (%d)\n"), ret));
-      status = errnoToCanStatus(errno);
+  // Copy data from memorator; only the header of info is set per block
+  memset(&info, 0, sizeof(info));
+  while (status == canOK && !done) {
+    chunk = pipeEmptyChunk(&pipe);
+    if (!chunk) {
       break;
-    } else {
+    }
+    len = 0;
+    while (len + MEMO_BLOCK <= MEMO_CHUNK) {
+      info.subcommand = MEMO_SUBCMD_READ_FILE;
+      info.buflen = 1000; // Only using 512 + bytesRead
+      info.timeout = 30*1000; // 30s
+      info.status = info.dio_status = info.lio_status = 0;
+      ret = vCanIoctl(hData->fd, KCANY_IOCTL_MEMO_GET_DATA, &info);
+      if (ret != 0) {
+        DEBUGPRINT((TXT("vCanMemo_file_read: Communication error (%d)\n"), ret));
+        status = errnoToCanStatus(errno);
+        break;
+      }
       memcpy(&bytes, &(info.buffer[0]), sizeof(bytes));
       status = memoResultToCanStatus(&info);
-      if (status != canOK) {
+      CANLIB_PROBE4(memo_block, hData->handle, MEMO_SUBCMD_READ_FILE, bytes, status);
+      if (status != canOK || bytes == 0) {
+        done = 1;
         break;
       }
-      ret = (int)fwrite(&info.buffer[4], bytes, 1, hFile);
-      if (ret < 0) {
-        DEBUGPRINT((TXT("vCanFileCopyFromDevice: Write file error\n")));
-        status = canERR_HOST_FILE;
+      if (bytes > MEMO_BLOCK) {
+        status = canERR_MEMO_FAIL;
         break;
       }
+      memcpy(chunk + len, &info.buffer[4], bytes);
+      len += bytes;
+    }
+    if (len > 0) {
+      pipeFilled(&pipe, len);
+    }
+    if (status == canOK) {
+      status = pipeProgress(&pipe, len);
     }
   }
-  if (hFile) {
-    fclose(hFile);
+  pipeFinish(&pipe, status);
+  pthread_join(thread, NULL);
+  if (status == canOK) {
+    status = pipeStatus(&pipe);
   }
+  pipeDestroy(&pipe);
 
+  closeStatus = memoClose(hData);
+  if (status == canOK) {
+    status = closeStatus;
+  }
+  return status;
+}
+
+//======================================================================
+// vCanMemo_file_write, from a source to the device
+//======================================================================
+canStatus vCanMemo_file_write(HandleData *hData, char *deviceFileName,
+                              MemoSource source, void *ctx, uint64_t total)
+{
+  KCANY_MEMO_INFO info;
+  MemoPipe pipe;
+  pthread_t thread;
+  unsigned char *chunk;
+  size_t len, off;
+  uint32_t bytes;
+  canStatus status, closeStatus;
+  int ret = 0;
+
+  if (is_filename_invalid(deviceFileName)) {
+    return canERR_PARAM;
+  }
+
+  status = memoOpen(hData, deviceFileName, CANIO_DFS_WRITE);
+  if (status != canOK) {
+    return status;
+  }
+
+  status = pipeInit(&pipe, hData, total);
+  if (status != canOK) {
+    memoClose(hData);
+    return status;
+  }
+  pipe.source = source;
+  pipe.ctx    = ctx;
+  if (vCanCreateThread(&thread, memoSourceThread, &pipe) != 0) {
+    pipeDestroy(&pipe);
+    memoClose(hData);
+    return canERR_NOMEM;
+  }
+
+  // Copy the blocks; only the header of info is set per block
   memset(&info, 0, sizeof(info));
-  info.subcommand = MEMO_SUBCMD_CLOSE_FILE;
-  info.timeout = 30*1000; // 30s
-  info.buflen = CANIO_MAX_FILE_NAME + 2; // 'mode' and '\0';
-  ret = ioctl(hData->fd, KCANY_IOCTL_MEMO_PUT_DATA, &info, sizeof(info));
-  if (ret != 0) {
-      DEBUGPRINT((TXT("vCanFileCopyFromDevice: (2) Communication error (%d)\n"), ret));
-      status = errnoToCanStatus(errno);
+  while (status == canOK && (chunk = pipeFullChunk(&pipe, &len)) != NULL) {
+    for (off = 0; off < len && status == canOK; off += bytes) {
+      bytes = (uint32_t)(len - off < MEMO_BLOCK ? len - off : MEMO_BLOCK);
+      memcpy(&info.buffer[0], &bytes, sizeof(bytes));
+      memcpy(&info.buffer[4], chunk + off, bytes);
+      info.subcommand = MEMO_SUBCMD_WRITE_FILE;
+      info.buflen = bytes + sizeof(bytes);
+      info.timeout = 30*1000; // 30s
+      info.status = info.dio_status = info.lio_status = 0;
+      ret = vCanIoctl(hData->fd, KCANY_IOCTL_MEMO_PUT_DATA, &info);
+      if (ret != 0) {
+        DEBUGPRINT((TXT("vCanMemo_file_write: Communication error (%d)\n"), ret));
+        status = errnoToCanStatus(errno);
+      } else {
+        status = memoResultToCanStatus(&info);
+      }
+      CANLIB_PROBE4(memo_block, hData->handle, MEMO_SUBCMD_WRITE_FILE, bytes, status);
+    }
+    pipeEmptied(&pipe);
+    if (status == canOK) {
+      status = pipeProgress(&pipe, len);
+    }
+  }
+  if (status != canOK) {
+    pipeFinish(&pipe, status);
+  }
+  pthread_join(thread, NULL);
+  if (status == canOK) {
+    status = pipeStatus(&pipe);
+  }
+  pipeDestroy(&pipe);
+
+  closeStatus = memoClose(hData);
+  if (status == canOK) {
+    status = closeStatus;
+  }
+  return status;
+}
+
+//======================================================================
+// CRC-32, as in zlib
+//======================================================================
+static uint32_t crcTable[256];
+static pthread_once_t crcOnce = PTHREAD_ONCE_INIT;
+
+static void crcInit (void)
+{
+  uint32_t c;
+  int i, k;
+
+  for (i = 0; i < 256; i++) {
+    c = (uint32_t)i;
+    for (k = 0; k < 8; k++) {
+      c = c & 1 ? 0xedb88320U ^ (c >> 1) : c >> 1;
+    }
+    crcTable[i] = c;
+  }
+}
+
+static uint32_t crc32Update (uint32_t crc, const unsigned char *data, size_t len)
+{
+  pthread_once(&crcOnce, crcInit);
+  crc = ~crc;
+  while (len--) {
+    crc = crcTable[(crc ^ *data++) & 0xff] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+//======================================================================
+// Host file sink and source
+//
+// A read that times out may be restarted, and the device file is read
+// from the start again, since the device can not seek. pos is where the
+// current pass is in the device file; the bytes below written are already
+// in the host file and those below checked are already in crc.
+//======================================================================
+#define MEMO_RETRIES      3
+
+typedef struct {
+  int      fd;
+  uint64_t pos;
+  uint64_t written;
+  uint64_t checked;
+  uint32_t crc;
+} HostFile;
+
+static canStatus fileSink(void *ctx, const unsigned char *data, size_t len)
+{
+  HostFile *h = (HostFile *)ctx;
+  uint64_t end = h->pos + len;
+  size_t   skip;
+  ssize_t  n;
+
+  if (end > h->checked) {
+    skip = (size_t)(h->checked > h->pos ? h->checked - h->pos : 0);
+    h->crc = crc32Update(h->crc, data + skip, len - skip);
+    h->checked = end;
+  }
+  if (end > h->written) {
+    skip = (size_t)(h->written > h->pos ? h->written - h->pos : 0);
+    data += skip;
+    len  -= skip;
+    while (len > 0) {
+      n = write(h->fd, data, len);
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        DEBUGPRINT((TXT("fileSink: Write file error (%d)\n"), errno));
+        return canERR_HOST_FILE;
+      }
+      data += n;
+      len  -= (size_t)n;
+    }
+    h->written = end;
+  }
+  h->pos = end;
+
+  return canOK;
+}
+
+static canStatus fileSource(void *ctx, unsigned char *data, size_t size,
+                            size_t *len)
+{
+  HostFile *h = (HostFile *)ctx;
+  ssize_t  n;
+
+  do {
+    n = read(h->fd, data, size);
+  } while (n < 0 && errno == EINTR);
+  if (n < 0) {
+    DEBUGPRINT((TXT("fileSource: Read file error (%d)\n"), errno));
+    *len = 0;
+    return canERR_HOST_FILE;
+  }
+  h->crc = crc32Update(h->crc, data, (size_t)n);
+  *len = (size_t)n;
+
+  return canOK;
+}
+
+static canStatus crcSink(void *ctx, const unsigned char *data, size_t len)
+{
+  uint32_t *crc = (uint32_t *)ctx;
+
+  *crc = crc32Update(*crc, data, len);
+
+  return canOK;
+}
+
+// CRC of what is on disk now
+static canStatus fileCrc(int fd, uint32_t *crc)
+{
+  unsigned char buf[MEMO_BLOCK * 16];
+  off_t   off = 0;
+  ssize_t n;
+
+  *crc = 0;
+  for (;;) {
+    n = pread(fd, buf, sizeof(buf), off);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0) {
+      return canERR_HOST_FILE;
+    }
+    if (n == 0) {
+      return canOK;
+    }
+    *crc = crc32Update(*crc, buf, (size_t)n);
+    off += n;
+  }
+}
+
+// Link failures that a new attempt on the same fd may get past; a device
+// that is gone fails with canERR_NOTFOUND and stays gone
+static int memoTransient(canStatus status)
+{
+  return status == canERR_TIMEOUT;
+}
+
+//======================================================================
+// Application callbacks as sink and source
+//======================================================================
+typedef struct {
+  HandleData          *hData;
+  kvFileReadCallback  read;
+  kvFileWriteCallback write;
+  void                *context;
+} StreamCallback;
+
+static canStatus streamSink(void *ctx, const unsigned char *data, size_t len)
+{
+  StreamCallback *s = (StreamCallback *)ctx;
+
+  if (s->read(s->hData->handle, data, (unsigned int)len, s->context)) {
+    return canERR_INTERRUPTED;
+  }
+
+  return canOK;
+}
+
+static canStatus streamSource(void *ctx, unsigned char *data, size_t size,
+                              size_t *len)
+{
+  StreamCallback *s = (StreamCallback *)ctx;
+  unsigned int   n = 0;
+
+  *len = 0;
+  if (s->write(s->hData->handle, data, (unsigned int)size, &n, s->context)) {
+    return canERR_INTERRUPTED;
+  }
+  if (n > size) {
+    return canERR_PARAM;
+  }
+  *len = n;
+
+  return canOK;
+}
+
+//======================================================================
+// vCanMemo_file_read_stream
+//======================================================================
+canStatus vCanMemo_file_read_stream(HandleData *hData, char *deviceFileName,
+                                    kvFileReadCallback callback,
+                                    void *context)
+{
+  StreamCallback s = { hData, callback, NULL, context };
+
+  return vCanMemo_file_read(hData, deviceFileName, streamSink, &s);
+}
+
+//======================================================================
+// vCanMemo_file_write_stream
+//======================================================================
+canStatus vCanMemo_file_write_stream(HandleData *hData, char *deviceFileName,
+                                     kvFileWriteCallback callback,
+                                     void *context, uint64_t total)
+{
+  StreamCallback s = { hData, NULL, callback, context };
+
+  return vCanMemo_file_write(hData, deviceFileName, streamSource, &s, total);
+}
+
+//======================================================================
+// vCanMemo_file_copy_to_device
+//======================================================================
+canStatus vCanMemo_file_copy_to_device(HandleData *hData, char *hostFileName,
+                                      char *deviceFileName,
+                                      unsigned int flags, uint32_t *crc)
+{
+  struct stat st;
+  HostFile h;
+  uint32_t deviceCrc = 0;
+  canStatus status;
+
+  if (is_filename_invalid(deviceFileName)) {
+    return canERR_PARAM;
+  }
+
+  memset(&h, 0, sizeof(h));
+  h.fd = open(hostFileName, O_RDONLY | O_CLOEXEC);
+  if (h.fd < 0) {
+    DEBUGPRINT((TXT("vCanFileCopyToDevice: Could not open the file '%s'\n"), hostFileName));
+    return canERR_HOST_FILE;
+  }
+
+  status = vCanMemo_file_write(hData, deviceFileName, fileSource, &h,
+                               fstat(h.fd, &st) == 0 ? (uint64_t)st.st_size : 0);
+  close(h.fd);
+
+  // Read the copy back
+  if (status == canOK && (flags & kvFILE_COPY_VERIFY)) {
+    status = vCanMemo_file_read(hData, deviceFileName, crcSink, &deviceCrc);
+    if (status == canOK && deviceCrc != h.crc) {
+      DEBUGPRINT((TXT("vCanFileCopyToDevice: CRC %08x on device, %08x sent\n"),
+                  deviceCrc, h.crc));
+      status = canERR_CRC;
+    }
+  }
+  if (crc) {
+    *crc = h.crc;
+  }
+
+  return status;
+}
+
+//======================================================================
+// vCanMemo_file_copy_from_device
+//======================================================================
+canStatus vCanMemo_file_copy_from_device(HandleData *hData,
+                                         char *deviceFileName,
+                                         char *hostFileName,
+                                         unsigned int flags, uint32_t *crc)
+{
+  struct timespec pause = { 0, 200 * 1000 * 1000 };
+  HostFile h;
+  uint32_t hostCrc;
+  canStatus status;
+  off_t size;
+  int tries;
+  int resumed;
+
+  if (is_filename_invalid(deviceFileName)) {
+    return canERR_PARAM;
+  }
+
+  memset(&h, 0, sizeof(h));
+  if (flags & kvFILE_COPY_RESUME) {
+    h.fd = open(hostFileName, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
   } else {
-      memcpy(&bytes, &(info.buffer[0]), sizeof(bytes));
-      status = memoResultToCanStatus(&info);
+    h.fd = open(hostFileName, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+  }
+  if (h.fd < 0) {
+    DEBUGPRINT((TXT("vCanFileCopyFromDevice: Could not create the file '%s'\n"), hostFileName));
+    return canERR_HOST_FILE;
+  }
+  size = lseek(h.fd, 0, SEEK_END);
+  if (size < 0) {
+    close(h.fd);
+    return canERR_HOST_FILE;
+  }
+  h.written = (uint64_t)size;
+  resumed   = size > 0;
+
+  for (tries = 0; ; tries++) {
+    h.pos = 0;
+    status = vCanMemo_file_read(hData, deviceFileName, fileSink, &h);
+    if (status == canOK || !(flags & kvFILE_COPY_RETRY) ||
+        !memoTransient(status) || tries == MEMO_RETRIES) {
+      break;
+    }
+    DEBUGPRINT((TXT("vCanFileCopyFromDevice: Resuming at %llu after error %d\n"),
+                (unsigned long long)h.written, status));
+    resumed |= h.written > 0;
+    nanosleep(&pause, NULL);
   }
+
+  // A host file longer than the device file is not a copy of it
+  if (status == canOK && h.pos < h.written) {
+    DEBUGPRINT((TXT("vCanFileCopyFromDevice: '%s' is longer than the device file\n"),
+                hostFileName));
+    status = canERR_HOST_FILE;
+  }
+  // Bytes kept from before were never compared with the device, so a
+  // resumed copy is always checked
+  if (status == canOK && (resumed || (flags & kvFILE_COPY_VERIFY))) {
+    status = fileCrc(h.fd, &hostCrc);
+    if (status == canOK && hostCrc != h.crc) {
+      DEBUGPRINT((TXT("vCanFileCopyFromDevice: CRC %08x on host, %08x received\n"),
+                  hostCrc, h.crc));
+      status = canERR_CRC;
+    }
+  }
+  if (close(h.fd) != 0 && status == canOK) {
+    status = canERR_HOST_FILE;
+  }
+  if (crc) {
+    *crc = h.crc;
+  }
+
   return status;
 }
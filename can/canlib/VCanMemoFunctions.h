@@ -59,12 +59,32 @@
 #include "canstat.h"
 #include "canlib_data.h"
 
+// Host side of a file transfer. A sink takes the next len bytes read from
+// the device; a source gives up to size bytes to write, and *len 0 at the
+// end. Both are called from a helper thread.
+typedef canStatus (*MemoSink) (void *ctx, const unsigned char *data,
+                               size_t len);
+typedef canStatus (*MemoSource) (void *ctx, unsigned char *data, size_t size,
+                                 size_t *len);
+
+canStatus vCanMemo_file_read(HandleData *hData, char *deviceFileName,
+                             MemoSink sink, void *ctx);
+canStatus vCanMemo_file_write(HandleData *hData, char *deviceFileName,
+                              MemoSource source, void *ctx, uint64_t total);
+canStatus vCanMemo_file_read_stream(HandleData *hData, char *deviceFileName,
+                                    kvFileReadCallback callback,
+                                    void *context);
+canStatus vCanMemo_file_write_stream(HandleData *hData, char *deviceFileName,
+                                     kvFileWriteCallback callback,
+                                     void *context, uint64_t total);
 canStatus vCanMemo_file_copy_to_device(HandleData *hData,
                                        char *hostFileName,
-                                       char *deviceFileName);
+                                       char *deviceFileName,
+                                       unsigned int flags, uint32_t *crc);
 canStatus vCanMemo_file_copy_from_device(HandleData *hData,
                                          char *deviceFileName,
-                                         char *hostFileName);
+                                         char *hostFileName,
+                                         unsigned int flags, uint32_t *crc);
 canStatus vCanMemo_file_delete(HandleData *hData, char *deviceFileName);
 
 
@@ -0,0 +1,495 @@
+/*
+**             Copyright 2017 by Kvaser AB, Molndal, Sweden
+**                        http://www.kvaser.com
+**
+** This software is dual licensed under the following two licenses:
+** BSD-new and GPLv2. You may use either one. See the included
+** COPYING file for details.
+**
+** License: BSD-new
+** ===============================================================================
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of the <organization> nor the
+**       names of its contributors may be used to endorse or promote products
+**       derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+** DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+** DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+** (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+** LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+** ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**
+**
+** License: GPLv2
+** ===============================================================================
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+** ---------------------------------------------------------------------------
+**/
+
+/*  Kvaser Linux Canlib notification dispatcher */
+#define _GNU_SOURCE // This is required for recursive mutex support in pthread
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "vcanevt.h"
+#include "VCanNotifyFunctions.h"
+#include "VCanFunctions.h"
+#include "VCanFuncUtil.h"
+#include "debug.h"
+
+
+#   if DEBUG
+#      define DEBUGPRINT(args) printf args
+#   else
+#      define DEBUGPRINT(args)
+#   endif
+
+// Max number of ready fds handled per epoll_wait
+#define NOTIFY_MAX_EVENTS 32
+
+typedef struct vCanNotifyEntry {
+  HandleData              *hData;
+  int                     fd;
+  vCanNotifyReadFn        readFn;
+  int                     active;
+  struct vCanNotifyEntry  *next;   // Graveyard link
+} vCanNotifyEntry;
+
+#if defined(PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP)
+static pthread_mutex_t notifyMutex = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+#elif defined(PTHREAD_RECURSIVE_MUTEX_INITIALIZER)
+static pthread_mutex_t notifyMutex = PTHREAD_RECURSIVE_MUTEX_INITIALIZER;
+#else
+#error Canlib requires GNUC.
+#endif
+
+static int             epollFd = -1;
+static int             wakeFd  = -1;
+static int             running = 0;
+static pthread_t       dispatchThread;
+
+// Entries that have been unregistered, but that may still be referenced
+// from the event array of an ongoing epoll_wait. Freed after each batch.
+static vCanNotifyEntry *graveyard = NULL;
+
+// The handle whose read function runs, and that handle if it was closed
+// from one of its own callbacks. It is freed when the read function is done.
+static HandleData      *dispatching   = NULL;
+static HandleData      *deferredFree  = NULL;
+
+
+//======================================================================
+// Free unregistered entries, called with notifyMutex held
+//======================================================================
+static void freeGraveyard (void)
+{
+  while (graveyard) {
+    vCanNotifyEntry *entry = graveyard;
+    graveyard = entry->next;
+    free(entry);
+  }
+}
+
+
+//======================================================================
+// Dispatcher thread
+//======================================================================
+static void *vCanNotifyDispatch (void *arg)
+{
+  struct epoll_event events[NOTIFY_MAX_EVENTS];
+  int                n, i;
+  int                stop = 0;
+
+  (void)arg;
+
+  while (!stop) {
+    n = epoll_wait(epollFd, events, NOTIFY_MAX_EVENTS, -1);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      DEBUGPRINT((TXT("epoll_wait failed (%d)\n"), errno));
+      break;
+    }
+
+    pthread_mutex_lock(&notifyMutex);
+    for (i = 0; i < n; i++) {
+      vCanNotifyEntry *entry = events[i].data.ptr;
+
+      if (entry == NULL) {
+        uint64_t count;
+        if (read(wakeFd, &count, sizeof(count)) < 0) {
+          DEBUGPRINT((TXT("Failed to read wake fd (%d)\n"), errno));
+        }
+        stop = !running;
+        continue;
+      }
+      if (entry->active) {
+        dispatching = entry->hData;
+        entry->readFn(entry->hData);
+        dispatching = NULL;
+        free(deferredFree);
+        deferredFree = NULL;
+      }
+    }
+    freeGraveyard();
+    pthread_mutex_unlock(&notifyMutex);
+  }
+
+  return NULL;
+}
+
+
+//======================================================================
+// Start dispatcher, called with notifyMutex held
+//======================================================================
+static canStatus startDispatcher (void)
+{
+  struct epoll_event ev;
+
+  if (running) {
+    return canOK;
+  }
+
+  if (epollFd < 0) {
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd < 0) {
+      return errnoToCanStatus(errno);
+    }
+  }
+
+  if (wakeFd < 0) {
+    wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (wakeFd < 0) {
+      return errnoToCanStatus(errno);
+    }
+    ev.events   = EPOLLIN;
+    ev.data.ptr = NULL;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &ev) != 0) {
+      close(wakeFd);
+      wakeFd = -1;
+      return errnoToCanStatus(errno);
+    }
+  }
+
+  if (vCanCreateThread(&dispatchThread, vCanNotifyDispatch, NULL) != 0) {
+    return canERR_NOMEM;
+  }
+  running = 1;
+
+  return canOK;
+}
+
+
+//======================================================================
+// Register fd to be watched for a handle
+//======================================================================
+canStatus vCanNotifyRegister (HandleData *hData, int fd, vCanNotifyReadFn readFn)
+{
+  vCanNotifyEntry    *entry;
+  struct epoll_event ev;
+  canStatus          stat;
+
+  entry = malloc(sizeof(vCanNotifyEntry));
+  if (entry == NULL) {
+    return canERR_NOMEM;
+  }
+  entry->hData  = hData;
+  entry->fd     = fd;
+  entry->readFn = readFn;
+  entry->active = 1;
+  entry->next   = NULL;
+
+  pthread_mutex_lock(&notifyMutex);
+
+  stat = startDispatcher();
+  if (stat != canOK) {
+    pthread_mutex_unlock(&notifyMutex);
+    free(entry);
+    return stat;
+  }
+
+  ev.events   = EPOLLIN;
+  ev.data.ptr = entry;
+  if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+    stat = errnoToCanStatus(errno);
+    pthread_mutex_unlock(&notifyMutex);
+    free(entry);
+    return stat;
+  }
+  hData->notifyEntry = entry;
+
+  pthread_mutex_unlock(&notifyMutex);
+
+  return canOK;
+}
+
+
+//======================================================================
+// Stop watching the notification fd of a handle
+//======================================================================
+void vCanNotifyUnregister (HandleData *hData)
+{
+  vCanNotifyEntry *entry;
+
+  pthread_mutex_lock(&notifyMutex);
+
+  entry = hData->notifyEntry;
+  if (entry) {
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, entry->fd, NULL);
+    entry->active = 0;
+    entry->next   = graveyard;
+    graveyard     = entry;
+    hData->notifyEntry = NULL;
+    if (!running) {
+      freeGraveyard();
+    }
+  }
+
+  pthread_mutex_unlock(&notifyMutex);
+}
+
+
+//======================================================================
+// Free a closed handle, not until its read function has returned if it
+// was closed from one of its own callbacks
+//======================================================================
+void vCanNotifyFreeHandle (HandleData *hData)
+{
+  pthread_mutex_lock(&notifyMutex);
+  // Only the dispatcher thread can hold the lock while dispatching is set
+  if (hData != NULL && hData == dispatching) {
+    deferredFree = hData;
+  } else {
+    free(hData);
+  }
+  pthread_mutex_unlock(&notifyMutex);
+}
+
+
+//======================================================================
+// Lock out the dispatcher while changing notification settings
+//======================================================================
+void vCanNotifyLock (void)
+{
+  pthread_mutex_lock(&notifyMutex);
+}
+
+void vCanNotifyUnlock (void)
+{
+  pthread_mutex_unlock(&notifyMutex);
+}
+
+
+//======================================================================
+// Stop the dispatcher thread
+//======================================================================
+void vCanNotifyShutdown (void)
+{
+  uint64_t  one = 1;
+  pthread_t thread;
+
+  pthread_mutex_lock(&notifyMutex);
+  if (!running) {
+    pthread_mutex_unlock(&notifyMutex);
+    return;
+  }
+  running = 0;
+  thread  = dispatchThread;
+  if (write(wakeFd, &one, sizeof(one)) < 0) {
+    DEBUGPRINT((TXT("Failed to wake dispatcher (%d)\n"), errno));
+  }
+  pthread_mutex_unlock(&notifyMutex);
+
+  if (!pthread_equal(thread, pthread_self())) {
+    pthread_join(thread, NULL);
+  } else {
+    pthread_detach(thread);
+  }
+
+  pthread_mutex_lock(&notifyMutex);
+  freeGraveyard();
+  pthread_mutex_unlock(&notifyMutex);
+}
+
+
+//======================================================================
+// Dispatch latency self-test
+//======================================================================
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t  done;
+  struct timespec sent;
+  uint64_t        *latency;
+  unsigned int    count;
+} LatencyProbe;
+
+static uint64_t timespecDiffNs (const struct timespec *a, const struct timespec *b)
+{
+  return (uint64_t)(b->tv_sec - a->tv_sec) * 1000000000ULL +
+         (uint64_t)b->tv_nsec - (uint64_t)a->tv_nsec;
+}
+
+// The probe events go through the same decoding and callback path as
+// received frames, so the time includes everything up to the callback
+static int latencyProbeFetch (HandleData *hData, VCAN_EVENT *msg)
+{
+  uint64_t count;
+
+  if (read(hData->fd, &count, sizeof(count)) < 0) {
+    return -1;
+  }
+
+  memset(msg, 0, sizeof(*msg));
+  msg->tag = V_RECEIVE_MSG;
+
+  return 0;
+}
+
+static void latencyProbeRead (HandleData *hData)
+{
+  vCanNotifyEvents(hData, latencyProbeFetch);
+}
+
+static void latencyProbeCallback (canNotifyData *data)
+{
+  LatencyProbe    *probe = data->tag;
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  pthread_mutex_lock(&probe->lock);
+  probe->latency[probe->count++] = timespecDiffNs(&probe->sent, &now);
+  pthread_cond_signal(&probe->done);
+  pthread_mutex_unlock(&probe->lock);
+}
+
+static int cmpU64 (const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+
+  return (x > y) - (x < y);
+}
+
+static uint64_t percentile (const uint64_t *sorted, unsigned int n, unsigned int permille)
+{
+  unsigned int i = (unsigned int)(((uint64_t)n * permille) / 1000);
+
+  return sorted[i < n ? i : n - 1];
+}
+
+canStatus vCanNotifyLatencyTest (unsigned int samples, unsigned int intervalUs,
+                                 kvLatencyStats *stats)
+{
+  LatencyProbe    probe;
+  HandleData      hData;
+  struct timespec deadline;
+  uint64_t        one = 1;
+  canStatus       stat = canOK;
+  unsigned int    i;
+  int             ret = 0;
+
+  memset(&hData, 0, sizeof(hData));
+  memset(&probe, 0, sizeof(probe));
+
+  probe.latency = malloc(samples * sizeof(uint64_t));
+  if (probe.latency == NULL) {
+    return canERR_NOMEM;
+  }
+  pthread_mutex_init(&probe.lock, NULL);
+  pthread_cond_init(&probe.done, NULL);
+
+  hData.fd              = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  hData.notifyFd        = hData.fd;
+  hData.handle          = canINVALID_HANDLE;
+  hData.notifyData.tag  = &probe;
+  hData.notifyFlags     = canNOTIFY_RX;
+  hData.callback        = latencyProbeCallback;
+  hData.timerResolution = 1000;
+  if (hData.fd < 0) {
+    stat = errnoToCanStatus(errno);
+    goto out;
+  }
+
+  stat = vCanNotifyRegister(&hData, hData.fd, latencyProbeRead);
+  if (stat != canOK) {
+    close(hData.fd);
+    goto out;
+  }
+
+  for (i = 0; i < samples && stat == canOK; i++) {
+    pthread_mutex_lock(&probe.lock);
+    clock_gettime(CLOCK_MONOTONIC, &probe.sent);
+    if (write(hData.fd, &one, sizeof(one)) < 0) {
+      stat = errnoToCanStatus(errno);
+    }
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += 1;
+    while (stat == canOK && probe.count <= i && ret != ETIMEDOUT) {
+      ret = pthread_cond_timedwait(&probe.done, &probe.lock, &deadline);
+    }
+    if (probe.count <= i) {
+      stat = canERR_TIMEOUT;
+    }
+    pthread_mutex_unlock(&probe.lock);
+
+    if (intervalUs) {
+      usleep(intervalUs);
+    }
+  }
+
+  vCanNotifyUnregister(&hData);
+  close(hData.fd);
+
+  if (stat == canOK && samples) {
+    qsort(probe.latency, samples, sizeof(uint64_t), cmpU64);
+    stats->samples = samples;
+    stats->min     = probe.latency[0];
+    stats->p50     = percentile(probe.latency, samples, 500);
+    stats->p90     = percentile(probe.latency, samples, 900);
+    stats->p99     = percentile(probe.latency, samples, 990);
+    stats->p999    = percentile(probe.latency, samples, 999);
+    stats->max     = probe.latency[samples - 1];
+  }
+
+out:
+  pthread_cond_destroy(&probe.done);
+  pthread_mutex_destroy(&probe.lock);
+  free(probe.latency);
+
+  return stat;
+}
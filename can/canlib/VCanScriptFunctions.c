@@ -54,10 +54,13 @@
 
 #include <errno.h>
 #include <string.h>
+#include <stdlib.h>
 #include <sys/ioctl.h>
 
 #include "VCanScriptFunctions.h"
 #include "VCanFuncUtil.h"
+#include "apistats.h"
+#include "trace.h"
 #include "hydra_host_cmds.h"
 #include "canstat.h"
 
@@ -135,7 +138,7 @@ canStatus vCanScript_stop(HandleData *hData, int slotNo, int mode)
   script_control.command = CMD_SCRIPT_STOP;
   script_control.stopMode = (signed char) mode;
   script_control.channel = hData->channelNr;
-  ret = ioctl(hData->fd, KCAN_IOCTL_SCRIPT_CONTROL, &script_control);
+  ret = vCanIoctl(hData->fd, KCAN_IOCTL_SCRIPT_CONTROL, &script_control);
   if (ret != 0) {
     return errnoToCanStatus(errno);
   }
@@ -154,7 +157,7 @@ canStatus vCanScript_start(HandleData *hData, int slotNo)
   script_control.scriptNo = slotNo;
   script_control.command = CMD_SCRIPT_START;
   script_control.channel = hData->channelNr;
-  ret = ioctl(hData->fd, KCAN_IOCTL_SCRIPT_CONTROL, &script_control);
+  ret = vCanIoctl(hData->fd, KCAN_IOCTL_SCRIPT_CONTROL, &script_control);
   if (ret != 0) {
     return errnoToCanStatus(errno);
   }
@@ -162,62 +165,58 @@ canStatus vCanScript_start(HandleData *hData, int slotNo)
 }
 
 //======================================================================
-// vCanScript_load_file
-// Load a compiled script file directly into the script engine on the device.
+// vCanScript_load_buffer
+// Load a compiled script image directly into the script engine on the device.
 //======================================================================
-canStatus vCanScript_load_file(HandleData *hData, int slotNo,
-                               char *hostFileName)
+canStatus vCanScript_load_buffer(HandleData *hData, int slotNo,
+                                 const unsigned char *image, size_t len)
 {
   int ret;
   canStatus status;
   size_t bytes;
-  FILE *hFile;
+  size_t offset = 0;
   KCAN_IOCTL_SCRIPT_CONTROL_T script_control;
   const size_t current_block_size = sizeof(script_control.data) - 1;
 
-  hFile = fopen(hostFileName, "rb");
-  if (!hFile) {
-    DEBUGPRINT((TXT("Could not open script file '%s'\n"), hostFileName));
-    return canERR_HOST_FILE;
-  }
-
   // Start transfer of data; setup slot for script
   memset(&script_control, 0, sizeof(script_control));
   script_control.scriptNo = slotNo;
   script_control.channel = hData->channelNr;
   script_control.command = CMD_SCRIPT_LOAD_REMOTE_START;
-  ret = ioctl(hData->fd, KCAN_IOCTL_SCRIPT_CONTROL, &script_control);
+  ret = vCanIoctl(hData->fd, KCAN_IOCTL_SCRIPT_CONTROL, &script_control);
   if (ret != 0) {
-    fclose(hFile);
     return errnoToCanStatus(errno);
   }
   status = scriptControlStatusToCanStatus(script_control.script_control_status);
   if (status != canOK) {
-    fclose(hFile);
     return status;
   }
 
+  // A last block shorter than current_block_size ends the image
   script_control.command = CMD_SCRIPT_LOAD_REMOTE_DATA;
   do {
-    bytes = fread(script_control.script.data, 1, current_block_size, hFile);
+    bytes = len - offset;
+    if (bytes > current_block_size) {
+      bytes = current_block_size;
+    }
+    memcpy(script_control.script.data, image + offset, bytes);
+    offset += bytes;
     script_control.script.length = bytes;
-    ret = ioctl(hData->fd, KCAN_IOCTL_SCRIPT_CONTROL, &script_control);
+    ret = vCanIoctl(hData->fd, KCAN_IOCTL_SCRIPT_CONTROL, &script_control);
     if (ret != 0) {
-      fclose(hFile);
       return errnoToCanStatus(errno);
     }
     status = scriptControlStatusToCanStatus(script_control.script_control_status);
+    CANLIB_PROBE4(script_block, hData->handle, slotNo, bytes, status);
     if (status != canOK) {
-      fclose(hFile);
       return status;
     }
   } while (bytes == current_block_size);
-  fclose(hFile);
 
   // Finish
   script_control.command = CMD_SCRIPT_LOAD_REMOTE_FINISH;
   script_control.script.length = 0;
-  ret = ioctl(hData->fd, KCAN_IOCTL_SCRIPT_CONTROL, &script_control);
+  ret = vCanIoctl(hData->fd, KCAN_IOCTL_SCRIPT_CONTROL, &script_control);
   if (ret != 0) {
     return errnoToCanStatus(errno);
   }
@@ -229,6 +228,83 @@ canStatus vCanScript_load_file(HandleData *hData, int slotNo,
   return canOK;
 }
 
+//======================================================================
+// vCanScript_load_file
+// Load a compiled script file directly into the script engine on the device.
+//======================================================================
+canStatus vCanScript_load_file(HandleData *hData, int slotNo,
+                               char *hostFileName)
+{
+  canStatus status;
+  unsigned char *image = NULL;
+  size_t len = 0;
+  size_t size = 0;
+  size_t bytes;
+  FILE *hFile;
+
+  hFile = fopen(hostFileName, "rb");
+  if (!hFile) {
+    DEBUGPRINT((TXT("Could not open script file '%s'\n"), hostFileName));
+    return canERR_HOST_FILE;
+  }
+
+  // Scripts are small; read the whole file, then load it as one image
+  do {
+    if (len == size) {
+      unsigned char *more;
+
+      size = size ? 2 * size : 64 * 1024;
+      more = realloc(image, size);
+      if (!more) {
+        free(image);
+        fclose(hFile);
+        return canERR_NOMEM;
+      }
+      image = more;
+    }
+    bytes = fread(image + len, 1, size - len, hFile);
+    len += bytes;
+  } while (bytes > 0);
+  if (ferror(hFile)) {
+    free(image);
+    fclose(hFile);
+    return canERR_HOST_FILE;
+  }
+  fclose(hFile);
+
+  status = vCanScript_load_buffer(hData, slotNo, image, len);
+  free(image);
+
+  return status;
+}
+
+//======================================================================
+// Envvars
+//
+// The driver's script control interface has no envvar commands, so
+// envvars cannot be reached on hardware channels.
+//======================================================================
+canStatus vCanScript_envvar_info(HandleData *hData, const char *name,
+                                 uint32_t *id, int *type, int *size)
+{
+  (void) hData;
+  (void) name;
+  (void) id;
+  (void) type;
+  (void) size;
+  return canERR_NOT_IMPLEMENTED;
+}
+
+canStatus vCanScript_envvar_transfer(HandleData *hData, int set,
+                                     EnvvarXfer *xfer, int n)
+{
+  (void) hData;
+  (void) set;
+  (void) xfer;
+  (void) n;
+  return canERR_NOT_IMPLEMENTED;
+}
+
 //======================================================================
 // vCanScript_unload
 //======================================================================
@@ -241,7 +317,7 @@ canStatus vCanScript_unload(HandleData *hData, int slotNo)
   script_control.scriptNo = slotNo;
   script_control.command = CMD_SCRIPT_UNLOAD;
   script_control.channel = hData->channelNr;
-  ret = ioctl(hData->fd, KCAN_IOCTL_SCRIPT_CONTROL, &script_control);
+  ret = vCanIoctl(hData->fd, KCAN_IOCTL_SCRIPT_CONTROL, &script_control);
   if (ret != 0) {
     return errnoToCanStatus(errno);
   }
@@ -61,6 +61,12 @@ canStatus vCanScript_stop(HandleData *hData, int slotNo, int mode);
 canStatus vCanScript_start(HandleData *hData, int slotNo);
 canStatus vCanScript_load_file(HandleData *hData, int slotNo,
                                char *hostFileName);
+canStatus vCanScript_load_buffer(HandleData *hData, int slotNo,
+                                 const unsigned char *image, size_t len);
 canStatus vCanScript_unload(HandleData *hData, int slotNo);
+canStatus vCanScript_envvar_info(HandleData *hData, const char *name,
+                                 uint32_t *id, int *type, int *size);
+canStatus vCanScript_envvar_transfer(HandleData *hData, int set,
+                                     EnvvarXfer *xfer, int n);
 
 #endif  /* VCANSCRIPTFUNCTIONS_H */
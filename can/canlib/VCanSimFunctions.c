@@ -0,0 +1,2531 @@
+/*
+**             Copyright 2017 by Kvaser AB, Molndal, Sweden
+**                        http://www.kvaser.com
+**
+** This software is dual licensed under the following two licenses:
+** BSD-new and GPLv2. You may use either one. See the included
+** COPYING file for details.
+**
+** License: BSD-new
+** ===============================================================================
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of the <organization> nor the
+**       names of its contributors may be used to endorse or promote products
+**       derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+** DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+** DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+** (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+** LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+** ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**
+**
+** License: GPLv2
+** ===============================================================================
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+** ---------------------------------------------------------------------------
+**/
+
+/*  Kvaser Linux Canlib simulated channels */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+#include "canlib.h"
+#include "canlib_data.h"
+#include "vcan_ioctl.h"
+#include "vcanevt.h"
+#include "dlc.h"
+#include "VCanFunctions.h"
+#include "VCanNotifyFunctions.h"
+#include "VCanFuncUtil.h"
+#include "VCanSimFunctions.h"
+#include "flightrec.h"
+#include "swobjbuf.h"
+#include "debug.h"
+
+
+#   if DEBUG
+#      define DEBUGPRINT(args) printf args
+#   else
+#      define DEBUGPRINT(args)
+#   endif
+
+// KVASER_CANLIB_SIM=<channels>[,<option>=<value>...], see canlib.h
+#define SIM_ENV             "KVASER_CANLIB_SIM"
+// KVASER_CANLIB_SIM_ENVVARS=<name>:<type>[:<size>][,...], see canlib.h
+#define SIM_ENVVARS_ENV     "KVASER_CANLIB_SIM_ENVVARS"
+
+#define SIM_MAX_CHANNELS    32
+#define SIM_MAX_BUSES       32     // As for canIOCTL_CONNECT_TO_VIRTUAL_BUS
+#define SIM_MAX_QUEUE       65536
+#define SIM_TX_QUEUE        256
+#define SIM_RX_QUEUE        4096
+#define SIM_BITRATE         500000
+#define SIM_BITRATE_BRS     2000000
+#define SIM_MAX_BITRATE     8000000
+#define SIM_MAX_ENVVARS     ENVVAR_MAX
+#define SIM_MAX_ENVVAR_SIZE 4096
+
+#define SIM_TICK_NS         10000  // VCAN time stamps are in 10 us ticks
+#define SIM_TIMER_FACTOR    100    // 1 ms time stamps by default, as for VCAN
+
+// Bits after the CRC: CRC delimiter, ACK slot and delimiter, EOF and
+// intermission
+#define SIM_TAIL_BITS       13
+// Error flag, error delimiter and intermission
+#define SIM_ERROR_BITS      17
+// Suspend transmission of an error passive transmitter
+#define SIM_SUSPEND_BITS    8
+
+#define SIM_WARNING_LIMIT   96
+#define SIM_PASSIVE_LIMIT   128
+#define SIM_BUSOFF_LIMIT    256
+
+#define SIM_CAPABILITIES    (VCAN_CHANNEL_CAP_EXTENDED_CAN         | \
+                             VCAN_CHANNEL_CAP_BUSLOAD_CALCULATION  | \
+                             VCAN_CHANNEL_CAP_ERROR_COUNTERS       | \
+                             VCAN_CHANNEL_CAP_SEND_ERROR_FRAMES    | \
+                             VCAN_CHANNEL_CAP_TXREQUEST            | \
+                             VCAN_CHANNEL_CAP_TXACKNOWLEDGE        | \
+                             VCAN_CHANNEL_CAP_SIMULATED            | \
+                             VCAN_CHANNEL_CAP_CANFD                | \
+                             VCAN_CHANNEL_CAP_CANFD_NONISO         | \
+                             VCAN_CHANNEL_CAP_SILENTMODE           | \
+                             VCAN_CHANNEL_CAP_SINGLE_SHOT)
+
+#define SIM_CANLIB_CAPABILITIES (canCHANNEL_CAP_EXTENDED_CAN      | \
+                                 canCHANNEL_CAP_BUS_STATISTICS    | \
+                                 canCHANNEL_CAP_ERROR_COUNTERS    | \
+                                 canCHANNEL_CAP_GENERATE_ERROR    | \
+                                 canCHANNEL_CAP_TXREQUEST         | \
+                                 canCHANNEL_CAP_TXACKNOWLEDGE     | \
+                                 canCHANNEL_CAP_SIMULATED         | \
+                                 canCHANNEL_CAP_CAN_FD            | \
+                                 canCHANNEL_CAP_CAN_FD_NONISO     | \
+                                 canCHANNEL_CAP_SILENT_MODE       | \
+                                 canCHANNEL_CAP_SINGLE_SHOT)
+
+// A frame waiting to be sent
+typedef struct {
+  CAN_MSG      msg;
+  int64_t      queuedNs;
+} SimTx;
+
+// An envvar declared in KVASER_CANLIB_SIM_ENVVARS, its id is the index
+typedef struct {
+  char         name[ENVVAR_NAME_MAX];
+  int          type;            // kvENVVAR_TYPE_xxx
+  unsigned int size;
+  unsigned int offset;          // In a channel's envvar values
+} SimEnvvar;
+
+// Events for a handle, the eventfd is readable while there are any
+typedef struct {
+  VCAN_EVENT   *ev;
+  unsigned int size;
+  unsigned int head;
+  unsigned int count;
+  unsigned int eventMask;  // V_xxx events to keep
+  int          fd;
+  int          overrun;    // Events were lost, flagged on the next frame
+  unsigned int overruns;
+  unsigned int pending;    // Other things to read, such as changed envvars
+} SimQueue;
+
+typedef struct SimHandle {
+  HandleData       *hData;
+  struct SimHandle *next;         // On the same channel
+  uint64_t         generation;    // Tells a reopened handle at the same address
+  int              channel;
+  int              onBus;
+  int              txAck;
+  int              txRq;
+  int              txEcho;        // Other handles on the channel see our frames
+  VCanMsgFilter    filter;        // Acceptance filter
+  SimQueue         rx;
+  pthread_cond_t   rxCond;
+  SimQueue         *notify;       // NULL unless notification is on
+  int              notifyTxAck;
+  int              notifyEnvvar;
+  // Per envvar, the first write by another handle not yet notified, or 0
+  int64_t          *envvarChanged;
+  SimTx            *tx;
+  unsigned int     txSize;
+  unsigned int     txHead;
+  unsigned int     txCount;
+  unsigned int     txSeq;         // Changes when the head frame is removed
+  pthread_cond_t   txCond;        // Signalled when tx gets empty
+} SimHandle;
+
+// A channel is a CAN controller, shared by the handles open on it
+typedef struct {
+  int               bus;          // -1 when not connected
+  int               onBus;        // Handles on bus
+  int               exclusive;
+  int               silent;
+  VCanBusParams     params;
+  unsigned int      tec;
+  unsigned int      rec;
+  unsigned char     busStatus;    // CHIPSTAT_xxx
+  unsigned int      injectErrors; // Frames still to destroy
+  uint32_t          errorRate;    // Frames destroyed per million
+  SimHandle         *handles;
+  VCanBusStatistics stats;
+  int64_t           loadBusyNs;   // Bus load since the last reqBusStats
+  int64_t           loadStartNs;
+  unsigned char     *envvars;     // Values of the declared envvars
+} SimChannel;
+
+typedef struct {
+  pthread_cond_t cond;
+  int            running;
+  int64_t        freeNs;        // End of the last frame
+  int64_t        busyNs;
+} SimBus;
+
+// How a frame on the bus ended
+enum {
+  SIM_FRAME_OK,
+  SIM_FRAME_NO_ACK,
+  SIM_FRAME_BIT_ERROR,
+  SIM_FRAME_ERROR_FRAME,        // An error frame sent on purpose
+};
+
+// Everything below is protected by simLock
+static pthread_once_t     simOnce = PTHREAD_ONCE_INIT;
+static pthread_mutex_t    simLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_condattr_t simCondAttr;
+static int                simChannelCount;
+static unsigned int       simTxQueue = SIM_TX_QUEUE;
+static unsigned int       simRxQueue = SIM_RX_QUEUE;
+static int64_t            simStartNs;
+static uint32_t           simRandomState = 0x2545f491;
+static uint64_t           simGeneration;
+static SimChannel         simChannel[SIM_MAX_CHANNELS];
+static SimBus             simBus[SIM_MAX_BUSES];
+// Set up once by simInit and not changed after that
+static SimEnvvar          simEnvvar[SIM_MAX_ENVVARS];
+static int                simEnvvarCount;
+static unsigned int       simEnvvarBytes;
+
+
+//======================================================================
+// Time
+//======================================================================
+static int64_t simNowNs (void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint64_t simTicks (int64_t ns)
+{
+  return (uint64_t)(ns - simStartNs) / SIM_TICK_NS;
+}
+
+static struct timespec simTimespec (int64_t ns)
+{
+  struct timespec ts;
+
+  ts.tv_sec  = ns / 1000000000;
+  ts.tv_nsec = ns % 1000000000;
+  return ts;
+}
+
+// Deadline of a canlib timeout in ms, 0 if it is infinite
+static int64_t simDeadline (unsigned long timeout)
+{
+  if (timeout >= 0xFFFFFFFF) {
+    return 0;
+  }
+  return simNowNs() + (int64_t)timeout * 1000000;
+}
+
+// Returns non-zero when the deadline has passed, lock held
+static int simWait (pthread_cond_t *cond, int64_t deadline)
+{
+  struct timespec ts;
+
+  if (deadline == 0) {
+    pthread_cond_wait(cond, &simLock);
+    return 0;
+  }
+  ts = simTimespec(deadline);
+  return pthread_cond_timedwait(cond, &simLock, &ts) == ETIMEDOUT;
+}
+
+static uint32_t simRandom (void)
+{
+  // xorshift32, the same sequence in every run for a given seed
+  simRandomState ^= simRandomState << 13;
+  simRandomState ^= simRandomState >> 17;
+  simRandomState ^= simRandomState << 5;
+  return simRandomState;
+}
+
+
+//======================================================================
+// Set up the channels from the environment
+//======================================================================
+// Envvars are <name>:int, <name>:float or <name>:string:<size>
+static void simInitEnvvars (void)
+{
+  const char   *env = getenv(SIM_ENVVARS_ENV);
+  char         *list, *item, *save = NULL;
+  char         *type, *size;
+  SimEnvvar    *e;
+
+  if (env == NULL || *env == 0) {
+    return;
+  }
+  list = strdup(env);
+  if (list == NULL) {
+    return;
+  }
+
+  for (item = strtok_r(list, ",", &save); item != NULL;
+       item = strtok_r(NULL, ",", &save)) {
+    if (simEnvvarCount == SIM_MAX_ENVVARS) {
+      DEBUGPRINT((TXT("%s: too many envvars\n"), SIM_ENVVARS_ENV));
+      break;
+    }
+    e    = &simEnvvar[simEnvvarCount];
+    type = strchr(item, ':');
+    if (type == NULL || type == item || type - item >= ENVVAR_NAME_MAX) {
+      DEBUGPRINT((TXT("%s: bad envvar %s\n"), SIM_ENVVARS_ENV, item));
+      continue;
+    }
+    *type++ = 0;
+    size    = strchr(type, ':');
+    if (size != NULL) {
+      *size++ = 0;
+    }
+
+    if (!strcmp(type, "int") && size == NULL) {
+      e->type = kvENVVAR_TYPE_INT;
+      e->size = sizeof(int);
+    } else if (!strcmp(type, "float") && size == NULL) {
+      e->type = kvENVVAR_TYPE_FLOAT;
+      e->size = sizeof(float);
+    } else if (!strcmp(type, "string") && size != NULL &&
+               atoi(size) > 0 && atoi(size) <= SIM_MAX_ENVVAR_SIZE) {
+      e->type = kvENVVAR_TYPE_STRING;
+      e->size = atoi(size);
+    } else {
+      DEBUGPRINT((TXT("%s: bad envvar %s\n"), SIM_ENVVARS_ENV, item));
+      continue;
+    }
+    strcpy(e->name, item);
+    e->offset       = simEnvvarBytes;
+    simEnvvarBytes += e->size;
+    simEnvvarCount++;
+  }
+
+  free(list);
+}
+
+static void simInit (void)
+{
+  const char    *env = getenv(SIM_ENV);
+  const char    *p;
+  char          *end;
+  unsigned long value;
+  long          bitrate   = SIM_BITRATE;
+  uint32_t      errorRate = 0;
+  int           i;
+
+  pthread_condattr_init(&simCondAttr);
+  pthread_condattr_setclock(&simCondAttr, CLOCK_MONOTONIC);
+  simStartNs = simNowNs();
+
+  for (i = 0; i < SIM_MAX_BUSES; i++) {
+    pthread_cond_init(&simBus[i].cond, &simCondAttr);
+  }
+
+  if (env == NULL || *env == 0) {
+    return;
+  }
+
+  value = strtoul(env, &end, 10);
+  simChannelCount = value > SIM_MAX_CHANNELS ? SIM_MAX_CHANNELS : (int)value;
+
+  // Options are name=value, separated by commas
+  for (p = end; *p == ','; p = end) {
+    p++;
+    end = strchr(p, '=');
+    if (end == NULL) {
+      break;
+    }
+    value = strtoul(end + 1, &end, 10);
+
+    if (!strncmp(p, "bitrate=", 8) && value && value <= SIM_MAX_BITRATE) {
+      bitrate = value;
+    } else if (!strncmp(p, "txqueue=", 8) && value && value <= SIM_MAX_QUEUE) {
+      simTxQueue = value;
+    } else if (!strncmp(p, "rxqueue=", 8) && value && value <= SIM_MAX_QUEUE) {
+      simRxQueue = value;
+    } else if (!strncmp(p, "errorrate=", 10) && value <= 1000000) {
+      errorRate = value;
+    } else if (!strncmp(p, "seed=", 5) && value) {
+      simRandomState = value;
+    } else {
+      DEBUGPRINT((TXT("%s: bad option at %s\n"), SIM_ENV, p));
+    }
+  }
+
+  for (i = 0; i < simChannelCount; i++) {
+    SimChannel *c = &simChannel[i];
+
+    c->bus             = 0;
+    c->busStatus       = CHIPSTAT_BUSOFF;
+    c->errorRate       = errorRate;
+    c->params.freq     = bitrate;
+    c->params.tseg1    = 5;
+    c->params.tseg2    = 2;
+    c->params.sjw      = 1;
+    c->params.samp3    = 1;
+    c->params.freq_brs = SIM_BITRATE_BRS;
+    c->params.tseg1_brs = 15;
+    c->params.tseg2_brs = 4;
+    c->params.sjw_brs  = 4;
+  }
+
+  simInitEnvvars();
+  for (i = 0; i < simChannelCount && simEnvvarBytes; i++) {
+    simChannel[i].envvars = calloc(1, simEnvvarBytes);
+  }
+}
+
+
+//======================================================================
+// Channel enumeration, the simulated channels come after the hardware
+//======================================================================
+int vCanSimChannels (void)
+{
+  pthread_once(&simOnce, simInit);
+  return simChannelCount;
+}
+
+void vCanSimDevParams (HandleData *hData, int index)
+{
+  snprintf(hData->deviceName, DEVICE_NAME_LEN, SIM_DEVICE_PREFIX "%d", index);
+  sprintf(hData->deviceOfficialName, "KVASER Simulated channel %d", index);
+  hData->canOps    = &vCanSimOps;
+  hData->channelNr = index;
+}
+
+static int simIndex (const char *deviceName)
+{
+  int index;
+
+  if (sscanf(deviceName, SIM_DEVICE_PREFIX "%d", &index) != 1 ||
+      index < 0 || index >= vCanSimChannels()) {
+    return -1;
+  }
+  return index;
+}
+
+
+//======================================================================
+// Event queues, lock held
+//======================================================================
+static int simQueueInit (SimQueue *q, unsigned int size)
+{
+  memset(q, 0, sizeof(*q));
+  q->ev = malloc(size * sizeof(VCAN_EVENT));
+  if (q->ev == NULL) {
+    return -1;
+  }
+  q->fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (q->fd < 0) {
+    free(q->ev);
+    return -1;
+  }
+  q->size      = size;
+  q->eventMask = V_RECEIVE_MSG;
+
+  return 0;
+}
+
+static void simQueueSignal (SimQueue *q, int readable)
+{
+  uint64_t value = 1;
+
+  if (readable) {
+    if (write(q->fd, &value, sizeof(value)) < 0) {
+      DEBUGPRINT((TXT("simQueueSignal failed (%d)\n"), errno));
+    }
+  } else if (read(q->fd, &value, sizeof(value)) < 0) {
+    DEBUGPRINT((TXT("simQueueSignal failed (%d)\n"), errno));
+  }
+}
+
+static void simQueuePut (SimQueue *q, const VCAN_EVENT *ev)
+{
+  VCAN_EVENT *slot;
+
+  if (!(q->eventMask & ev->tag)) {
+    return;
+  }
+  if (q->count == q->size) {
+    q->overrun = 1;
+    q->overruns++;
+    return;
+  }
+
+  slot  = &q->ev[(q->head + q->count) % q->size];
+  *slot = *ev;
+  if (q->overrun && ev->tag == V_RECEIVE_MSG) {
+    slot->tagData.msg.flags |= VCAN_MSG_FLAG_OVERRUN;
+    q->overrun = 0;
+  }
+  if (q->count++ == 0 && q->pending == 0) {
+    simQueueSignal(q, 1);
+  }
+}
+
+// Remove event i, the events before it move up one step
+static void simQueueTake (SimQueue *q, unsigned int i, VCAN_EVENT *ev)
+{
+  unsigned int idx = (q->head + i) % q->size;
+  unsigned int prev;
+
+  if (ev) {
+    *ev = q->ev[idx];
+  }
+  for (; i > 0; i--) {
+    prev       = (q->head + i - 1) % q->size;
+    q->ev[idx] = q->ev[prev];
+    idx        = prev;
+  }
+  q->head = (q->head + 1) % q->size;
+  if (--q->count == 0 && q->pending == 0) {
+    simQueueSignal(q, 0);
+  }
+}
+
+static void simQueueFlush (SimQueue *q)
+{
+  if (q->count) {
+    q->count = 0;
+    q->head  = 0;
+    if (q->pending == 0) {
+      simQueueSignal(q, 0);
+    }
+  }
+}
+
+
+//======================================================================
+// Frame timing
+//======================================================================
+typedef struct {
+  unsigned int count;     // Bits so far, without stuff bits
+  unsigned int stuffed;   // Stuff bits so far
+  int          last;
+  int          run;
+  uint16_t     crc;       // CRC-15 of the bits so far
+} SimBits;
+
+static void simBit (SimBits *b, int bit)
+{
+  int crcNext = bit ^ ((b->crc >> 14) & 1);
+
+  b->crc = (b->crc << 1) & 0x7fff;
+  if (crcNext) {
+    b->crc ^= 0x4599;
+  }
+
+  // A bit of the other value is stuffed after five equal ones
+  b->count++;
+  if (bit == b->last) {
+    if (++b->run == 5) {
+      b->stuffed++;
+      b->last = !bit;
+      b->run  = 1;
+    }
+  } else {
+    b->last = bit;
+    b->run  = 1;
+  }
+}
+
+static void simBits (SimBits *b, uint32_t value, int n)
+{
+  while (n--) {
+    simBit(b, (value >> n) & 1);
+  }
+}
+
+// Number of bits in a frame at the nominal and at the data bitrate
+static void simFrameBits (const CAN_MSG *msg, unsigned int *nominal,
+                          unsigned int *fast)
+{
+  SimBits      b   = {0, 0, -1, 0, 0};
+  uint32_t     id  = msg->id & ~EXT_MSG;
+  int          ext = (msg->id & EXT_MSG) != 0;
+  unsigned int len;
+  unsigned int arbitration;
+  unsigned int crcLen;
+  unsigned int i;
+
+  simBit(&b, 0);                               // SOF
+  if (ext) {
+    simBits(&b, id >> 18, 11);
+    simBits(&b, 3, 2);                         // SRR, IDE
+    simBits(&b, id & 0x3ffff, 18);
+  } else {
+    simBits(&b, id, 11);
+  }
+
+  if (msg->flags & VCAN_MSG_FLAG_FDF) {
+    len = dlc_dlc_to_bytes_fd(msg->length);
+    simBit(&b, 0);                             // RRS
+    if (!ext) {
+      simBit(&b, 0);                           // IDE
+    }
+    simBits(&b, 2, 2);                         // FDF, res
+    simBit(&b, (msg->flags & VCAN_MSG_FLAG_BRS) != 0);
+    arbitration = b.count + b.stuffed;
+
+    simBit(&b, 0);                             // ESI
+    simBits(&b, msg->length, 4);
+    for (i = 0; i < len; i++) {
+      simBits(&b, msg->data[i], 8);
+    }
+    // Stuff count and CRC, with fixed stuff bits every fourth bit
+    crcLen = len <= 16 ? 17 : 21;
+    *fast    = b.count + b.stuffed - arbitration + 4 + crcLen + (4 + crcLen + 3) / 4;
+    *nominal = arbitration + SIM_TAIL_BITS;
+    if (!(msg->flags & VCAN_MSG_FLAG_BRS)) {
+      *nominal += *fast;
+      *fast     = 0;
+    }
+    return;
+  }
+
+  len = (msg->flags & VCAN_MSG_FLAG_REMOTE_FRAME) ? 0 :
+        dlc_dlc_to_bytes_classic(msg->length);
+  simBit(&b, (msg->flags & VCAN_MSG_FLAG_REMOTE_FRAME) != 0);
+  simBits(&b, 0, 2);                           // IDE and r0, or r1 and r0
+  simBits(&b, msg->length, 4);
+  for (i = 0; i < len; i++) {
+    simBits(&b, msg->data[i], 8);
+  }
+  simBits(&b, b.crc, 15);
+
+  *nominal = b.count + b.stuffed + SIM_TAIL_BITS;
+  *fast    = 0;
+}
+
+static int64_t simBitsNs (unsigned int bits, long bitrate)
+{
+  return (int64_t)bits * 1000000000 / bitrate;
+}
+
+
+//======================================================================
+// Channel state, lock held
+//======================================================================
+static void simChipState (SimChannel *c, int64_t now)
+{
+  VCAN_EVENT ev;
+  SimHandle  *h;
+
+  memset(&ev, 0, sizeof(ev));
+  ev.tag                             = V_CHIP_STATE;
+  ev.timeStamp                       = simTicks(now);
+  ev.tagData.chipState.busStatus      = c->busStatus;
+  ev.tagData.chipState.txErrorCounter = c->tec > 255 ? 255 : c->tec;
+  ev.tagData.chipState.rxErrorCounter = c->rec > 255 ? 255 : c->rec;
+
+  for (h = c->handles; h != NULL; h = h->next) {
+    simQueuePut(&h->rx, &ev);
+    if (h->notify) {
+      simQueuePut(h->notify, &ev);
+    }
+  }
+}
+
+static void simFlushTx (SimHandle *h)
+{
+  h->txCount = 0;
+  h->txSeq++;
+  pthread_cond_broadcast(&h->txCond);
+}
+
+// Update the bus status from the error counters, report if asked to or
+// if it changed
+static void simUpdateState (SimChannel *c, int64_t now, int report)
+{
+  unsigned char status;
+  SimHandle     *h;
+
+  if (c->busStatus & CHIPSTAT_BUSOFF || c->tec >= SIM_BUSOFF_LIMIT) {
+    status = CHIPSTAT_BUSOFF;
+  } else if (c->tec >= SIM_PASSIVE_LIMIT || c->rec >= SIM_PASSIVE_LIMIT) {
+    status = CHIPSTAT_ERROR_PASSIVE;
+  } else if (c->tec >= SIM_WARNING_LIMIT || c->rec >= SIM_WARNING_LIMIT) {
+    status = CHIPSTAT_ERROR_WARNING;
+  } else {
+    status = CHIPSTAT_ERROR_ACTIVE;
+  }
+
+  if (status != c->busStatus || report) {
+    // The controller drops what it had to send when it goes bus off
+    if (status == CHIPSTAT_BUSOFF && !(c->busStatus & CHIPSTAT_BUSOFF)) {
+      for (h = c->handles; h != NULL; h = h->next) {
+        simFlushTx(h);
+      }
+    }
+    c->busStatus = status;
+    simChipState(c, now);
+  }
+}
+
+static int simActive (const SimChannel *c)
+{
+  return c->onBus && !(c->busStatus & CHIPSTAT_BUSOFF);
+}
+
+static int simBusActive (int bus)
+{
+  int i;
+
+  for (i = 0; i < simChannelCount; i++) {
+    if (simChannel[i].bus == bus && simChannel[i].onBus) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static int simAcceptMsg (const SimHandle *h, const CAN_MSG *msg)
+{
+  uint32_t id = msg->id & ~EXT_MSG;
+
+  if (msg->flags & VCAN_MSG_FLAG_ERROR_FRAME) {
+    return 1;
+  }
+  if (msg->id & EXT_MSG) {
+    return ((id ^ h->filter.extId) & h->filter.extMask) == 0;
+  }
+  return ((id ^ h->filter.stdId) & h->filter.stdMask) == 0;
+}
+
+
+//======================================================================
+// Delivery of events to handles, lock held
+//======================================================================
+static void simMsgEvent (VCAN_EVENT *ev, const CAN_MSG *msg,
+                         unsigned int flags, int64_t time)
+{
+  memset(ev, 0, sizeof(*ev));
+  ev->tag                = V_RECEIVE_MSG;
+  ev->timeStamp          = simTicks(time);
+  ev->tagData.msg.id     = msg->id;
+  ev->tagData.msg.dlc    = msg->length;
+  ev->tagData.msg.flags  = (msg->flags & (VCAN_MSG_FLAG_FDF | VCAN_MSG_FLAG_BRS |
+                                          VCAN_MSG_FLAG_REMOTE_FRAME |
+                                          VCAN_MSG_FLAG_ERROR_FRAME)) | flags;
+  memcpy(ev->tagData.msg.data, msg->data, sizeof(ev->tagData.msg.data));
+}
+
+static void simPut (SimHandle *h, const VCAN_EVENT *ev, int rx, int notify)
+{
+  if (rx && h->onBus) {
+    simQueuePut(&h->rx, ev);
+    pthread_cond_broadcast(&h->rxCond);
+  }
+  if (notify && h->notify) {
+    simQueuePut(h->notify, ev);
+  }
+}
+
+static void simErrorFrame (int bus, int64_t time)
+{
+  VCAN_EVENT ev;
+  CAN_MSG    msg;
+  SimHandle  *h;
+  int        i;
+
+  memset(&msg, 0, sizeof(msg));
+  msg.flags = VCAN_MSG_FLAG_ERROR_FRAME;
+  simMsgEvent(&ev, &msg, 0, time);
+
+  for (i = 0; i < simChannelCount; i++) {
+    if (simChannel[i].bus != bus || !simActive(&simChannel[i])) {
+      continue;
+    }
+    simChannel[i].stats.errFrame++;
+    for (h = simChannel[i].handles; h != NULL; h = h->next) {
+      simPut(h, &ev, 1, 1);
+    }
+  }
+}
+
+// Channels that receive a frame, i.e. are on the bus at the same bitrate
+static int simReceives (const SimChannel *c, const SimChannel *from,
+                        const CAN_MSG *msg)
+{
+  return c != from && simActive(c) &&
+         c->params.freq == from->params.freq &&
+         (!(msg->flags & VCAN_MSG_FLAG_BRS) ||
+          c->params.freq_brs == from->params.freq_brs);
+}
+
+static int simAcked (int bus, const SimChannel *from, const CAN_MSG *msg)
+{
+  int i;
+
+  for (i = 0; i < simChannelCount; i++) {
+    if (simChannel[i].bus == bus && !simChannel[i].silent &&
+        simReceives(&simChannel[i], from, msg)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void simCount (SimChannel *c, const CAN_MSG *msg)
+{
+  if (msg->id & EXT_MSG) {
+    if (msg->flags & VCAN_MSG_FLAG_REMOTE_FRAME) {
+      c->stats.extRemote++;
+    } else {
+      c->stats.extData++;
+    }
+  } else {
+    if (msg->flags & VCAN_MSG_FLAG_REMOTE_FRAME) {
+      c->stats.stdRemote++;
+    } else {
+      c->stats.stdData++;
+    }
+  }
+}
+
+// A frame made it through, hand it to everyone else on the bus
+static void simReceived (int bus, SimChannel *from, SimHandle *sender,
+                         const CAN_MSG *msg, int64_t time)
+{
+  VCAN_EVENT ev;
+  SimHandle  *h;
+  SimChannel *c;
+  int        i;
+
+  simMsgEvent(&ev, msg, 0, time);
+
+  for (i = 0; i < simChannelCount; i++) {
+    c = &simChannel[i];
+    if (c->bus != bus || !simReceives(c, from, msg)) {
+      continue;
+    }
+    if (c->rec > 0) {
+      c->rec--;
+      simUpdateState(c, time, 0);
+    }
+    if (!(msg->flags & VCAN_MSG_FLAG_ERROR_FRAME)) {
+      simCount(c, msg);
+    }
+    for (h = c->handles; h != NULL; h = h->next) {
+      simPut(h, &ev, simAcceptMsg(h, msg), 1);
+    }
+  }
+
+  // Local echo to the other handles on the sending channel
+  if (sender == NULL || sender->txEcho) {
+    for (h = from->handles; h != NULL; h = h->next) {
+      if (h != sender) {
+        simPut(h, &ev, simAcceptMsg(h, msg), 1);
+      }
+    }
+  }
+}
+
+
+//======================================================================
+// The bus, one thread for each bus that has channels on it
+//======================================================================
+static uint32_t simArbitrationKey (const CAN_MSG *msg)
+{
+  uint32_t id  = msg->id & ~EXT_MSG;
+  uint32_t key;
+
+  // Base id first, then SRR/IDE (recessive for extended), then the
+  // extended id; data frames win over remote frames
+  if (msg->id & EXT_MSG) {
+    key = ((id >> 18) << 20) | (1 << 19) | ((id & 0x3ffff) << 1);
+  } else {
+    key = id << 20;
+  }
+  if (msg->flags & VCAN_MSG_FLAG_REMOTE_FRAME) {
+    key |= 1;
+  }
+  return key;
+}
+
+// Pick the frame to send next and when it starts
+static SimHandle *simArbitrate (int bus, int64_t *start)
+{
+  SimHandle  *best = NULL;
+  SimHandle  *h;
+  SimChannel *c;
+  SimTx      *tx;
+  int64_t    first = INT64_MAX;
+  uint32_t   key;
+  uint32_t   bestKey = 0;
+  int        pass;
+  int        i;
+
+  // The first pass finds when the bus is taken, the second which of
+  // the frames waiting by then wins the arbitration
+  for (pass = 0; pass < 2; pass++) {
+    for (i = 0; i < simChannelCount; i++) {
+      c = &simChannel[i];
+      if (c->bus != bus || !simActive(c) || c->silent) {
+        continue;
+      }
+      for (h = c->handles; h != NULL; h = h->next) {
+        if (!h->onBus || !h->txCount) {
+          continue;
+        }
+        tx = &h->tx[h->txHead];
+        if (pass == 0) {
+          if (tx->queuedNs < first) {
+            first = tx->queuedNs;
+          }
+        } else if (tx->queuedNs <= *start) {
+          key = simArbitrationKey(&tx->msg);
+          if (best == NULL || key < bestKey) {
+            best    = h;
+            bestKey = key;
+          }
+        }
+      }
+    }
+    if (first == INT64_MAX) {
+      return NULL;
+    }
+    *start = first > simBus[bus].freeNs ? first : simBus[bus].freeNs;
+  }
+
+  return best;
+}
+
+// A handle closed while simLock was released may have been replaced by a
+// new one at the same address, so the generation is compared as well
+static int simHandleOnChannel (const SimChannel *c, const SimHandle *h,
+                               uint64_t generation)
+{
+  const SimHandle *p;
+
+  for (p = c->handles; p != NULL; p = p->next) {
+    if (p == h) {
+      return p->generation == generation;
+    }
+  }
+  return 0;
+}
+
+// Send the head frame of a handle that won the arbitration
+static void simTransmit (int bus, SimHandle *sender, int64_t start)
+{
+  SimBus       *b = &simBus[bus];
+  SimChannel   *c = &simChannel[sender->channel];
+  CAN_MSG      msg = sender->tx[sender->txHead].msg;
+  unsigned int seq = sender->txSeq;
+  uint64_t     generation = sender->generation;
+  unsigned int nominal;
+  unsigned int fast;
+  int64_t      end;
+  int          result;
+  VCAN_EVENT   ev;
+  struct timespec ts;
+
+  if (msg.flags & VCAN_MSG_FLAG_ERROR_FRAME) {
+    result = SIM_FRAME_ERROR_FRAME;
+    end    = start + simBitsNs(SIM_ERROR_BITS, c->params.freq);
+  } else {
+    simFrameBits(&msg, &nominal, &fast);
+    end = start + simBitsNs(nominal, c->params.freq);
+    if (fast) {
+      end += simBitsNs(fast, c->params.freq_brs);
+    }
+
+    if (c->injectErrors ||
+        (c->errorRate && simRandom() % 1000000 < c->errorRate)) {
+      // Destroyed somewhere in the frame, followed by an error frame
+      result = SIM_FRAME_BIT_ERROR;
+      end    = start + simBitsNs(simRandom() % (nominal + fast) +
+                                 SIM_ERROR_BITS, c->params.freq);
+    } else if (!simAcked(bus, c, &msg)) {
+      // The error frame starts right after the ACK delimiter
+      result = SIM_FRAME_NO_ACK;
+      end   += simBitsNs(SIM_ERROR_BITS - (SIM_TAIL_BITS - 3), c->params.freq);
+    } else {
+      result = SIM_FRAME_OK;
+    }
+    if (result != SIM_FRAME_OK && c->tec >= SIM_PASSIVE_LIMIT) {
+      end += simBitsNs(SIM_SUSPEND_BITS, c->params.freq);
+    }
+  }
+
+  if (sender->txRq) {
+    simMsgEvent(&ev, &msg, VCAN_MSG_FLAG_TX_START, start);
+    simPut(sender, &ev, 1, 0);
+  }
+
+  // Let the frame take its time on the bus
+  ts = simTimespec(end);
+  while (simNowNs() < end) {
+    pthread_cond_timedwait(&b->cond, &simLock, &ts);
+  }
+  b->freeNs  = end;
+  b->busyNs += end - start;
+
+  // The sender may have been closed, flushed or moved while we waited
+  if (!simHandleOnChannel(c, sender, generation) || c->bus != bus) {
+    sender = NULL;
+  }
+
+  switch (result) {
+  case SIM_FRAME_BIT_ERROR:
+  case SIM_FRAME_NO_ACK:
+    simErrorFrame(bus, end);
+    if (sender == NULL || sender->txSeq != seq) {
+      return;   // Given up by the sender, nothing to count
+    }
+    if (c->injectErrors) {
+      c->injectErrors--;
+    }
+    // An error passive transmitter does not count missing ACKs
+    if (result == SIM_FRAME_BIT_ERROR || c->tec < SIM_PASSIVE_LIMIT) {
+      c->tec += 8;
+    }
+    if (result == SIM_FRAME_BIT_ERROR) {
+      int i;
+      for (i = 0; i < simChannelCount; i++) {
+        if (simChannel[i].bus == bus && &simChannel[i] != c &&
+            simActive(&simChannel[i]) && simChannel[i].rec < 255) {
+          simChannel[i].rec++;
+          simUpdateState(&simChannel[i], end, 1);
+        }
+      }
+    }
+    simUpdateState(c, end, 1);
+
+    if (!(msg.flags & VCAN_MSG_FLAG_SINGLE_SHOT)) {
+      return;   // Sent again when it wins the arbitration
+    }
+    break;
+
+  case SIM_FRAME_ERROR_FRAME:
+    simErrorFrame(bus, end);
+    break;
+
+  default:
+    if (c->tec > 0) {
+      c->tec--;
+      simUpdateState(c, end, 0);
+    }
+    simCount(c, &msg);
+    simReceived(bus, c, sender, &msg, end);
+    break;
+  }
+
+  if (sender == NULL) {
+    return;
+  }
+
+  if (sender->txSeq == seq) {
+    sender->txHead = (sender->txHead + 1) % sender->txSize;
+    sender->txSeq++;
+    if (--sender->txCount == 0) {
+      pthread_cond_broadcast(&sender->txCond);
+    }
+  }
+
+  if (result == SIM_FRAME_OK || result == SIM_FRAME_ERROR_FRAME) {
+    simMsgEvent(&ev, &msg, VCAN_MSG_FLAG_TXACK, end);
+  } else {
+    simMsgEvent(&ev, &msg, VCAN_MSG_FLAG_TXACK | VCAN_MSG_FLAG_SSM_NACK, end);
+  }
+  simPut(sender, &ev, sender->txAck, sender->notifyTxAck);
+}
+
+static void *simBusThread (void *arg)
+{
+  int       bus = (int)(intptr_t)arg;
+  SimHandle *h;
+  int64_t   start = 0;
+
+  pthread_mutex_lock(&simLock);
+  while (simBusActive(bus)) {
+    h = simArbitrate(bus, &start);
+    if (h == NULL) {
+      pthread_cond_wait(&simBus[bus].cond, &simLock);
+    } else {
+      simTransmit(bus, h, start);
+    }
+  }
+  simBus[bus].running = 0;
+  pthread_mutex_unlock(&simLock);
+
+  // Nobody waits for the thread
+  pthread_detach(pthread_self());
+
+  return NULL;
+}
+
+// Make sure the thread of a bus runs, lock held
+static canStatus simStartBus (int bus)
+{
+  pthread_t thread;
+
+  if (bus < 0) {
+    return canOK;
+  }
+  if (simBus[bus].running) {
+    pthread_cond_signal(&simBus[bus].cond);
+    return canOK;
+  }
+  if (vCanCreateThread(&thread, simBusThread, (void *)(intptr_t)bus) != 0) {
+    return canERR_NOMEM;
+  }
+  simBus[bus].running = 1;
+
+  return canOK;
+}
+
+
+//======================================================================
+// simOpenChannel
+//======================================================================
+static canStatus simOpenChannel (HandleData *hData)
+{
+  SimHandle  *h;
+  SimChannel *c;
+  int        index = simIndex(hData->deviceName);
+
+  if (index < 0) {
+    return canERR_NOTFOUND;
+  }
+  if (hData->openMode == OPEN_AS_LIN) {
+    return canERR_NOT_SUPPORTED;
+  }
+
+  h = calloc(1, sizeof(SimHandle));
+  if (h == NULL) {
+    return canERR_NOMEM;
+  }
+  h->tx = malloc(simTxQueue * sizeof(SimTx));
+  if (h->tx == NULL || simQueueInit(&h->rx, simRxQueue) != 0) {
+    free(h->tx);
+    free(h);
+    return canERR_NOMEM;
+  }
+  pthread_cond_init(&h->rxCond, &simCondAttr);
+  pthread_cond_init(&h->txCond, &simCondAttr);
+  h->hData   = hData;
+  h->channel = index;
+  h->txEcho  = 1;
+  h->txSize  = simTxQueue;
+
+  pthread_mutex_lock(&simLock);
+  c = &simChannel[index];
+  if (c->exclusive || (hData->wantExclusive && c->handles)) {
+    pthread_mutex_unlock(&simLock);
+    pthread_cond_destroy(&h->rxCond);
+    pthread_cond_destroy(&h->txCond);
+    close(h->rx.fd);
+    free(h->rx.ev);
+    free(h->tx);
+    free(h);
+    return canERR_NOCHANNELS;
+  }
+  c->exclusive   = hData->wantExclusive;
+  h->generation  = ++simGeneration;
+  h->next        = c->handles;
+  c->handles     = h;
+  pthread_mutex_unlock(&simLock);
+
+  hData->sim             = h;
+  hData->fd              = h->rx.fd;
+  hData->capabilities    = SIM_CAPABILITIES;
+  hData->timerScale      = 1.0 / SIM_TIMER_FACTOR;
+  hData->timerResolution = (unsigned int)(10.0 / hData->timerScale);
+
+  return canOK;
+}
+
+
+//======================================================================
+// Remove a simulated handle
+//======================================================================
+static canStatus simCloseChannel (HandleData *hData)
+{
+  SimHandle  *h = hData->sim;
+  SimHandle  **p;
+  SimChannel *c;
+
+  if (h == NULL) {
+    return canERR_INVHANDLE;
+  }
+
+  pthread_mutex_lock(&simLock);
+  c = &simChannel[h->channel];
+  if (h->onBus) {
+    c->onBus--;
+    if (c->bus >= 0) {
+      pthread_cond_signal(&simBus[c->bus].cond);
+    }
+  }
+  for (p = &c->handles; *p != NULL; p = &(*p)->next) {
+    if (*p == h) {
+      *p = h->next;
+      break;
+    }
+  }
+  if (c->handles == NULL) {
+    c->exclusive = 0;
+  }
+  pthread_mutex_unlock(&simLock);
+
+  pthread_cond_destroy(&h->rxCond);
+  pthread_cond_destroy(&h->txCond);
+  free(h->rx.ev);
+  free(h->tx);
+  free(h->envvarChanged);
+  free(h);
+  hData->sim = NULL;
+
+  // The rx eventfd is the handle's fd
+  if (close(hData->fd) != 0) {
+    return canERR_INVHANDLE;
+  }
+
+  return canOK;
+}
+
+
+//======================================================================
+// Notification
+//======================================================================
+static int simNotifyFetch (HandleData *hData, VCAN_EVENT *msg)
+{
+  SimHandle *h = hData->sim;
+  int       ret = -1;
+
+  pthread_mutex_lock(&simLock);
+  if (h && h->notify && h->notify->count) {
+    simQueueTake(h->notify, 0, msg);
+    ret = 0;
+  }
+  pthread_mutex_unlock(&simLock);
+
+  return ret;
+}
+
+// Takes an envvar changed since it was last notified
+static int simNotifyEnvvarFetch (HandleData *hData, uint32_t *id,
+                                 uint64_t *ticks)
+{
+  SimHandle *h = hData->sim;
+  SimQueue  *q;
+  int       ret = -1;
+  int       i;
+
+  pthread_mutex_lock(&simLock);
+  q = h ? h->notify : NULL;
+  if (q && q->pending) {
+    for (i = 0; h->envvarChanged[i] == 0; i++) {
+    }
+    *id    = i;
+    *ticks = simTicks(h->envvarChanged[i]);
+    h->envvarChanged[i] = 0;
+    if (--q->pending == 0 && q->count == 0) {
+      simQueueSignal(q, 0);
+    }
+    ret = 0;
+  }
+  pthread_mutex_unlock(&simLock);
+
+  return ret;
+}
+
+static void simNotifyRead (HandleData *hData)
+{
+  uint32_t id;
+  uint64_t ticks;
+
+  // An envvar written several times is notified once
+  while (simNotifyEnvvarFetch(hData, &id, &ticks) == 0) {
+    vCanNotifyEnvvar(hData, id, ticks);
+  }
+  vCanNotifyEvents(hData, simNotifyFetch);
+}
+
+// Called with the dispatcher locked
+static canStatus simSetNotifyInternal (HandleData *hData,
+                                       void (*callback) (canNotifyData *),
+                                       kvCallback_t callback2,
+                                       kvFrameCallback_t frameCallback,
+                                       unsigned int notifyFlags)
+{
+  SimHandle *h = hData->sim;
+  SimQueue  *q;
+  int64_t   *changed = NULL;
+  canStatus stat;
+
+  if (notifyFlags == 0 ||
+      (callback == NULL && callback2 == NULL && frameCallback == NULL)) {
+    if (h->notify) {
+      vCanNotifyUnregister(hData);
+      pthread_mutex_lock(&simLock);
+      q               = h->notify;
+      h->notify       = NULL;
+      h->notifyEnvvar = 0;
+      if (h->envvarChanged) {
+        memset(h->envvarChanged, 0, simEnvvarCount * sizeof(int64_t));
+      }
+      pthread_mutex_unlock(&simLock);
+      close(q->fd);
+      free(q->ev);
+      free(q);
+      hData->notifyFd = canINVALID_HANDLE;
+    }
+    hData->callback      = NULL;
+    hData->callback2     = NULL;
+    hData->frameCallback = NULL;
+    hData->notifyFlags   = 0;
+    return canOK;
+  }
+
+  q = h->notify;
+  if (q == NULL) {
+    q = malloc(sizeof(SimQueue));
+    if (q == NULL) {
+      return canERR_NOMEM;
+    }
+    if (simQueueInit(q, simRxQueue) != 0) {
+      free(q);
+      return canERR_NOMEM;
+    }
+    q->eventMask = 0;
+    pthread_mutex_lock(&simLock);
+    h->notify = q;
+    pthread_mutex_unlock(&simLock);
+    hData->notifyFd = q->fd;
+  }
+
+  if ((notifyFlags & canNOTIFY_ENVVAR) && simEnvvarCount &&
+      h->envvarChanged == NULL) {
+    changed = calloc(simEnvvarCount, sizeof(int64_t));
+    if (changed == NULL) {
+      return canERR_NOMEM;
+    }
+  }
+
+  hData->notifyFlags = notifyFlags;
+
+  pthread_mutex_lock(&simLock);
+  if (changed) {
+    h->envvarChanged = changed;
+  }
+  h->notifyEnvvar = (notifyFlags & canNOTIFY_ENVVAR) && simEnvvarCount;
+  if (!h->notifyEnvvar && q->pending) {
+    memset(h->envvarChanged, 0, simEnvvarCount * sizeof(int64_t));
+    q->pending = 0;
+    if (q->count == 0) {
+      simQueueSignal(q, 0);
+    }
+  }
+  q->eventMask = 0;
+  if (notifyFlags & (canNOTIFY_RX | canNOTIFY_TX | canNOTIFY_ERROR)) {
+    q->eventMask |= V_RECEIVE_MSG;
+  }
+  if (notifyFlags & canNOTIFY_STATUS) {
+    q->eventMask |= V_CHIP_STATE;
+  }
+  h->notifyTxAck = (notifyFlags & canNOTIFY_TX) != 0;
+  simQueueFlush(&h->rx);
+  pthread_mutex_unlock(&simLock);
+
+  hData->callback      = callback;
+  hData->callback2     = callback2;
+  hData->frameCallback = frameCallback;
+
+  if (hData->notifyEntry == NULL) {
+    stat = vCanNotifyRegister(hData, hData->notifyFd, simNotifyRead);
+    if (stat != canOK) {
+      hData->callback      = NULL;
+      hData->callback2     = NULL;
+      hData->frameCallback = NULL;
+      simSetNotifyInternal(hData, NULL, NULL, NULL, 0);
+      return stat;
+    }
+  }
+
+  return canOK;
+}
+
+static canStatus simSetNotify (HandleData *hData,
+                               void (*callback) (canNotifyData *),
+                               kvCallback_t callback2,
+                               unsigned int notifyFlags)
+{
+  return vCanSetNotifyWith(hData, simSetNotifyInternal, callback, callback2,
+                           NULL, notifyFlags, 0);
+}
+
+static canStatus simSetNotifyFrame (HandleData *hData,
+                                    kvFrameCallback_t callback,
+                                    unsigned int notifyFlags,
+                                    unsigned int maxBatch)
+{
+  return vCanSetNotifyWith(hData, simSetNotifyInternal, NULL, NULL, callback,
+                           notifyFlags, maxBatch);
+}
+
+
+//======================================================================
+// Bus on and off
+//======================================================================
+static canStatus simBusOn (HandleData *hData)
+{
+  SimHandle  *h = hData->sim;
+  SimChannel *c;
+  canStatus  stat;
+
+  pthread_mutex_lock(&simLock);
+  c = &simChannel[h->channel];
+  if (!h->onBus) {
+    h->onBus = 1;
+    c->onBus++;
+  }
+  // Going on bus starts the controller over, as does leaving bus off
+  if (c->busStatus & CHIPSTAT_BUSOFF) {
+    c->tec       = 0;
+    c->rec       = 0;
+    c->busStatus = CHIPSTAT_ERROR_ACTIVE;
+    simChipState(c, simNowNs());
+  }
+  stat = simStartBus(c->bus);
+  if (stat != canOK) {
+    h->onBus = 0;
+    c->onBus--;
+  }
+  pthread_mutex_unlock(&simLock);
+
+  return stat;
+}
+
+static canStatus simBusOff (HandleData *hData)
+{
+  SimHandle  *h = hData->sim;
+  SimChannel *c;
+
+  pthread_mutex_lock(&simLock);
+  c = &simChannel[h->channel];
+  if (h->onBus) {
+    h->onBus = 0;
+    simFlushTx(h);
+    if (--c->onBus == 0) {
+      c->busStatus = CHIPSTAT_BUSOFF;
+      simChipState(c, simNowNs());
+    }
+    if (c->bus >= 0) {
+      pthread_cond_signal(&simBus[c->bus].cond);
+    }
+  }
+  pthread_mutex_unlock(&simLock);
+
+  return canOK;
+}
+
+
+//======================================================================
+// Bus parameters
+//======================================================================
+static canStatus simSetBusParams (HandleData *hData,
+                                  long freq,
+                                  unsigned int tseg1,
+                                  unsigned int tseg2,
+                                  unsigned int sjw,
+                                  unsigned int noSamp,
+                                  long freq_brs,
+                                  unsigned int tseg1_brs,
+                                  unsigned int tseg2_brs,
+                                  unsigned int sjw_brs,
+                                  unsigned int syncmode)
+{
+  VCanBusParams *params;
+
+  (void)syncmode; // Unused.
+
+  if (freq <= 0 || freq > SIM_MAX_BITRATE || freq_brs < 0 ||
+      freq_brs > SIM_MAX_BITRATE) {
+    return canERR_PARAM;
+  }
+
+  pthread_mutex_lock(&simLock);
+  params = &simChannel[hData->sim->channel].params;
+  params->freq      = freq;
+  params->tseg1     = tseg1;
+  params->tseg2     = tseg2;
+  params->sjw       = sjw;
+  params->samp3     = noSamp;
+  if (freq_brs) {
+    params->freq_brs  = freq_brs;
+    params->tseg1_brs = tseg1_brs;
+    params->tseg2_brs = tseg2_brs;
+    params->sjw_brs   = sjw_brs;
+  }
+  pthread_mutex_unlock(&simLock);
+
+  return canOK;
+}
+
+static canStatus simGetBusParams (HandleData *hData,
+                                  long *freq,
+                                  unsigned int *tseg1,
+                                  unsigned int *tseg2,
+                                  unsigned int *sjw,
+                                  unsigned int *noSamp,
+                                  long *freq_brs,
+                                  unsigned int *tseg1_brs,
+                                  unsigned int *tseg2_brs,
+                                  unsigned int *sjw_brs,
+                                  unsigned int *syncmode)
+{
+  VCanBusParams params;
+
+  pthread_mutex_lock(&simLock);
+  params = simChannel[hData->sim->channel].params;
+  pthread_mutex_unlock(&simLock);
+
+  if (freq)      *freq      = params.freq;
+  if (sjw)       *sjw       = params.sjw;
+  if (tseg1)     *tseg1     = params.tseg1;
+  if (tseg2)     *tseg2     = params.tseg2;
+  if (noSamp)    *noSamp    = params.samp3;
+
+  if (freq_brs)  *freq_brs  = params.freq_brs;
+  if (sjw_brs)   *sjw_brs   = params.sjw_brs;
+  if (tseg1_brs) *tseg1_brs = params.tseg1_brs;
+  if (tseg2_brs) *tseg2_brs = params.tseg2_brs;
+
+  if (syncmode)  *syncmode  = 0;
+
+  return canOK;
+}
+
+static canStatus simSetBusOutputControl (HandleData *hData,
+                                         unsigned int drivertype)
+{
+  int silent;
+
+  switch (drivertype) {
+  case canDRIVER_NORMAL:
+    silent = 0;
+    break;
+  case canDRIVER_SILENT:
+    silent = 1;
+    break;
+  default:
+    return canERR_PARAM;
+  }
+
+  pthread_mutex_lock(&simLock);
+  simChannel[hData->sim->channel].silent = silent;
+  pthread_mutex_unlock(&simLock);
+
+  return canOK;
+}
+
+static canStatus simGetBusOutputControl (HandleData *hData,
+                                         unsigned int *drivertype)
+{
+  pthread_mutex_lock(&simLock);
+  *drivertype = simChannel[hData->sim->channel].silent ? canDRIVER_SILENT :
+                                                         canDRIVER_NORMAL;
+  pthread_mutex_unlock(&simLock);
+
+  return canOK;
+}
+
+
+//======================================================================
+// Bus statistics
+//======================================================================
+static canStatus simReqBusStats (HandleData *hData)
+{
+  SimChannel *c;
+  int64_t    now = simNowNs();
+  int64_t    busy;
+
+  pthread_mutex_lock(&simLock);
+  c = &simChannel[hData->sim->channel];
+  busy = c->bus >= 0 ? simBus[c->bus].busyNs : 0;
+  if (now > c->loadStartNs && c->loadStartNs) {
+    c->stats.busLoad = (busy - c->loadBusyNs) * 10000 / (now - c->loadStartNs);
+    if (c->stats.busLoad > 10000) {
+      c->stats.busLoad = 10000;
+    }
+  }
+  c->loadBusyNs  = busy;
+  c->loadStartNs = now;
+  pthread_mutex_unlock(&simLock);
+
+  return canOK;
+}
+
+static canStatus simGetBusStats (HandleData *hData, canBusStatistics *stat)
+{
+  VCanBusStatistics tstat;
+
+  pthread_mutex_lock(&simLock);
+  tstat          = simChannel[hData->sim->channel].stats;
+  tstat.overruns = hData->sim->rx.overruns;
+  pthread_mutex_unlock(&simLock);
+
+  memset(stat, 0, sizeof(canBusStatistics));
+  stat->stdData   = tstat.stdData;
+  stat->stdRemote = tstat.stdRemote;
+  stat->extData   = tstat.extData;
+  stat->extRemote = tstat.extRemote;
+  stat->errFrame  = tstat.errFrame;
+  stat->busLoad   = tstat.busLoad;
+  stat->overruns  = tstat.overruns;
+
+  return canOK;
+}
+
+
+//======================================================================
+// Reading
+//======================================================================
+enum {
+  SIM_READ,
+  SIM_READ_SPECIFIC,        // Leave the other messages in the queue
+  SIM_READ_SPECIFIC_SKIP,   // Drop the messages before it
+  SIM_READ_SYNC,            // Only wait for a message
+  SIM_READ_SYNC_SPECIFIC,
+};
+
+// Index of the event to read, -1 if there is none, lock held
+static int simFind (SimQueue *q, int mode, long id)
+{
+  VCAN_EVENT   *ev;
+  unsigned int i;
+
+  if (mode == SIM_READ || mode == SIM_READ_SYNC) {
+    return q->count ? 0 : -1;
+  }
+  for (i = 0; i < q->count; i++) {
+    ev = &q->ev[(q->head + i) % q->size];
+    if (ev->tag == V_RECEIVE_MSG &&
+        !(ev->tagData.msg.flags & VCAN_MSG_FLAG_ERROR_FRAME) &&
+        (long)(ev->tagData.msg.id & ~EXT_MSG) == id) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static canStatus simReadInternal (HandleData *hData, int mode, long specific,
+                                  unsigned long timeout, long *id,
+                                  void *msgPtr, unsigned int *dlc,
+                                  unsigned int *flag, unsigned long *time)
+{
+  SimHandle  *h = hData->sim;
+  VCAN_EVENT msg;
+  int64_t    deadline = simDeadline(timeout);
+  int        i;
+
+  pthread_mutex_lock(&simLock);
+  for (;;) {
+    i = simFind(&h->rx, mode, specific);
+    if (i >= 0) {
+      if (mode == SIM_READ_SYNC || mode == SIM_READ_SYNC_SPECIFIC) {
+        pthread_mutex_unlock(&simLock);
+        return canOK;
+      }
+      if (mode == SIM_READ_SPECIFIC_SKIP) {
+        for (; i > 0; i--) {
+          simQueueTake(&h->rx, 0, NULL);
+        }
+      }
+      simQueueTake(&h->rx, i, &msg);
+      pthread_mutex_unlock(&simLock);
+
+      if (vCanReceivedMsg(hData, &msg, id, msgPtr, dlc, flag, time)) {
+        return canOK;
+      }
+      pthread_mutex_lock(&simLock);
+      continue;
+    }
+    if (timeout == 0 || simWait(&h->rxCond, deadline)) {
+      break;
+    }
+  }
+  pthread_mutex_unlock(&simLock);
+
+  if (mode == SIM_READ_SYNC || mode == SIM_READ_SYNC_SPECIFIC) {
+    return canERR_TIMEOUT;
+  }
+  return canERR_NOMSG;
+}
+
+static canStatus simRead (HandleData    *hData,
+                          long          *id,
+                          void          *msgPtr,
+                          unsigned int  *dlc,
+                          unsigned int  *flag,
+                          unsigned long *time)
+{
+  return simReadInternal(hData, SIM_READ, 0, 0, id, msgPtr, dlc, flag, time);
+}
+
+static canStatus simReadWait (HandleData    *hData,
+                              long          *id,
+                              void          *msgPtr,
+                              unsigned int  *dlc,
+                              unsigned int  *flag,
+                              unsigned long *time,
+                              long          timeout)
+{
+  return simReadInternal(hData, SIM_READ, 0, (unsigned long)timeout, id,
+                         msgPtr, dlc, flag, time);
+}
+
+static canStatus simReadSync (HandleData *hData, unsigned long timeout)
+{
+  return simReadInternal(hData, SIM_READ_SYNC, 0, timeout, NULL, NULL, NULL,
+                         NULL, NULL);
+}
+
+static canStatus simReadSpecific (HandleData    *hData,
+                                  long          id,
+                                  void          *msgPtr,
+                                  unsigned int  *dlc,
+                                  unsigned int  *flag,
+                                  unsigned long *time)
+{
+  return simReadInternal(hData, SIM_READ_SPECIFIC, id, 0, NULL, msgPtr, dlc,
+                         flag, time);
+}
+
+static canStatus simReadSpecificSkip (HandleData    *hData,
+                                      long          id,
+                                      void          *msgPtr,
+                                      unsigned int  *dlc,
+                                      unsigned int  *flag,
+                                      unsigned long *time)
+{
+  return simReadInternal(hData, SIM_READ_SPECIFIC_SKIP, id, 0, NULL, msgPtr,
+                         dlc, flag, time);
+}
+
+static canStatus simReadSyncSpecific (HandleData    *hData,
+                                      long          id,
+                                      unsigned long timeout)
+{
+  return simReadInternal(hData, SIM_READ_SYNC_SPECIFIC, id, timeout, NULL,
+                         NULL, NULL, NULL, NULL);
+}
+
+
+//======================================================================
+// Acceptance filters
+//======================================================================
+static canStatus simAccept (HandleData *hData, const long envelope,
+                            const unsigned int flag)
+{
+  VCanMsgFilter *filter = &hData->sim->filter;
+  canStatus     stat = canOK;
+
+  pthread_mutex_lock(&simLock);
+  switch (flag) {
+  case canFILTER_SET_CODE_STD:
+    filter->stdId   = envelope & 0xFFFF;
+    break;
+  case canFILTER_SET_MASK_STD:
+    filter->stdMask = envelope & 0xFFFF;
+    break;
+  case canFILTER_SET_CODE_EXT:
+    filter->extId   = envelope & ((1 << 29) - 1);
+    break;
+  case canFILTER_SET_MASK_EXT:
+    filter->extMask = envelope & ((1 << 29) - 1);
+    break;
+  default:
+    stat = canERR_PARAM;
+  }
+  pthread_mutex_unlock(&simLock);
+
+  return stat;
+}
+
+static canStatus simSetAcceptanceFilter (HandleData *hData,
+                                         unsigned int code,
+                                         unsigned int mask,
+                                         int is_extended)
+{
+  VCanMsgFilter *filter = &hData->sim->filter;
+
+  pthread_mutex_lock(&simLock);
+  if (is_extended) {
+    filter->extId   = code & ((1 << 29) - 1);
+    filter->extMask = mask & ((1 << 29) - 1);
+  } else {
+    filter->stdId   = code & 0xFFFF;
+    filter->stdMask = mask & 0xFFFF;
+  }
+  pthread_mutex_unlock(&simLock);
+
+  return canOK;
+}
+
+
+//======================================================================
+// Writing
+//======================================================================
+static canStatus simWrite (HandleData *hData, long id, void *msgPtr,
+                           unsigned int dlc, unsigned int flag)
+{
+  SimHandle  *h = hData->sim;
+  SimChannel *c;
+  SimTx      *tx;
+  CAN_MSG    msg;
+  canStatus  stat;
+
+  stat = vCanEncodeMsg(hData, id, msgPtr, dlc, flag, &msg);
+  if (stat != canOK) {
+    return stat;
+  }
+
+  pthread_mutex_lock(&simLock);
+  c = &simChannel[h->channel];
+  if (!h->onBus || (c->busStatus & CHIPSTAT_BUSOFF)) {
+    stat = canERR_NOTINITIALIZED;
+  } else if (h->txCount == h->txSize) {
+    stat = canERR_TXBUFOFL;
+  } else {
+    tx           = &h->tx[(h->txHead + h->txCount) % h->txSize];
+    tx->msg      = msg;
+    tx->queuedNs = simNowNs();
+    if (h->txCount++ == 0 && c->bus >= 0) {
+      pthread_cond_signal(&simBus[c->bus].cond);
+    }
+  }
+  pthread_mutex_unlock(&simLock);
+
+  if (stat == canERR_TXBUFOFL) {
+    flightRecEvent(FLIGHTREC_TX_OVERFLOW, 0, hData->handle, (uint32_t)id, 0);
+  }
+
+  return stat;
+}
+
+static canStatus simWriteSync (HandleData *hData, unsigned long timeout)
+{
+  SimHandle *h = hData->sim;
+  int64_t   deadline = simDeadline(timeout);
+  canStatus stat = canOK;
+
+  pthread_mutex_lock(&simLock);
+  while (h->txCount) {
+    if (timeout == 0 || simWait(&h->txCond, deadline)) {
+      stat = canERR_TIMEOUT;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&simLock);
+
+  return stat;
+}
+
+static canStatus simWriteWait (HandleData *hData, long id, void *msgPtr,
+                               unsigned int dlc, unsigned int flag,
+                               long timeout)
+{
+  canStatus stat;
+
+  stat = simWrite(hData, id, msgPtr, dlc, flag);
+  if (stat != canOK) {
+    return stat;
+  }
+
+  return simWriteSync(hData, (unsigned long)timeout);
+}
+
+
+//======================================================================
+// Timers
+//======================================================================
+static canStatus simReadTimerRaw (HandleData *hData, uint64_t *time)
+{
+  (void)hData;
+
+  *time = (uint64_t)(simNowNs() - simStartNs) / 1000;
+
+  return canOK;
+}
+
+static canStatus simReadTimer64 (HandleData *hData, uint64_t *time)
+{
+  if (!time) {
+    return canERR_PARAM;
+  }
+  *time = vCanTimestamp(hData, simTicks(simNowNs()));
+
+  return canOK;
+}
+
+static canStatus simReadTimer32 (HandleData *hData, unsigned int *time)
+{
+  uint64_t tmpTime;
+
+  if (!time) {
+    return canERR_PARAM;
+  }
+  simReadTimer64(hData, &tmpTime);
+  *time = (unsigned int)tmpTime;
+
+  return canOK;
+}
+
+static canStatus simReadTimer (HandleData *hData, unsigned long *time)
+{
+  uint64_t tmpTime;
+
+  if (!time) {
+    return canERR_PARAM;
+  }
+  simReadTimer64(hData, &tmpTime);
+  *time = (unsigned long)tmpTime;
+
+  return canOK;
+}
+
+
+//======================================================================
+// Status
+//======================================================================
+static canStatus simReadErrorCounters (HandleData *hData, unsigned int *txErr,
+                                       unsigned int *rxErr, unsigned int *ovErr)
+{
+  SimChannel *c;
+
+  pthread_mutex_lock(&simLock);
+  c = &simChannel[hData->sim->channel];
+  if (txErr) *txErr = c->tec > 255 ? 255 : c->tec;
+  if (rxErr) *rxErr = c->rec;
+  if (ovErr) *ovErr = hData->sim->rx.overruns != 0;
+  pthread_mutex_unlock(&simLock);
+
+  return canOK;
+}
+
+static canStatus simReadStatus (HandleData *hData, unsigned long *flags)
+{
+  SimHandle  *h = hData->sim;
+  SimChannel *c;
+
+  if (flags == NULL) {
+    return canERR_PARAM;
+  }
+
+  pthread_mutex_lock(&simLock);
+  c = &simChannel[h->channel];
+  if (c->busStatus & CHIPSTAT_BUSOFF) {
+    *flags = canSTAT_BUS_OFF;
+  } else if (c->busStatus & CHIPSTAT_ERROR_PASSIVE) {
+    *flags = canSTAT_ERROR_PASSIVE;
+  } else if (c->busStatus & CHIPSTAT_ERROR_WARNING) {
+    *flags = canSTAT_ERROR_WARNING;
+  } else {
+    *flags = canSTAT_ERROR_ACTIVE;
+  }
+  if (c->tec)          *flags |= canSTAT_TXERR;
+  if (c->rec)          *flags |= canSTAT_RXERR;
+  if (h->rx.overruns)  *flags |= canSTAT_SW_OVERRUN;
+  if (h->rx.count)     *flags |= canSTAT_RX_PENDING;
+  if (h->txCount)      *flags |= canSTAT_TX_PENDING;
+  pthread_mutex_unlock(&simLock);
+
+  return canOK;
+}
+
+static canStatus simFlashLeds (HandleData *hData, int action, int timeout)
+{
+  (void)hData;
+  (void)action;
+  (void)timeout;
+
+  return canOK;
+}
+
+static canStatus simRequestChipStatus (HandleData *hData)
+{
+  pthread_mutex_lock(&simLock);
+  simChipState(&simChannel[hData->sim->channel], simNowNs());
+  pthread_mutex_unlock(&simLock);
+
+  return canOK;
+}
+
+
+//======================================================================
+// simGetChannelData
+//======================================================================
+static canStatus simGetChannelData (char *deviceName, int item,
+                                    void *buffer, size_t bufsize)
+{
+  int index = simIndex(deviceName);
+
+  if (index < 0) {
+    return canERR_NOTFOUND;
+  }
+  if (buffer == NULL) {
+    return canERR_PARAM;
+  }
+
+  switch (item) {
+  case canCHANNELDATA_CARD_NUMBER:
+  case canCHANNELDATA_TRANS_TYPE:
+  case canCHANNELDATA_IS_REMOTE:
+    if (bufsize < sizeof(uint32_t)) {
+      return canERR_PARAM;
+    }
+    *(uint32_t *)buffer = 0;
+    break;
+
+  case canCHANNELDATA_CARD_SERIAL_NO:
+  case canCHANNELDATA_CARD_UPC_NO:
+  case canCHANNELDATA_CARD_FIRMWARE_REV:
+  case canCHANNELDATA_CARD_HARDWARE_REV:
+    memset(buffer, 0, bufsize);
+    break;
+
+  case canCHANNELDATA_DRIVER_NAME:
+    if (bufsize == 0) {
+      return canERR_PARAM;
+    }
+    snprintf(buffer, bufsize, "kvsim");
+    break;
+
+  case canCHANNELDATA_CHANNEL_CAP:
+  case canCHANNELDATA_CHANNEL_CAP_MASK:
+    if (bufsize < sizeof(uint32_t)) {
+      return canERR_PARAM;
+    }
+    *(uint32_t *)buffer = SIM_CANLIB_CAPABILITIES;
+    break;
+
+  case canCHANNELDATA_CARD_TYPE:
+    if (bufsize < sizeof(uint32_t)) {
+      return canERR_PARAM;
+    }
+    *(uint32_t *)buffer = canHWTYPE_VIRTUAL;
+    break;
+
+  case canCHANNELDATA_MAX_BITRATE:
+    if (bufsize < sizeof(uint32_t)) {
+      return canERR_PARAM;
+    }
+    *(uint32_t *)buffer = SIM_MAX_BITRATE;
+    break;
+
+  case canCHANNELDATA_CUST_CHANNEL_NAME:
+  case canCHANNELDATA_FEATURE_EAN:
+  case canCHANNELDATA_HW_STATUS:
+  case canCHANNELDATA_LOGGER_TYPE:
+  case canCHANNELDATA_REMOTE_TYPE:
+    return canERR_NOT_IMPLEMENTED;
+
+  default:
+    return canERR_PARAM;
+  }
+
+  return canOK;
+}
+
+
+//======================================================================
+// simIoCtl
+//======================================================================
+static int simCheckArg (void *buf, size_t buflen, size_t size)
+{
+  return buf == NULL || buflen < size;
+}
+
+static canStatus simIoCtl (HandleData *hData, unsigned int func,
+                           void *buf, size_t buflen)
+{
+  SimHandle  *h = hData->sim;
+  SimChannel *c = &simChannel[h->channel];
+  canStatus  stat = canOK;
+  uint32_t   value = 0;
+  VCAN_EVENT *ev;
+
+  switch (func) {
+  case canIOCTL_GET_TIMER_SCALE:
+  case canIOCTL_FLUSH_RX_BUFFER:
+  case canIOCTL_FLUSH_TX_BUFFER:
+  case canIOCTL_RESET_OVERRUN_COUNT:
+  case canIOCTL_GET_RX_BUFFER_LEVEL:
+  case canIOCTL_GET_TX_BUFFER_LEVEL:
+  case canIOCTL_GET_TXACK:
+    break;
+
+  case canIOCTL_SET_LOCAL_TXECHO:
+    if (simCheckArg(buf, buflen, sizeof(uint8_t))) {
+      return canERR_PARAM;
+    }
+    value = *(uint8_t *)buf;
+    break;
+
+  default:
+    if (simCheckArg(buf, buflen, sizeof(uint32_t))) {
+      return canERR_PARAM;
+    }
+    value = *(uint32_t *)buf;
+    break;
+  }
+
+  pthread_mutex_lock(&simLock);
+  switch (func) {
+  case canIOCTL_GET_RX_BUFFER_LEVEL:
+    if (simCheckArg(buf, buflen, sizeof(uint32_t))) {
+      stat = canERR_PARAM;
+    } else {
+      *(uint32_t *)buf = h->rx.count;
+    }
+    break;
+
+  case canIOCTL_GET_TX_BUFFER_LEVEL:
+    if (simCheckArg(buf, buflen, sizeof(uint32_t))) {
+      stat = canERR_PARAM;
+    } else {
+      *(uint32_t *)buf = h->txCount;
+    }
+    break;
+
+  case canIOCTL_FLUSH_RX_BUFFER:
+    simQueueFlush(&h->rx);
+    break;
+
+  case canIOCTL_FLUSH_TX_BUFFER:
+    simFlushTx(h);
+    break;
+
+  case canIOCTL_SET_TXACK:
+    h->txAck = value != 0;
+    break;
+
+  case canIOCTL_GET_TXACK:
+    if (simCheckArg(buf, buflen, sizeof(uint32_t))) {
+      stat = canERR_PARAM;
+    } else {
+      *(uint32_t *)buf = h->txAck;
+    }
+    break;
+
+  case canIOCTL_SET_TXRQ:
+    h->txRq = value != 0;
+    break;
+
+  case canIOCTL_SET_LOCAL_TXECHO:
+    h->txEcho = value != 0;
+    break;
+
+  case canIOCTL_RESET_OVERRUN_COUNT:
+    h->rx.overruns = 0;
+    h->rx.overrun  = 0;
+    break;
+
+  case canIOCTL_SET_TIMER_SCALE:
+    // The resolution in microseconds, in 10 us ticks as for VCAN
+    if (value == 0) {
+      value = SIM_TIMER_FACTOR * 10;
+    }
+    hData->timerScale      = 10.0 / value;
+    hData->timerResolution = value;
+    break;
+
+  case canIOCTL_GET_TIMER_SCALE:
+    if (simCheckArg(buf, buflen, sizeof(uint32_t))) {
+      stat = canERR_PARAM;
+    } else {
+      *(uint32_t *)buf = hData->timerResolution;
+    }
+    break;
+
+  case canIOCTL_SET_RX_QUEUE_SIZE:
+    if (h->onBus) {
+      stat = canERR_NOT_SUPPORTED;
+    } else if (value == 0 || value > SIM_MAX_QUEUE) {
+      stat = canERR_PARAM;
+    } else if ((ev = malloc(value * sizeof(VCAN_EVENT))) == NULL) {
+      stat = canERR_NOMEM;
+    } else {
+      simQueueFlush(&h->rx);
+      free(h->rx.ev);
+      h->rx.ev   = ev;
+      h->rx.size = value;
+    }
+    break;
+
+  case canIOCTL_CONNECT_TO_VIRTUAL_BUS:
+    if (value >= SIM_MAX_BUSES) {
+      stat = canERR_PARAM;
+    } else if ((int)value != c->bus) {
+      if (c->bus >= 0) {
+        pthread_cond_signal(&simBus[c->bus].cond);
+      }
+      c->bus = value;
+      if (c->onBus) {
+        stat = simStartBus(c->bus);
+      }
+    }
+    break;
+
+  case canIOCTL_DISCONNECT_FROM_VIRTUAL_BUS:
+    if (value >= SIM_MAX_BUSES) {
+      stat = canERR_PARAM;
+    } else if ((int)value == c->bus) {
+      pthread_cond_signal(&simBus[c->bus].cond);
+      c->bus = -1;
+    }
+    break;
+
+  case canIOCTL_SIM_SET_ERROR_RATE:
+    if (value > 1000000) {
+      stat = canERR_PARAM;
+    } else {
+      c->errorRate = value;
+    }
+    break;
+
+  case canIOCTL_SIM_INJECT_ERRORS:
+    c->injectErrors = value;
+    break;
+
+  default:
+    stat = canERR_PARAM;
+    break;
+  }
+  pthread_mutex_unlock(&simLock);
+
+  return stat;
+}
+
+
+//======================================================================
+// Features a simulated channel does not have
+//======================================================================
+static canStatus simSetDeviceMode (HandleData *hData, int mode)
+{
+  (void)hData;
+  (void)mode;
+  return canERR_NOT_SUPPORTED;
+}
+
+static canStatus simGetDeviceMode (HandleData *hData, int *mode)
+{
+  (void)hData;
+  (void)mode;
+  return canERR_NOT_SUPPORTED;
+}
+
+static canStatus simFileGetCount (HandleData *hData, int *count)
+{
+  (void)hData;
+  (void)count;
+  return canERR_NOT_SUPPORTED;
+}
+
+static canStatus simFileGetName (HandleData *hData, int fileNo, char *name,
+                                 int namelen)
+{
+  (void)hData;
+  (void)fileNo;
+  (void)name;
+  (void)namelen;
+  return canERR_NOT_SUPPORTED;
+}
+
+static canStatus simFileDelete (HandleData *hData, char *deviceFileName)
+{
+  (void)hData;
+  (void)deviceFileName;
+  return canERR_NOT_SUPPORTED;
+}
+
+static canStatus simFileCopy (HandleData *hData, char *from, char *to,
+                              unsigned int flags, uint32_t *crc)
+{
+  (void)hData;
+  (void)from;
+  (void)to;
+  (void)flags;
+  (void)crc;
+  return canERR_NOT_SUPPORTED;
+}
+
+static canStatus simFileReadStream (HandleData *hData, char *deviceFileName,
+                                    kvFileReadCallback callback, void *context)
+{
+  (void)hData;
+  (void)deviceFileName;
+  (void)callback;
+  (void)context;
+  return canERR_NOT_SUPPORTED;
+}
+
+static canStatus simFileWriteStream (HandleData *hData, char *deviceFileName,
+                                     kvFileWriteCallback callback,
+                                     void *context, uint64_t size)
+{
+  (void)hData;
+  (void)deviceFileName;
+  (void)callback;
+  (void)context;
+  (void)size;
+  return canERR_NOT_SUPPORTED;
+}
+
+static canStatus simScriptSlot (HandleData *hData, int slotNo)
+{
+  (void)hData;
+  (void)slotNo;
+  return canERR_NOT_SUPPORTED;
+}
+
+static canStatus simScriptStop (HandleData *hData, int slotNo, int mode)
+{
+  (void)hData;
+  (void)slotNo;
+  (void)mode;
+  return canERR_NOT_SUPPORTED;
+}
+
+static canStatus simScriptLoadFile (HandleData *hData, int slotNo,
+                                    char *hostFileName)
+{
+  (void)hData;
+  (void)slotNo;
+  (void)hostFileName;
+  return canERR_NOT_SUPPORTED;
+}
+
+static canStatus simScriptLoadBuffer (HandleData *hData, int slotNo,
+                                      const void *buf, unsigned int len)
+{
+  (void)hData;
+  (void)slotNo;
+  (void)buf;
+  (void)len;
+  return canERR_NOT_SUPPORTED;
+}
+
+static canStatus simEnvvarInfo (HandleData *hData, const char *name,
+                                uint32_t *id, int *type, int *size)
+{
+  int i;
+
+  if (simChannel[hData->channelNr].envvars == NULL) {
+    return canERR_NOTFOUND;
+  }
+  for (i = 0; i < simEnvvarCount; i++) {
+    if (!strcmp(simEnvvar[i].name, name)) {
+      *id   = i;
+      *type = simEnvvar[i].type;
+      *size = simEnvvar[i].size;
+      return canOK;
+    }
+  }
+
+  return canERR_NOTFOUND;
+}
+
+// A write is seen by the other handles on the channel, as a change made
+// by a t-script would be. Lock held.
+static void simEnvvarChanged (SimChannel *c, SimHandle *writer, uint32_t id)
+{
+  SimHandle *h;
+
+  for (h = c->handles; h != NULL; h = h->next) {
+    if (h == writer || !h->notifyEnvvar || h->envvarChanged[id]) {
+      continue;
+    }
+    h->envvarChanged[id] = simNowNs();
+    if (h->notify->pending++ == 0 && h->notify->count == 0) {
+      simQueueSignal(h->notify, 1);
+    }
+  }
+}
+
+static canStatus simEnvvarTransfer (HandleData *hData, int set,
+                                    EnvvarXfer *xfer, int count)
+{
+  SimChannel    *c = &simChannel[hData->channelNr];
+  unsigned char *value;
+  int           i;
+
+  for (i = 0; i < count; i++) {
+    if (xfer[i].id >= (uint32_t)simEnvvarCount ||
+        xfer[i].start + xfer[i].len > simEnvvar[xfer[i].id].size ||
+        c->envvars == NULL) {
+      return canERR_PARAM;
+    }
+  }
+
+  pthread_mutex_lock(&simLock);
+  for (i = 0; i < count; i++) {
+    value = c->envvars + simEnvvar[xfer[i].id].offset + xfer[i].start;
+    if (set) {
+      memcpy(value, xfer[i].data, xfer[i].len);
+      simEnvvarChanged(c, hData->sim, xfer[i].id);
+    } else {
+      memcpy(xfer[i].data, value, xfer[i].len);
+    }
+  }
+  pthread_mutex_unlock(&simLock);
+
+  return canOK;
+}
+
+//======================================================================
+// Object buffers are the software ones, the frame is checked as by the
+// driver backend
+//======================================================================
+static canStatus simObjbufWrite (HandleData *hData, int idx, int id, void *msg,
+                                 unsigned int dlc, unsigned int flags)
+{
+  canStatus stat = vCanObjbufCheck(hData, dlc, flags);
+
+  if (stat != canOK) {
+    return stat;
+  }
+  if (!(flags & canFDMSG_FDF) && dlc > 15) {
+    dlc = 15;
+  }
+
+  return swObjBufWrite(hData, idx, id, msg, dlc, flags);
+}
+
+static canStatus simGetCardInfo (HandleData *hData, VCAN_IOCTL_CARD_INFO *ci)
+{
+  (void)hData;
+  (void)ci;
+  return canERR_NOT_SUPPORTED;
+}
+
+static canStatus simGetCardInfo2 (HandleData *hData, KCAN_IOCTL_CARD_INFO_2 *ci)
+{
+  (void)hData;
+  (void)ci;
+  return canERR_NOT_SUPPORTED;
+}
+
+
+CANOps vCanSimOps = {
+  .openChannel          = simOpenChannel,
+  .closeChannel         = simCloseChannel,
+  .setNotify            = simSetNotify,
+  .setNotifyFrame       = simSetNotifyFrame,
+  .busOn                = simBusOn,
+  .busOff               = simBusOff,
+  .setBusParams         = simSetBusParams,
+  .getBusParams         = simGetBusParams,
+  .reqBusStats          = simReqBusStats,
+  .getBusStats          = simGetBusStats,
+  .read                 = simRead,
+  .readSync             = simReadSync,
+  .readWait             = simReadWait,
+  .readSpecific         = simReadSpecific,
+  .readSpecificSkip     = simReadSpecificSkip,
+  .readSyncSpecific     = simReadSyncSpecific,
+  .setBusOutputControl  = simSetBusOutputControl,
+  .getBusOutputControl  = simGetBusOutputControl,
+  .kvDeviceSetMode      = simSetDeviceMode,
+  .kvDeviceGetMode      = simGetDeviceMode,
+  .kvFileGetCount       = simFileGetCount,
+  .kvFileGetName        = simFileGetName,
+  .kvFileDelete         = simFileDelete,
+  .kvFileCopyToDevice   = simFileCopy,
+  .kvFileCopyFromDevice = simFileCopy,
+  .kvFileReadStream     = simFileReadStream,
+  .kvFileWriteStream    = simFileWriteStream,
+  .kvScriptStart        = simScriptSlot,
+  .kvScriptStop         = simScriptStop,
+  .kvScriptLoadFile     = simScriptLoadFile,
+  .kvScriptLoadBuffer   = simScriptLoadBuffer,
+  .kvScriptUnload       = simScriptSlot,
+  .envvarInfo           = simEnvvarInfo,
+  .envvarTransfer       = simEnvvarTransfer,
+  .accept               = simAccept,
+  .setAcceptanceFilter  = simSetAcceptanceFilter,
+  .write                = simWrite,
+  .writeWait            = simWriteWait,
+  .writeSync            = simWriteSync,
+  .readTimer            = simReadTimer,
+  .kvReadTimer          = simReadTimer32,
+  .kvReadTimer64        = simReadTimer64,
+  .kvReadTimerRaw       = simReadTimerRaw,
+  .readErrorCounters    = simReadErrorCounters,
+  .readStatus           = simReadStatus,
+  .kvFlashLeds          = simFlashLeds,
+  .requestChipStatus    = simRequestChipStatus,
+  .getChannelData       = simGetChannelData,
+  .ioCtl                = simIoCtl,
+  .objbufFreeAll        = swObjBufFreeAll,
+  .objbufAllocate       = swObjBufAllocate,
+  .objbufFree           = swObjBufFree,
+  .objbufWrite          = simObjbufWrite,
+  .objbufSetFilter      = swObjBufSetFilter,
+  .objbufSetFlags       = swObjBufSetFlags,
+  .objbufSetPeriod      = swObjBufSetPeriod,
+  .objbufSetMsgCount    = swObjBufSetMsgCount,
+  .objbufSendBurst      = swObjBufSendBurst,
+  .objbufEnable         = swObjBufEnable,
+  .objbufDisable        = swObjBufDisable,
+  .getCardInfo          = simGetCardInfo,
+  .getCardInfo2         = simGetCardInfo2,
+};
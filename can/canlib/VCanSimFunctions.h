@@ -0,0 +1,82 @@
+/*
+**             Copyright 2017 by Kvaser AB, Molndal, Sweden
+**                        http://www.kvaser.com
+**
+** This software is dual licensed under the following two licenses:
+** BSD-new and GPLv2. You may use either one. See the included
+** COPYING file for details.
+**
+** License: BSD-new
+** ===============================================================================
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of the <organization> nor the
+**       names of its contributors may be used to endorse or promote products
+**       derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+** DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+** DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+** (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+** LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+** ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**
+**
+** License: GPLv2
+** ===============================================================================
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+** ---------------------------------------------------------------------------
+**/
+
+/*  Kvaser Linux Canlib simulated channels
+ *
+ *  A CAN bus simulated in the process, for running canlib without a
+ *  driver or hardware. The channels are turned on with the environment
+ *  variable KVASER_CANLIB_SIM and are numbered after the hardware
+ *  channels. All simulated channels start out connected to the same bus;
+ *  canIOCTL_CONNECT_TO_VIRTUAL_BUS moves a channel to another one.
+ *
+ *  Frames take the time they would take on a real bus at the channel's
+ *  bitrate, bit stuffing included, and the frames waiting to be sent on
+ *  a bus are arbitrated by identifier. The channels keep CAN error
+ *  counters and go error passive and bus off as a real controller would.
+ *
+ *  Script envvars, declared with KVASER_CANLIB_SIM_ENVVARS, are kept per
+ *  channel.
+ */
+
+#ifndef VCANSIMFUNCTIONS_H
+#define VCANSIMFUNCTIONS_H
+
+#include "canlib_data.h"
+
+#define SIM_DEVICE_PREFIX  "sim"
+
+extern CANOps vCanSimOps;
+
+int vCanSimChannels (void);
+void vCanSimDevParams (HandleData *hData, int index);
+
+#endif  /* VCANSIMFUNCTIONS_H */
@@ -0,0 +1,500 @@
+/*
+**             Copyright 2017 by Kvaser AB, Molndal, Sweden
+**                        http://www.kvaser.com
+**
+** This software is dual licensed under the following two licenses:
+** BSD-new and GPLv2. You may use either one. See the included
+** COPYING file for details.
+**
+** License: BSD-new
+** ===============================================================================
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of the <organization> nor the
+**       names of its contributors may be used to endorse or promote products
+**       derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+** DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+** DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+** (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+** LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+** ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**
+**
+** License: GPLv2
+** ===============================================================================
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+** ---------------------------------------------------------------------------
+**/
+
+/*  Kvaser Linux Canlib API statistics */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "apistats.h"
+
+
+// Set to turn statistics on when the library is initialized
+#define APISTATS_ENV "KVASER_CANLIB_STATS"
+
+// Log-linear histogram of latencies in ns: 2^HIST_SUB_BITS buckets per
+// power of two, i.e. within 12.5%, up to 2^HIST_MAX_EXP ns.
+#define HIST_SUB_BITS  3
+#define HIST_SUB       (1 << HIST_SUB_BITS)
+#define HIST_MAX_EXP   40
+#define HIST_BUCKETS   (HIST_SUB + (HIST_MAX_EXP - HIST_SUB_BITS + 1) * HIST_SUB)
+
+// The last counter is for all driver calls
+#define IOCTL_COUNTER  APISTATS_COUNT
+
+typedef struct {
+  uint64_t calls;
+  uint64_t ioctls;
+  uint64_t totalNs;
+  uint64_t driverNs;
+  uint64_t maxNs;
+  uint32_t hist[HIST_BUCKETS];
+} ApiCounter;
+
+typedef struct ApiStatsShard {
+  struct ApiStatsShard *next;
+  ApiCounter           counter[APISTATS_COUNT + 1];
+} ApiStatsShard;
+
+static const char *apiNames[APISTATS_COUNT + 1] = {
+#define APISTATS_NAME(name) #name,
+  APISTATS_LIST(APISTATS_NAME)
+#undef APISTATS_NAME
+  "ioctl"
+};
+
+int apiStatsEnabled = 0;
+static int dumpOnUnload = 0;
+
+static pthread_mutex_t shardMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t   shardKey;
+static int             shardKeyValid = 0; // Deleted by apiStatsUnload
+static ApiStatsShard   *shards   = NULL;  // Shards of live threads
+static ApiStatsShard   retired;           // Sum of exited threads
+static ApiStatsShard   baseline;          // Subtracted on read, set by reset
+
+static __thread ApiStatsShard *threadShard = NULL;
+static __thread ApiStatsScope *threadScope = NULL;
+
+
+static int64_t nowNs (void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static unsigned int bucketOf (uint64_t ns)
+{
+  int e;
+
+  if (ns < HIST_SUB) {
+    return (unsigned int)ns;
+  }
+  e = 63 - __builtin_clzll(ns);
+  if (e > HIST_MAX_EXP) {
+    return HIST_BUCKETS - 1;
+  }
+
+  return HIST_SUB + (e - HIST_SUB_BITS) * HIST_SUB +
+         ((ns >> (e - HIST_SUB_BITS)) & (HIST_SUB - 1));
+}
+
+// Middle of a bucket, in ns
+static uint64_t bucketValue (unsigned int bucket)
+{
+  unsigned int e, m;
+
+  if (bucket < HIST_SUB) {
+    return bucket;
+  }
+  e = (bucket - HIST_SUB) / HIST_SUB + HIST_SUB_BITS;
+  m = (bucket - HIST_SUB) % HIST_SUB;
+
+  return ((uint64_t)(HIST_SUB + m) << (e - HIST_SUB_BITS)) +
+         ((1ULL << (e - HIST_SUB_BITS)) >> 1);
+}
+
+// Only the owning thread writes a shard; relaxed accesses keep the
+// concurrent reads well defined without making the writes atomic RMW.
+static inline void add64 (uint64_t *p, uint64_t v)
+{
+  __atomic_store_n(p, __atomic_load_n(p, __ATOMIC_RELAXED) + v, __ATOMIC_RELAXED);
+}
+
+static inline void add32 (uint32_t *p)
+{
+  __atomic_store_n(p, __atomic_load_n(p, __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+}
+
+static void record (ApiCounter *c, uint64_t ns, uint64_t ioctls, uint64_t driverNs)
+{
+  add64(&c->calls, 1);
+  add64(&c->ioctls, ioctls);
+  add64(&c->totalNs, ns);
+  add64(&c->driverNs, driverNs);
+  if (ns > __atomic_load_n(&c->maxNs, __ATOMIC_RELAXED)) {
+    __atomic_store_n(&c->maxNs, ns, __ATOMIC_RELAXED);
+  }
+  add32(&c->hist[bucketOf(ns)]);
+}
+
+static void sumShard (ApiStatsShard *dst, ApiStatsShard *src)
+{
+  unsigned int i, b;
+
+  for (i = 0; i <= APISTATS_COUNT; i++) {
+    ApiCounter *d = &dst->counter[i];
+    ApiCounter *s = &src->counter[i];
+    uint64_t   max = __atomic_load_n(&s->maxNs, __ATOMIC_RELAXED);
+
+    d->calls    += __atomic_load_n(&s->calls, __ATOMIC_RELAXED);
+    d->ioctls   += __atomic_load_n(&s->ioctls, __ATOMIC_RELAXED);
+    d->totalNs  += __atomic_load_n(&s->totalNs, __ATOMIC_RELAXED);
+    d->driverNs += __atomic_load_n(&s->driverNs, __ATOMIC_RELAXED);
+    if (max > d->maxNs) {
+      d->maxNs = max;
+    }
+    for (b = 0; b < HIST_BUCKETS; b++) {
+      d->hist[b] += __atomic_load_n(&s->hist[b], __ATOMIC_RELAXED);
+    }
+  }
+}
+
+// The max cannot be subtracted like the sums, so a reset starts it over
+static void clearMax (ApiStatsShard *shard)
+{
+  unsigned int i;
+
+  for (i = 0; i <= APISTATS_COUNT; i++) {
+    __atomic_store_n(&shard->counter[i].maxNs, 0, __ATOMIC_RELAXED);
+  }
+}
+
+//======================================================================
+// Fold the shard of an exiting thread into the retired sums
+//======================================================================
+static void shardDestructor (void *arg)
+{
+  ApiStatsShard *shard = (ApiStatsShard *)arg;
+  ApiStatsShard **p;
+
+  pthread_mutex_lock(&shardMutex);
+  for (p = &shards; *p != NULL; p = &(*p)->next) {
+    if (*p == shard) {
+      *p = shard->next;
+      break;
+    }
+  }
+  sumShard(&retired, shard);
+  pthread_mutex_unlock(&shardMutex);
+
+  free(shard);
+}
+
+static ApiStatsShard *getShard (void)
+{
+  ApiStatsShard *shard = threadShard;
+
+  if (shard != NULL) {
+    return shard;
+  }
+
+  shard = calloc(1, sizeof(ApiStatsShard));
+  if (shard == NULL) {
+    return NULL;
+  }
+
+  pthread_mutex_lock(&shardMutex);
+  if (!shardKeyValid) {
+    shardKeyValid = (pthread_key_create(&shardKey, shardDestructor) == 0);
+  }
+  if (shardKeyValid) {
+    pthread_setspecific(shardKey, shard);
+  }
+  shard->next = shards;
+  shards      = shard;
+  pthread_mutex_unlock(&shardMutex);
+
+  threadShard = shard;
+
+  return shard;
+}
+
+//======================================================================
+// apiStatsInit, turns statistics on if asked for in the environment
+//======================================================================
+void apiStatsInit (void)
+{
+  const char *env = getenv(APISTATS_ENV);
+
+  if (env && *env && strcmp(env, "0") != 0) {
+    apiStatsEnabled = 1;
+    dumpOnUnload    = 1;
+  }
+}
+
+//======================================================================
+// apiStatsEnable
+//======================================================================
+canStatus apiStatsEnable (int enable)
+{
+  apiStatsEnabled = enable ? 1 : 0;
+  if (!enable) {
+    dumpOnUnload = 0;
+  }
+
+  return canOK;
+}
+
+//======================================================================
+// apiStatsReset
+//======================================================================
+void apiStatsReset (void)
+{
+  ApiStatsShard *shard;
+
+  pthread_mutex_lock(&shardMutex);
+  memset(&baseline, 0, sizeof(baseline));
+  sumShard(&baseline, &retired);
+  clearMax(&retired);
+  for (shard = shards; shard != NULL; shard = shard->next) {
+    sumShard(&baseline, shard);
+    clearMax(shard);
+  }
+  pthread_mutex_unlock(&shardMutex);
+}
+
+//======================================================================
+// apiStatsBegin
+//======================================================================
+void apiStatsBegin (ApiStatsScope *scope, int api)
+{
+  scope->api     = api;
+  scope->ioctlNs = 0;
+  scope->ioctls  = 0;
+  scope->outer   = threadScope;
+  threadScope    = scope;
+  scope->startNs = nowNs();
+}
+
+//======================================================================
+// apiStatsEnd
+//======================================================================
+void apiStatsEnd (ApiStatsScope *scope)
+{
+  int64_t       ns = nowNs() - scope->startNs;
+  ApiStatsShard *shard;
+
+  threadScope = scope->outer;
+  if (scope->outer) {
+    // Nested API calls count towards the caller's driver time as well
+    scope->outer->ioctlNs += scope->ioctlNs;
+    scope->outer->ioctls  += scope->ioctls;
+  }
+
+  shard = getShard();
+  if (shard) {
+    record(&shard->counter[scope->api], ns, scope->ioctls, scope->ioctlNs);
+  }
+}
+
+//======================================================================
+// apiStatsIoctl
+//======================================================================
+int apiStatsIoctl (int fd, unsigned long request, void *arg)
+{
+  int64_t       t0, ns;
+  int           ret;
+  ApiStatsShard *shard;
+
+  t0  = nowNs();
+  ret = ioctl(fd, request, arg);
+  ns  = nowNs() - t0;
+
+  if (threadScope) {
+    threadScope->ioctlNs += ns;
+    threadScope->ioctls++;
+  }
+  shard = getShard();
+  if (shard) {
+    record(&shard->counter[IOCTL_COUNTER], ns, 1, ns);
+  }
+
+  return ret;
+}
+
+static uint64_t percentile (const ApiCounter *c, uint64_t calls, double p)
+{
+  uint64_t     rank = (uint64_t)(p * calls);
+  uint64_t     seen = 0;
+  unsigned int b;
+
+  for (b = 0; b < HIST_BUCKETS; b++) {
+    seen += c->hist[b];
+    if (seen > rank) {
+      uint64_t value = bucketValue(b);
+      return (value < c->maxNs) ? value : c->maxNs;
+    }
+  }
+
+  return c->maxNs;
+}
+
+//======================================================================
+// apiStatsName
+//======================================================================
+const char *apiStatsName (int api)
+{
+  if (api < 0 || api >= APISTATS_COUNT) {
+    return "?";
+  }
+
+  return apiNames[api];
+}
+
+//======================================================================
+// apiStatsGet, functions that have been called, and the driver calls
+//======================================================================
+canStatus apiStatsGet (kvApiStats *stats, unsigned int *count)
+{
+  ApiStatsShard *sum;
+  ApiStatsShard *shard;
+  unsigned int  i, b, n = 0;
+
+  if (stats == NULL || count == NULL) {
+    return canERR_PARAM;
+  }
+
+  sum = calloc(1, sizeof(ApiStatsShard));
+  if (sum == NULL) {
+    return canERR_NOMEM;
+  }
+
+  pthread_mutex_lock(&shardMutex);
+  sumShard(sum, &retired);
+  for (shard = shards; shard != NULL; shard = shard->next) {
+    sumShard(sum, shard);
+  }
+  for (i = 0; i <= APISTATS_COUNT; i++) {
+    ApiCounter *c    = &sum->counter[i];
+    ApiCounter *base = &baseline.counter[i];
+    c->calls    -= base->calls;
+    c->ioctls   -= base->ioctls;
+    c->totalNs  -= base->totalNs;
+    c->driverNs -= base->driverNs;
+    for (b = 0; b < HIST_BUCKETS; b++) {
+      c->hist[b] -= base->hist[b];
+    }
+  }
+  pthread_mutex_unlock(&shardMutex);
+
+  for (i = 0; i <= APISTATS_COUNT && n < *count; i++) {
+    ApiCounter *c = &sum->counter[i];
+    kvApiStats *s = &stats[n];
+
+    if (c->calls == 0) {
+      continue;
+    }
+    memset(s, 0, sizeof(*s));
+    strncpy(s->name, apiNames[i], sizeof(s->name) - 1);
+    s->calls    = c->calls;
+    s->ioctls   = c->ioctls;
+    s->totalNs  = c->totalNs;
+    s->driverNs = c->driverNs;
+    s->maxNs    = c->maxNs;
+    s->p50Ns    = percentile(c, c->calls, 0.50);
+    s->p90Ns    = percentile(c, c->calls, 0.90);
+    s->p99Ns    = percentile(c, c->calls, 0.99);
+    s->p999Ns   = percentile(c, c->calls, 0.999);
+    n++;
+  }
+  *count = n;
+
+  free(sum);
+
+  return canOK;
+}
+
+//======================================================================
+// apiStatsDump, prints a table to stderr
+//======================================================================
+canStatus apiStatsDump (void)
+{
+  kvApiStats   stats[APISTATS_COUNT + 1];
+  unsigned int i, n = APISTATS_COUNT + 1;
+  canStatus    stat;
+
+  stat = apiStatsGet(stats, &n);
+  if (stat != canOK) {
+    return stat;
+  }
+
+  fprintf(stderr, "%-24s %10s %10s %11s %11s %9s %9s %9s %9s\n",
+          "function", "calls", "ioctls", "total ms", "driver ms",
+          "p50 us", "p99 us", "p99.9 us", "max us");
+  for (i = 0; i < n; i++) {
+    fprintf(stderr, "%-24s %10llu %10llu %11.3f %11.3f %9.1f %9.1f %9.1f %9.1f\n",
+            stats[i].name,
+            (unsigned long long)stats[i].calls,
+            (unsigned long long)stats[i].ioctls,
+            stats[i].totalNs / 1e6, stats[i].driverNs / 1e6,
+            stats[i].p50Ns / 1e3, stats[i].p99Ns / 1e3,
+            stats[i].p999Ns / 1e3, stats[i].maxNs / 1e3);
+  }
+
+  return canOK;
+}
+
+//======================================================================
+// apiStatsUnload, dumps the statistics if they were asked for in the
+// environment, and drops the key so that no thread exit calls into the
+// library once it is unloaded. Shards of threads still running stay in
+// the list.
+//======================================================================
+void apiStatsUnload (void)
+{
+  if (dumpOnUnload) {
+    apiStatsDump();
+  }
+
+  pthread_mutex_lock(&shardMutex);
+  if (shardKeyValid) {
+    pthread_key_delete(shardKey);
+    shardKeyValid = 0;
+  }
+  pthread_mutex_unlock(&shardMutex);
+}
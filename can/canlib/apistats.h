@@ -0,0 +1,166 @@
+/*
+**             Copyright 2017 by Kvaser AB, Molndal, Sweden
+**                        http://www.kvaser.com
+**
+** This software is dual licensed under the following two licenses:
+** BSD-new and GPLv2. You may use either one. See the included
+** COPYING file for details.
+**
+** License: BSD-new
+** ===============================================================================
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of the <organization> nor the
+**       names of its contributors may be used to endorse or promote products
+**       derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+** DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+** DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+** (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+** LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+** ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**
+**
+** License: GPLv2
+** ===============================================================================
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+** ---------------------------------------------------------------------------
+**/
+
+/*  Kvaser Linux Canlib API statistics
+ *
+ *  Opt-in call counts and latency histograms per API function, with the
+ *  time spent in driver calls split out. Counters live in per-thread
+ *  shards that only their own thread writes, so recording needs no locks
+ *  or atomic read-modify-write; readers sum the shards. When statistics
+ *  are off, each ioctl costs one predictable branch and each API call one
+ *  more than the flight recorder, which for a repeated call only bumps a
+ *  count without reading the clock.
+ */
+
+#ifndef APISTATS_H
+#define APISTATS_H
+
+#include <stdint.h>
+#include <sys/ioctl.h>
+
+#include "canlib.h"
+#include "flightrec.h"
+
+// API functions with statistics
+#define APISTATS_LIST(X)        \
+  X(canOpenChannel)             \
+  X(canOpenChannels)            \
+  X(canClose)                   \
+  X(canBusOn)                   \
+  X(canBusOff)                  \
+  X(canSetBusParams)            \
+  X(canSetBusParamsFd)          \
+  X(canGetBusParams)            \
+  X(canSetBusOutputControl)     \
+  X(canAccept)                  \
+  X(canSetAcceptanceFilter)     \
+  X(canReadStatus)              \
+  X(canReadErrorCounters)       \
+  X(canWrite)                   \
+  X(canWriteSync)               \
+  X(canWriteWait)               \
+  X(canRead)                    \
+  X(canReadWait)                \
+  X(canReadSync)                \
+  X(canReadSpecific)            \
+  X(canReadSpecificSkip)        \
+  X(canReadSyncSpecific)        \
+  X(canIoCtl)                   \
+  X(canSetNotify)               \
+  X(canRequestBusStatistics)    \
+  X(canGetBusStatistics)        \
+  X(canObjBufConfigure)         \
+  X(kvReadTimer)                \
+  X(kvReadTimer64)
+
+enum {
+#define APISTATS_ENUM(name) APISTATS_##name,
+  APISTATS_LIST(APISTATS_ENUM)
+#undef APISTATS_ENUM
+  APISTATS_COUNT
+};
+
+// An API call in progress, on the caller's stack
+typedef struct ApiStatsScope {
+  int                  api;      // -1 when statistics are off
+  int64_t              startNs;
+  int64_t              ioctlNs;
+  uint64_t             ioctls;
+  struct ApiStatsScope *outer;
+} ApiStatsScope;
+
+extern int apiStatsEnabled;
+
+void apiStatsInit (void);
+canStatus apiStatsEnable (int enable);
+void apiStatsReset (void);
+void apiStatsBegin (ApiStatsScope *scope, int api);
+void apiStatsEnd (ApiStatsScope *scope);
+int apiStatsIoctl (int fd, unsigned long request, void *arg);
+canStatus apiStatsGet (kvApiStats *stats, unsigned int *count);
+const char *apiStatsName (int api);
+canStatus apiStatsDump (void);
+void apiStatsUnload (void);
+
+static inline void apiStatsEnter (ApiStatsScope *scope, int api)
+{
+  flightRecApi(api);
+  if (__builtin_expect(apiStatsEnabled, 0)) {
+    apiStatsBegin(scope, api);
+  } else {
+    scope->api = -1;
+  }
+}
+
+static inline void apiStatsLeave (ApiStatsScope *scope)
+{
+  if (__builtin_expect(scope->api >= 0, 0)) {
+    apiStatsEnd(scope);
+  }
+}
+
+// Records the enclosing function as an API call, until it returns, and
+// logs the call in the flight recorder
+#define API_STATS(name)                                                   \
+  ApiStatsScope apiStatsScope __attribute__((cleanup(apiStatsLeave)));    \
+  apiStatsEnter(&apiStatsScope, APISTATS_##name)
+
+// Driver call, counted and timed when statistics are on
+static inline int vCanIoctl (int fd, unsigned long request, void *arg)
+{
+  if (__builtin_expect(apiStatsEnabled, 0)) {
+    return apiStatsIoctl(fd, request, arg);
+  }
+  return ioctl(fd, request, arg);
+}
+
+#endif  /* APISTATS_H */
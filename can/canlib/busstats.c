@@ -0,0 +1,476 @@
+/*
+**             Copyright 2017 by Kvaser AB, Molndal, Sweden
+**                        http://www.kvaser.com
+**
+** This software is dual licensed under the following two licenses:
+** BSD-new and GPLv2. You may use either one. See the included
+** COPYING file for details.
+**
+** License: BSD-new
+** ===============================================================================
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of the <organization> nor the
+**       names of its contributors may be used to endorse or promote products
+**       derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+** DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+** DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+** (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+** LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+** ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**
+**
+** License: GPLv2
+** ===============================================================================
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+** ---------------------------------------------------------------------------
+**/
+
+/*  Kvaser Linux Canlib bus statistics sampler */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+
+#include "busstats.h"
+#include "canlib_data.h"
+#include "VCanFuncUtil.h"
+#include "debug.h"
+
+
+#   if DEBUG
+#      define DEBUGPRINT(args) printf args
+#   else
+#      define DEBUGPRINT(args)
+#   endif
+
+
+static int64_t nowUs (void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Change of a cumulative counter, which restarts from zero on bus on
+static unsigned int delta (unsigned long cur, unsigned long prev)
+{
+  return (unsigned int)((cur >= prev) ? cur - prev : cur);
+}
+
+//======================================================================
+// Take one sample, only called from the sampler thread
+//======================================================================
+static void busStatsSample (BusStats *bs)
+{
+  HandleData       *hData = bs->hData;
+  canBusStatistics cur;
+  kvBusStatsSample s;
+  BusStatsSlot     *slot;
+  canStatus        stat;
+  int64_t          now;
+
+  stat = hData->canOps->reqBusStats(hData);
+  if (stat == canOK) {
+    stat = hData->canOps->getBusStats(hData, &cur);
+  }
+  if (stat != canOK) {
+    DEBUGPRINT((TXT("busStatsSample failed (%d)\n"), stat));
+    return;
+  }
+  now = nowUs();
+
+  if (!bs->havePrev) {
+    bs->prev     = cur;
+    bs->prevUs   = now;
+    bs->havePrev = 1;
+    return;
+  }
+
+  s.timeUs     = now;
+  s.intervalUs = (unsigned int)(now - bs->prevUs);
+  s.stdData    = delta(cur.stdData, bs->prev.stdData);
+  s.stdRemote  = delta(cur.stdRemote, bs->prev.stdRemote);
+  s.extData    = delta(cur.extData, bs->prev.extData);
+  s.extRemote  = delta(cur.extRemote, bs->prev.extRemote);
+  s.errFrame   = delta(cur.errFrame, bs->prev.errFrame);
+  s.overruns   = delta(cur.overruns, bs->prev.overruns);
+  s.busLoad    = (unsigned int)cur.busLoad;
+  bs->prev     = cur;
+  bs->prevUs   = now;
+
+  // Seqlock write, then publish the new head
+  slot = &bs->ring[bs->head % bs->depth];
+  __atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  slot->index  = bs->head;
+  slot->sample = s;
+  __atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELEASE);
+  __atomic_store_n(&bs->head, bs->head + 1, __ATOMIC_RELEASE);
+}
+
+//======================================================================
+// Sampler thread
+//======================================================================
+static void *busStatsThread (void *arg)
+{
+  BusStats        *bs = (BusStats *)arg;
+  struct timespec deadline, now;
+
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+  pthread_mutex_lock(&bs->lock);
+  while (!bs->stop) {
+    pthread_mutex_unlock(&bs->lock);
+    busStatsSample(bs);
+    pthread_mutex_lock(&bs->lock);
+
+    deadline.tv_nsec += bs->intervalMs % 1000 * 1000000L;
+    deadline.tv_sec  += bs->intervalMs / 1000;
+    if (deadline.tv_nsec >= 1000000000L) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000L;
+    }
+
+    // Skip missed periods rather than sampling in a burst
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (deadline.tv_sec < now.tv_sec ||
+        (deadline.tv_sec == now.tv_sec && deadline.tv_nsec < now.tv_nsec)) {
+      deadline = now;
+    }
+
+    while (!bs->stop &&
+           pthread_cond_timedwait(&bs->cond, &bs->lock, &deadline) != ETIMEDOUT) {
+    }
+  }
+  pthread_mutex_unlock(&bs->lock);
+
+  return NULL;
+}
+
+//======================================================================
+// Copy sample number idx, returns 0 if it has been overwritten
+//======================================================================
+static int busStatsRead (BusStats *bs, uint64_t idx, kvBusStatsSample *sample)
+{
+  BusStatsSlot *slot = &bs->ring[idx % bs->depth];
+  uint64_t     seq, index;
+
+  do {
+    seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    index   = slot->index;
+    *sample = slot->sample;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  } while ((seq & 1) || __atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq);
+
+  return index == idx;
+}
+
+//======================================================================
+// The bus statistics of a handle, created on first use
+//======================================================================
+static BusStats *busStatsGet (HandleData *hData)
+{
+  BusStats           *bs = __atomic_load_n(&hData->busStats, __ATOMIC_ACQUIRE);
+  BusStats           *none = NULL;
+  pthread_condattr_t attr;
+
+  if (bs != NULL) {
+    return bs;
+  }
+
+  bs = calloc(1, sizeof(BusStats));
+  if (bs == NULL) {
+    return NULL;
+  }
+  bs->hData = hData;
+  pthread_mutex_init(&bs->lock, NULL);
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&bs->cond, &attr);
+  pthread_condattr_destroy(&attr);
+
+  // Another thread may have got there first
+  if (!__atomic_compare_exchange_n(&hData->busStats, &none, bs, 0,
+                                   __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+    pthread_cond_destroy(&bs->cond);
+    pthread_mutex_destroy(&bs->lock);
+    free(bs);
+    bs = none;
+  }
+
+  return bs;
+}
+
+//======================================================================
+// busStatsStart
+//======================================================================
+canStatus busStatsStart (HandleData *hData, unsigned int intervalMs,
+                         unsigned int depth)
+{
+  BusStats     *bs;
+  BusStatsSlot *ring, *old;
+
+  if (intervalMs == 0 || depth < 2) {
+    return canERR_PARAM;
+  }
+
+  bs = busStatsGet(hData);
+  if (bs == NULL) {
+    return canERR_NOMEM;
+  }
+  ring = calloc(depth, sizeof(BusStatsSlot));
+  if (ring == NULL) {
+    return canERR_NOMEM;
+  }
+
+  // Another start may get a sampler going while this one stops the old
+  pthread_mutex_lock(&bs->lock);
+  while (bs->running) {
+    pthread_mutex_unlock(&bs->lock);
+    busStatsStop(hData);
+    pthread_mutex_lock(&bs->lock);
+  }
+  old            = bs->ring;
+  bs->ring       = ring;
+  bs->depth      = depth;
+  bs->intervalMs = intervalMs;
+  bs->head       = 0;
+  bs->havePrev   = 0;
+  bs->stop       = 0;
+
+  // The sampler waits for the lock before its first sample
+  if (vCanCreateThread(&bs->thread, busStatsThread, bs) != 0) {
+    pthread_mutex_unlock(&bs->lock);
+    free(old);
+    return canERR_NOMEM;
+  }
+  bs->running = 1;
+  pthread_mutex_unlock(&bs->lock);
+  free(old);
+
+  return canOK;
+}
+
+//======================================================================
+// busStatsStop
+//======================================================================
+canStatus busStatsStop (HandleData *hData)
+{
+  BusStats *bs = __atomic_load_n(&hData->busStats, __ATOMIC_ACQUIRE);
+
+  if (bs == NULL) {
+    return canOK;
+  }
+
+  // A start may run a new sampler while waiting for another thread to
+  // join the old one, then that one is stopped as well.
+  pthread_mutex_lock(&bs->lock);
+  while (bs->running) {
+    if (bs->stop) {
+      pthread_cond_wait(&bs->cond, &bs->lock);
+      continue;
+    }
+    bs->stop = 1;
+    pthread_cond_broadcast(&bs->cond);
+    pthread_mutex_unlock(&bs->lock);
+
+    pthread_join(bs->thread, NULL);
+
+    pthread_mutex_lock(&bs->lock);
+    bs->running = 0;
+    pthread_cond_broadcast(&bs->cond);
+  }
+  pthread_mutex_unlock(&bs->lock);
+
+  return canOK;
+}
+
+//======================================================================
+// busStatsFree
+//======================================================================
+void busStatsFree (HandleData *hData)
+{
+  BusStats *bs = hData->busStats;
+
+  if (bs == NULL) {
+    return;
+  }
+
+  busStatsStop(hData);
+  pthread_cond_destroy(&bs->cond);
+  pthread_mutex_destroy(&bs->lock);
+  free(bs->ring);
+  free(bs);
+  hData->busStats = NULL;
+}
+
+//======================================================================
+// busStatsGetSamples
+//======================================================================
+canStatus busStatsGetSamples (HandleData *hData, kvBusStatsSample *samples,
+                              unsigned int *count)
+{
+  BusStats     *bs = __atomic_load_n(&hData->busStats, __ATOMIC_ACQUIRE);
+  uint64_t     head, idx, first;
+  unsigned int n = 0;
+
+  if (samples == NULL || count == NULL) {
+    return canERR_PARAM;
+  }
+  if (bs == NULL) {
+    return canERR_PARAM;
+  }
+
+  pthread_mutex_lock(&bs->lock);
+  if (bs->ring == NULL) {
+    pthread_mutex_unlock(&bs->lock);
+    return canERR_PARAM;
+  }
+  head  = __atomic_load_n(&bs->head, __ATOMIC_ACQUIRE);
+  first = head;
+  if (first > *count) {
+    first -= *count;
+  } else {
+    first = 0;
+  }
+  if (head - first > bs->depth) {
+    first = head - bs->depth;
+  }
+
+  // Samples overwritten while copying are skipped
+  for (idx = first; idx < head; idx++) {
+    if (busStatsRead(bs, idx, &samples[n])) {
+      n++;
+    }
+  }
+  pthread_mutex_unlock(&bs->lock);
+  *count = n;
+
+  return canOK;
+}
+
+static int cmpLoad (const void *a, const void *b)
+{
+  unsigned int x = *(const unsigned int *)a;
+  unsigned int y = *(const unsigned int *)b;
+
+  return (x > y) - (x < y);
+}
+
+//======================================================================
+// busStatsGetSummary
+//======================================================================
+canStatus busStatsGetSummary (HandleData *hData, unsigned int windowMs,
+                              kvBusStatsSummary *summary)
+{
+  BusStats         *bs = __atomic_load_n(&hData->busStats,
+                                             __ATOMIC_ACQUIRE);
+  kvBusStatsSample *samples;
+  unsigned int     *load;
+  unsigned int     i, n, first;
+  uint64_t         frames = 0, errFrames = 0, overruns = 0, loadSum = 0;
+  uint64_t         spanUs = 0;
+  int64_t          since;
+  canStatus        stat;
+  unsigned int     depth;
+
+  if (summary == NULL) {
+    return canERR_PARAM;
+  }
+  if (bs == NULL) {
+    return canERR_PARAM;
+  }
+  pthread_mutex_lock(&bs->lock);
+  depth = bs->ring ? bs->depth : 0;
+  pthread_mutex_unlock(&bs->lock);
+  if (depth == 0) {
+    return canERR_PARAM;
+  }
+
+  samples = malloc(depth * sizeof(*samples));
+  load    = malloc(depth * sizeof(*load));
+  if (samples == NULL || load == NULL) {
+    free(samples);
+    free(load);
+    return canERR_NOMEM;
+  }
+
+  n    = depth;
+  stat = busStatsGetSamples(hData, samples, &n);
+  if (stat != canOK) {
+    free(samples);
+    free(load);
+    return stat;
+  }
+
+  first = 0;
+  if (windowMs) {
+    since = nowUs() - (int64_t)windowMs * 1000;
+    while (first < n && samples[first].timeUs < since) {
+      first++;
+    }
+  }
+
+  memset(summary, 0, sizeof(*summary));
+  for (i = first; i < n; i++) {
+    kvBusStatsSample *s = &samples[i];
+    frames    += s->stdData + s->stdRemote + s->extData + s->extRemote;
+    errFrames += s->errFrame;
+    overruns  += s->overruns;
+    spanUs    += s->intervalUs;
+    loadSum   += s->busLoad;
+    load[i - first] = s->busLoad;
+  }
+  summary->nSamples = n - first;
+
+  if (summary->nSamples) {
+    unsigned int m = summary->nSamples;
+
+    qsort(load, m, sizeof(*load), cmpLoad);
+    summary->busLoadMean = (unsigned int)(loadSum / m);
+    summary->busLoadMin  = load[0];
+    summary->busLoadP50  = load[m / 2];
+    summary->busLoadP90  = load[(m * 90) / 100];
+    summary->busLoadP99  = load[(m * 99) / 100];
+    summary->busLoadMax  = load[m - 1];
+  }
+  if (spanUs) {
+    summary->spanSec         = spanUs / 1e6;
+    summary->framesPerSec    = frames / summary->spanSec;
+    summary->errFramesPerSec = errFrames / summary->spanSec;
+    summary->overrunsPerSec  = overruns / summary->spanSec;
+  }
+
+  free(samples);
+  free(load);
+
+  return canOK;
+}
@@ -0,0 +1,102 @@
+/*
+**             Copyright 2017 by Kvaser AB, Molndal, Sweden
+**                        http://www.kvaser.com
+**
+** This software is dual licensed under the following two licenses:
+** BSD-new and GPLv2. You may use either one. See the included
+** COPYING file for details.
+**
+** License: BSD-new
+** ===============================================================================
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of the <organization> nor the
+**       names of its contributors may be used to endorse or promote products
+**       derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+** DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+** DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+** (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+** LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+** ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**
+**
+** License: GPLv2
+** ===============================================================================
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+** ---------------------------------------------------------------------------
+**/
+
+/*  Kvaser Linux Canlib bus statistics sampler
+ *
+ *  A thread per handle reads the bus statistics at a fixed rate and stores
+ *  the changes in a ring. Each slot is a seqlock, so readers never wait
+ *  for a sample to be taken and never touch the device. Readers copy
+ *  under the lock, which keeps a restart from swapping the ring under them.
+ */
+
+#ifndef BUSSTATS_H
+#define BUSSTATS_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "canlib.h"
+
+struct HandleData;
+
+typedef struct {
+  uint64_t         seq;    // Odd while the slot is written
+  uint64_t         index;  // Sample number stored in the slot
+  kvBusStatsSample sample;
+} BusStatsSlot;
+
+typedef struct BusStats {
+  struct HandleData *hData;
+  pthread_t         thread;
+  pthread_mutex_t   lock;     // Protects running, stop, ring and depth
+  pthread_cond_t    cond;     // Wakes the sampler and waiting stoppers
+  int               running;  // Until the sampler has been joined
+  int               stop;
+  unsigned int      intervalMs;
+  unsigned int      depth;
+  BusStatsSlot      *ring;
+  uint64_t          head;     // Number of samples written
+  canBusStatistics  prev;     // Counters at the previous sample
+  int64_t           prevUs;
+  int               havePrev;
+} BusStats;
+
+canStatus busStatsStart (struct HandleData *hData, unsigned int intervalMs,
+                         unsigned int depth);
+canStatus busStatsStop (struct HandleData *hData);
+void busStatsFree (struct HandleData *hData);
+canStatus busStatsGetSamples (struct HandleData *hData,
+                              kvBusStatsSample *samples, unsigned int *count);
+canStatus busStatsGetSummary (struct HandleData *hData, unsigned int windowMs,
+                              kvBusStatsSummary *summary);
+
+#endif  /* BUSSTATS_H */
@@ -61,6 +61,11 @@
 #include "vcanevt.h"
 
 #include "VCanFunctions.h"
+#include "VCanNotifyFunctions.h"
+#include "VCanFuncUtil.h"
+#include "VCanSimFunctions.h"
+#include "apistats.h"
+#include "flightrec.h"
 #include "debug.h"
 
 #include <stdio.h>
@@ -72,6 +77,7 @@
 #include <signal.h>
 #include <pthread.h>
 #include <string.h>
+#include <stdlib.h>
 #include <sys/ioctl.h>
 
 #if DEBUG
@@ -241,24 +247,204 @@ static struct dev_descr dev_descr_list[] = {
           {"ATI Memorator Pro 2xHS v2",                         {0x30009714, 0x00073301}}
 };
 
+// Additional device descriptions can be supplied at run time, without
+// rebuilding canlib, through a data file named by this environment variable.
+// Each line holds an EAN followed by the description, e.g.
+//   73-30130-00082-7   Kvaser PCIcan-S
+// Empty lines and lines starting with '#' are ignored. Entries in the file
+// take precedence over the built-in list.
+#define DEV_DESCR_FILE_ENV "KVASER_CANLIB_DEVDESCR"
+
+// Lookup index over dev_descr_list (except the "unknown" and "virtual"
+// entries) and the data file, sorted on EAN. Built once on first use.
+static const struct dev_descr **dev_descr_index = NULL;
+static unsigned int             dev_descr_index_len = 0;
+static pthread_once_t           dev_descr_once = PTHREAD_ONCE_INIT;
+
+static int dev_descr_cmp (const struct dev_descr *a, const struct dev_descr *b)
+{
+  if (a->ean[1] != b->ean[1]) return (a->ean[1] < b->ean[1]) ? -1 : 1;
+  if (a->ean[0] != b->ean[0]) return (a->ean[0] < b->ean[0]) ? -1 : 1;
+  return 0;
+}
+
+static int dev_descr_sort_cmp (const void *a, const void *b)
+{
+  return dev_descr_cmp(*(const struct dev_descr * const *)a,
+                       *(const struct dev_descr * const *)b);
+}
+
+static int dev_descr_search_cmp (const void *key, const void *elem)
+{
+  return dev_descr_cmp((const struct dev_descr *)key,
+                       *(const struct dev_descr * const *)elem);
+}
+
+//******************************************************
+// Parse one line of the device description data file
+//******************************************************
+static int dev_descr_parse_line (char *line, struct dev_descr *descr)
+{
+  unsigned long long ean = 0;
+  int digits = 0;
+  char *p = line;
+  size_t len;
+
+  while (*p == ' ' || *p == '\t') p++;
+  if (*p == '#' || *p == '\0' || *p == '\n') {
+    return 0;
+  }
+
+  for (; *p && *p != ' ' && *p != '\t'; p++) {
+    if (*p == '-') {
+      continue;
+    }
+    if (*p >= '0' && *p <= '9') {
+      ean = (ean << 4) | (unsigned long long)(*p - '0');
+    } else {
+      return 0;
+    }
+    if (++digits > 16) {
+      return 0;
+    }
+  }
+  if (!digits) {
+    return 0;
+  }
+
+  while (*p == ' ' || *p == '\t') p++;
+  len = strlen(p);
+  while (len && (p[len - 1] == '\n' || p[len - 1] == '\r' ||
+                 p[len - 1] == ' '  || p[len - 1] == '\t')) {
+    p[--len] = '\0';
+  }
+  if (!len) {
+    return 0;
+  }
+
+  descr->descr_string = strdup(p);
+  if (!descr->descr_string) {
+    return 0;
+  }
+  descr->ean[0] = (unsigned int)(ean & 0xffffffff);
+  descr->ean[1] = (unsigned int)(ean >> 32);
+
+  return 1;
+}
+
+//******************************************************
+// Read extra device descriptions from the data file
+//******************************************************
+static unsigned int dev_descr_read_file (struct dev_descr **list)
+{
+  const char *fname = getenv(DEV_DESCR_FILE_ENV);
+  struct dev_descr *entries = NULL;
+  unsigned int n = 0, size = 0;
+  char line[256];
+  FILE *f;
+
+  *list = NULL;
+  if (!fname || !*fname) {
+    return 0;
+  }
+
+  f = fopen(fname, "r");
+  if (!f) {
+    DEBUGPRINT((TXT("Unable to open %s\n"), fname));
+    return 0;
+  }
+
+  while (fgets(line, sizeof(line), f)) {
+    if (n == size) {
+      struct dev_descr *tmp;
+      size = size ? 2 * size : 16;
+      tmp = realloc(entries, size * sizeof(*entries));
+      if (!tmp) {
+        break;
+      }
+      entries = tmp;
+    }
+    n += dev_descr_parse_line(line, &entries[n]);
+  }
+  fclose(f);
+
+  *list = entries;
+  return n;
+}
+
+//******************************************************
+// Build the sorted device description index
+//******************************************************
+static void dev_descr_build_index (void)
+{
+  unsigned int builtin = sizeof(dev_descr_list) / sizeof(struct dev_descr) - 2;
+  struct dev_descr *extra;
+  unsigned int nextra, i, n;
+
+  nextra = dev_descr_read_file(&extra);
+
+  dev_descr_index = malloc((nextra + builtin) * sizeof(*dev_descr_index));
+  if (!dev_descr_index) {
+    for (i = 0; i < nextra; i++) {
+      free(extra[i].descr_string);
+    }
+    free(extra);
+    return;
+  }
+
+  // File entries go first so that they win over built-in duplicates,
+  // and among built-in duplicates the first one in the list wins.
+  n = 0;
+  for (i = 0; i < nextra; i++) {
+    dev_descr_index[n++] = &extra[i];
+  }
+  for (i = 0; i < builtin; i++) {
+    dev_descr_index[n++] = &dev_descr_list[i + 2];
+  }
+
+  // Insertion sort is stable and the list is nearly sorted already.
+  for (i = 1; i < n; i++) {
+    const struct dev_descr *tmp = dev_descr_index[i];
+    unsigned int j = i;
+    while (j > 0 && dev_descr_sort_cmp(&dev_descr_index[j - 1], &tmp) > 0) {
+      dev_descr_index[j] = dev_descr_index[j - 1];
+      j--;
+    }
+    dev_descr_index[j] = tmp;
+  }
+
+  // Drop duplicates, keeping the first (highest precedence) entry.
+  dev_descr_index_len = 0;
+  for (i = 0; i < n; i++) {
+    if (dev_descr_index_len &&
+        !dev_descr_cmp(dev_descr_index[dev_descr_index_len - 1],
+                       dev_descr_index[i])) {
+      continue;
+    }
+    dev_descr_index[dev_descr_index_len++] = dev_descr_index[i];
+  }
+}
+
 static canStatus check_bitrate (const CanHandle hnd, unsigned int bitrate);
 
 //******************************************************
-// Find out channel specific data
+// Find out channel specific data for a set of channels
 //******************************************************
 static
-canStatus getDevParams (int channel, char devName[], int *devChannel,
-                        CANOps **canOps, char officialName[])
+canStatus getDevParamsList (const int *channel, int count, HandleData **hData)
 {
   // For now, we just count the number of /dev/%s%d files (see dev_name),
   // where %d is numbers between 0 and 255.
-  // This is slow!
+  // This is slow, so all requested channels are looked up in a single pass.
 
   int         chanCounter = 0;
   int         devCounter  = 0;
+  int         remaining   = count;
   struct stat stbuf;
+  char        devName[DEVICE_NAME_LEN];
 
   unsigned n = 0;
+  int i;
 
   int CardNo          = -1;
   int ChannelNoOnCard = 0;
@@ -266,13 +452,19 @@ canStatus getDevParams (int channel, char devName[], int *devChannel,
   int err;
   int fd;
 
-  for(n = 0; n < sizeof(dev_name) / sizeof(*dev_name); n++) {
+  for (i = 0; i < count; i++) {
+    hData[i]->deviceName[0] = 0;
+    hData[i]->channelNr     = -1;
+    hData[i]->canOps        = NULL;
+  }
+
+  for(n = 0; n < sizeof(dev_name) / sizeof(*dev_name) && remaining; n++) {
     CardNo = -1;
     ChannelNoOnCard = 0;
     ChannelsOnCard = 0;
 
     // There are 256 minor inode numbers
-    for(devCounter = 0; devCounter <= 255; devCounter++) {
+    for(devCounter = 0; devCounter <= 255 && remaining; devCounter++) {
       snprintf(devName, DEVICE_NAME_LEN, "/dev/%s%d", dev_name[n], devCounter);
       if (stat(devName, &stbuf) != -1) {  // Check for existance
 
@@ -280,7 +472,7 @@ canStatus getDevParams (int channel, char devName[], int *devChannel,
           err = 1;
           fd = open(devName, O_RDONLY);
           if (fd != -1) {
-            err = ioctl(fd, VCAN_IOC_GET_NRCHANNELS, &ChannelsOnCard);
+            err = vCanIoctl(fd, VCAN_IOC_GET_NRCHANNELS, &ChannelsOnCard);
             close(fd);
           }
           if (err) {
@@ -294,14 +486,17 @@ canStatus getDevParams (int channel, char devName[], int *devChannel,
         }
         ChannelsOnCard--;
 
-        if (chanCounter++ == channel) {
-          *canOps = &vCanOps;
-          sprintf(officialName, "KVASER %s channel %d", off_name[n], devCounter);
-          *devChannel = ChannelNoOnCard;
-
-          errno = 0; // Calling stat() may set errno.
-          return canOK;
+        for (i = 0; i < count; i++) {
+          if (channel[i] == chanCounter && hData[i]->canOps == NULL) {
+            strcpy(hData[i]->deviceName, devName);
+            hData[i]->canOps = &vCanOps;
+            sprintf(hData[i]->deviceOfficialName, "KVASER %s channel %d",
+                    off_name[n], devCounter);
+            hData[i]->channelNr = ChannelNoOnCard;
+            remaining--;
+          }
         }
+        chanCounter++;
       }
       else {
         // Handle gaps in device numbers
@@ -310,26 +505,43 @@ canStatus getDevParams (int channel, char devName[], int *devChannel,
     }
   }
 
-  DEBUGPRINT((TXT("return canERR_NOTFOUND\n")));
-  devName[0]  = 0;
-  *devChannel = -1;
-  *canOps     = NULL;
+  errno = 0; // Calling stat() may set errno.
+
+  // Simulated channels, see VCanSimFunctions.h, come after the hardware
+  for (n = 0; n < (unsigned)vCanSimChannels() && remaining; n++) {
+    for (i = 0; i < count; i++) {
+      if (channel[i] == chanCounter && hData[i]->canOps == NULL) {
+        vCanSimDevParams(hData[i], n);
+        remaining--;
+      }
+    }
+    chanCounter++;
+  }
+
+  if (remaining) {
+    DEBUGPRINT((TXT("return canERR_NOTFOUND\n")));
+    return canERR_NOTFOUND;
+  }
 
-  return canERR_NOTFOUND;
+  return canOK;
 }
 
-//
-// API FUNCTIONS
-//
+//******************************************************
+// Find out channel specific data
+//******************************************************
+static
+canStatus getDevParams (int channel, HandleData *hData)
+{
+  return getDevParamsList(&channel, 1, &hData);
+}
 
 //******************************************************
-// Open a can channel
+// Allocate and set up handle data from open flags
 //******************************************************
-CanHandle CANLIBAPI canOpenChannel (int channel, int flags)
+static
+canStatus newHandleData (int flags, HandleData **phData)
 {
-  canStatus          status;
-  HandleData         *hData;
-  CanHandle          hnd;
+  HandleData *hData;
   const int validFlags = canOPEN_EXCLUSIVE      | canOPEN_REQUIRE_EXTENDED |
                          canOPEN_ACCEPT_VIRTUAL | canOPEN_ACCEPT_LARGE_DLC |
                          canOPEN_CAN_FD         | canOPEN_CAN_FD_NONISO |
@@ -365,11 +577,36 @@ CanHandle CANLIBAPI canOpenChannel (int channel, int flags)
   hData->notifyFd            = canINVALID_HANDLE;
   hData->valid               = TRUE;
 
-  status = getDevParams(channel,
-                        hData->deviceName,
-                        &hData->channelNr,
-                        &hData->canOps,
-                        hData->deviceOfficialName);
+  clockSyncInit(&hData->clockSync);
+  pthread_rwlock_init(&hData->filterLock, NULL);
+  pthread_mutex_init(&hData->fileTransferLock, NULL);
+
+  *phData = hData;
+
+  return canOK;
+}
+
+//
+// API FUNCTIONS
+//
+
+//******************************************************
+// Open a can channel
+//******************************************************
+CanHandle CANLIBAPI canOpenChannel (int channel, int flags)
+{
+  canStatus          status;
+  HandleData         *hData;
+  CanHandle          hnd;
+
+  API_STATS(canOpenChannel);
+
+  status = newHandleData(flags, &hData);
+  if (status < 0) {
+    return status;
+  }
+
+  status = getDevParams(channel, hData);
 
   if (status < 0) {
     DEBUGPRINT((TXT("getDevParams ret %d\n"), status));
@@ -388,7 +625,7 @@ CanHandle CANLIBAPI canOpenChannel (int channel, int flags)
 
   if (hnd < 0) {
     DEBUGPRINT((TXT("insertHandle ret %d\n"), hnd));
-    close(hData->fd);
+    hData->canOps->closeChannel(hData);
     free(hData);
     return canERR_NOMEM;
   }
@@ -397,6 +634,170 @@ CanHandle CANLIBAPI canOpenChannel (int channel, int flags)
 }
 
 
+// Number of worker threads used by canOpenChannels
+#define OPEN_CHANNELS_MAX_THREADS 8
+
+typedef struct {
+  HandleData      **hData;
+  canStatus       *status;
+  int             count;
+  int             next;
+  pthread_mutex_t lock;
+} OpenChannelsJob;
+
+static void *openChannelsWorker (void *arg)
+{
+  OpenChannelsJob *job = (OpenChannelsJob *)arg;
+  int i;
+
+  for (;;) {
+    pthread_mutex_lock(&job->lock);
+    i = job->next++;
+    pthread_mutex_unlock(&job->lock);
+
+    if (i >= job->count) {
+      break;
+    }
+    job->status[i] = job->hData[i]->canOps->openChannel(job->hData[i]);
+  }
+
+  return NULL;
+}
+
+//******************************************************
+// Open a set of can channels
+//******************************************************
+canStatus CANLIBAPI canOpenChannels (const int *channels, int n, int flags,
+                                     canHandle *out, canStatus *status)
+{
+  OpenChannelsJob job;
+  pthread_t       threads[OPEN_CHANNELS_MAX_THREADS];
+  int             nThreads = 0;
+  canStatus       stat = canOK;
+  canStatus       *chanStatus;
+  HandleData      **hData;
+  int             i, noHandle = -1;
+
+  API_STATS(canOpenChannels);
+
+  if (channels == NULL || out == NULL || n <= 0) {
+    return canERR_PARAM;
+  }
+
+  // Every handle is valid or none is, status tells which channels failed
+  for (i = 0; i < n; i++) {
+    out[i] = canINVALID_HANDLE;
+  }
+
+  hData      = calloc(n, sizeof(*hData));
+  chanStatus = calloc(n, sizeof(*chanStatus));
+  if (hData == NULL || chanStatus == NULL) {
+    free(hData);
+    free(chanStatus);
+    if (status) {
+      for (i = 0; i < n; i++) {
+        status[i] = canERR_NOMEM;
+      }
+    }
+    return canERR_NOMEM;
+  }
+
+  for (i = 0; i < n; i++) {
+    stat = newHandleData(flags, &hData[i]);
+    if (stat < 0) {
+      for (i = 0; i < n; i++) {
+        chanStatus[i] = stat;
+      }
+      goto cleanup;
+    }
+  }
+
+  // Enumerate the devices once for all channels.
+  stat = getDevParamsList(channels, n, hData);
+  if (stat < 0) {
+    for (i = 0; i < n; i++) {
+      if (hData[i]->canOps == NULL) {
+        chanStatus[i] = canERR_NOTFOUND;
+      }
+    }
+    goto cleanup;
+  }
+
+  // The open sequence consists of several driver round-trips, so run the
+  // channels in parallel. The calling thread takes part as well, which
+  // guarantees progress even if no worker thread could be started.
+  job.hData  = hData;
+  job.status = chanStatus;
+  job.count  = n;
+  job.next   = 0;
+  pthread_mutex_init(&job.lock, NULL);
+
+  while (nThreads < OPEN_CHANNELS_MAX_THREADS && nThreads < n - 1) {
+    if (vCanCreateThread(&threads[nThreads], openChannelsWorker, &job)) {
+      break;
+    }
+    nThreads++;
+  }
+  openChannelsWorker(&job);
+  for (i = 0; i < nThreads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  pthread_mutex_destroy(&job.lock);
+
+  for (i = 0; i < n; i++) {
+    if (chanStatus[i] < 0) {
+      DEBUGPRINT((TXT("openChannel %d ret %d\n"), channels[i], chanStatus[i]));
+      if (stat == canOK) {
+        stat = chanStatus[i];
+      }
+    }
+  }
+
+  if (stat == canOK) {
+    for (i = 0; i < n; i++) {
+      out[i] = insertHandle(hData[i]);
+      if (out[i] < 0) {
+        DEBUGPRINT((TXT("insertHandle ret %d\n"), out[i]));
+        out[i]   = canINVALID_HANDLE;
+        stat     = canERR_NOMEM;
+        noHandle = i;
+        break;
+      }
+    }
+  }
+
+  if (stat < 0) {
+    // Roll back everything that was opened.
+    for (i = 0; i < n; i++) {
+      if (out[i] >= 0) {
+        removeHandle(out[i]);
+        out[i] = canINVALID_HANDLE;
+      }
+      if (chanStatus[i] == canOK) {
+        hData[i]->canOps->closeChannel(hData[i]);
+      }
+    }
+    if (noHandle >= 0) {
+      chanStatus[noHandle] = canERR_NOMEM;
+    }
+  }
+
+cleanup:
+  if (status) {
+    memcpy(status, chanStatus, n * sizeof(*status));
+  }
+  if (stat < 0) {
+    for (i = 0; i < n; i++) {
+      free(hData[i]);
+    }
+  }
+  free(hData);
+  free(chanStatus);
+
+  return stat;
+}
+
+
 //******************************************************
 // Close can channel
 //******************************************************
@@ -405,6 +806,8 @@ int CANLIBAPI canClose (const CanHandle hnd)
   HandleData *hData;
   canStatus stat;
 
+  API_STATS(canClose);
+
   // Try to go Bus Off before closing
   stat = canBusOff(hnd);
 
@@ -417,17 +820,34 @@ int CANLIBAPI canClose (const CanHandle hnd)
   if (stat != canOK) {
     return stat;
   }
+
+  hData = findHandle(hnd);
+  if (hData != NULL) {
+    clockSyncDetach(hData);
+    busStatsFree(hData);
+    swObjBufDestroy(hData);
+    envvarDestroy(hData);
+  }
   
   hData = removeHandle(hnd);
   if (hData == NULL) {
     return canERR_INVHANDLE;
   }
 
-  if (close(hData->fd) != 0) {
+  if (hData->canOps->closeChannel(hData) != canOK) {
     return canERR_INVHANDLE;
   }
 
-  free(hData);
+  pthread_rwlock_wrlock(&hData->filterLock);
+  idFilterFree(&hData->idFilter);
+  free(hData->filterProg);
+  hData->filterProg = NULL;
+  pthread_rwlock_unlock(&hData->filterLock);
+  pthread_rwlock_destroy(&hData->filterLock);
+  pthread_mutex_destroy(&hData->fileTransferLock);
+  idStatsDestroy(hData->idStats);
+  // The dispatcher may still be in a callback of this handle
+  vCanNotifyFreeHandle(hData);
 
   return canOK;
 }
@@ -457,6 +877,8 @@ canStatus CANLIBAPI canBusOn (const CanHandle hnd)
 {
   HandleData *hData;
 
+  API_STATS(canBusOn);
+
   hData = findHandle(hnd);
   if (hData == NULL) {
     return canERR_INVHANDLE;
@@ -473,6 +895,8 @@ canStatus CANLIBAPI canBusOff (const CanHandle hnd)
 {
   HandleData *hData;
 
+  API_STATS(canBusOff);
+
   hData = findHandle(hnd);
   if (hData == NULL) {
     return canERR_INVHANDLE;
@@ -519,6 +943,8 @@ canSetBusParams (const CanHandle hnd, long freq, unsigned int tseg1,
   long freq_brs;
   unsigned int tseg1_brs, tseg2_brs, sjw_brs;
 
+  API_STATS(canSetBusParams);
+
   if ((noSamp != 3) && (noSamp != 1) && (noSamp != 0)) {
     return canERR_PARAM;
   }
@@ -564,6 +990,8 @@ canSetBusParamsFd (const CanHandle hnd, long freq_brs, unsigned int tseg1_brs,
   long freq;
   unsigned int tseg1, tseg2, sjw, noSamp, syncmode;
 
+  API_STATS(canSetBusParamsFd);
+
   hData = findHandle(hnd);
   if (hData == NULL) {
     return canERR_INVHANDLE;
@@ -636,6 +1064,8 @@ canGetBusParams (const CanHandle hnd, long *freq, unsigned int *tseg1,
 {
   HandleData *hData;
 
+  API_STATS(canGetBusParams);
+
   hData = findHandle(hnd);
   if (hData == NULL) {
     return canERR_INVHANDLE;
@@ -675,6 +1105,8 @@ canSetBusOutputControl (const CanHandle hnd, const unsigned int drivertype)
 {
   HandleData *hData;
 
+  API_STATS(canSetBusOutputControl);
+
   hData = findHandle(hnd);
   if (hData == NULL) {
     return canERR_INVHANDLE;
@@ -754,6 +1186,8 @@ canStatus CANLIBAPI canAccept (const CanHandle hnd,
 {
   HandleData *hData;
 
+  API_STATS(canAccept);
+
   hData = findHandle(hnd);
   if (hData == NULL) {
     return canERR_INVHANDLE;
@@ -767,83 +1201,216 @@ canStatus CANLIBAPI canSetAcceptanceFilter(const CanHandle hnd,
                                            unsigned int code,
                                            unsigned int mask,
                                            int is_extended)
-{
-  (void) hnd;
-  (void) code;
-  (void) mask;
-  (void) is_extended;
-  return canERR_NOT_IMPLEMENTED;
-}
-
-//******************************************************
-// Read bus status
-//******************************************************
-canStatus CANLIBAPI canReadStatus (const CanHandle hnd,
-                                   unsigned long *const flags)
 {
   HandleData *hData;
 
+  API_STATS(canSetAcceptanceFilter);
+
   hData = findHandle(hnd);
   if (hData == NULL) {
     return canERR_INVHANDLE;
   }
 
-  return hData->canOps->readStatus(hData, flags);
+  return hData->canOps->setAcceptanceFilter(hData, code, mask, is_extended);
 }
 
+/***************************************************************************/
+canStatus CANLIBAPI kvFilterCompile(const unsigned int *ids,
+                                    unsigned int count,
+                                    int is_extended,
+                                    kvFilterSet *filter)
+{
+  return idFilterCompile(ids, count, is_extended, filter);
+}
 
-//******************************************************
-// Flash LED
-//******************************************************
-canStatus CANLIBAPI kvFlashLeds (const CanHandle hnd,
-                                 int action, int timeout)
+/***************************************************************************/
+canStatus CANLIBAPI kvSetFilterIds(const CanHandle hnd,
+                                   const unsigned int *ids,
+                                   unsigned int count,
+                                   int is_extended,
+                                   kvFilterSet *filter)
 {
-  HandleData *hData;
+  HandleData  *hData;
+  kvFilterSet set;
+  canStatus   stat;
 
   hData = findHandle(hnd);
   if (hData == NULL) {
     return canERR_INVHANDLE;
   }
 
-  return hData->canOps->kvFlashLeds(hData, action, timeout);
-}
+  if (ids == NULL || count == 0) {
+    memset(&set, 0, sizeof(set));
+    set.is_extended = is_extended;
+    set.passRatio   = 1.0;
+    count           = 0;
+  } else {
+    stat = idFilterCompile(ids, count, is_extended, &set);
+    if (stat != canOK) {
+      return stat;
+    }
+  }
 
+  // The read path and the dispatcher may be filtering with the old set
+  pthread_rwlock_wrlock(&hData->filterLock);
+  stat = idFilterSet(&hData->idFilter, ids, count, is_extended);
+  pthread_rwlock_unlock(&hData->filterLock);
+  if (stat != canOK) {
+    return stat;
+  }
 
-//******************************************************
-// Request chip status
-//******************************************************
-canStatus CANLIBAPI canRequestChipStatus (const CanHandle hnd)
-{
-  HandleData *hData;
+  stat = hData->canOps->setAcceptanceFilter(hData, set.code, set.mask,
+                                            is_extended);
+  if (stat != canOK) {
+    pthread_rwlock_wrlock(&hData->filterLock);
+    idFilterSet(&hData->idFilter, NULL, 0, is_extended);
+    pthread_rwlock_unlock(&hData->filterLock);
+    return stat;
+  }
 
-  hData = findHandle(hnd);
-  if (hData == NULL) {
-    return canERR_INVHANDLE;
+  if (filter) {
+    *filter = set;
   }
 
-  // canRequestChipStatus is not needed in Linux, but in order to make code
-  // portable between Windows and Linux, a dummy function returning canOK
-  // was added.
-  return hData->canOps->requestChipStatus(hData);
+  return canOK;
 }
 
-
-//******************************************************
-// Read the error counters
-//******************************************************
-canStatus CANLIBAPI canReadErrorCounters (const CanHandle hnd,
-                                          unsigned int *txErr,
-                                          unsigned int *rxErr,
-                                          unsigned int *ovErr)
+/***************************************************************************/
+canStatus CANLIBAPI kvSetFilterProgram(const CanHandle hnd,
+                                       const char *expr,
+                                       int *errorPos)
 {
   HandleData *hData;
+  FilterProg *prog = NULL;
+  FilterProg *old;
+  canStatus  stat;
+
+  if (errorPos) {
+    *errorPos = -1;
+  }
+
   hData = findHandle(hnd);
   if (hData == NULL) {
     return canERR_INVHANDLE;
   }
 
-  return hData->canOps->readErrorCounters(hData, txErr, rxErr, ovErr);
-}
+  if (expr) {
+    stat = filterProgCompile(expr, &prog, errorPos);
+    if (stat != canOK) {
+      return stat;
+    }
+  }
+
+  // The read path and the dispatcher may be running the old program
+  pthread_rwlock_wrlock(&hData->filterLock);
+  old               = hData->filterProg;
+  hData->filterProg = prog;
+  pthread_rwlock_unlock(&hData->filterLock);
+  free(old);
+
+  return canOK;
+}
+
+/***************************************************************************/
+canStatus CANLIBAPI kvGetFilterProgramStats(const CanHandle hnd,
+                                            kvFilterProgramStats *stats)
+{
+  HandleData *hData;
+
+  if (stats == NULL) {
+    return canERR_PARAM;
+  }
+
+  hData = findHandle(hnd);
+  if (hData == NULL) {
+    return canERR_INVHANDLE;
+  }
+
+  pthread_rwlock_rdlock(&hData->filterLock);
+  if (hData->filterProg == NULL) {
+    pthread_rwlock_unlock(&hData->filterLock);
+    return canERR_PARAM;
+  }
+  filterProgGetStats(hData->filterProg, stats);
+  pthread_rwlock_unlock(&hData->filterLock);
+
+  return canOK;
+}
+
+//******************************************************
+// Read bus status
+//******************************************************
+canStatus CANLIBAPI canReadStatus (const CanHandle hnd,
+                                   unsigned long *const flags)
+{
+  HandleData *hData;
+
+  API_STATS(canReadStatus);
+
+  hData = findHandle(hnd);
+  if (hData == NULL) {
+    return canERR_INVHANDLE;
+  }
+
+  return hData->canOps->readStatus(hData, flags);
+}
+
+
+//******************************************************
+// Flash LED
+//******************************************************
+canStatus CANLIBAPI kvFlashLeds (const CanHandle hnd,
+                                 int action, int timeout)
+{
+  HandleData *hData;
+
+  hData = findHandle(hnd);
+  if (hData == NULL) {
+    return canERR_INVHANDLE;
+  }
+
+  return hData->canOps->kvFlashLeds(hData, action, timeout);
+}
+
+
+//******************************************************
+// Request chip status
+//******************************************************
+canStatus CANLIBAPI canRequestChipStatus (const CanHandle hnd)
+{
+  HandleData *hData;
+
+  hData = findHandle(hnd);
+  if (hData == NULL) {
+    return canERR_INVHANDLE;
+  }
+
+  // canRequestChipStatus is not needed in Linux, but in order to make code
+  // portable between Windows and Linux, a dummy function returning canOK
+  // was added.
+  return hData->canOps->requestChipStatus(hData);
+}
+
+
+//******************************************************
+// Read the error counters
+//******************************************************
+canStatus CANLIBAPI canReadErrorCounters (const CanHandle hnd,
+                                          unsigned int *txErr,
+                                          unsigned int *rxErr,
+                                          unsigned int *ovErr)
+{
+  HandleData *hData;
+
+  API_STATS(canReadErrorCounters);
+
+  hData = findHandle(hnd);
+  if (hData == NULL) {
+    return canERR_INVHANDLE;
+  }
+
+  return hData->canOps->readErrorCounters(hData, txErr, rxErr, ovErr);
+}
 
 
 //******************************************************
@@ -855,6 +1422,8 @@ canWrite (const CanHandle hnd, long id, void *msgPtr,
 {
   HandleData *hData;
 
+  API_STATS(canWrite);
+
   // If msgPtr is NULL then dlc must be 0, unless it is a remote frame.
   if ((msgPtr == NULL) && (dlc != 0) && ((flag & canMSG_RTR) == 0)) {
     return canERR_PARAM;
@@ -878,6 +1447,8 @@ canWriteWait (const CanHandle hnd, long id, void *msgPtr,
 {
   HandleData *hData;
 
+  API_STATS(canWriteWait);
+
   // If msgPtr is NULL then dlc must be 0, unless it is a remote frame.
   if ((msgPtr == NULL) && (dlc != 0) && ((flag & canMSG_RTR) == 0)) {
     return canERR_PARAM;
@@ -901,6 +1472,8 @@ canRead (const CanHandle hnd, long *id, void *msgPtr, unsigned int *dlc,
 {
   HandleData *hData;
   
+  API_STATS(canRead);
+
   hData = findHandle(hnd);
   if (hData == NULL) {
     return canERR_INVHANDLE;
@@ -924,6 +1497,8 @@ canReadSpecific(const CanHandle hnd,
 {
   HandleData *hData;
 
+  API_STATS(canReadSpecific);
+
   hData = findHandle(hnd);
   if (hData == NULL) {
     return canERR_INVHANDLE;
@@ -943,6 +1518,8 @@ canReadSyncSpecific(const CanHandle hnd,
 {
   HandleData *hData;
 
+  API_STATS(canReadSyncSpecific);
+
   hData = findHandle(hnd);
   if (hData == NULL) {
     return canERR_INVHANDLE;
@@ -965,6 +1542,8 @@ canReadSpecificSkip(const CanHandle hnd,
 {
   HandleData *hData;
 
+  API_STATS(canReadSpecificSkip);
+
   hData = findHandle(hnd);
   if (hData == NULL) {
     return canERR_INVHANDLE;
@@ -982,6 +1561,8 @@ canReadWait (const CanHandle hnd, long *id, void *msgPtr, unsigned int *dlc,
 {
   HandleData *hData;
 
+  API_STATS(canReadWait);
+
   hData = findHandle(hnd);
 
   if (hData == NULL) {
@@ -1000,6 +1581,8 @@ canReadSync(const CanHandle hnd, unsigned long timeout)
 {
   HandleData *hData;
 
+  API_STATS(canReadSync);
+
   hData = findHandle(hnd);
 
   if (hData == NULL) {
@@ -1017,6 +1600,8 @@ canWriteSync (const CanHandle hnd, unsigned long timeout)
 {
   HandleData *hData;
 
+  API_STATS(canWriteSync);
+
   hData = findHandle(hnd);
   if (hData == NULL) {
     return canERR_INVHANDLE;
@@ -1035,11 +1620,45 @@ canIoCtl (const CanHandle hnd, unsigned int func,
 {
   HandleData *hData;
 
+  API_STATS(canIoCtl);
+
   hData = findHandle(hnd);
   if (hData == NULL) {
     return canERR_INVHANDLE;
   }
 
+  // Clock correlation is done by the library for all kinds of channels
+  switch (func) {
+  case canIOCTL_SET_CLOCK_CORRELATION:
+    if (buf == NULL || buflen != sizeof(uint32_t)) {
+      return canERR_PARAM;
+    }
+    return clockSyncSetCorrelation(hData, *(uint32_t *)buf != 0);
+
+  case canIOCTL_SET_TIMESTAMP_CLOCK:
+    if (buf == NULL || buflen != sizeof(uint32_t)) {
+      return canERR_PARAM;
+    }
+    return clockSyncSetTimestampClock(hData, *(uint32_t *)buf);
+
+  case canIOCTL_GET_TIMESTAMP_CLOCK:
+    if (buf == NULL || buflen != sizeof(uint32_t)) {
+      return canERR_PARAM;
+    }
+    *(uint32_t *)buf = hData->clockSync.timestampClock;
+    return canOK;
+
+  case canIOCTL_SET_API_STATS:
+    if (buf == NULL || buflen != sizeof(uint32_t)) {
+      return canERR_PARAM;
+    }
+    return apiStatsEnable(*(uint32_t *)buf);
+
+  case canIOCTL_RESET_API_STATS:
+    apiStatsReset();
+    return canOK;
+  }
+
   return hData->canOps->ioCtl(hData, func, buf, buflen);
 }
 
@@ -1066,6 +1685,8 @@ canStatus CANLIBAPI kvReadTimer (const CanHandle hnd, unsigned int *time)
 {
   HandleData *hData;
 
+  API_STATS(kvReadTimer);
+
   hData = findHandle(hnd);
   if (hData == NULL) {
     return canERR_INVHANDLE;
@@ -1082,6 +1703,8 @@ canStatus CANLIBAPI kvReadTimer64 (const CanHandle hnd, uint64_t *time)
 {
   HandleData *hData;
 
+  API_STATS(kvReadTimer64);
+
   hData = findHandle(hnd);
   if (hData == NULL) {
     return canERR_INVHANDLE;
@@ -1091,6 +1714,148 @@ canStatus CANLIBAPI kvReadTimer64 (const CanHandle hnd, uint64_t *time)
 }
 
 
+//******************************************************
+// Create time domain
+//******************************************************
+kvStatus CANLIBAPI kvTimeDomainCreate (kvTimeDomain *domain)
+{
+  if (domain == NULL) {
+    return canERR_PARAM;
+  }
+
+  return clockSyncDomainCreate((struct ClockSyncDomain **)domain);
+}
+
+//******************************************************
+// Delete time domain
+//******************************************************
+kvStatus CANLIBAPI kvTimeDomainDelete (kvTimeDomain domain)
+{
+  return clockSyncDomainDelete(domain);
+}
+
+//******************************************************
+// Reset time of time domain
+//******************************************************
+kvStatus CANLIBAPI kvTimeDomainResetTime (kvTimeDomain domain)
+{
+  return clockSyncDomainReset(domain);
+}
+
+//******************************************************
+// Get time domain data
+//******************************************************
+kvStatus CANLIBAPI kvTimeDomainGetData (kvTimeDomain domain,
+                                        kvTimeDomainData *data,
+                                        size_t bufsiz)
+{
+  kvTimeDomainData tmp;
+  kvStatus         stat;
+
+  // Older callers only know about the first four members
+  if (data == NULL || bufsiz < 4 * sizeof(int)) {
+    return canERR_PARAM;
+  }
+
+  memset(&tmp, 0, sizeof(tmp));
+  stat = clockSyncDomainGetData(domain, &tmp.nNonMagiSyncedMembers,
+                                &tmp.nSoftSyncedMembers,
+                                &tmp.maxDriftPpm, &tmp.maxResidualUs);
+  if (stat != canOK) {
+    return stat;
+  }
+
+  // There is no MagiSync support; each channel is synchronized on its own.
+  tmp.nNonMagiSyncCards = tmp.nNonMagiSyncedMembers;
+
+  memcpy(data, &tmp, bufsiz < sizeof(tmp) ? bufsiz : sizeof(tmp));
+
+  return canOK;
+}
+
+//******************************************************
+// Add handle to time domain
+//******************************************************
+kvStatus CANLIBAPI kvTimeDomainAddHandle (kvTimeDomain domain,
+                                          const CanHandle hnd)
+{
+  HandleData *hData;
+
+  hData = findHandle(hnd);
+  if (hData == NULL) {
+    return canERR_INVHANDLE;
+  }
+
+  return clockSyncDomainAdd(domain, hData);
+}
+
+//******************************************************
+// Remove handle from time domain
+//******************************************************
+kvStatus CANLIBAPI kvTimeDomainRemoveHandle (kvTimeDomain domain,
+                                             const CanHandle hnd)
+{
+  HandleData *hData;
+
+  hData = findHandle(hnd);
+  if (hData == NULL) {
+    return canERR_INVHANDLE;
+  }
+
+  return clockSyncDomainRemove(domain, hData);
+}
+
+//******************************************************
+// Get device to host clock correlation
+//******************************************************
+kvStatus CANLIBAPI kvGetClockCorrelation (const CanHandle hnd,
+                                          kvClockCorrelation *data,
+                                          size_t bufsiz)
+{
+  HandleData         *hData;
+  kvClockCorrelation tmp;
+  kvStatus           stat;
+
+  if (data == NULL) {
+    return canERR_PARAM;
+  }
+
+  hData = findHandle(hnd);
+  if (hData == NULL) {
+    return canERR_INVHANDLE;
+  }
+
+  stat = clockSyncGetCorrelation(hData, &tmp);
+  if (stat != canOK) {
+    return stat;
+  }
+  memcpy(data, &tmp, bufsiz < sizeof(tmp) ? bufsiz : sizeof(tmp));
+
+  return canOK;
+}
+
+//******************************************************
+// Get clock correlation fit residuals
+//******************************************************
+kvStatus CANLIBAPI kvGetClockResiduals (const CanHandle hnd,
+                                        double *residuals,
+                                        unsigned int *count)
+{
+  HandleData *hData;
+
+  if (residuals == NULL || count == NULL) {
+    return canERR_PARAM;
+  }
+
+  hData = findHandle(hnd);
+  if (hData == NULL) {
+    return canERR_INVHANDLE;
+  }
+
+  return clockSyncGetResiduals(hData, residuals, count);
+}
+
+
 //******************************************************
 // Translate from baud macro to bus params
 //******************************************************
@@ -1291,7 +2056,7 @@ canStatus CANLIBAPI canGetNumberOfChannels (int *channelCount)
     }
   }
 
-  *channelCount = tmpCount;
+  *channelCount = tmpCount + vCanSimChannels();
 
   return canOK;
 }
@@ -1305,9 +2070,10 @@ canStatus CANLIBAPI canGetNumberOfChannels (int *channelCount)
 canStatus CANLIBAPI
 canGetDescrData (void *buffer, const size_t bufsize, unsigned int ean[], int cap)
 {
-  unsigned int len, i;
+  const struct dev_descr **found = NULL;
+  struct dev_descr key;
 
-  len = sizeof(dev_descr_list)/sizeof(struct dev_descr);
+  pthread_once(&dev_descr_once, dev_descr_build_index);
 
   /* set Unknown device description */
   strncpy(buffer, dev_descr_list[0].descr_string, bufsize - 1);
@@ -1320,15 +2086,14 @@ canGetDescrData (void *buffer, const size_t bufsize, unsigned int ean[], int cap
     strncpy(buffer, dev_descr_list[1].descr_string, bufsize - 1);
   }
   /* search for description by matching ean number */
-  else
+  else if (dev_descr_index)
   {
-    for (i = 2; i<len; i++)
-    {
-      if ((ean[0] == dev_descr_list[i].ean[0]) && (ean[1] == dev_descr_list[i].ean[1]))
-      {
-        strncpy(buffer, dev_descr_list[i].descr_string, bufsize - 1);
-        break;
-      }
+    key.ean[0] = ean[0];
+    key.ean[1] = ean[1];
+    found = bsearch(&key, dev_descr_index, dev_descr_index_len,
+                    sizeof(*dev_descr_index), dev_descr_search_cmp);
+    if (found) {
+      strncpy(buffer, (*found)->descr_string, bufsize - 1);
     }
   }
   return canOK;
@@ -1425,8 +2190,7 @@ canGetChannelData (int channel, int item, void *buffer, const size_t bufsize)
   canStatus status;
   HandleData hData;
 
-  status = getDevParams(channel, hData.deviceName, &hData.channelNr,
-                        &hData.canOps, hData.deviceOfficialName);
+  status = getDevParams(channel, &hData);
 
   if (status < 0) {
     return status;
@@ -1626,40 +2390,175 @@ canStatus CANLIBAPI canObjBufDisable (const CanHandle hnd, int idx)
 }
 
 
-//******************************************************
-// Flush receive queue
-//******************************************************
-canStatus CANLIBAPI
-canFlushReceiveQueue (const CanHandle hnd)
+//===========================================================================
+static canStatus objBufSpecCheck (HandleData *hData, const canObjBufSpec *spec)
 {
-  HandleData *hData;
+  int ext;
 
-  hData = findHandle(hnd);
-  if (hData == NULL) {
-    return canERR_INVHANDLE;
+  if (spec->type != canOBJBUF_TYPE_AUTO_RESPONSE &&
+      spec->type != canOBJBUF_TYPE_PERIODIC_TX) {
+    return canERR_PARAM;
   }
 
-  return hData->canOps->ioCtl(hData, canIOCTL_FLUSH_RX_BUFFER, NULL, 0);
+  ext = (spec->flags & canMSG_EXT) != 0;
+  if (spec->id < 0 || spec->id >= (ext ? (1L << 29) : (1L << 11))) {
+    return canERR_PARAM;
+  }
+
+  return vCanObjbufCheck(hData, spec->dlc, spec->flags);
 }
 
+// Undoes what canObjBufConfigure did to the first n buffers
+static void objBufConfigureUndo (HandleData *hData, int *indices, int n)
+{
+  int i;
 
-//******************************************************
-// Flush transmit queue
-//******************************************************
+  for (i = 0; i < n; i++) {
+    hData->canOps->objbufDisable(hData, indices[i]);
+    hData->canOps->objbufFree(hData, indices[i]);
+    indices[i] = -1;
+  }
+}
+
+//===========================================================================
 canStatus CANLIBAPI
-canFlushTransmitQueue (const CanHandle hnd)
+canObjBufConfigure (const CanHandle hnd, const canObjBufSpec *specs, int n,
+                    int *indices)
 {
-  HandleData *hData;
+  HandleData          *hData;
+  const canObjBufSpec *spec;
+  canStatus           stat = canOK;
+  int                 i, allocated;
+
+  API_STATS(canObjBufConfigure);
+
+  if (specs == NULL || indices == NULL || n < 0) {
+    return canERR_PARAM;
+  }
 
   hData = findHandle(hnd);
   if (hData == NULL) {
     return canERR_INVHANDLE;
   }
 
-  return hData->canOps->ioCtl(hData, canIOCTL_FLUSH_TX_BUFFER, NULL, 0);
-}
-
-//******************************************************
+  for (i = 0; i < n; i++) {
+    indices[i] = -1;
+  }
+  for (i = 0; i < n; i++) {
+    stat = objBufSpecCheck(hData, &specs[i]);
+    if (stat != canOK) {
+      return stat;
+    }
+  }
+
+  // Settings that are still at their value after allocation are skipped,
+  // the driver has no call that sets up a buffer in one go
+  for (allocated = 0; allocated < n; allocated++) {
+    spec = &specs[allocated];
+    stat = hData->canOps->objbufAllocate(hData, spec->type, &indices[allocated]);
+    if (stat != canOK) {
+      indices[allocated] = -1;
+      break;
+    }
+
+    stat = hData->canOps->objbufWrite(hData, indices[allocated], spec->id,
+                                      (void *)spec->data, spec->dlc, spec->flags);
+    if (stat == canOK && spec->type == canOBJBUF_TYPE_PERIODIC_TX) {
+      if (spec->period) {
+        stat = hData->canOps->objbufSetPeriod(hData, indices[allocated],
+                                              spec->period);
+      }
+      if (stat == canOK && spec->msgCount) {
+        stat = hData->canOps->objbufSetMsgCount(hData, indices[allocated],
+                                                spec->msgCount);
+      }
+    } else if (stat == canOK) {
+      if (spec->code || spec->mask) {
+        stat = hData->canOps->objbufSetFilter(hData, indices[allocated],
+                                              spec->code, spec->mask);
+      }
+      if (stat == canOK && spec->bufFlags) {
+        stat = hData->canOps->objbufSetFlags(hData, indices[allocated],
+                                             spec->bufFlags);
+      }
+    }
+    if (stat != canOK) {
+      allocated++;
+      break;
+    }
+  }
+
+  // Nothing is enabled until every buffer is in place. Auto-response
+  // buffers go first, so that a failure before the periodic buffers are
+  // enabled has not sent anything.
+  for (i = 0; stat == canOK && i < n; i++) {
+    if (specs[i].enable && specs[i].type == canOBJBUF_TYPE_AUTO_RESPONSE) {
+      stat = hData->canOps->objbufEnable(hData, indices[i]);
+    }
+  }
+  for (i = 0; stat == canOK && i < n; i++) {
+    if (specs[i].enable && specs[i].type == canOBJBUF_TYPE_PERIODIC_TX) {
+      stat = hData->canOps->objbufEnable(hData, indices[i]);
+    }
+  }
+
+  if (stat != canOK) {
+    objBufConfigureUndo(hData, indices, allocated);
+  }
+
+  return stat;
+}
+
+
+//===========================================================================
+canStatus CANLIBAPI
+kvObjBufGetStats (const CanHandle hnd, int idx, kvObjBufStats *stats)
+{
+  HandleData *hData;
+
+  hData = findHandle(hnd);
+  if (hData == NULL) {
+    return canERR_INVHANDLE;
+  }
+
+  return swObjBufGetStats(hData, idx, stats);
+}
+
+
+//******************************************************
+// Flush receive queue
+//******************************************************
+canStatus CANLIBAPI
+canFlushReceiveQueue (const CanHandle hnd)
+{
+  HandleData *hData;
+
+  hData = findHandle(hnd);
+  if (hData == NULL) {
+    return canERR_INVHANDLE;
+  }
+
+  return hData->canOps->ioCtl(hData, canIOCTL_FLUSH_RX_BUFFER, NULL, 0);
+}
+
+
+//******************************************************
+// Flush transmit queue
+//******************************************************
+canStatus CANLIBAPI
+canFlushTransmitQueue (const CanHandle hnd)
+{
+  HandleData *hData;
+
+  hData = findHandle(hnd);
+  if (hData == NULL) {
+    return canERR_INVHANDLE;
+  }
+
+  return hData->canOps->ioCtl(hData, canIOCTL_FLUSH_TX_BUFFER, NULL, 0);
+}
+
+//******************************************************
 // Request bus statistics
 //******************************************************
 canStatus CANLIBAPI
@@ -1667,6 +2566,8 @@ canRequestBusStatistics(const CanHandle hnd)
 {
   HandleData *hData;
 
+  API_STATS(canRequestBusStatistics);
+
   hData = findHandle(hnd);
   if (hData == NULL) {
     return canERR_INVHANDLE;
@@ -1684,6 +2585,8 @@ canStatus CANLIBAPI canGetBusStatistics (const CanHandle hnd,
 {
   HandleData *hData;
 
+  API_STATS(canGetBusStatistics);
+
   if ((stat == NULL) || (bufsiz != sizeof(canBusStatistics))) {
     return canERR_PARAM;
   }
@@ -1696,6 +2599,136 @@ canStatus CANLIBAPI canGetBusStatistics (const CanHandle hnd,
   return hData->canOps->getBusStats(hData, stat);
 }
 
+//******************************************************
+// Bus statistics sampler
+//******************************************************
+canStatus CANLIBAPI kvBusStatsStart (const CanHandle hnd,
+                                     unsigned int intervalMs,
+                                     unsigned int depth)
+{
+  HandleData *hData;
+
+  hData = findHandle(hnd);
+  if (hData == NULL) {
+    return canERR_INVHANDLE;
+  }
+
+  return busStatsStart(hData, intervalMs, depth);
+}
+
+canStatus CANLIBAPI kvBusStatsStop (const CanHandle hnd)
+{
+  HandleData *hData;
+
+  hData = findHandle(hnd);
+  if (hData == NULL) {
+    return canERR_INVHANDLE;
+  }
+
+  return busStatsStop(hData);
+}
+
+canStatus CANLIBAPI kvBusStatsGetSamples (const CanHandle hnd,
+                                          kvBusStatsSample *samples,
+                                          unsigned int *count)
+{
+  HandleData *hData;
+
+  hData = findHandle(hnd);
+  if (hData == NULL) {
+    return canERR_INVHANDLE;
+  }
+
+  return busStatsGetSamples(hData, samples, count);
+}
+
+canStatus CANLIBAPI kvBusStatsGetSummary (const CanHandle hnd,
+                                          unsigned int windowMs,
+                                          kvBusStatsSummary *summary)
+{
+  HandleData *hData;
+
+  hData = findHandle(hnd);
+  if (hData == NULL) {
+    return canERR_INVHANDLE;
+  }
+
+  return busStatsGetSummary(hData, windowMs, summary);
+}
+
+//******************************************************
+// Per-id statistics
+//******************************************************
+canStatus CANLIBAPI kvIdStatsEnable (const CanHandle hnd, int enable)
+{
+  HandleData *hData;
+  IdStats    *stats;
+  IdStats    *none = NULL;
+
+  hData = findHandle(hnd);
+  if (hData == NULL) {
+    return canERR_INVHANDLE;
+  }
+
+  // Kept until the handle is closed, the read path may be using it
+  stats = __atomic_load_n(&hData->idStats, __ATOMIC_ACQUIRE);
+  if (stats == NULL) {
+    if (!enable) {
+      return canOK;
+    }
+    stats = idStatsCreate();
+    if (stats == NULL) {
+      return canERR_NOMEM;
+    }
+    if (!__atomic_compare_exchange_n(&hData->idStats, &none, stats, 0,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      idStatsDestroy(stats);
+      stats = none;
+    }
+  }
+  idStatsEnable(stats, enable != 0);
+
+  return canOK;
+}
+
+canStatus CANLIBAPI kvIdStatsGet (const CanHandle hnd,
+                                  kvIdStats *stats,
+                                  unsigned int *count,
+                                  unsigned int *total)
+{
+  HandleData *hData;
+
+  hData = findHandle(hnd);
+  if (hData == NULL) {
+    return canERR_INVHANDLE;
+  }
+
+  if (hData->idStats == NULL) {
+    return canERR_PARAM;
+  }
+
+  return idStatsGet(hData->idStats, stats, count, total);
+}
+
+canStatus CANLIBAPI kvIdStatsGetId (const CanHandle hnd,
+                                    unsigned int id,
+                                    unsigned int flags,
+                                    kvIdStats *stats)
+{
+  HandleData *hData;
+
+  hData = findHandle(hnd);
+  if (hData == NULL) {
+    return canERR_INVHANDLE;
+  }
+
+  if (hData->idStats == NULL) {
+    return canERR_PARAM;
+  }
+
+  return idStatsGetId(hData->idStats, id, (flags & canMSG_EXT) != 0, stats);
+}
+
 
 /***************************************************************************/
 kvStatus CANLIBAPI kvFileCopyToDevice(const CanHandle hnd, char *hostFileName, char *deviceFileName)
@@ -1710,7 +2743,27 @@ kvStatus CANLIBAPI kvFileCopyToDevice(const CanHandle hnd, char *hostFileName, c
     return canERR_PARAM;
   }
 
-  return hData->canOps->kvFileCopyToDevice(hData, hostFileName, deviceFileName);
+  return hData->canOps->kvFileCopyToDevice(hData, hostFileName, deviceFileName,
+                                           0, NULL);
+}
+
+/***************************************************************************/
+kvStatus CANLIBAPI kvFileCopyToDeviceEx(const CanHandle hnd, char *hostFileName,
+                                        char *deviceFileName,
+                                        unsigned int flags, uint32_t *crc)
+{
+  HandleData *hData;
+
+  hData = findHandle(hnd);
+  if (hData == NULL) {
+    return canERR_INVHANDLE;
+  }
+  if (!hostFileName || !deviceFileName || (flags & ~kvFILE_COPY_VERIFY)) {
+    return canERR_PARAM;
+  }
+
+  return hData->canOps->kvFileCopyToDevice(hData, hostFileName, deviceFileName,
+                                           flags, crc);
 }
 
 /***************************************************************************/
@@ -1726,7 +2779,30 @@ kvStatus CANLIBAPI kvFileCopyFromDevice(const CanHandle hnd, char *deviceFileNam
     return canERR_PARAM;
   }
 
-  return hData->canOps->kvFileCopyFromDevice(hData, deviceFileName, hostFileName);
+  return hData->canOps->kvFileCopyFromDevice(hData, deviceFileName, hostFileName,
+                                             0, NULL);
+}
+
+/***************************************************************************/
+kvStatus CANLIBAPI kvFileCopyFromDeviceEx(const CanHandle hnd,
+                                          char *deviceFileName,
+                                          char *hostFileName,
+                                          unsigned int flags, uint32_t *crc)
+{
+  HandleData *hData;
+
+  hData = findHandle(hnd);
+  if (hData == NULL) {
+    return canERR_INVHANDLE;
+  }
+  if (!hostFileName || !deviceFileName ||
+      (flags & ~(kvFILE_COPY_RESUME | kvFILE_COPY_VERIFY |
+                 kvFILE_COPY_RETRY))) {
+    return canERR_PARAM;
+  }
+
+  return hData->canOps->kvFileCopyFromDevice(hData, deviceFileName, hostFileName,
+                                             flags, crc);
 }
 
 /***************************************************************************/
@@ -1745,6 +2821,179 @@ kvStatus CANLIBAPI kvFileDelete(const CanHandle hnd, char *deviceFileName)
   return hData->canOps->kvFileDelete(hData, deviceFileName);
 }
 
+/***************************************************************************/
+kvStatus CANLIBAPI kvFileReadStream(const CanHandle hnd, char *deviceFileName,
+                                    kvFileReadCallback callback, void *context)
+{
+  HandleData *hData;
+
+  hData = findHandle(hnd);
+  if (hData == NULL) {
+    return canERR_INVHANDLE;
+  }
+  if (!deviceFileName || !callback) {
+    return canERR_PARAM;
+  }
+
+  return hData->canOps->kvFileReadStream(hData, deviceFileName, callback,
+                                         context);
+}
+
+/***************************************************************************/
+kvStatus CANLIBAPI kvFileWriteStream(const CanHandle hnd, char *deviceFileName,
+                                     kvFileWriteCallback callback,
+                                     void *context)
+{
+  HandleData *hData;
+
+  hData = findHandle(hnd);
+  if (hData == NULL) {
+    return canERR_INVHANDLE;
+  }
+  if (!deviceFileName || !callback) {
+    return canERR_PARAM;
+  }
+
+  return hData->canOps->kvFileWriteStream(hData, deviceFileName, callback,
+                                          context, 0);
+}
+
+//======================================================================
+// Memory buffers on top of the streams
+//======================================================================
+typedef struct {
+  unsigned char *buffer;
+  unsigned int  size;
+  unsigned int  len;
+  int           overflow;
+} FileMemory;
+
+static int CANLIBAPI fileMemoryRead(CanHandle hnd, const void *data,
+                                    unsigned int len, void *context)
+{
+  FileMemory *m = (FileMemory *)context;
+
+  (void)hnd;
+  if (len > m->size - m->len) {
+    len = m->size - m->len;
+    m->overflow = 1;
+  }
+  memcpy(m->buffer + m->len, data, len);
+  m->len += len;
+
+  return m->overflow;
+}
+
+static int CANLIBAPI fileMemoryWrite(CanHandle hnd, void *buffer,
+                                     unsigned int size, unsigned int *len,
+                                     void *context)
+{
+  FileMemory *m = (FileMemory *)context;
+
+  (void)hnd;
+  if (size > m->size - m->len) {
+    size = m->size - m->len;
+  }
+  memcpy(buffer, m->buffer + m->len, size);
+  m->len += size;
+  *len    = size;
+
+  return 0;
+}
+
+/***************************************************************************/
+kvStatus CANLIBAPI kvFileReadMemory(const CanHandle hnd, char *deviceFileName,
+                                    void *buffer, unsigned int size,
+                                    unsigned int *len)
+{
+  HandleData *hData;
+  FileMemory m;
+  canStatus stat;
+
+  hData = findHandle(hnd);
+  if (hData == NULL) {
+    return canERR_INVHANDLE;
+  }
+  if (!deviceFileName || (!buffer && size) || !len) {
+    return canERR_PARAM;
+  }
+
+  memset(&m, 0, sizeof(m));
+  m.buffer = buffer;
+  m.size   = size;
+  stat = hData->canOps->kvFileReadStream(hData, deviceFileName,
+                                         fileMemoryRead, &m);
+  if (m.overflow) {
+    stat = canERR_NOMEM;
+  }
+  *len = m.len;
+
+  return stat;
+}
+
+/***************************************************************************/
+kvStatus CANLIBAPI kvFileWriteMemory(const CanHandle hnd, char *deviceFileName,
+                                     const void *buffer, unsigned int len)
+{
+  HandleData *hData;
+  FileMemory m;
+
+  hData = findHandle(hnd);
+  if (hData == NULL) {
+    return canERR_INVHANDLE;
+  }
+  if (!deviceFileName || (!buffer && len)) {
+    return canERR_PARAM;
+  }
+
+  memset(&m, 0, sizeof(m));
+  m.buffer = (unsigned char *)buffer;
+  m.size   = len;
+
+  return hData->canOps->kvFileWriteStream(hData, deviceFileName,
+                                          fileMemoryWrite, &m, len);
+}
+
+/***************************************************************************/
+kvStatus CANLIBAPI kvFileSetProgressCallback(const CanHandle hnd,
+                                             kvFileProgressCallback callback,
+                                             void *context)
+{
+  HandleData *hData;
+
+  hData = findHandle(hnd);
+  if (hData == NULL) {
+    return canERR_INVHANDLE;
+  }
+
+  hData->fileProgress        = callback;
+  hData->fileProgressContext = context;
+
+  return canOK;
+}
+
+/***************************************************************************/
+kvStatus CANLIBAPI kvFileGetTransferStats(const CanHandle hnd,
+                                          kvFileProgress *progress)
+{
+  HandleData *hData;
+
+  hData = findHandle(hnd);
+  if (hData == NULL) {
+    return canERR_INVHANDLE;
+  }
+  if (!progress) {
+    return canERR_PARAM;
+  }
+
+  // Written by the thread that runs the transfer
+  pthread_mutex_lock(&hData->fileTransferLock);
+  *progress = hData->fileTransfer;
+  pthread_mutex_unlock(&hData->fileTransferLock);
+
+  return canOK;
+}
+
 /***************************************************************************/
 kvStatus CANLIBAPI kvFileGetName(const CanHandle hnd, int fileNo, char *name, int namelen)
 {
@@ -1879,50 +3128,103 @@ kvEnvHandle CANLIBAPI kvScriptEnvvarOpen(const CanHandle hnd,
                                          int *envvarType,
                                          int *envvarSize)
 {
-  (void) hnd;
-  (void) envvarName;
-  (void) envvarType;
-  (void) envvarSize;
-  return canERR_NOT_IMPLEMENTED;
+  HandleData *hData;
+  canStatus stat;
+  int index;
+
+  hData = findHandle(hnd);
+  if (hData == NULL) {
+    return canERR_INVHANDLE;
+  }
+  if (!envvarName || !envvarType || !envvarSize) {
+    return canERR_PARAM;
+  }
+
+  stat = envvarOpen(hData, envvarName, envvarType, envvarSize, &index);
+  if (stat != canOK) {
+    return stat;
+  }
+  return ENVVAR_HANDLE(hnd, index);
 }
 
 /***************************************************************************/
 kvStatus CANLIBAPI kvScriptEnvvarClose (kvEnvHandle eHnd)
 {
-  (void) eHnd;
-  return canERR_NOT_IMPLEMENTED;
+  HandleData *hData;
+
+  if (eHnd <= 0) {
+    return canERR_PARAM;
+  }
+  hData = findHandle(ENVVAR_CANHANDLE(eHnd));
+  if (hData == NULL) {
+    return canERR_INVHANDLE;
+  }
+  return envvarClose(hData, ENVVAR_INDEX(eHnd));
+}
+
+//======================================================================
+// Single envvar access, as batches of one
+//======================================================================
+static canStatus envvarAccess (kvEnvHandle eHnd, int set, int type,
+                               void *buf, int start, int len)
+{
+  HandleData *hData;
+  kvEnvvarIo io;
+  canStatus stat;
+  int envType, envSize;
+
+  if (eHnd <= 0) {
+    return canERR_PARAM;
+  }
+  hData = findHandle(ENVVAR_CANHANDLE(eHnd));
+  if (hData == NULL) {
+    return canERR_INVHANDLE;
+  }
+  if (type) {
+    stat = envvarGetType(hData, ENVVAR_INDEX(eHnd), &envType, &envSize);
+    if (stat != canOK) {
+      return stat;
+    }
+    if (envType != type || envSize < len) {
+      return canERR_PARAM;
+    }
+  }
+
+  io.eHnd        = eHnd;
+  io.buf         = buf;
+  io.start_index = start;
+  io.data_len    = len;
+  return set ? envvarSet(hData, &io, 1) : envvarGet(hData, &io, 1);
 }
 
 /***************************************************************************/
 kvStatus CANLIBAPI kvScriptEnvvarSetInt(kvEnvHandle eHnd, int val)
 {
-  (void) eHnd;
-  (void) val;
-  return canERR_NOT_IMPLEMENTED;
+  return envvarAccess(eHnd, 1, kvENVVAR_TYPE_INT, &val, 0, sizeof(val));
 }
 
 /***************************************************************************/
 kvStatus CANLIBAPI kvScriptEnvvarGetInt(kvEnvHandle eHnd, int *val)
 {
-  (void) eHnd;
-  (void) val;
-  return canERR_NOT_IMPLEMENTED;
+  if (!val) {
+    return canERR_PARAM;
+  }
+  return envvarAccess(eHnd, 0, kvENVVAR_TYPE_INT, val, 0, sizeof(*val));
 }
 
 /***************************************************************************/
 kvStatus CANLIBAPI kvScriptEnvvarSetFloat(kvEnvHandle eHnd, float val)
 {
-  (void) eHnd;
-  (void) val;
-  return canERR_NOT_IMPLEMENTED;
+  return envvarAccess(eHnd, 1, kvENVVAR_TYPE_FLOAT, &val, 0, sizeof(val));
 }
 
 /***************************************************************************/
 kvStatus CANLIBAPI kvScriptEnvvarGetFloat(kvEnvHandle eHnd, float *val)
 {
-  (void) eHnd;
-  (void) val;
-  return canERR_NOT_IMPLEMENTED;
+  if (!val) {
+    return canERR_PARAM;
+  }
+  return envvarAccess(eHnd, 0, kvENVVAR_TYPE_FLOAT, val, 0, sizeof(*val));
 }
 
 /***************************************************************************/
@@ -1931,11 +3233,7 @@ kvStatus CANLIBAPI kvScriptEnvvarSetData(kvEnvHandle eHnd,
                                          int start_index,
                                          int data_len)
 {
-  (void) eHnd;
-  (void) buf;
-  (void) start_index;
-  (void) data_len;
-  return canERR_NOT_IMPLEMENTED;
+  return envvarAccess(eHnd, 1, 0, buf, start_index, data_len);
 }
 
 /***************************************************************************/
@@ -1944,11 +3242,86 @@ kvStatus CANLIBAPI kvScriptEnvvarGetData(kvEnvHandle eHnd,
                                          int start_index,
                                          int data_len)
 {
-  (void) eHnd;
-  (void) buf;
-  (void) start_index;
-  (void) data_len;
-  return canERR_NOT_IMPLEMENTED;
+  return envvarAccess(eHnd, 0, 0, buf, start_index, data_len);
+}
+
+//======================================================================
+// Batches
+//======================================================================
+static canStatus envvarBatchCheck (const CanHandle hnd, const kvEnvvarIo *io,
+                                   int n)
+{
+  int i;
+
+  if ((!io && n) || n < 0) {
+    return canERR_PARAM;
+  }
+  for (i = 0; i < n; i++) {
+    if (io[i].eHnd <= 0 || ENVVAR_CANHANDLE(io[i].eHnd) != hnd) {
+      return canERR_PARAM;
+    }
+  }
+  return canOK;
+}
+
+/***************************************************************************/
+kvStatus CANLIBAPI kvScriptEnvvarGetBatch(const CanHandle hnd,
+                                          kvEnvvarIo *io, int n)
+{
+  HandleData *hData;
+  canStatus stat;
+
+  hData = findHandle(hnd);
+  if (hData == NULL) {
+    return canERR_INVHANDLE;
+  }
+  stat = envvarBatchCheck(hnd, io, n);
+  if (stat != canOK) {
+    return stat;
+  }
+  return envvarGet(hData, io, n);
+}
+
+/***************************************************************************/
+kvStatus CANLIBAPI kvScriptEnvvarSetBatch(const CanHandle hnd,
+                                          const kvEnvvarIo *io, int n)
+{
+  HandleData *hData;
+  canStatus stat;
+
+  hData = findHandle(hnd);
+  if (hData == NULL) {
+    return canERR_INVHANDLE;
+  }
+  stat = envvarBatchCheck(hnd, io, n);
+  if (stat != canOK) {
+    return stat;
+  }
+  return envvarSet(hData, io, n);
+}
+
+/***************************************************************************/
+kvStatus CANLIBAPI kvScriptEnvvarSetCache(const CanHandle hnd, int on)
+{
+  HandleData *hData;
+
+  hData = findHandle(hnd);
+  if (hData == NULL) {
+    return canERR_INVHANDLE;
+  }
+  return envvarSetCache(hData, on != 0);
+}
+
+/***************************************************************************/
+kvStatus CANLIBAPI kvScriptEnvvarFlush(const CanHandle hnd)
+{
+  HandleData *hData;
+
+  hData = findHandle(hnd);
+  if (hData == NULL) {
+    return canERR_INVHANDLE;
+  }
+  return envvarFlush(hData);
 }
 
 /***************************************************************************/
@@ -1965,6 +3338,24 @@ kvStatus CANLIBAPI kvScriptLoadFile(const CanHandle hnd,
   return hData->canOps->kvScriptLoadFile(hData, slotNo, hostFileName);
 }
 
+/***************************************************************************/
+kvStatus CANLIBAPI kvScriptLoadBuffer(const CanHandle hnd,
+                                      int slotNo,
+                                      const void *image,
+                                      unsigned int len)
+{
+  HandleData *hData;
+
+  hData = findHandle(hnd);
+  if (hData == NULL) {
+    return canERR_INVHANDLE;
+  }
+  if (!image && len) {
+    return canERR_PARAM;
+  }
+  return hData->canOps->kvScriptLoadBuffer(hData, slotNo, image, len);
+}
+
 /***************************************************************************/
 kvStatus CANLIBAPI kvScriptLoadFileOnDevice(const CanHandle hnd,
                                             int slotNo,
@@ -1991,13 +3382,15 @@ canSetNotify (const CanHandle hnd, void (*callback)(canNotifyData *),
               unsigned int notifyFlags, void *tag)
 //
 // Notification is done by filtering out interesting messages and
-// doing a blocked read from a thread.
+// reading them from a library-wide dispatcher thread.
 //
 {
   HandleData *hData;
   const int validFlags = canNOTIFY_RX | canNOTIFY_TX | canNOTIFY_ERROR |
                          canNOTIFY_STATUS | canNOTIFY_ENVVAR;
 
+  API_STATS(canSetNotify);
+
   if (notifyFlags & ~validFlags) {
     return canERR_PARAM;
   }
@@ -2007,21 +3400,8 @@ canSetNotify (const CanHandle hnd, void (*callback)(canNotifyData *),
     return canERR_INVHANDLE;
   }
   if (notifyFlags == 0 || callback == NULL) {
-    if (hData->notifyFd != canINVALID_HANDLE) {
-      // We want to shut off notification, close file and clear callback
-
-      pthread_cancel(hData->notifyThread);
-
-      // Wait for thread to finish
-      pthread_join(hData->notifyThread, NULL);
-
-      if (hData->notifyFd != canINVALID_HANDLE) {
-        close(hData->notifyFd);
-      }
-      hData->notifyFd = canINVALID_HANDLE;
-    }
-
-    return canOK;
+    // We want to shut off notification
+    return hData->canOps->setNotify(hData, NULL, NULL, 0);
   }
 
   hData->notifyData.tag = tag;
@@ -2046,26 +3426,84 @@ kvStatus CANLIBAPI kvSetNotifyCallback(const CanHandle hnd,
     return canERR_INVHANDLE;
   }
   if (notifyFlags == 0 || callback == NULL) {
-    if (hData->notifyFd != canINVALID_HANDLE) {
-      // We want to shut off notification, close file and clear callback
+    // We want to shut off notification
+    return hData->canOps->setNotify(hData, NULL, NULL, 0);
+  }
 
-      pthread_cancel(hData->notifyThread);
+  hData->notifyData.tag = context;
 
-      // Wait for thread to finish
-      pthread_join(hData->notifyThread, NULL);
+  return hData->canOps->setNotify(hData, NULL, callback, notifyFlags);
+}
 
-      if (hData->notifyFd != canINVALID_HANDLE) {
-        close(hData->notifyFd);
-      }
-      hData->notifyFd = canINVALID_HANDLE;
-    }
+//******************************************************
+// Set notification callback receiving decoded frames
+//******************************************************
+kvStatus CANLIBAPI kvSetNotifyFrameCallback(const CanHandle hnd,
+                                            kvFrameCallback_t callback,
+                                            void* context,
+                                            unsigned int notifyFlags,
+                                            unsigned int maxBatch)
+{
+  HandleData *hData;
+  const unsigned int validFlags = canNOTIFY_RX | canNOTIFY_TX | canNOTIFY_ERROR;
 
-    return canOK;
+  if (notifyFlags & ~validFlags) {
+    return canERR_PARAM;
+  }
+
+  hData = findHandle(hnd);
+  if (hData == NULL) {
+    return canERR_INVHANDLE;
+  }
+  if (notifyFlags == 0 || callback == NULL) {
+    // We want to shut off notification
+    return hData->canOps->setNotify(hData, NULL, NULL, 0);
   }
 
   hData->notifyData.tag = context;
 
-  return hData->canOps->setNotify(hData, NULL, callback, notifyFlags);
+  return hData->canOps->setNotifyFrame(hData, callback, notifyFlags, maxBatch);
+}
+
+
+//******************************************************
+// Set attributes for threads created by the library
+//******************************************************
+kvStatus CANLIBAPI kvSetThreadConfig (const kvThreadConfig *config)
+{
+  if (config == NULL) {
+    return canERR_PARAM;
+  }
+
+  return vCanSetThreadConfig(config);
+}
+
+//******************************************************
+// Get attributes for threads created by the library
+//******************************************************
+kvStatus CANLIBAPI kvGetThreadConfig (kvThreadConfig *config)
+{
+  if (config == NULL) {
+    return canERR_PARAM;
+  }
+
+  vCanGetThreadConfig(config);
+
+  return canOK;
+}
+
+//******************************************************
+// Measure notification dispatch latency
+//******************************************************
+kvStatus CANLIBAPI kvNotifyLatencyTest (unsigned int samples,
+                                        unsigned int intervalUs,
+                                        kvLatencyStats *stats)
+{
+  if (stats == NULL || samples == 0) {
+    return canERR_PARAM;
+  }
+
+  return vCanNotifyLatencyTest(samples, intervalUs, stats);
 }
 
 
@@ -2074,6 +3512,9 @@ kvStatus CANLIBAPI kvSetNotifyCallback(const CanHandle hnd,
 //******************************************************
 void CANLIBAPI canInitializeLibrary (void)
 {
+  apiStatsInit();
+  flightRecInit();
+  vCanThreadInit();
 
   Initialized = TRUE;
   return;
@@ -2085,11 +3526,41 @@ void CANLIBAPI canInitializeLibrary (void)
 canStatus CANLIBAPI canUnloadLibrary (void)
 {
   foreachHandle(&canClose);
+  vCanNotifyShutdown();
+  apiStatsUnload();
+  flightRecUnload();
   Initialized = FALSE;
 
   return canOK;
 }
 
+//******************************************************
+// API statistics
+//******************************************************
+canStatus CANLIBAPI canGetStats (kvApiStats *stats, unsigned int *count)
+{
+  return apiStatsGet(stats, count);
+}
+
+canStatus CANLIBAPI canDumpStats (void)
+{
+  return apiStatsDump();
+}
+
+//******************************************************
+// Flight recorder
+//******************************************************
+canStatus CANLIBAPI kvFlightRecorderDump (const char *filename)
+{
+  return flightRecDump(filename);
+}
+
+canStatus CANLIBAPI kvFlightRecorderSetDump (const char *filename,
+                                             int dumpSignal, int onCrash)
+{
+  return flightRecSetDump(filename, dumpSignal, onCrash);
+}
+
 static canStatus check_bitrate (const CanHandle hnd, unsigned int bitrate)
 {
   canStatus    ret;
@@ -60,9 +60,17 @@
 #include "vcanevt.h"
 #include "canIfData.h"
 #include "kcan_ioctl.h"
+#include "clocksync.h"
+#include "idfilter.h"
+#include "filterprog.h"
+#include "busstats.h"
+#include "idstats.h"
+#include "swobjbuf.h"
+#include "envvar.h"
 
 #include <canlib.h>
 #include <canlib_version.h>
+#include <pthread.h>
 
 
 #define OPEN_AS_CAN           0
@@ -76,6 +84,8 @@
 typedef LinkedList HandleList;
 
 struct CANops;
+struct vCanNotifyEntry;
+struct SimHandle;
 
 // This struct is associated with each handle
 // returned by canOpenChannel
@@ -97,13 +107,31 @@ typedef struct HandleData
   double             timerScale;
   void               (*callback)(canNotifyData *);
   void               (*callback2)(CanHandle hnd, void* ctx, unsigned int event);
+  kvFrameCallback_t  frameCallback;
+  kvNotifyFrame      *notifyFrames;    // Batch buffer for frameCallback
+  unsigned int       notifyFramesMax;
   canNotifyData      notifyData;
   int                notifyFd;
-  pthread_t          notifyThread;
+  struct vCanNotifyEntry *notifyEntry;
   unsigned int       notifyFlags;
   struct CANOps      *canOps;
   int                valid;
   uint32_t           capabilities;
+  ClockSync          clockSync;
+  unsigned int       acceptCode[2];   // Acceptance filter, standard and extended
+  unsigned int       acceptMask[2];
+  pthread_rwlock_t   filterLock;      // Guards idFilter and filterProg
+  IdFilter           idFilter;        // Drops what the acceptance filter lets through
+  FilterProg         *filterProg;
+  BusStats           *busStats;
+  IdStats            *idStats;         // NULL unless per-id statistics are on
+  SwObjBufs          *swObjBufs;       // NULL unless the device has no object buffers
+  kvFileProgressCallback fileProgress;
+  void               *fileProgressContext;
+  kvFileProgress     fileTransfer;     // Progress of the last file transfer
+  pthread_mutex_t    fileTransferLock; // Guards fileTransfer
+  Envvars            *envvars;         // NULL until an envvar is opened
+  struct SimHandle   *sim;             // NULL unless on a simulated channel
 } HandleData;
 
 
@@ -117,9 +145,14 @@ typedef struct CANOps
    */
 
   canStatus (*openChannel)(HandleData *);
+  /* Undo openChannel */
+  canStatus (*closeChannel)(HandleData *);
   /* Read a callback function and flags that defines which events triggers it */
   canStatus (*setNotify)(HandleData *hData, void (*callback) (canNotifyData *),
                          kvCallback_t callback2, unsigned int notifyFlags);
+  /* Read a frame callback, flags and the max number of frames per call */
+  canStatus (*setNotifyFrame)(HandleData *hData, kvFrameCallback_t callback,
+                              unsigned int notifyFlags, unsigned int maxBatch);
   canStatus (*busOn)(HandleData *);
   canStatus (*busOff)(HandleData *);
   canStatus (*setBusParams)(HandleData *hData, long freq, unsigned int tseg1,
@@ -152,13 +185,29 @@ typedef struct CANOps
   canStatus (*kvFileGetCount) (HandleData *, int *);
   canStatus (*kvFileGetName) (HandleData *, int, char *, int);
   canStatus (*kvFileDelete) (HandleData *, char *);
-  canStatus (*kvFileCopyToDevice) (HandleData *, char *, char *);
-  canStatus (*kvFileCopyFromDevice) (HandleData *, char *, char *);
+  /* Flags are kvFILE_COPY_xxx; the CRC-32 of the file goes in the last argument */
+  canStatus (*kvFileCopyToDevice) (HandleData *, char *, char *,
+                                   unsigned int, uint32_t *);
+  canStatus (*kvFileCopyFromDevice) (HandleData *, char *, char *,
+                                     unsigned int, uint32_t *);
+  canStatus (*kvFileReadStream) (HandleData *, char *, kvFileReadCallback,
+                                 void *);
+  /* The last argument is the size of the file, 0 if not known */
+  canStatus (*kvFileWriteStream) (HandleData *, char *, kvFileWriteCallback,
+                                  void *, uint64_t);
   canStatus (*kvScriptStart) (HandleData *, int);
   canStatus (*kvScriptStop) (HandleData *, int, int);
   canStatus (*kvScriptLoadFile) (HandleData *, int, char *);
+  canStatus (*kvScriptLoadBuffer) (HandleData *, int, const void *,
+                                   unsigned int);
   canStatus (*kvScriptUnload) (HandleData *, int);
+  canStatus (*envvarInfo) (HandleData *, const char *, uint32_t *, int *,
+                           int *);
+  /* Reads, or with the second argument set writes, a list of envvars */
+  canStatus (*envvarTransfer) (HandleData *, int, EnvvarXfer *, int);
   canStatus (*accept)(HandleData *, const long, const unsigned int);
+  canStatus (*setAcceptanceFilter)(HandleData *hData, unsigned int code,
+                                   unsigned int mask, int is_extended);
   canStatus (*write)(HandleData *, long, void *, unsigned int, unsigned int);
   canStatus (*writeWait)(HandleData *, long, void *,
                          unsigned int, unsigned int, long);
@@ -167,6 +216,8 @@ typedef struct CANOps
   canStatus (*readTimer)(HandleData *, unsigned long *);
   canStatus (*kvReadTimer)(HandleData *, unsigned int *);
   canStatus (*kvReadTimer64)(HandleData *, uint64_t *);
+  /* Read the device timer in microseconds, without time domain correction */
+  canStatus (*kvReadTimerRaw)(HandleData *, uint64_t *);
   canStatus (*readErrorCounters)(HandleData *, unsigned int *,
                                  unsigned int *, unsigned int *);
   canStatus (*readStatus)(HandleData *, unsigned long *);
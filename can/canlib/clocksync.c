@@ -0,0 +1,742 @@
+/*
+**             Copyright 2017 by Kvaser AB, Molndal, Sweden
+**                        http://www.kvaser.com
+**
+** This software is dual licensed under the following two licenses:
+** BSD-new and GPLv2. You may use either one. See the included
+** COPYING file for details.
+**
+** License: BSD-new
+** ===============================================================================
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of the <organization> nor the
+**       names of its contributors may be used to endorse or promote products
+**       derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+** DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+** DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+** (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+** LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+** ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**
+**
+** License: GPLv2
+** ===============================================================================
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+** ---------------------------------------------------------------------------
+**/
+
+/*  Kvaser Linux Canlib software clock synchronization */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+
+#include "clocksync.h"
+#include "canlib_data.h"
+#include "linkedlist.h"
+#include "VCanFuncUtil.h"
+#include "debug.h"
+
+
+#   if DEBUG
+#      define DEBUGPRINT(args) printf args
+#   else
+#      define DEBUGPRINT(args)
+#   endif
+
+// Time between samples of each device timer
+#define CLOCKSYNC_PERIOD_MS  100
+
+// Number of timer reads per sample; the one with the shortest round-trip
+// is used, since it bounds the time of the device read most tightly.
+#define CLOCKSYNC_BURST      5
+
+// A sample with a round-trip longer than this many times the shortest one
+// seen, plus some slack (us), is dropped as disturbed.
+#define CLOCKSYNC_RTT_FACTOR 4
+#define CLOCKSYNC_RTT_SLACK  20
+
+// A sample this far (us) from the fit means that the device timer has
+// jumped, e.g. been reset, and the fit is started over.
+#define CLOCKSYNC_RESYNC_US  10000
+
+typedef struct ClockSyncDomain {
+  LinkedList *members;   // HandleData *
+  int64_t    epoch;      // Host time of domain time zero
+} ClockSyncDomain;
+
+static pthread_mutex_t syncMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  syncCond;         // On CLOCK_MONOTONIC
+static pthread_once_t  syncCondOnce = PTHREAD_ONCE_INIT;
+static LinkedList      *domains  = NULL;
+static LinkedList      *sampled  = NULL;   // HandleData * with users != 0
+static int             running   = 0;
+
+
+//======================================================================
+// Host time in us
+//======================================================================
+static int64_t hostTimeUs (const struct timespec *ts)
+{
+  return (int64_t)ts->tv_sec * 1000000 + ts->tv_nsec / 1000;
+}
+
+static void syncCondInit (void)
+{
+  pthread_condattr_t attr;
+
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&syncCond, &attr);
+  pthread_condattr_destroy(&attr);
+}
+
+static int ptrCmp (const void *a, const void *b)
+{
+  return a == b;
+}
+
+//======================================================================
+// Initialize clock sync state of a handle
+//======================================================================
+void clockSyncInit (ClockSync *cs)
+{
+  memset(cs, 0, sizeof(ClockSync));
+  pthread_mutex_init(&cs->lock, NULL);
+  cs->slope = 1.0;
+}
+
+//======================================================================
+// Forget all samples, cs->lock held
+//======================================================================
+static void clockSyncClear (ClockSync *cs)
+{
+  cs->valid     = 0;
+  cs->nSamples  = 0;
+  cs->next      = 0;
+  cs->minRtt    = UINT32_MAX;
+  cs->nRejected = 0;
+  cs->slope     = 1.0;
+  cs->haveLast  = 0;
+}
+
+//======================================================================
+// Fit residual of a sample, cs->lock held
+//======================================================================
+static double clockSyncResidual (const ClockSync *cs, const ClockSyncSample *sample)
+{
+  double x = (double)(int64_t)(sample->dev - cs->dev0);
+  double y = (double)(sample->host - cs->host0);
+
+  return y - (cs->offset + cs->slope * x);
+}
+
+//======================================================================
+// Least-squares fit of host time against device time, cs->lock held
+//======================================================================
+static void clockSyncFit (ClockSync *cs)
+{
+  double       sx = 0, sy = 0, sxx = 0, sxy = 0, err = 0;
+  double       n = cs->nSamples;
+  double       x, y, d;
+  unsigned int i;
+
+  for (i = 0; i < cs->nSamples; i++) {
+    x = (double)(int64_t)(cs->samples[i].dev - cs->dev0);
+    y = (double)(cs->samples[i].host - cs->host0);
+    sx  += x;
+    sy  += y;
+    sxx += x * x;
+    sxy += x * y;
+  }
+
+  d = n * sxx - sx * sx;
+  if (cs->nSamples < 2 || d <= 0) {
+    cs->slope = 1.0;
+  } else {
+    cs->slope = (n * sxy - sx * sy) / d;
+  }
+  cs->offset = (sy - cs->slope * sx) / n;
+
+  for (i = 0; i < cs->nSamples; i++) {
+    d = clockSyncResidual(cs, &cs->samples[i]);
+    err += d * d;
+  }
+  cs->residual = sqrt(err / n);
+  cs->valid    = 1;
+}
+
+//======================================================================
+// Add a sample and update the fit
+//======================================================================
+static void clockSyncAddSample (ClockSync *cs, const ClockSyncSample *sample,
+                                int64_t realtimeOffset)
+{
+  unsigned int oldest;
+
+  pthread_mutex_lock(&cs->lock);
+
+  // A step of the wall clock may move realtime timestamps backwards
+  if (llabs(realtimeOffset - cs->realtimeOffset) > CLOCKSYNC_RESYNC_US &&
+      cs->timestampClock == canTIMESTAMP_CLOCK_REALTIME) {
+    cs->haveLast = 0;
+  }
+  cs->realtimeOffset = realtimeOffset;
+
+  if (cs->valid) {
+    if (fabs(clockSyncResidual(cs, sample)) > CLOCKSYNC_RESYNC_US) {
+      DEBUGPRINT((TXT("Clock sync lost, restarting fit\n")));
+      clockSyncClear(cs);
+    } else if (sample->rtt > (uint64_t)CLOCKSYNC_RTT_FACTOR * cs->minRtt +
+                             CLOCKSYNC_RTT_SLACK) {
+      // Let the limit creep up, so that a lasting change in round-trip
+      // time does not stop the fit from being updated.
+      cs->nRejected++;
+      cs->minRtt += cs->minRtt / 8 + 1;
+      pthread_mutex_unlock(&cs->lock);
+      return;
+    }
+  }
+
+  if (cs->nSamples == 0) {
+    cs->minRtt = UINT32_MAX;
+  }
+  if (sample->rtt < cs->minRtt) {
+    cs->minRtt = sample->rtt;
+  }
+
+  cs->samples[cs->next] = *sample;
+  cs->next = (cs->next + 1) % CLOCKSYNC_SAMPLES;
+  if (cs->nSamples < CLOCKSYNC_SAMPLES) {
+    cs->nSamples++;
+  }
+
+  // Keep the origin at the oldest sample, so that the fit works on small
+  // numbers however long the handle has been sampled.
+  oldest     = (cs->nSamples < CLOCKSYNC_SAMPLES) ? 0 : cs->next;
+  cs->dev0   = cs->samples[oldest].dev;
+  cs->host0  = cs->samples[oldest].host;
+
+  clockSyncFit(cs);
+
+  pthread_mutex_unlock(&cs->lock);
+}
+
+//======================================================================
+// Sample the device timer of a handle, syncMutex held
+//======================================================================
+static void clockSyncSample (HandleData *hData)
+{
+  struct timespec t0, t1, rt;
+  ClockSyncSample sample, best;
+  int64_t         realtimeOffset = 0;
+  uint64_t        dev;
+  int             i, n = 0;
+
+  for (i = 0; i < CLOCKSYNC_BURST; i++) {
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if (hData->canOps->kvReadTimerRaw(hData, &dev) != canOK) {
+      DEBUGPRINT((TXT("clockSyncSample failed\n")));
+      continue;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    clock_gettime(CLOCK_REALTIME, &rt);
+
+    // The device was read somewhere between t0 and t1
+    sample.dev  = dev;
+    sample.host = (hostTimeUs(&t0) + hostTimeUs(&t1)) / 2;
+    sample.rtt  = (uint32_t)(hostTimeUs(&t1) - hostTimeUs(&t0));
+    if (n++ == 0 || sample.rtt < best.rtt) {
+      best = sample;
+      realtimeOffset = hostTimeUs(&rt) - hostTimeUs(&t1);
+    }
+  }
+
+  if (n) {
+    clockSyncAddSample(&hData->clockSync, &best, realtimeOffset);
+  }
+}
+
+//======================================================================
+// Convert device time (us) to the timebase selected for the handle (us)
+//
+// Later device times never convert to earlier times, also when the fit
+// is updated in between. Only a new fit, a reset domain, a new timestamp
+// clock or a step of the wall clock for canTIMESTAMP_CLOCK_REALTIME may
+// move the converted time backwards.
+//======================================================================
+uint64_t clockSyncConvert (ClockSync *cs, uint64_t dev)
+{
+  double   t;
+  uint64_t out;
+
+  pthread_mutex_lock(&cs->lock);
+  if (!cs->valid) {
+    cs->haveLast = 0;
+    pthread_mutex_unlock(&cs->lock);
+    return dev;
+  }
+
+  t = (double)cs->host0 + cs->offset + cs->slope * (double)(int64_t)(dev - cs->dev0);
+  if (cs->timestampClock == canTIMESTAMP_CLOCK_REALTIME) {
+    t += (double)cs->realtimeOffset;
+  } else if (cs->timestampClock == canTIMESTAMP_CLOCK_DEVICE) {
+    if (cs->domain == NULL) {
+      cs->haveLast = 0;
+      pthread_mutex_unlock(&cs->lock);
+      return dev;
+    }
+    t -= (double)cs->epoch;
+  }
+  out = (t < 0) ? 0 : (uint64_t)(t + 0.5);
+
+  if (!cs->haveLast || (int64_t)(dev - cs->lastDev) >= 0) {
+    if (cs->haveLast && out < cs->lastOut) {
+      out = cs->lastOut;
+    }
+    cs->haveLast = 1;
+    cs->lastDev  = dev;
+    cs->lastOut  = out;
+  } else if (out > cs->lastOut) {
+    out = cs->lastOut;
+  }
+  pthread_mutex_unlock(&cs->lock);
+
+  return out;
+}
+
+//======================================================================
+// Sampling thread
+//======================================================================
+static void *clockSyncThread (void *arg)
+{
+  struct timespec deadline;
+  LinkedList      *m;
+
+  (void)arg;
+
+  pthread_detach(pthread_self());
+
+  pthread_mutex_lock(&syncMutex);
+  while (sampled != NULL) {
+    for (m = sampled; m != NULL; m = m->next) {
+      clockSyncSample(m->elem);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_nsec += CLOCKSYNC_PERIOD_MS * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_cond_timedwait(&syncCond, &syncMutex, &deadline);
+  }
+  running = 0;
+  pthread_mutex_unlock(&syncMutex);
+
+  return NULL;
+}
+
+//======================================================================
+// Start sampling a handle for a reason, syncMutex held
+//======================================================================
+static canStatus clockSyncAddUser (HandleData *hData, unsigned int user)
+{
+  ClockSync *cs = &hData->clockSync;
+
+  pthread_once(&syncCondOnce, syncCondInit);
+
+  if (cs->users == 0) {
+    if (listInsertFirst(&sampled, hData) != 0) {
+      return canERR_NOMEM;
+    }
+
+    if (!running) {
+      pthread_t thread;
+      if (vCanCreateThread(&thread, clockSyncThread, NULL) != 0) {
+        listRemove(&sampled, hData, ptrCmp);
+        return canERR_NOMEM;
+      }
+      running = 1;
+    }
+
+    pthread_mutex_lock(&cs->lock);
+    clockSyncClear(cs);
+    cs->users = user;
+    pthread_mutex_unlock(&cs->lock);
+
+    // Get a first estimate right away
+    clockSyncSample(hData);
+  } else {
+    pthread_mutex_lock(&cs->lock);
+    cs->users |= user;
+    pthread_mutex_unlock(&cs->lock);
+  }
+
+  return canOK;
+}
+
+//======================================================================
+// Stop sampling a handle for a reason, syncMutex held
+//======================================================================
+static void clockSyncRemoveUser (HandleData *hData, unsigned int user)
+{
+  ClockSync *cs = &hData->clockSync;
+
+  if (!(cs->users & user)) {
+    return;
+  }
+
+  pthread_mutex_lock(&cs->lock);
+  cs->users &= ~user;
+  if (cs->users == 0) {
+    clockSyncClear(cs);
+  }
+  pthread_mutex_unlock(&cs->lock);
+
+  if (cs->users == 0) {
+    listRemove(&sampled, hData, ptrCmp);
+    if (sampled == NULL) {
+      pthread_cond_signal(&syncCond);
+    }
+  }
+}
+
+//======================================================================
+// Remove handle from domain, syncMutex held
+//======================================================================
+static void clockSyncRemoveMember (ClockSyncDomain *domain, HandleData *hData)
+{
+  ClockSync *cs = &hData->clockSync;
+
+  listRemove(&domain->members, hData, ptrCmp);
+
+  pthread_mutex_lock(&cs->lock);
+  cs->domain = NULL;
+  pthread_mutex_unlock(&cs->lock);
+
+  clockSyncRemoveUser(hData, CLOCKSYNC_USER_DOMAIN);
+}
+
+//======================================================================
+// Create time domain
+//======================================================================
+canStatus clockSyncDomainCreate (ClockSyncDomain **domain)
+{
+  ClockSyncDomain *d;
+  struct timespec now;
+
+  d = malloc(sizeof(ClockSyncDomain));
+  if (d == NULL) {
+    return canERR_NOMEM;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  d->members = NULL;
+  d->epoch   = hostTimeUs(&now);
+
+  pthread_mutex_lock(&syncMutex);
+  if (listInsertFirst(&domains, d) != 0) {
+    pthread_mutex_unlock(&syncMutex);
+    free(d);
+    return canERR_NOMEM;
+  }
+  pthread_mutex_unlock(&syncMutex);
+
+  *domain = d;
+
+  return canOK;
+}
+
+//======================================================================
+// Delete time domain
+//======================================================================
+canStatus clockSyncDomainDelete (ClockSyncDomain *domain)
+{
+  pthread_mutex_lock(&syncMutex);
+  if (listRemove(&domains, domain, ptrCmp) == NULL) {
+    pthread_mutex_unlock(&syncMutex);
+    return canERR_PARAM;
+  }
+  while (domain->members) {
+    clockSyncRemoveMember(domain, domain->members->elem);
+  }
+  pthread_mutex_unlock(&syncMutex);
+
+  free(domain);
+
+  return canOK;
+}
+
+//======================================================================
+// Restart domain time at zero
+//======================================================================
+canStatus clockSyncDomainReset (ClockSyncDomain *domain)
+{
+  struct timespec now;
+  LinkedList      *m;
+
+  pthread_mutex_lock(&syncMutex);
+  if (listFind(&domains, domain, ptrCmp) == NULL) {
+    pthread_mutex_unlock(&syncMutex);
+    return canERR_PARAM;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  domain->epoch = hostTimeUs(&now);
+  for (m = domain->members; m != NULL; m = m->next) {
+    ClockSync *cs = &((HandleData *)m->elem)->clockSync;
+    pthread_mutex_lock(&cs->lock);
+    cs->epoch    = domain->epoch;
+    cs->haveLast = 0;
+    pthread_mutex_unlock(&cs->lock);
+  }
+  pthread_mutex_unlock(&syncMutex);
+
+  return canOK;
+}
+
+//======================================================================
+// Add handle to domain
+//======================================================================
+canStatus clockSyncDomainAdd (ClockSyncDomain *domain, HandleData *hData)
+{
+  ClockSync *cs = &hData->clockSync;
+  canStatus stat;
+
+  pthread_mutex_lock(&syncMutex);
+  if (listFind(&domains, domain, ptrCmp) == NULL || cs->domain != NULL) {
+    pthread_mutex_unlock(&syncMutex);
+    return canERR_PARAM;
+  }
+  if (listInsertFirst(&domain->members, hData) != 0) {
+    pthread_mutex_unlock(&syncMutex);
+    return canERR_NOMEM;
+  }
+
+  pthread_mutex_lock(&cs->lock);
+  cs->domain   = domain;
+  cs->epoch    = domain->epoch;
+  cs->haveLast = 0;
+  pthread_mutex_unlock(&cs->lock);
+
+  stat = clockSyncAddUser(hData, CLOCKSYNC_USER_DOMAIN);
+  if (stat != canOK) {
+    clockSyncRemoveMember(domain, hData);
+  }
+  pthread_mutex_unlock(&syncMutex);
+
+  return stat;
+}
+
+//======================================================================
+// Remove handle from domain
+//======================================================================
+canStatus clockSyncDomainRemove (ClockSyncDomain *domain, HandleData *hData)
+{
+  pthread_mutex_lock(&syncMutex);
+  if (listFind(&domains, domain, ptrCmp) == NULL ||
+      hData->clockSync.domain != domain) {
+    pthread_mutex_unlock(&syncMutex);
+    return canERR_PARAM;
+  }
+  clockSyncRemoveMember(domain, hData);
+  pthread_mutex_unlock(&syncMutex);
+
+  return canOK;
+}
+
+//======================================================================
+// Stop all sampling of a handle, used when the handle is closed
+//======================================================================
+void clockSyncDetach (HandleData *hData)
+{
+  pthread_mutex_lock(&syncMutex);
+  if (hData->clockSync.domain) {
+    clockSyncRemoveMember(hData->clockSync.domain, hData);
+  }
+  clockSyncRemoveUser(hData, hData->clockSync.users);
+  pthread_mutex_unlock(&syncMutex);
+}
+
+//======================================================================
+// Get sync state of domain
+//======================================================================
+canStatus clockSyncDomainGetData (ClockSyncDomain *domain,
+                                  int *nMembers, int *nSynced,
+                                  double *maxDriftPpm, double *maxResidual)
+{
+  LinkedList *m;
+
+  *nMembers    = 0;
+  *nSynced     = 0;
+  *maxDriftPpm = 0;
+  *maxResidual = 0;
+
+  pthread_mutex_lock(&syncMutex);
+  if (listFind(&domains, domain, ptrCmp) == NULL) {
+    pthread_mutex_unlock(&syncMutex);
+    return canERR_PARAM;
+  }
+  for (m = domain->members; m != NULL; m = m->next) {
+    ClockSync *cs = &((HandleData *)m->elem)->clockSync;
+
+    (*nMembers)++;
+    pthread_mutex_lock(&cs->lock);
+    // Drift is only meaningful once there are a few samples
+    if (cs->valid && cs->nSamples > 1) {
+      double drift = fabs(cs->slope - 1.0) * 1e6;
+      (*nSynced)++;
+      if (drift > *maxDriftPpm) {
+        *maxDriftPpm = drift;
+      }
+      if (cs->residual > *maxResidual) {
+        *maxResidual = cs->residual;
+      }
+    }
+    pthread_mutex_unlock(&cs->lock);
+  }
+  pthread_mutex_unlock(&syncMutex);
+
+  return canOK;
+}
+
+//======================================================================
+// Turn the background correlator on or off for a handle
+//======================================================================
+canStatus clockSyncSetCorrelation (HandleData *hData, int enable)
+{
+  canStatus stat = canOK;
+
+  pthread_mutex_lock(&syncMutex);
+  if (enable) {
+    stat = clockSyncAddUser(hData, CLOCKSYNC_USER_CORRELATION);
+  } else {
+    clockSyncRemoveUser(hData, CLOCKSYNC_USER_CORRELATION);
+  }
+  pthread_mutex_unlock(&syncMutex);
+
+  return stat;
+}
+
+//======================================================================
+// Select the clock used for timestamps of a handle
+//======================================================================
+canStatus clockSyncSetTimestampClock (HandleData *hData, int clock)
+{
+  ClockSync *cs = &hData->clockSync;
+  canStatus stat = canOK;
+
+  if (clock != canTIMESTAMP_CLOCK_DEVICE &&
+      clock != canTIMESTAMP_CLOCK_MONOTONIC &&
+      clock != canTIMESTAMP_CLOCK_REALTIME) {
+    return canERR_PARAM;
+  }
+
+  pthread_mutex_lock(&syncMutex);
+  if (clock != canTIMESTAMP_CLOCK_DEVICE) {
+    stat = clockSyncAddUser(hData, CLOCKSYNC_USER_HOSTCLOCK);
+  } else {
+    clockSyncRemoveUser(hData, CLOCKSYNC_USER_HOSTCLOCK);
+  }
+  if (stat == canOK) {
+    pthread_mutex_lock(&cs->lock);
+    cs->timestampClock = clock;
+    cs->haveLast       = 0;
+    pthread_mutex_unlock(&cs->lock);
+  }
+  pthread_mutex_unlock(&syncMutex);
+
+  return stat;
+}
+
+//======================================================================
+// Get correlation state of a handle
+//======================================================================
+canStatus clockSyncGetCorrelation (HandleData *hData, kvClockCorrelation *info)
+{
+  ClockSync    *cs = &hData->clockSync;
+  unsigned int i;
+  double       d;
+
+  memset(info, 0, sizeof(kvClockCorrelation));
+
+  pthread_mutex_lock(&cs->lock);
+  if (cs->users == 0) {
+    pthread_mutex_unlock(&cs->lock);
+    return canERR_PARAM;
+  }
+  info->valid     = cs->valid && cs->nSamples > 1;
+  info->nSamples  = cs->nSamples;
+  info->nRejected = cs->nRejected;
+  if (cs->valid) {
+    info->driftPpm         = (cs->slope - 1.0) * 1e6;
+    info->offsetUs         = (double)cs->host0 + cs->offset -
+                             cs->slope * (double)cs->dev0;
+    info->rmsResidualUs    = cs->residual;
+    info->minRttUs         = cs->minRtt;
+    info->realtimeOffsetUs = cs->realtimeOffset;
+    for (i = 0; i < cs->nSamples; i++) {
+      d = fabs(clockSyncResidual(cs, &cs->samples[i]));
+      if (d > info->maxResidualUs) {
+        info->maxResidualUs = d;
+      }
+    }
+  }
+  pthread_mutex_unlock(&cs->lock);
+
+  return canOK;
+}
+
+//======================================================================
+// Get fit residuals of a handle, oldest first
+//======================================================================
+canStatus clockSyncGetResiduals (HandleData *hData, double *residuals,
+                                 unsigned int *count)
+{
+  ClockSync    *cs = &hData->clockSync;
+  unsigned int i, n, first;
+
+  pthread_mutex_lock(&cs->lock);
+  if (cs->users == 0) {
+    pthread_mutex_unlock(&cs->lock);
+    return canERR_PARAM;
+  }
+  n = cs->nSamples < *count ? cs->nSamples : *count;
+  // Oldest sample in the ring, skipping any that do not fit in the buffer
+  first = (cs->next + CLOCKSYNC_SAMPLES - cs->nSamples) % CLOCKSYNC_SAMPLES;
+  first = (first + cs->nSamples - n) % CLOCKSYNC_SAMPLES;
+  for (i = 0; i < n; i++) {
+    residuals[i] = clockSyncResidual(cs, &cs->samples[(first + i) % CLOCKSYNC_SAMPLES]);
+  }
+  *count = n;
+  pthread_mutex_unlock(&cs->lock);
+
+  return canOK;
+}
@@ -0,0 +1,132 @@
+/*
+**             Copyright 2017 by Kvaser AB, Molndal, Sweden
+**                        http://www.kvaser.com
+**
+** This software is dual licensed under the following two licenses:
+** BSD-new and GPLv2. You may use either one. See the included
+** COPYING file for details.
+**
+** License: BSD-new
+** ===============================================================================
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of the <organization> nor the
+**       names of its contributors may be used to endorse or promote products
+**       derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+** DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+** DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+** (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+** LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+** ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**
+**
+** License: GPLv2
+** ===============================================================================
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+** ---------------------------------------------------------------------------
+**/
+
+/*  Kvaser Linux Canlib software clock synchronization
+ *
+ *  The device timer of each handle in a time domain is sampled against the
+ *  host's monotonic clock, and a least-squares fit gives its offset and
+ *  drift. Timestamps are then mapped to a common, host based timebase.
+ */
+
+#ifndef CLOCKSYNC_H
+#define CLOCKSYNC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "canlib.h"
+
+// Number of samples in the fit window
+#define CLOCKSYNC_SAMPLES 128
+
+// Reasons for sampling the device timer of a handle
+#define CLOCKSYNC_USER_DOMAIN       0x01
+#define CLOCKSYNC_USER_CORRELATION  0x02
+#define CLOCKSYNC_USER_HOSTCLOCK    0x04
+
+struct HandleData;
+struct ClockSyncDomain;
+
+typedef struct {
+  uint64_t dev;    // Device time in us
+  int64_t  host;   // Host time in us
+  uint32_t rtt;    // Round-trip time of the timer read in us
+} ClockSyncSample;
+
+// Clock sync state, one per handle
+typedef struct ClockSync {
+  pthread_mutex_t          lock;
+  unsigned int             users;     // CLOCKSYNC_USER_xxx, sampled while non-zero
+  struct ClockSyncDomain   *domain;   // NULL when not in a domain
+  int                      timestampClock;  // canTIMESTAMP_CLOCK_xxx
+  int                      valid;     // Non-zero when the fit below is valid
+  uint64_t                 dev0;      // Fit origin, the oldest sample
+  int64_t                  host0;
+  double                   offset;    // host = host0 + offset + slope * (dev - dev0)
+  double                   slope;
+  double                   residual;  // RMS fit residual in us
+  int64_t                  epoch;     // Host time of domain time zero
+  int64_t                  realtimeOffset;  // CLOCK_REALTIME - CLOCK_MONOTONIC in us
+  int                      haveLast;  // Non-zero when lastDev and lastOut are set
+  uint64_t                 lastDev;   // Latest device time converted
+  uint64_t                 lastOut;   // and what it was converted to
+  uint32_t                 minRtt;    // Shortest round-trip seen in the window
+  unsigned int             nRejected;
+  ClockSyncSample          samples[CLOCKSYNC_SAMPLES];
+  unsigned int             nSamples;
+  unsigned int             next;
+} ClockSync;
+
+void clockSyncInit (ClockSync *cs);
+uint64_t clockSyncConvert (ClockSync *cs, uint64_t dev);
+
+canStatus clockSyncDomainCreate (struct ClockSyncDomain **domain);
+canStatus clockSyncDomainDelete (struct ClockSyncDomain *domain);
+canStatus clockSyncDomainReset (struct ClockSyncDomain *domain);
+canStatus clockSyncDomainAdd (struct ClockSyncDomain *domain,
+                              struct HandleData *hData);
+canStatus clockSyncDomainRemove (struct ClockSyncDomain *domain,
+                                 struct HandleData *hData);
+canStatus clockSyncDomainGetData (struct ClockSyncDomain *domain,
+                                  int *nMembers, int *nSynced,
+                                  double *maxDriftPpm, double *maxResidual);
+void clockSyncDetach (struct HandleData *hData);
+
+canStatus clockSyncSetCorrelation (struct HandleData *hData, int enable);
+canStatus clockSyncSetTimestampClock (struct HandleData *hData, int clock);
+canStatus clockSyncGetCorrelation (struct HandleData *hData,
+                                   kvClockCorrelation *info);
+canStatus clockSyncGetResiduals (struct HandleData *hData, double *residuals,
+                                 unsigned int *count);
+
+#endif  /* CLOCKSYNC_H */
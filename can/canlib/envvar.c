@@ -0,0 +1,523 @@
+/*
+**             Copyright 2017 by Kvaser AB, Molndal, Sweden
+**                        http://www.kvaser.com
+**
+** This software is dual licensed under the following two licenses:
+** BSD-new and GPLv2. You may use either one. See the included
+** COPYING file for details.
+**
+** License: BSD-new
+** ===============================================================================
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of the <organization> nor the
+**       names of its contributors may be used to endorse or promote products
+**       derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+** DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+** DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+** (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+** LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+** ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**
+**
+** License: GPLv2
+** ===============================================================================
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+** ---------------------------------------------------------------------------
+**/
+
+/*  Kvaser Linux Canlib script envvars */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "envvar.h"
+#include "canlib_data.h"
+
+//======================================================================
+// Table
+//======================================================================
+static Envvars *envvarsGet (HandleData *hData)
+{
+  Envvars *ev = __atomic_load_n(&hData->envvars, __ATOMIC_ACQUIRE);
+  Envvars *none = NULL;
+
+  if (ev != NULL) {
+    return ev;
+  }
+
+  ev = calloc(1, sizeof(Envvars));
+  if (ev == NULL) {
+    return NULL;
+  }
+  ev->xfer = malloc(ENVVAR_MAX * sizeof(EnvvarXfer));
+  if (ev->xfer == NULL) {
+    free(ev);
+    return NULL;
+  }
+  pthread_mutex_init(&ev->lock, NULL);
+
+  // Another thread may have got there first
+  if (!__atomic_compare_exchange_n(&hData->envvars, &none, ev, 0,
+                                   __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+    pthread_mutex_destroy(&ev->lock);
+    free(ev->xfer);
+    free(ev);
+    ev = none;
+  }
+
+  return ev;
+}
+
+static int isDirty (const EnvvarEntry *e)
+{
+  return e->dirtyEnd > e->dirtyStart;
+}
+
+// Lock held
+static EnvvarEntry *entryOf (Envvars *ev, kvEnvHandle eHnd)
+{
+  int index = ENVVAR_INDEX(eHnd);
+
+  if (index < 0 || index >= ev->count || ev->entry[index].refs == 0) {
+    return NULL;
+  }
+  return &ev->entry[index];
+}
+
+// Lock held
+static canStatus checkIo (Envvars *ev, const kvEnvvarIo *io, int n)
+{
+  EnvvarEntry *e;
+  int         i;
+
+  for (i = 0; i < n; i++) {
+    e = entryOf(ev, io[i].eHnd);
+    if (e == NULL || io[i].start_index < 0 || io[i].data_len < 0 ||
+        io[i].start_index + io[i].data_len > e->size ||
+        (io[i].buf == NULL && io[i].data_len > 0)) {
+      return canERR_PARAM;
+    }
+  }
+  return canOK;
+}
+
+//======================================================================
+// Transfers, lock held
+//======================================================================
+static canStatus flushEntries (HandleData *hData, Envvars *ev,
+                               EnvvarEntry **entries, int n)
+{
+  canStatus stat;
+  int       i;
+
+  for (i = 0; i < n; i++) {
+    ev->xfer[i].id    = entries[i]->id;
+    ev->xfer[i].start = entries[i]->dirtyStart;
+    ev->xfer[i].len   = entries[i]->dirtyEnd - entries[i]->dirtyStart;
+    ev->xfer[i].data  = entries[i]->value + entries[i]->dirtyStart;
+  }
+  stat = hData->canOps->envvarTransfer(hData, 1, ev->xfer, n);
+  if (stat != canOK) {
+    return stat;
+  }
+  for (i = 0; i < n; i++) {
+    entries[i]->dirtyStart = entries[i]->dirtyEnd = 0;
+  }
+  ev->nDirty -= n;
+
+  return canOK;
+}
+
+static canStatus flushEntry (HandleData *hData, Envvars *ev, EnvvarEntry *e)
+{
+  return isDirty(e) ? flushEntries(hData, ev, &e, 1) : canOK;
+}
+
+static canStatus transfer (HandleData *hData, Envvars *ev, int set,
+                           const kvEnvvarIo *io, int n)
+{
+  canStatus stat = canOK;
+  int       i, k;
+
+  for (i = 0; i < n && stat == canOK; i += k) {
+    for (k = 0; k < ENVVAR_MAX && i + k < n; k++) {
+      ev->xfer[k].id    = entryOf(ev, io[i + k].eHnd)->id;
+      ev->xfer[k].start = (unsigned int)io[i + k].start_index;
+      ev->xfer[k].len   = (unsigned int)io[i + k].data_len;
+      ev->xfer[k].data  = io[i + k].buf;
+    }
+    stat = hData->canOps->envvarTransfer(hData, set, ev->xfer, k);
+  }
+
+  return stat;
+}
+
+// Keeps a write for the next flush. A write that does not touch the part
+// already waiting sends that part first, so the gap between them is not
+// written with stale data.
+static canStatus cacheWrite (HandleData *hData, Envvars *ev,
+                             const kvEnvvarIo *io)
+{
+  EnvvarEntry  *e = entryOf(ev, io->eHnd);
+  unsigned int start = (unsigned int)io->start_index;
+  unsigned int end = start + (unsigned int)io->data_len;
+  canStatus    stat;
+
+  if (io->data_len == 0) {
+    return canOK;
+  }
+  if (e->value == NULL) {
+    e->value = calloc(1, e->size);
+    if (e->value == NULL) {
+      return canERR_NOMEM;
+    }
+  }
+  if (isDirty(e) && (end < e->dirtyStart || start > e->dirtyEnd)) {
+    stat = flushEntry(hData, ev, e);
+    if (stat != canOK) {
+      return stat;
+    }
+  }
+
+  memcpy(e->value + start, io->buf, io->data_len);
+  if (!isDirty(e)) {
+    e->dirtyStart = start;
+    e->dirtyEnd   = end;
+    ev->nDirty++;
+  } else {
+    if (start < e->dirtyStart) {
+      e->dirtyStart = start;
+    }
+    if (end > e->dirtyEnd) {
+      e->dirtyEnd = end;
+    }
+  }
+
+  return canOK;
+}
+
+//======================================================================
+// envvarOpen
+//======================================================================
+canStatus envvarOpen (HandleData *hData, const char *name, int *type,
+                      int *size, int *index)
+{
+  Envvars     *ev;
+  EnvvarEntry *e;
+  canStatus   stat;
+  uint32_t    id;
+  int         i;
+
+  if (strlen(name) >= ENVVAR_NAME_MAX) {
+    return canERR_PARAM;
+  }
+  ev = envvarsGet(hData);
+  if (ev == NULL) {
+    return canERR_NOMEM;
+  }
+
+  pthread_mutex_lock(&ev->lock);
+  for (i = 0; i < ev->count; i++) {
+    if (strcmp(ev->entry[i].name, name) == 0) {
+      break;
+    }
+  }
+  if (i == ev->count) {
+    // First time; ask the device
+    if (ev->count == ENVVAR_MAX) {
+      pthread_mutex_unlock(&ev->lock);
+      return canERR_NOMEM;
+    }
+    if (ev->count == ev->max) {
+      int max = ev->max ? 2 * ev->max : 64;
+
+      e = realloc(ev->entry, max * sizeof(EnvvarEntry));
+      if (e == NULL) {
+        pthread_mutex_unlock(&ev->lock);
+        return canERR_NOMEM;
+      }
+      ev->entry = e;
+      ev->max   = max;
+    }
+    e = &ev->entry[i];
+    memset(e, 0, sizeof(*e));
+    stat = hData->canOps->envvarInfo(hData, name, &id, &e->type, &e->size);
+    if (stat != canOK) {
+      pthread_mutex_unlock(&ev->lock);
+      return stat;
+    }
+    strcpy(e->name, name);
+    e->id = id;
+    ev->count++;
+  }
+  e = &ev->entry[i];
+  e->refs++;
+  *type  = e->type;
+  *size  = e->size;
+  *index = i;
+  pthread_mutex_unlock(&ev->lock);
+
+  return canOK;
+}
+
+//======================================================================
+// envvarClose
+// The name stays in the table, so opening it again is free.
+//======================================================================
+canStatus envvarClose (HandleData *hData, int index)
+{
+  Envvars     *ev = hData->envvars;
+  EnvvarEntry *e;
+  canStatus   stat;
+
+  if (ev == NULL) {
+    return canERR_PARAM;
+  }
+  pthread_mutex_lock(&ev->lock);
+  if (index < 0 || index >= ev->count || ev->entry[index].refs == 0) {
+    pthread_mutex_unlock(&ev->lock);
+    return canERR_PARAM;
+  }
+  e = &ev->entry[index];
+  stat = flushEntry(hData, ev, e);
+  e->refs--;
+  pthread_mutex_unlock(&ev->lock);
+
+  return stat;
+}
+
+//======================================================================
+// envvarChanged
+// Reads the value of the open envvar with the device id, for the notify.
+// The event is valid until the next call, canERR_NOTFOUND if the handle
+// does not have the envvar open.
+//======================================================================
+canStatus envvarChanged (HandleData *hData, uint32_t id,
+                         const kvEnvvarEvent **event)
+{
+  Envvars       *ev = __atomic_load_n(&hData->envvars, __ATOMIC_ACQUIRE);
+  EnvvarEntry   *e = NULL;
+  EnvvarXfer    xfer;
+  unsigned char *value;
+  canStatus     stat;
+  int           i;
+
+  if (ev == NULL) {
+    return canERR_NOTFOUND;
+  }
+  pthread_mutex_lock(&ev->lock);
+  for (i = 0; i < ev->count; i++) {
+    if (ev->entry[i].id == id && ev->entry[i].refs > 0) {
+      e = &ev->entry[i];
+      break;
+    }
+  }
+  if (e == NULL) {
+    pthread_mutex_unlock(&ev->lock);
+    return canERR_NOTFOUND;
+  }
+  if (e->size > ev->eventSize) {
+    value = realloc(ev->eventValue, e->size);
+    if (value == NULL) {
+      pthread_mutex_unlock(&ev->lock);
+      return canERR_NOMEM;
+    }
+    ev->eventValue = value;
+    ev->eventSize  = e->size;
+  }
+
+  xfer.id    = id;
+  xfer.start = 0;
+  xfer.len   = (unsigned int)e->size;
+  xfer.data  = ev->eventValue;
+  stat = hData->canOps->envvarTransfer(hData, 0, &xfer, 1);
+  if (stat == canOK) {
+    ev->event.envHandle = ENVVAR_HANDLE(hData->handle, i);
+    ev->event.type      = e->type;
+    ev->event.len       = e->size;
+    ev->event.value     = ev->eventValue;
+    *event = &ev->event;
+  }
+  pthread_mutex_unlock(&ev->lock);
+
+  return stat;
+}
+
+//======================================================================
+// envvarGetType
+//======================================================================
+canStatus envvarGetType (HandleData *hData, int index, int *type, int *size)
+{
+  Envvars *ev = hData->envvars;
+
+  if (ev == NULL) {
+    return canERR_PARAM;
+  }
+  pthread_mutex_lock(&ev->lock);
+  if (index < 0 || index >= ev->count || ev->entry[index].refs == 0) {
+    pthread_mutex_unlock(&ev->lock);
+    return canERR_PARAM;
+  }
+  *type = ev->entry[index].type;
+  *size = ev->entry[index].size;
+  pthread_mutex_unlock(&ev->lock);
+
+  return canOK;
+}
+
+//======================================================================
+// envvarGet
+// Cached writes to the envvars read are sent first.
+//======================================================================
+canStatus envvarGet (HandleData *hData, const kvEnvvarIo *io, int n)
+{
+  Envvars     *ev = hData->envvars;
+  EnvvarEntry *dirty[ENVVAR_MAX];
+  EnvvarEntry *e;
+  canStatus   stat;
+  int         i, k, nDirty = 0;
+
+  if (ev == NULL) {
+    return canERR_PARAM;
+  }
+  pthread_mutex_lock(&ev->lock);
+  stat = checkIo(ev, io, n);
+  for (i = 0; i < n && stat == canOK && ev->nDirty > nDirty; i++) {
+    e = entryOf(ev, io[i].eHnd);
+    if (!isDirty(e)) {
+      continue;
+    }
+    for (k = 0; k < nDirty && dirty[k] != e; k++) {
+    }
+    if (k == nDirty) {
+      dirty[nDirty++] = e;
+    }
+  }
+  if (stat == canOK && nDirty > 0) {
+    stat = flushEntries(hData, ev, dirty, nDirty);
+  }
+  if (stat == canOK) {
+    stat = transfer(hData, ev, 0, io, n);
+  }
+  pthread_mutex_unlock(&ev->lock);
+
+  return stat;
+}
+
+//======================================================================
+// envvarSet
+//======================================================================
+canStatus envvarSet (HandleData *hData, const kvEnvvarIo *io, int n)
+{
+  Envvars   *ev = hData->envvars;
+  canStatus stat;
+  int       i;
+
+  if (ev == NULL) {
+    return canERR_PARAM;
+  }
+  pthread_mutex_lock(&ev->lock);
+  stat = checkIo(ev, io, n);
+  if (stat == canOK && ev->cache) {
+    for (i = 0; i < n && stat == canOK; i++) {
+      stat = cacheWrite(hData, ev, &io[i]);
+    }
+  } else if (stat == canOK) {
+    stat = transfer(hData, ev, 1, io, n);
+  }
+  pthread_mutex_unlock(&ev->lock);
+
+  return stat;
+}
+
+//======================================================================
+// envvarFlush
+//======================================================================
+canStatus envvarFlush (HandleData *hData)
+{
+  Envvars     *ev = hData->envvars;
+  EnvvarEntry *dirty[ENVVAR_MAX];
+  canStatus   stat = canOK;
+  int         i, n = 0;
+
+  if (ev == NULL) {
+    return canOK;
+  }
+  pthread_mutex_lock(&ev->lock);
+  for (i = 0; i < ev->count && n < ev->nDirty; i++) {
+    if (isDirty(&ev->entry[i])) {
+      dirty[n++] = &ev->entry[i];
+    }
+  }
+  if (n > 0) {
+    stat = flushEntries(hData, ev, dirty, n);
+  }
+  pthread_mutex_unlock(&ev->lock);
+
+  return stat;
+}
+
+//======================================================================
+// envvarSetCache
+//======================================================================
+canStatus envvarSetCache (HandleData *hData, int on)
+{
+  Envvars *ev = envvarsGet(hData);
+
+  if (ev == NULL) {
+    return canERR_NOMEM;
+  }
+  pthread_mutex_lock(&ev->lock);
+  ev->cache = on;
+  pthread_mutex_unlock(&ev->lock);
+
+  return on ? canOK : envvarFlush(hData);
+}
+
+//======================================================================
+// envvarDestroy
+//======================================================================
+void envvarDestroy (HandleData *hData)
+{
+  Envvars *ev = hData->envvars;
+  int     i;
+
+  if (ev == NULL) {
+    return;
+  }
+  envvarFlush(hData);
+  for (i = 0; i < ev->count; i++) {
+    free(ev->entry[i].value);
+  }
+  pthread_mutex_destroy(&ev->lock);
+  free(ev->entry);
+  free(ev->xfer);
+  free(ev->eventValue);
+  free(ev);
+  hData->envvars = NULL;
+}
@@ -0,0 +1,123 @@
+/*
+**             Copyright 2017 by Kvaser AB, Molndal, Sweden
+**                        http://www.kvaser.com
+**
+** This software is dual licensed under the following two licenses:
+** BSD-new and GPLv2. You may use either one. See the included
+** COPYING file for details.
+**
+** License: BSD-new
+** ===============================================================================
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of the <organization> nor the
+**       names of its contributors may be used to endorse or promote products
+**       derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+** DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+** DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+** (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+** LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+** ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**
+**
+** License: GPLv2
+** ===============================================================================
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+** ---------------------------------------------------------------------------
+**/
+
+/*  Kvaser Linux Canlib script envvars
+ *
+ *  Envvar names are resolved with the device once per handle and kept in
+ *  a table; kvEnvHandle is the CanHandle and the table index. Reads and
+ *  writes go to the backend in batches. With the cache on, writes are
+ *  kept until the next flush, where all dirty envvars go in one batch.
+ */
+
+#ifndef ENVVAR_H
+#define ENVVAR_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "canlib.h"
+
+#define ENVVAR_NAME_MAX  64
+#define ENVVAR_MAX       1024
+
+#define ENVVAR_HANDLE(hnd, index)  (((kvEnvHandle)(hnd) << 32) | ((index) + 1))
+#define ENVVAR_CANHANDLE(eHnd)     ((CanHandle)((eHnd) >> 32))
+#define ENVVAR_INDEX(eHnd)         ((int)((eHnd) & 0xffffffff) - 1)
+
+struct HandleData;
+
+// One piece of an envvar to move to or from the device
+typedef struct {
+  uint32_t      id;          // Device id, from the backend's envvarInfo
+  unsigned int  start;
+  unsigned int  len;
+  unsigned char *data;
+} EnvvarXfer;
+
+typedef struct {
+  char          name[ENVVAR_NAME_MAX];
+  uint32_t      id;
+  int           type;        // kvENVVAR_TYPE_xxx
+  int           size;
+  int           refs;        // Open handles
+  unsigned char *value;      // Cached value, size bytes
+  unsigned int  dirtyStart;  // Part of value not yet written
+  unsigned int  dirtyEnd;
+} EnvvarEntry;
+
+typedef struct Envvars {
+  pthread_mutex_t lock;
+  int             cache;     // Writes wait for envvarFlush
+  int             count;
+  int             max;
+  EnvvarEntry     *entry;
+  EnvvarXfer      *xfer;     // Scratch list for batches, max long
+  int             nDirty;
+  kvEnvvarEvent   event;     // For the envvar notify, dispatcher only
+  unsigned char   *eventValue;
+  int             eventSize;
+} Envvars;
+
+canStatus envvarOpen (struct HandleData *hData, const char *name,
+                      int *type, int *size, int *index);
+canStatus envvarClose (struct HandleData *hData, int index);
+canStatus envvarChanged (struct HandleData *hData, uint32_t id,
+                         const kvEnvvarEvent **event);
+canStatus envvarGetType (struct HandleData *hData, int index, int *type,
+                         int *size);
+canStatus envvarGet (struct HandleData *hData, const kvEnvvarIo *io, int n);
+canStatus envvarSet (struct HandleData *hData, const kvEnvvarIo *io, int n);
+canStatus envvarSetCache (struct HandleData *hData, int on);
+canStatus envvarFlush (struct HandleData *hData);
+void envvarDestroy (struct HandleData *hData);
+
+#endif  /* ENVVAR_H */
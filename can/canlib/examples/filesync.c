@@ -0,0 +1,370 @@
+/*
+**             Copyright 2012-2016 by Kvaser AB, Molndal, Sweden
+**                        http://www.kvaser.com
+**
+** This software is dual licensed under the following two licenses:
+** BSD-new and GPLv2. You may use either one. See the included
+** COPYING file for details.
+**
+** License: BSD-new
+** ===============================================================================
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of the <organization> nor the
+**       names of its contributors may be used to endorse or promote products
+**       derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+** DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+** DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+** (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+** LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+** ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**
+**
+** License: GPLv2
+** ===============================================================================
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+** ---------------------------------------------------------------------------
+**/
+
+/*
+ * Kvaser Linux Canlib
+ * Incremental file offload from Memorators
+ *
+ * Copies the files on one or more devices into <dir>/<serial>/, one thread
+ * per device. The device reports no file sizes, so every run reads each
+ * device file again. A host copy that is a prefix of the device file is
+ * kept and only the rest is written, and a manifest with the size and
+ * CRC-32 of each copy tells changed files from unchanged ones.
+ */
+
+#include <canlib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#define MANIFEST     ".filesync"
+#define MAX_DEVICES  64
+#define SIZE_UNKNOWN (-1)
+
+typedef struct {
+  char     name[64];
+  int64_t  size;
+  uint32_t crc;
+  int      seen;          // Still on the device
+} Entry;
+
+typedef struct {
+  int       channel;
+  uint64_t  serial;
+  char      dir[PATH_MAX];
+  Entry     *entries;
+  int       nEntries;
+  int       copied;
+  int       skipped;
+  int       failed;
+  uint64_t  bytes;
+  canStatus stat;
+} Device;
+
+static const char *root;
+
+static void printUsageAndExit(char *prgName)
+{
+  printf("Usage: '%s <dir> <channel> [<channel> ...]'\n", prgName);
+  printf("  dir       files go to <dir>/<serial>/\n");
+  printf("  channel   one channel on each device to offload\n");
+  exit(1);
+}
+
+static long parseArg(char *prgName, char *arg)
+{
+  char *endPtr = NULL;
+  long value;
+
+  errno = 0;
+  value = strtol(arg, &endPtr, 10);
+  if ((errno != 0) || (endPtr == arg) || (*endPtr != '\0')) {
+    printUsageAndExit(prgName);
+  }
+  return value;
+}
+
+static void check(Device *d, const char *id, canStatus stat)
+{
+  char buf[50];
+
+  buf[0] = '\0';
+  canGetErrorText(stat, buf, sizeof(buf));
+  printf("%llu: %s: failed, stat=%d (%s)\n",
+         (unsigned long long)d->serial, id, (int)stat, buf);
+}
+
+static Entry *findEntry(Device *d, const char *name)
+{
+  int i;
+
+  for (i = 0; i < d->nEntries; i++) {
+    if (strcmp(d->entries[i].name, name) == 0) {
+      return &d->entries[i];
+    }
+  }
+  return NULL;
+}
+
+static Entry *addEntry(Device *d, const char *name)
+{
+  Entry *e = realloc(d->entries, (d->nEntries + 1) * sizeof(Entry));
+
+  if (e == NULL) {
+    return NULL;
+  }
+  d->entries = e;
+  e = &d->entries[d->nEntries++];
+  memset(e, 0, sizeof(*e));
+  snprintf(e->name, sizeof(e->name), "%s", name);
+  e->size = SIZE_UNKNOWN;
+  return e;
+}
+
+// One line per file: name, size (-1 if not known) and CRC-32
+static void loadManifest(Device *d)
+{
+  char path[PATH_MAX + 16];
+  char name[64];
+  long long size;
+  unsigned int crc;
+  Entry *e;
+  FILE *f;
+
+  snprintf(path, sizeof(path), "%s/" MANIFEST, d->dir);
+  f = fopen(path, "r");
+  if (f == NULL) {
+    return;
+  }
+  while (fscanf(f, "%63s %lld %x", name, &size, &crc) == 3) {
+    e = addEntry(d, name);
+    if (e == NULL) {
+      break;
+    }
+    e->size = size;
+    e->crc  = crc;
+  }
+  fclose(f);
+}
+
+static int saveManifest(Device *d)
+{
+  char path[PATH_MAX + 16];
+  char tmp[PATH_MAX + 16];
+  FILE *f;
+  int i;
+
+  snprintf(path, sizeof(path), "%s/" MANIFEST, d->dir);
+  snprintf(tmp, sizeof(tmp), "%s/" MANIFEST ".tmp", d->dir);
+  f = fopen(tmp, "w");
+  if (f == NULL) {
+    return -1;
+  }
+  for (i = 0; i < d->nEntries; i++) {
+    if (d->entries[i].seen) {
+      fprintf(f, "%s %lld %08x\n", d->entries[i].name,
+              (long long)d->entries[i].size, d->entries[i].crc);
+    }
+  }
+  if (fclose(f) != 0) {
+    return -1;
+  }
+  return rename(tmp, path);
+}
+
+static void syncFile(Device *d, canHandle hnd, char *name)
+{
+  char path[PATH_MAX + 80];
+  unsigned int flags = kvFILE_COPY_VERIFY | kvFILE_COPY_RETRY;
+  struct stat st;
+  uint32_t crc = 0;
+  canStatus res;
+  int64_t size;
+  Entry *e;
+
+  snprintf(path, sizeof(path), "%s/%s", d->dir, name);
+  e = findEntry(d, name);
+  if (e == NULL) {
+    e = addEntry(d, name);
+    if (e == NULL) {
+      d->failed++;
+      return;
+    }
+  }
+  e->seen = 1;
+
+  // Keep the host copy as far as it matches the device file. The whole
+  // device file is still read and checked against its CRC-32.
+  res = kvFileCopyFromDeviceEx(hnd, name, path, flags | kvFILE_COPY_RESUME,
+                               &crc);
+  if (res == canERR_CRC || res == canERR_HOST_FILE) {
+    // The host file was not a prefix of the device file, start over
+    res = kvFileCopyFromDeviceEx(hnd, name, path, flags, &crc);
+  }
+  if (res != canOK) {
+    check(d, name, res);
+    e->size = SIZE_UNKNOWN;
+    d->failed++;
+    return;
+  }
+
+  size = stat(path, &st) == 0 ? (int64_t)st.st_size : SIZE_UNKNOWN;
+  // Same size and CRC-32 as the last run
+  if (size != SIZE_UNKNOWN && size == e->size && crc == e->crc) {
+    d->skipped++;
+    return;
+  }
+  e->size = size;
+  e->crc  = crc;
+  d->copied++;
+  if (e->size > 0) {
+    d->bytes += (uint64_t)e->size;
+  }
+  printf("%llu: %s, %lld bytes, crc %08x\n", (unsigned long long)d->serial,
+         name, (long long)e->size, crc);
+}
+
+static void *syncThread(void *arg)
+{
+  Device    *d = (Device *)arg;
+  canHandle hnd;
+  char      name[64];
+  int       count = 0, i;
+
+  snprintf(d->dir, sizeof(d->dir), "%s/%llu", root,
+           (unsigned long long)d->serial);
+  if (mkdir(d->dir, 0777) != 0 && errno != EEXIST) {
+    printf("%s: %s\n", d->dir, strerror(errno));
+    d->stat = canERR_HOST_FILE;
+    return NULL;
+  }
+  loadManifest(d);
+
+  hnd = canOpenChannel(d->channel, 0);
+  if (hnd < 0) {
+    check(d, "canOpenChannel", hnd);
+    d->stat = hnd;
+    free(d->entries);
+    return NULL;
+  }
+
+  d->stat = kvFileGetCount(hnd, &count);
+  if (d->stat != canOK) {
+    check(d, "kvFileGetCount", d->stat);
+  }
+  for (i = 0; d->stat == canOK && i < count; i++) {
+    d->stat = kvFileGetName(hnd, i, name, sizeof(name));
+    if (d->stat != canOK) {
+      check(d, "kvFileGetName", d->stat);
+      break;
+    }
+    name[sizeof(name) - 1] = '\0';
+    syncFile(d, hnd, name);
+  }
+  if (d->stat == canOK && saveManifest(d) != 0) {
+    printf("%s/%s: %s\n", d->dir, MANIFEST, strerror(errno));
+  }
+
+  canClose(hnd);
+  free(d->entries);
+  return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+  Device    devices[MAX_DEVICES];
+  pthread_t threads[MAX_DEVICES];
+  int       nDevices = 0, failed = 0;
+  int       argi = 1, i, k, ret;
+  uint64_t  serial;
+  canStatus stat;
+
+  if (argc - argi < 2) {
+    printUsageAndExit(argv[0]);
+  }
+  root = argv[argi++];
+
+  canInitializeLibrary();
+
+  for (; argi < argc && nDevices < MAX_DEVICES; argi++) {
+    int channel = (int)parseArg(argv[0], argv[argi]);
+
+    serial = 0;
+    stat = canGetChannelData(channel, canCHANNELDATA_CARD_SERIAL_NO,
+                             &serial, sizeof(serial));
+    if (stat != canOK) {
+      printf("Channel %d: no device\n", channel);
+      failed = 1;
+      continue;
+    }
+    // The channels of a device share its storage
+    for (k = 0; k < nDevices && devices[k].serial != serial; k++) {
+    }
+    if (k < nDevices) {
+      continue;
+    }
+    memset(&devices[nDevices], 0, sizeof(Device));
+    devices[nDevices].channel = channel;
+    devices[nDevices].serial  = serial;
+    nDevices++;
+  }
+
+  for (i = 0; i < nDevices; i++) {
+    ret = pthread_create(&threads[i], NULL, syncThread, &devices[i]);
+    if (ret != 0) {
+      printf("pthread_create: %s\n", strerror(ret));
+      // Wait for the devices already started
+      nDevices = i;
+      failed   = 1;
+      break;
+    }
+  }
+  for (i = 0; i < nDevices; i++) {
+    Device *d = &devices[i];
+
+    pthread_join(threads[i], NULL);
+    printf("%llu: %d copied (%llu bytes), %d unchanged, %d failed\n",
+           (unsigned long long)d->serial, d->copied,
+           (unsigned long long)d->bytes, d->skipped, d->failed);
+    if (d->stat != canOK || d->failed) {
+      failed = 1;
+    }
+  }
+
+  canUnloadLibrary();
+  return failed;
+}
@@ -0,0 +1,184 @@
+/*
+**             Copyright 2012-2016 by Kvaser AB, Molndal, Sweden
+**                        http://www.kvaser.com
+**
+** This software is dual licensed under the following two licenses:
+** BSD-new and GPLv2. You may use either one. See the included
+** COPYING file for details.
+**
+** License: BSD-new
+** ===============================================================================
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of the <organization> nor the
+**       names of its contributors may be used to endorse or promote products
+**       derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+** DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+** DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+** (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+** LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+** ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**
+**
+** License: GPLv2
+** ===============================================================================
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+** ---------------------------------------------------------------------------
+**/
+
+/*
+ * Kvaser Linux Canlib
+ * Per-id statistics cost
+ *
+ * Sends frames from one channel to another on the same bus, and times
+ * reading them with per-id statistics off and on. The difference is what
+ * kvIdStatsEnable adds to each frame read.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <canlib.h>
+#include <errno.h>
+
+#define BATCH 1000
+
+static void printUsageAndExit(char *prgName)
+{
+  printf("Usage: '%s <tx channel> <rx channel> <frames> [<ids>]'\n", prgName);
+  printf("  ids  number of different extended ids to send, default 100\n");
+  exit(1);
+}
+
+static long parseArg(char *prgName, char *arg)
+{
+  char *endPtr = NULL;
+  long value;
+
+  errno = 0;
+  value = strtol(arg, &endPtr, 10);
+  if ((errno != 0) || (endPtr == arg) || (*endPtr != '\0') || value < 0) {
+    printUsageAndExit(prgName);
+  }
+  return value;
+}
+
+static void check(const char *id, canStatus stat)
+{
+  if (stat < 0) {
+    char errorString[50];
+    canGetErrorText(stat, errorString, sizeof(errorString));
+    printf("%s: %s\n", id, errorString);
+    exit(1);
+  }
+}
+
+static double nowNs(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Returns the read time per frame in ns
+static double run(canHandle tx, canHandle rx, long frames, long ids)
+{
+  unsigned char data[8] = {0};
+  unsigned int  dlc, flags;
+  unsigned long time;
+  long          id, sent, i, n;
+  double        readNs = 0, t0;
+
+  for (sent = 0; sent < frames; sent += n) {
+    n = (frames - sent < BATCH) ? frames - sent : BATCH;
+    for (i = 0; i < n; i++) {
+      data[0] = (unsigned char)(sent + i);
+      check("canWriteWait",
+            canWriteWait(tx, (sent + i) % ids, data, 8, canMSG_EXT, 1000));
+    }
+    check("canWriteSync", canWriteSync(tx, 1000));
+
+    // The frames are all queued now, so only the read path is timed
+    t0 = nowNs();
+    for (i = 0; i < n; i++) {
+      check("canRead", canReadWait(rx, &id, data, &dlc, &flags, &time, 1000));
+    }
+    readNs += nowNs() - t0;
+  }
+
+  return readNs / frames;
+}
+
+int main(int argc, char *argv[])
+{
+  canHandle tx, rx;
+  long      frames, ids = 100;
+  double    off, on;
+
+  if (argc < 4 || argc > 5) {
+    printUsageAndExit(argv[0]);
+  }
+  frames = parseArg(argv[0], argv[3]);
+  if (argc > 4) {
+    ids = parseArg(argv[0], argv[4]);
+  }
+  if (frames == 0 || ids == 0) {
+    printUsageAndExit(argv[0]);
+  }
+
+  canInitializeLibrary();
+
+  tx = canOpenChannel((int)parseArg(argv[0], argv[1]), canOPEN_ACCEPT_VIRTUAL);
+  check("canOpenChannel", tx);
+  rx = canOpenChannel((int)parseArg(argv[0], argv[2]), canOPEN_ACCEPT_VIRTUAL);
+  check("canOpenChannel", rx);
+  check("canSetBusParams", canSetBusParams(tx, canBITRATE_1M, 0, 0, 0, 0, 0));
+  check("canSetBusParams", canSetBusParams(rx, canBITRATE_1M, 0, 0, 0, 0, 0));
+  check("canBusOn", canBusOn(tx));
+  check("canBusOn", canBusOn(rx));
+
+  // Warm up, then off and on
+  run(tx, rx, frames < BATCH ? frames : BATCH, ids);
+  off = run(tx, rx, frames, ids);
+  check("kvIdStatsEnable", kvIdStatsEnable(rx, 1));
+  on  = run(tx, rx, frames, ids);
+  check("kvIdStatsEnable", kvIdStatsEnable(rx, 0));
+
+  printf("Read time per frame, %ld frames on %ld ids (ns):\n", frames, ids);
+  printf("  statistics off %8.1f\n", off);
+  printf("  statistics on  %8.1f\n", on);
+  printf("  difference     %8.1f\n", on - off);
+
+  canBusOff(tx);
+  canBusOff(rx);
+  canClose(tx);
+  canClose(rx);
+  canUnloadLibrary();
+
+  return 0;
+}
@@ -0,0 +1,151 @@
+/*
+**             Copyright 2012-2016 by Kvaser AB, Molndal, Sweden
+**                        http://www.kvaser.com
+**
+** This software is dual licensed under the following two licenses:
+** BSD-new and GPLv2. You may use either one. See the included
+** COPYING file for details.
+**
+** License: BSD-new
+** ===============================================================================
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of the <organization> nor the
+**       names of its contributors may be used to endorse or promote products
+**       derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+** DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+** DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+** (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+** LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+** ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**
+**
+** License: GPLv2
+** ===============================================================================
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+** ---------------------------------------------------------------------------
+**/
+
+/*
+ * Kvaser Linux Canlib
+ * Notification dispatch latency test
+ *
+ * Measures the time from an event becoming ready until CANLIB's notification
+ * thread dispatches it, using the given real-time settings. Use it to verify
+ * that a deployment gives bounded callback latency.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <canlib.h>
+#include <errno.h>
+
+static void printUsageAndExit(char *prgName)
+{
+  printf("Usage: '%s <samples> <interval_us> [<priority> [<cpu> [<lock>]]]'\n",
+         prgName);
+  printf("  priority  SCHED_FIFO priority (1-99), 0 for default\n");
+  printf("  cpu       CPU to run the notification thread on, -1 for any\n");
+  printf("  lock      1 to lock memory and prefault the thread stack\n");
+  exit(1);
+}
+
+static long parseArg(char *prgName, char *arg)
+{
+  char *endPtr = NULL;
+  long value;
+
+  errno = 0;
+  value = strtol(arg, &endPtr, 10);
+  if ((errno != 0) || (endPtr == arg) || (*endPtr != '\0')) {
+    printUsageAndExit(prgName);
+  }
+  return value;
+}
+
+int main(int argc, char *argv[])
+{
+  kvThreadConfig config = {0};
+  kvLatencyStats stats;
+  canStatus      stat;
+  unsigned int   samples;
+  unsigned int   interval;
+  long           cpu = -1;
+
+  if (argc < 3 || argc > 6) {
+    printUsageAndExit(argv[0]);
+  }
+
+  samples  = (unsigned int)parseArg(argv[0], argv[1]);
+  interval = (unsigned int)parseArg(argv[0], argv[2]);
+  if (argc > 3) {
+    config.schedPriority = (int)parseArg(argv[0], argv[3]);
+  }
+  if (argc > 4) {
+    cpu = parseArg(argv[0], argv[4]);
+    if (cpu >= 64) {
+      printUsageAndExit(argv[0]);
+    }
+    if (cpu >= 0) {
+      config.cpuMask = (uint64_t)1 << cpu;
+    }
+  }
+  if (argc > 5 && parseArg(argv[0], argv[5])) {
+    config.lockMemory    = 1;
+    config.prefaultStack = 64 * 1024;
+  }
+
+  canInitializeLibrary();
+
+  stat = kvSetThreadConfig(&config);
+  if (stat != canOK) {
+    char errorString[50];
+    canGetErrorText(stat, errorString, sizeof(errorString));
+    printf("kvSetThreadConfig: %s\n", errorString);
+    return -1;
+  }
+
+  stat = kvNotifyLatencyTest(samples, interval, &stats);
+  if (stat != canOK) {
+    char errorString[50];
+    canGetErrorText(stat, errorString, sizeof(errorString));
+    printf("kvNotifyLatencyTest: %s\n", errorString);
+    return -1;
+  }
+
+  printf("Dispatch latency, %u samples (us):\n", stats.samples);
+  printf("  min   %8.1f\n", stats.min / 1000.0);
+  printf("  p50   %8.1f\n", stats.p50 / 1000.0);
+  printf("  p90   %8.1f\n", stats.p90 / 1000.0);
+  printf("  p99   %8.1f\n", stats.p99 / 1000.0);
+  printf("  p99.9 %8.1f\n", stats.p999 / 1000.0);
+  printf("  max   %8.1f\n", stats.max / 1000.0);
+
+  canUnloadLibrary();
+
+  return 0;
+}
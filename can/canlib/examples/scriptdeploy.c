@@ -0,0 +1,262 @@
+/*
+**             Copyright 2012-2016 by Kvaser AB, Molndal, Sweden
+**                        http://www.kvaser.com
+**
+** This software is dual licensed under the following two licenses:
+** BSD-new and GPLv2. You may use either one. See the included
+** COPYING file for details.
+**
+** License: BSD-new
+** ===============================================================================
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of the <organization> nor the
+**       names of its contributors may be used to endorse or promote products
+**       derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+** DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+** DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+** (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+** LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+** ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**
+**
+** License: GPLv2
+** ===============================================================================
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+** ---------------------------------------------------------------------------
+**/
+
+/*
+ * Kvaser Linux Canlib
+ * Parallel t-script deployment
+ *
+ * Reads a compiled script (.txe) once and loads it into a slot on every
+ * given device at the same time, one thread per device. Script slots
+ * belong to the device, so of several channels on one device only the
+ * first is used. Each slot is stopped and unloaded, loaded with
+ * kvScriptLoadBuffer() and started. Prints the time each step took per
+ * device.
+ *
+ * kvScriptStatus() is not implemented on Linux, so a script that stops
+ * right after kvScriptStart() is not noticed here.
+ */
+
+#include <canlib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#define MAX_CHANNELS  128
+
+typedef struct {
+  int       channel;
+  uint64_t  serial;
+  canStatus stat;
+  const char *step;       // Step that failed
+  double    loadMs;
+  double    startMs;
+  double    totalMs;
+} Target;
+
+static unsigned char *image;
+static unsigned int  imageLen;
+static int           slot;
+
+static void printUsageAndExit(char *prgName)
+{
+  printf("Usage: '%s <file.txe> <slot> <channel> [<channel> ...]'\n", prgName);
+  exit(1);
+}
+
+static long parseArg(char *prgName, char *arg)
+{
+  char *endPtr = NULL;
+  long value;
+
+  errno = 0;
+  value = strtol(arg, &endPtr, 10);
+  if ((errno != 0) || (endPtr == arg) || (*endPtr != '\0')) {
+    printUsageAndExit(prgName);
+  }
+  return value;
+}
+
+static double nowMs(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static int readImage(const char *fileName)
+{
+  FILE *f = fopen(fileName, "rb");
+  long size;
+
+  if (f == NULL) {
+    return -1;
+  }
+  if (fseek(f, 0, SEEK_END) != 0 || (size = ftell(f)) < 0 ||
+      fseek(f, 0, SEEK_SET) != 0) {
+    fclose(f);
+    return -1;
+  }
+  image = malloc(size ? size : 1);
+  if (image == NULL || fread(image, 1, size, f) != (size_t)size) {
+    fclose(f);
+    return -1;
+  }
+  imageLen = (unsigned int)size;
+  fclose(f);
+  return 0;
+}
+
+static void *deployThread(void *arg)
+{
+  Target       *t = (Target *)arg;
+  double       t0, t1;
+  canHandle    hnd;
+
+  t0 = nowMs();
+  hnd = canOpenChannel(t->channel, 0);
+  if (hnd < 0) {
+    t->stat = hnd;
+    t->step = "canOpenChannel";
+    return NULL;
+  }
+
+  // An empty slot is fine
+  kvScriptStop(hnd, slot, kvSCRIPT_STOP_NORMAL);
+  kvScriptUnload(hnd, slot);
+
+  t1 = nowMs();
+  t->stat = kvScriptLoadBuffer(hnd, slot, image, imageLen);
+  t->loadMs = nowMs() - t1;
+  if (t->stat != canOK) {
+    t->step = "kvScriptLoadBuffer";
+    canClose(hnd);
+    return NULL;
+  }
+
+  t1 = nowMs();
+  t->stat = kvScriptStart(hnd, slot);
+  t->startMs = nowMs() - t1;
+  if (t->stat != canOK) {
+    t->step = "kvScriptStart";
+    canClose(hnd);
+    return NULL;
+  }
+
+  canClose(hnd);
+  t->totalMs = nowMs() - t0;
+  return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+  Target    targets[MAX_CHANNELS];
+  pthread_t threads[MAX_CHANNELS];
+  int       n = 0, i, k, ret, failed = 0;
+  uint64_t  serial;
+  canStatus stat;
+  double    t0;
+
+  if (argc < 4 || argc - 3 > MAX_CHANNELS) {
+    printUsageAndExit(argv[0]);
+  }
+  if (readImage(argv[1]) != 0) {
+    printf("%s: %s\n", argv[1], strerror(errno));
+    return 1;
+  }
+  slot = (int)parseArg(argv[0], argv[2]);
+
+  canInitializeLibrary();
+
+  memset(targets, 0, sizeof(targets));
+  for (i = 3; i < argc; i++) {
+    int channel = (int)parseArg(argv[0], argv[i]);
+
+    serial = 0;
+    stat = canGetChannelData(channel, canCHANNELDATA_CARD_SERIAL_NO,
+                             &serial, sizeof(serial));
+    if (stat != canOK) {
+      printf("Channel %d: no device\n", channel);
+      failed = 1;
+      continue;
+    }
+    // The channels of a device share its script slots
+    for (k = 0; k < n && targets[k].serial != serial; k++) {
+    }
+    if (k < n) {
+      continue;
+    }
+    targets[n].channel = channel;
+    targets[n].serial  = serial;
+    n++;
+  }
+
+  t0 = nowMs();
+  for (i = 0; i < n; i++) {
+    ret = pthread_create(&threads[i], NULL, deployThread, &targets[i]);
+    if (ret != 0) {
+      printf("pthread_create: %s\n", strerror(ret));
+      // Wait for the devices already started
+      n      = i;
+      failed = 1;
+      break;
+    }
+  }
+
+  printf("Channel   Load ms  Start ms  Total ms  Result\n");
+  for (i = 0; i < n; i++) {
+    Target *t = &targets[i];
+
+    pthread_join(threads[i], NULL);
+    if (t->stat != canOK) {
+      char buf[50];
+
+      buf[0] = '\0';
+      canGetErrorText(t->stat, buf, sizeof(buf));
+      printf("%7d  %s failed, stat=%d (%s)\n", t->channel, t->step,
+             (int)t->stat, buf);
+      failed = 1;
+      continue;
+    }
+    printf("%7d  %8.1f  %8.1f  %8.1f  started\n", t->channel, t->loadMs,
+           t->startMs, t->totalMs);
+  }
+  printf("%d devices, %u byte image, %.1f ms\n", n, imageLen, nowMs() - t0);
+
+  canUnloadLibrary();
+  free(image);
+  return failed;
+}
@@ -52,20 +52,86 @@
 
 /*
  * Kvaser Linux Canlib
- * Examine MagiSync time domains
+ * Examine time domains
+ *
+ * Opens a number of channels, puts them in one time domain and prints the
+ * sync state and the current time of each channel once per second.
  */
 
 #include <canlib.h>
 #include <stdio.h>
+#include <unistd.h>
 
 
 #define NUMBER_OF_CHANNELS 5
 
+static void check(const char *id, canStatus stat)
+{
+  if (stat != canOK) {
+    char buf[50];
+    buf[0] = '\0';
+    canGetErrorText(stat, buf, sizeof(buf));
+    printf("%s: failed, stat=%d (%s)\n", id, (int)stat, buf);
+  }
+}
+
 int main (int argc, char *argv[])
 {
+  canHandle        hnd[NUMBER_OF_CHANNELS];
+  kvTimeDomain     domain;
+  kvTimeDomainData data;
+  canStatus        stat;
+  int              nChannels = 0;
+  int              i, j;
 
   (void)argc; // Unused.
   (void)argv; // Unused.
 
+  canInitializeLibrary();
+
+  stat = kvTimeDomainCreate(&domain);
+  check("kvTimeDomainCreate", stat);
+  if (stat != canOK) {
+    return -1;
+  }
+
+  for (i = 0; i < NUMBER_OF_CHANNELS; i++) {
+    hnd[nChannels] = canOpenChannel(i, canOPEN_ACCEPT_VIRTUAL);
+    if (hnd[nChannels] < 0) {
+      break;
+    }
+    stat = kvTimeDomainAddHandle(domain, hnd[nChannels]);
+    check("kvTimeDomainAddHandle", stat);
+    nChannels++;
+  }
+  printf("Added %d channels to time domain\n", nChannels);
+
+  stat = kvTimeDomainResetTime(domain);
+  check("kvTimeDomainResetTime", stat);
+
+  for (j = 0; j < 10; j++) {
+    sleep(1);
+
+    stat = kvTimeDomainGetData(domain, &data, sizeof(data));
+    check("kvTimeDomainGetData", stat);
+    printf("Members: %d, synced: %d, max drift: %.2f ppm, max residual: %.1f us\n",
+           data.nNonMagiSyncedMembers, data.nSoftSyncedMembers,
+           data.maxDriftPpm, data.maxResidualUs);
+
+    for (i = 0; i < nChannels; i++) {
+      uint64_t time;
+      stat = kvReadTimer64(hnd[i], &time);
+      check("kvReadTimer64", stat);
+      printf("  Channel %d: %llu ms\n", i, (unsigned long long)time);
+    }
+  }
+
+  stat = kvTimeDomainDelete(domain);
+  check("kvTimeDomainDelete", stat);
+
+  for (i = 0; i < nChannels; i++) {
+    canClose(hnd[i]);
+  }
+
   return 0;
 }
@@ -0,0 +1,334 @@
+/*
+**             Copyright 2012-2016 by Kvaser AB, Molndal, Sweden
+**                        http://www.kvaser.com
+**
+** This software is dual licensed under the following two licenses:
+** BSD-new and GPLv2. You may use either one. See the included
+** COPYING file for details.
+**
+** License: BSD-new
+** ===============================================================================
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of the <organization> nor the
+**       names of its contributors may be used to endorse or promote products
+**       derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+** DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+** DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+** (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+** LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+** ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**
+**
+** License: GPLv2
+** ===============================================================================
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+** ---------------------------------------------------------------------------
+**/
+
+/*
+ * Kvaser Linux Canlib
+ * Timer access latency and jitter benchmark
+ *
+ * Reads the device timer with kvReadTimer() and kvReadTimer64() as fast as
+ * possible from a pinned thread, optionally with SCHED_FIFO priority, and
+ * reports the round-trip latency distribution and the drift of the device
+ * timer against the host's CLOCK_MONOTONIC.
+ */
+
+#define _GNU_SOURCE // This is required for pthread affinity support
+
+#include <canlib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+
+// Timer resolution used during the test, in us
+#define TIMER_SCALE_US  10
+
+typedef struct {
+  int64_t  host;   // Host time in ns, middle of the read
+  uint64_t dev;    // Device time in us
+  uint32_t rtt;    // Round-trip time in ns
+} Sample;
+
+typedef struct {
+  canHandle    hnd;
+  int          use64;
+  double       seconds;
+  Sample       *samples;
+  size_t       nSamples;
+  canStatus    stat;
+} Bench;
+
+static void printUsageAndExit(char *prgName)
+{
+  printf("Usage: '%s <channel> [<seconds> [<cpu> [<priority>]]]'\n", prgName);
+  printf("  seconds   duration of each test, default 5\n");
+  printf("  cpu       CPU to pin the test thread to, -1 for any\n");
+  printf("  priority  SCHED_FIFO priority (1-99), 0 for default\n");
+  exit(1);
+}
+
+static long parseArg(char *prgName, char *arg)
+{
+  char *endPtr = NULL;
+  long value;
+
+  errno = 0;
+  value = strtol(arg, &endPtr, 10);
+  if ((errno != 0) || (endPtr == arg) || (*endPtr != '\0')) {
+    printUsageAndExit(prgName);
+  }
+  return value;
+}
+
+static int64_t nowNs(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void *benchThread(void *arg)
+{
+  Bench   *b = (Bench *)arg;
+  size_t  size = 1 << 16;
+  int64_t end, t0, t1;
+  uint64_t dev;
+
+  b->samples  = malloc(size * sizeof(Sample));
+  b->nSamples = 0;
+  b->stat     = canOK;
+  if (b->samples == NULL) {
+    b->stat = canERR_NOMEM;
+    return NULL;
+  }
+
+  end = nowNs() + (int64_t)(b->seconds * 1e9);
+  do {
+    if (b->nSamples == size) {
+      Sample *tmp = realloc(b->samples, 2 * size * sizeof(Sample));
+      if (tmp == NULL) {
+        break;
+      }
+      b->samples = tmp;
+      size *= 2;
+    }
+
+    if (b->use64) {
+      t0 = nowNs();
+      b->stat = kvReadTimer64(b->hnd, &dev);
+      t1 = nowNs();
+    } else {
+      unsigned int time32;
+      t0 = nowNs();
+      b->stat = kvReadTimer(b->hnd, &time32);
+      t1 = nowNs();
+      dev = time32;
+    }
+    if (b->stat != canOK) {
+      break;
+    }
+
+    b->samples[b->nSamples].host = t0 + (t1 - t0) / 2;
+    b->samples[b->nSamples].dev  = dev * TIMER_SCALE_US;
+    b->samples[b->nSamples].rtt  = (uint32_t)(t1 - t0);
+    b->nSamples++;
+  } while (t1 < end);
+
+  return NULL;
+}
+
+static int cmpU32(const void *a, const void *b)
+{
+  uint32_t x = *(const uint32_t *)a;
+  uint32_t y = *(const uint32_t *)b;
+
+  return (x > y) - (x < y);
+}
+
+static void report(const char *name, const Bench *b)
+{
+  uint32_t *rtt;
+  size_t   i, n = b->nSamples;
+  unsigned int hist[32];
+  double   sx = 0, sy = 0, sxx = 0, sxy = 0, slope;
+  int      bucket;
+
+  if (n < 2) {
+    printf("%s: too few samples\n", name);
+    return;
+  }
+
+  rtt = malloc(n * sizeof(uint32_t));
+  if (rtt == NULL) {
+    return;
+  }
+  memset(hist, 0, sizeof(hist));
+  for (i = 0; i < n; i++) {
+    rtt[i] = b->samples[i].rtt;
+    for (bucket = 0; bucket < 31 && (rtt[i] >> (bucket + 1)) >= 1000; bucket++) {
+    }
+    hist[bucket]++;
+  }
+  qsort(rtt, n, sizeof(uint32_t), cmpU32);
+
+  printf("%s: %zu reads, %.0f reads/s\n", name, n,
+         n / ((b->samples[n - 1].host - b->samples[0].host) / 1e9));
+  printf("  round-trip (us): p50 %.2f  p99 %.2f  p99.9 %.2f  max %.2f\n",
+         rtt[n / 2] / 1000.0, rtt[(n * 99) / 100] / 1000.0,
+         rtt[(n * 999) / 1000] / 1000.0, rtt[n - 1] / 1000.0);
+  printf("  histogram:\n");
+  for (bucket = 0; bucket < 32; bucket++) {
+    if (hist[bucket]) {
+      printf("    < %6u us  %10u\n", 1u << (bucket + 1), hist[bucket]);
+    }
+  }
+
+  // Least-squares fit of device time against host time
+  for (i = 0; i < n; i++) {
+    double x = (b->samples[i].host - b->samples[0].host) / 1000.0;
+    double y = (double)(int64_t)(b->samples[i].dev - b->samples[0].dev);
+    sx  += x;
+    sy  += y;
+    sxx += x * x;
+    sxy += x * y;
+  }
+  slope = (n * sxy - sx * sy) / (n * sxx - sx * sx);
+  printf("  device vs host drift: %+.2f ppm\n", (slope - 1.0) * 1e6);
+
+  free(rtt);
+}
+
+static int runBench(Bench *b, int cpu, int priority)
+{
+  pthread_attr_t     attr;
+  pthread_t          thread;
+  struct sched_param param;
+  cpu_set_t          cpus;
+  int                ret;
+
+  pthread_attr_init(&attr);
+  if (cpu >= 0) {
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+  }
+  if (priority > 0) {
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = priority;
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+    pthread_attr_setschedparam(&attr, &param);
+  }
+
+  ret = pthread_create(&thread, &attr, benchThread, b);
+  pthread_attr_destroy(&attr);
+  if (ret != 0) {
+    printf("pthread_create failed: %s\n", strerror(ret));
+    return -1;
+  }
+  pthread_join(thread, NULL);
+
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  canHandle hnd;
+  Bench     b;
+  double    seconds  = 5;
+  int       channel;
+  int       cpu      = -1;
+  int       priority = 0;
+  uint32_t  scale    = TIMER_SCALE_US;
+  canStatus stat;
+
+  if (argc < 2 || argc > 5) {
+    printUsageAndExit(argv[0]);
+  }
+  channel = (int)parseArg(argv[0], argv[1]);
+  if (argc > 2) {
+    seconds = parseArg(argv[0], argv[2]);
+  }
+  if (argc > 3) {
+    cpu = (int)parseArg(argv[0], argv[3]);
+  }
+  if (argc > 4) {
+    priority = (int)parseArg(argv[0], argv[4]);
+  }
+
+  canInitializeLibrary();
+
+  hnd = canOpenChannel(channel, canOPEN_ACCEPT_VIRTUAL);
+  if (hnd < 0) {
+    char errorString[50];
+    canGetErrorText(hnd, errorString, sizeof(errorString));
+    printf("%s\n", errorString);
+    return -1;
+  }
+
+  stat = canIoCtl(hnd, canIOCTL_SET_TIMER_SCALE, &scale, sizeof(scale));
+  if (stat != canOK) {
+    printf("canIOCTL_SET_TIMER_SCALE failed (%d)\n", stat);
+    canClose(hnd);
+    return -1;
+  }
+
+  memset(&b, 0, sizeof(b));
+  b.hnd     = hnd;
+  b.seconds = seconds;
+
+  b.use64 = 0;
+  if (runBench(&b, cpu, priority) == 0) {
+    if (b.stat != canOK) {
+      printf("kvReadTimer failed (%d)\n", b.stat);
+    }
+    report("kvReadTimer", &b);
+  }
+  free(b.samples);
+
+  b.use64 = 1;
+  if (runBench(&b, cpu, priority) == 0) {
+    if (b.stat != canOK) {
+      printf("kvReadTimer64 failed (%d)\n", b.stat);
+    }
+    report("kvReadTimer64", &b);
+  }
+  free(b.samples);
+
+  canClose(hnd);
+
+  return 0;
+}
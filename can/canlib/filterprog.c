@@ -0,0 +1,760 @@
+/*
+**             Copyright 2017 by Kvaser AB, Molndal, Sweden
+**                        http://www.kvaser.com
+**
+** This software is dual licensed under the following two licenses:
+** BSD-new and GPLv2. You may use either one. See the included
+** COPYING file for details.
+**
+** License: BSD-new
+** ===============================================================================
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of the <organization> nor the
+**       names of its contributors may be used to endorse or promote products
+**       derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+** DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+** DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+** (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+** LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+** ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**
+**
+** License: GPLv2
+** ===============================================================================
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+** ---------------------------------------------------------------------------
+**/
+
+/*  Kvaser Linux Canlib filter programs
+ *
+ *  Expression syntax, with C operators and precedence:
+ *
+ *    expr    := expr || expr | expr && expr | expr <op> expr
+ *               | ! expr | ~ expr | ( expr ) | number | field
+ *    op      := | ^ & == != < <= > >= << >> + - *
+ *    field   := id | ext | flags | dlc | len | data[number]
+ *
+ *  Numbers are decimal, hex (0x) or octal (0), all values are unsigned
+ *  32-bit. Parentheses nest at most 64 deep. A frame is accepted if the
+ *  expression is non-zero, e.g.
+ *
+ *    data[0] == 0x12 && (id & 0x700) == 0x100
+ *    (flags & 0x10000) || data[3] & 0x80
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+
+#include "filterprog.h"
+
+
+// One evaluation in this many is timed
+#define TIMING_INTERVAL  256
+
+#define MAX_NODES    256
+#define MAX_NESTING  64     // Parentheses, bounds the parser's recursion
+
+enum {
+  T_END, T_NUM, T_IDENT, T_LPAREN, T_RPAREN, T_LBRACKET, T_RBRACKET,
+  T_LOR, T_LAND, T_OR, T_XOR, T_AND, T_EQ, T_NE, T_LT, T_LE, T_GT, T_GE,
+  T_LSH, T_RSH, T_ADD, T_SUB, T_MUL, T_NOT, T_BITNOT, T_ERROR
+};
+
+enum {
+  N_NUM, N_FIELD, N_NOT, N_BITNOT, N_BINARY, N_LAND, N_LOR
+};
+
+typedef struct {
+  int      kind;
+  int      op;      // Token of a binary operator
+  uint32_t k;       // Number, byte index
+  int      field;   // FP_LD_xxx of a field
+  int      l, r;
+} Node;
+
+typedef struct {
+  const char  *s;
+  int         pos;
+  int         tok;
+  int         tokPos;
+  uint32_t    num;
+  char        ident[8];
+  Node        node[MAX_NODES];
+  int         nNodes;
+  int         nesting;
+  int         errorPos;
+  FilterInsn  *insn;
+  unsigned int nInsns;
+} Compiler;
+
+static const struct {
+  const char *text;
+  int        tok;
+} operators[] = {
+  {"||", T_LOR}, {"&&", T_LAND}, {"==", T_EQ}, {"!=", T_NE}, {"<=", T_LE},
+  {">=", T_GE}, {"<<", T_LSH}, {">>", T_RSH}, {"|", T_OR}, {"^", T_XOR},
+  {"&", T_AND}, {"<", T_LT}, {">", T_GT}, {"+", T_ADD}, {"-", T_SUB},
+  {"*", T_MUL}, {"!", T_NOT}, {"~", T_BITNOT}, {"(", T_LPAREN},
+  {")", T_RPAREN}, {"[", T_LBRACKET}, {"]", T_RBRACKET}
+};
+
+static const struct {
+  const char *name;
+  int        op;
+} fields[] = {
+  {"id", FP_LD_ID}, {"ext", FP_LD_EXT}, {"flags", FP_LD_FLAGS},
+  {"dlc", FP_LD_DLC}, {"len", FP_LD_LEN}, {"data", FP_LD_BYTE}
+};
+
+
+//======================================================================
+// Lexer
+//======================================================================
+static void next (Compiler *c)
+{
+  const char *p;
+  unsigned int i;
+
+  while (isspace((unsigned char)c->s[c->pos])) {
+    c->pos++;
+  }
+  p         = &c->s[c->pos];
+  c->tokPos = c->pos;
+
+  if (*p == '\0') {
+    c->tok = T_END;
+    return;
+  }
+
+  if (isdigit((unsigned char)*p)) {
+    char *end;
+    unsigned long long val = strtoull(p, &end, 0);
+    if (val > 0xFFFFFFFFULL || isalnum((unsigned char)*end)) {
+      c->tok = T_ERROR;
+      return;
+    }
+    c->num  = (uint32_t)val;
+    c->pos += end - p;
+    c->tok  = T_NUM;
+    return;
+  }
+
+  if (isalpha((unsigned char)*p)) {
+    int n = 0;
+    while (isalnum((unsigned char)p[n]) || p[n] == '_') {
+      n++;
+    }
+    c->pos += n;
+    if (n >= (int)sizeof(c->ident)) {
+      c->tok = T_ERROR;
+      return;
+    }
+    memcpy(c->ident, p, n);
+    c->ident[n] = '\0';
+    c->tok      = T_IDENT;
+    return;
+  }
+
+  for (i = 0; i < sizeof(operators) / sizeof(operators[0]); i++) {
+    size_t len = strlen(operators[i].text);
+    if (strncmp(p, operators[i].text, len) == 0) {
+      c->pos += len;
+      c->tok  = operators[i].tok;
+      return;
+    }
+  }
+
+  c->tok = T_ERROR;
+}
+
+
+//======================================================================
+// Parser, builds an expression tree
+//======================================================================
+static int newNode (Compiler *c, int kind)
+{
+  Node *n;
+
+  if (c->nNodes == MAX_NODES) {
+    c->errorPos = c->tokPos;
+    return -1;
+  }
+  n = &c->node[c->nNodes];
+  memset(n, 0, sizeof(*n));
+  n->kind = kind;
+
+  return c->nNodes++;
+}
+
+static int parseBinary (Compiler *c, int level);
+
+static int parseUnary (Compiler *c)
+{
+  int n, sub;
+  unsigned int i;
+
+  switch (c->tok) {
+  case T_NOT:
+  case T_BITNOT:
+    n = newNode(c, (c->tok == T_NOT) ? N_NOT : N_BITNOT);
+    if (n < 0) {
+      return -1;
+    }
+    next(c);
+    sub = parseUnary(c);
+    if (sub < 0) {
+      return -1;
+    }
+    c->node[n].l = sub;
+    return n;
+
+  case T_LPAREN:
+    if (c->nesting == MAX_NESTING) {
+      break;
+    }
+    c->nesting++;
+    next(c);
+    n = parseBinary(c, 0);
+    if (n < 0) {
+      return -1;
+    }
+    if (c->tok != T_RPAREN) {
+      c->errorPos = c->tokPos;
+      return -1;
+    }
+    c->nesting--;
+    next(c);
+    return n;
+
+  case T_NUM:
+    n = newNode(c, N_NUM);
+    if (n < 0) {
+      return -1;
+    }
+    c->node[n].k = c->num;
+    next(c);
+    return n;
+
+  case T_IDENT:
+    for (i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+      if (strcmp(c->ident, fields[i].name) == 0) {
+        break;
+      }
+    }
+    if (i == sizeof(fields) / sizeof(fields[0])) {
+      break;
+    }
+    n = newNode(c, N_FIELD);
+    if (n < 0) {
+      return -1;
+    }
+    c->node[n].field = fields[i].op;
+    next(c);
+    if (fields[i].op == FP_LD_BYTE) {
+      if (c->tok != T_LBRACKET) {
+        break;
+      }
+      next(c);
+      if (c->tok != T_NUM || c->num >= FILTERPROG_MAX_DATA) {
+        break;
+      }
+      c->node[n].k = c->num;
+      next(c);
+      if (c->tok != T_RBRACKET) {
+        break;
+      }
+      next(c);
+    }
+    return n;
+
+  default:
+    break;
+  }
+
+  c->errorPos = c->tokPos;
+  return -1;
+}
+
+// Binary operators by precedence, lowest first
+static const int precedence[][4] = {
+  {T_LOR}, {T_LAND}, {T_OR}, {T_XOR}, {T_AND}, {T_EQ, T_NE},
+  {T_LT, T_LE, T_GT, T_GE}, {T_LSH, T_RSH}, {T_ADD, T_SUB}, {T_MUL}
+};
+#define LEVELS ((int)(sizeof(precedence) / sizeof(precedence[0])))
+
+static int isOperatorAt (int tok, int level)
+{
+  int i;
+
+  for (i = 0; i < 4; i++) {
+    if (precedence[level][i] == tok && tok != T_END) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+static int parseBinary (Compiler *c, int level)
+{
+  int l, r, n, op;
+
+  if (level == LEVELS) {
+    return parseUnary(c);
+  }
+
+  l = parseBinary(c, level + 1);
+  while (l >= 0 && isOperatorAt(c->tok, level)) {
+    op = c->tok;
+    next(c);
+    r = parseBinary(c, level + 1);
+    if (r < 0) {
+      return -1;
+    }
+    n = newNode(c, (op == T_LOR) ? N_LOR : (op == T_LAND) ? N_LAND : N_BINARY);
+    if (n < 0) {
+      return -1;
+    }
+    c->node[n].op = op;
+    c->node[n].l  = l;
+    c->node[n].r  = r;
+    if ((op == T_LSH || op == T_RSH) &&
+        c->node[r].kind == N_NUM && c->node[r].k >= 32) {
+      c->errorPos = c->tokPos;
+      return -1;
+    }
+    l = n;
+  }
+
+  return l;
+}
+
+
+//======================================================================
+// Code generator, leaves the value of a node in A
+//======================================================================
+static int emit (Compiler *c, int op, int alu, int src, uint32_t k)
+{
+  FilterInsn *insn;
+
+  if (c->nInsns == FILTERPROG_MAX_INSNS) {
+    return -1;
+  }
+  insn = &c->insn[c->nInsns];
+  memset(insn, 0, sizeof(*insn));
+  insn->op  = op;
+  insn->alu = alu;
+  insn->src = src;
+  insn->k   = k;
+
+  return c->nInsns++;
+}
+
+// Emits "A = A ? 1 : 0" style tail for a conditional jump at index j,
+// where the jump's true branch means a result of 1.
+static int emitBool (Compiler *c, int j, int invert)
+{
+  if (emit(c, FP_LD_IMM, 0, 0, 1) < 0 ||
+      emit(c, FP_JA, 0, 0, 1) < 0 ||
+      emit(c, FP_LD_IMM, 0, 0, 0) < 0) {
+    return -1;
+  }
+  c->insn[j].jt = invert ? 2 : 0;
+  c->insn[j].jf = invert ? 0 : 2;
+
+  return 0;
+}
+
+static int gen (Compiler *c, int n, int depth)
+{
+  Node *node = &c->node[n];
+  int  j1, j2, constant, src;
+  uint32_t k = 0;
+
+  switch (node->kind) {
+  case N_NUM:
+    return emit(c, FP_LD_IMM, 0, 0, node->k) < 0 ? -1 : 0;
+
+  case N_FIELD:
+    return emit(c, node->field, 0, 0, node->k) < 0 ? -1 : 0;
+
+  case N_NOT:
+    if (gen(c, node->l, depth) < 0) {
+      return -1;
+    }
+    return emit(c, FP_NOT, 0, 0, 0) < 0 ? -1 : 0;
+
+  case N_BITNOT:
+    if (gen(c, node->l, depth) < 0) {
+      return -1;
+    }
+    return emit(c, FP_ALU, FP_XOR, 0, 0xFFFFFFFF) < 0 ? -1 : 0;
+
+  case N_LAND:
+  case N_LOR:
+    if (gen(c, node->l, depth) < 0) {
+      return -1;
+    }
+    j1 = emit(c, FP_JMP, FP_JEQ, 0, 0);
+    if (j1 < 0 || gen(c, node->r, depth) < 0) {
+      return -1;
+    }
+    j2 = emit(c, FP_JMP, FP_JEQ, 0, 0);
+    if (j2 < 0 || emitBool(c, j2, 1) < 0) {
+      return -1;
+    }
+    // j2: A == 0 goes to the "0" tail, else to the "1" tail. j1 skips
+    // the right side to the matching tail.
+    if (node->kind == N_LAND) {
+      c->insn[j1].jt = c->nInsns - 1 - (j1 + 1);
+      c->insn[j1].jf = 0;
+    } else {
+      c->insn[j1].jt = 0;
+      c->insn[j1].jf = c->nInsns - 3 - (j1 + 1);
+    }
+    return 0;
+
+  default:
+    break;
+  }
+
+  // Binary operator, use k when the right side is a constant
+  constant = (c->node[node->r].kind == N_NUM);
+  if (constant) {
+    k   = c->node[node->r].k;
+    src = 0;
+    if (gen(c, node->l, depth) < 0) {
+      return -1;
+    }
+  } else {
+    if (depth == FILTERPROG_MEM_WORDS) {
+      return -1;
+    }
+    src = 1;
+    if (gen(c, node->r, depth) < 0 ||
+        emit(c, FP_ST, 0, 0, depth) < 0 ||
+        gen(c, node->l, depth + 1) < 0 ||
+        emit(c, FP_LDX_MEM, 0, 0, depth) < 0) {
+      return -1;
+    }
+  }
+
+  switch (node->op) {
+  case T_ADD: return emit(c, FP_ALU, FP_ADD, src, k) < 0 ? -1 : 0;
+  case T_SUB: return emit(c, FP_ALU, FP_SUB, src, k) < 0 ? -1 : 0;
+  case T_MUL: return emit(c, FP_ALU, FP_MUL, src, k) < 0 ? -1 : 0;
+  case T_AND: return emit(c, FP_ALU, FP_AND, src, k) < 0 ? -1 : 0;
+  case T_OR:  return emit(c, FP_ALU, FP_OR,  src, k) < 0 ? -1 : 0;
+  case T_XOR: return emit(c, FP_ALU, FP_XOR, src, k) < 0 ? -1 : 0;
+  case T_LSH: return emit(c, FP_ALU, FP_LSH, src, k) < 0 ? -1 : 0;
+  case T_RSH: return emit(c, FP_ALU, FP_RSH, src, k) < 0 ? -1 : 0;
+  case T_EQ:  j1 = emit(c, FP_JMP, FP_JEQ, src, k); return j1 < 0 ? -1 : emitBool(c, j1, 0);
+  case T_NE:  j1 = emit(c, FP_JMP, FP_JEQ, src, k); return j1 < 0 ? -1 : emitBool(c, j1, 1);
+  case T_GT:  j1 = emit(c, FP_JMP, FP_JGT, src, k); return j1 < 0 ? -1 : emitBool(c, j1, 0);
+  case T_LE:  j1 = emit(c, FP_JMP, FP_JGT, src, k); return j1 < 0 ? -1 : emitBool(c, j1, 1);
+  case T_GE:  j1 = emit(c, FP_JMP, FP_JGE, src, k); return j1 < 0 ? -1 : emitBool(c, j1, 0);
+  case T_LT:  j1 = emit(c, FP_JMP, FP_JGE, src, k); return j1 < 0 ? -1 : emitBool(c, j1, 1);
+  default:    return -1;
+  }
+}
+
+
+//======================================================================
+// filterProgCompile
+//======================================================================
+canStatus filterProgCompile (const char *expr, FilterProg **prog, int *errorPos)
+{
+  Compiler  *c;
+  FilterProg *p;
+  int       root;
+  canStatus stat;
+
+  if (errorPos) {
+    *errorPos = -1;
+  }
+  if (expr == NULL || prog == NULL) {
+    return canERR_PARAM;
+  }
+
+  c = malloc(sizeof(*c));
+  p = calloc(1, sizeof(*p));
+  if (c == NULL || p == NULL) {
+    free(c);
+    free(p);
+    return canERR_NOMEM;
+  }
+  memset(c, 0, sizeof(*c));
+  c->s        = expr;
+  c->errorPos = -1;
+  c->insn     = p->insn;
+
+  next(c);
+  root = parseBinary(c, 0);
+  if (root >= 0 && c->tok != T_END) {
+    c->errorPos = c->tokPos;
+    root        = -1;
+  }
+  if (root < 0) {
+    if (errorPos) {
+      *errorPos = c->errorPos;
+    }
+    free(c);
+    free(p);
+    return canERR_PARAM;
+  }
+
+  if (gen(c, root, 0) < 0 || emit(c, FP_RET_A, 0, 0, 0) < 0) {
+    // Too long or too deeply nested
+    free(c);
+    free(p);
+    return canERR_PARAM;
+  }
+  p->nInsns = c->nInsns;
+  free(c);
+
+  stat = filterProgVerify(p->insn, p->nInsns);
+  if (stat != canOK) {
+    free(p);
+    return stat;
+  }
+
+  filterProgResetStats(p);
+  *prog = p;
+
+  return canOK;
+}
+
+
+//======================================================================
+// filterProgVerify
+//======================================================================
+canStatus filterProgVerify (const FilterInsn *insn, unsigned int nInsns)
+{
+  unsigned int pc;
+
+  if (nInsns == 0 || nInsns > FILTERPROG_MAX_INSNS) {
+    return canERR_PARAM;
+  }
+
+  // Jumps are forward only, so a program that cannot fall off its end
+  // always terminates.
+  if (insn[nInsns - 1].op != FP_RET_A && insn[nInsns - 1].op != FP_RET) {
+    return canERR_PARAM;
+  }
+
+  for (pc = 0; pc < nInsns; pc++) {
+    const FilterInsn *i = &insn[pc];
+
+    switch (i->op) {
+    case FP_LD_ID:
+    case FP_LD_EXT:
+    case FP_LD_FLAGS:
+    case FP_LD_DLC:
+    case FP_LD_LEN:
+    case FP_LD_IMM:
+    case FP_NOT:
+    case FP_RET_A:
+    case FP_RET:
+      break;
+    case FP_LD_BYTE:
+      if (i->k >= FILTERPROG_MAX_DATA) {
+        return canERR_PARAM;
+      }
+      break;
+    case FP_LD_MEM:
+    case FP_ST:
+    case FP_LDX_MEM:
+      if (i->k >= FILTERPROG_MEM_WORDS) {
+        return canERR_PARAM;
+      }
+      break;
+    case FP_ALU:
+      if (i->alu > FP_RSH) {
+        return canERR_PARAM;
+      }
+      if (!i->src && (i->alu == FP_LSH || i->alu == FP_RSH) && i->k >= 32) {
+        return canERR_PARAM;
+      }
+      break;
+    case FP_JMP:
+      if (i->alu > FP_JSET ||
+          pc + 1 + i->jt >= nInsns || pc + 1 + i->jf >= nInsns) {
+        return canERR_PARAM;
+      }
+      break;
+    case FP_JA:
+      if (pc + 1 + (uint64_t)i->k >= nInsns) {
+        return canERR_PARAM;
+      }
+      break;
+    default:
+      return canERR_PARAM;
+    }
+  }
+
+  return canOK;
+}
+
+
+//======================================================================
+// filterProgRun, the program must be verified
+//======================================================================
+int filterProgRun (const FilterProg *prog, const FilterFrame *frame)
+{
+  const FilterInsn *insn = prog->insn;
+  uint32_t A = 0, X = 0, v;
+  uint32_t M[FILTERPROG_MEM_WORDS] = {0};
+  unsigned int pc = 0;
+
+  while (1) {
+    const FilterInsn *i = &insn[pc++];
+
+    switch (i->op) {
+    case FP_LD_ID:    A = frame->id;    break;
+    case FP_LD_EXT:   A = frame->ext;   break;
+    case FP_LD_FLAGS: A = frame->flags; break;
+    case FP_LD_DLC:   A = frame->dlc;   break;
+    case FP_LD_LEN:   A = frame->len;   break;
+    case FP_LD_BYTE:  A = (i->k < frame->len) ? frame->data[i->k] : 0; break;
+    case FP_LD_IMM:   A = i->k;         break;
+    case FP_LD_MEM:   A = M[i->k];      break;
+    case FP_ST:       M[i->k] = A;      break;
+    case FP_LDX_MEM:  X = M[i->k];      break;
+    case FP_NOT:      A = !A;           break;
+
+    case FP_ALU:
+      v = i->src ? X : i->k;
+      switch (i->alu) {
+      case FP_ADD: A += v;        break;
+      case FP_SUB: A -= v;        break;
+      case FP_MUL: A *= v;        break;
+      case FP_AND: A &= v;        break;
+      case FP_OR:  A |= v;        break;
+      case FP_XOR: A ^= v;        break;
+      case FP_LSH: A <<= v & 31;  break;
+      case FP_RSH: A >>= v & 31;  break;
+      }
+      break;
+
+    case FP_JMP:
+      v = i->src ? X : i->k;
+      switch (i->alu) {
+      case FP_JEQ:  pc += (A == v) ? i->jt : i->jf;       break;
+      case FP_JGT:  pc += (A > v) ? i->jt : i->jf;        break;
+      case FP_JGE:  pc += (A >= v) ? i->jt : i->jf;       break;
+      case FP_JSET: pc += (A & v) ? i->jt : i->jf;        break;
+      }
+      break;
+
+    case FP_JA:
+      pc += i->k;
+      break;
+
+    case FP_RET_A:
+      return A != 0;
+
+    default:
+      return i->k != 0;
+    }
+  }
+}
+
+static int64_t nowNs (void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+//======================================================================
+// filterProgAccept, runs the program and counts the result
+// The read path and the dispatcher may run the same program at once.
+//======================================================================
+int filterProgAccept (FilterProg *prog, const FilterFrame *frame)
+{
+  int accept;
+
+  if ((__atomic_fetch_add(&prog->evaluations, 1, __ATOMIC_RELAXED) %
+       TIMING_INTERVAL) == 0) {
+    int64_t t0 = nowNs();
+    accept = filterProgRun(prog, frame);
+    __atomic_fetch_add(&prog->timedNs, nowNs() - t0, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&prog->timedEvaluations, 1, __ATOMIC_RELAXED);
+  } else {
+    accept = filterProgRun(prog, frame);
+  }
+  if (!accept) {
+    __atomic_fetch_add(&prog->rejected, 1, __ATOMIC_RELAXED);
+  }
+
+  return accept;
+}
+
+//======================================================================
+// filterProgGetStats
+//======================================================================
+void filterProgGetStats (FilterProg *prog, kvFilterProgramStats *stats)
+{
+  double   elapsed = (nowNs() - prog->startNs) / 1e9;
+  uint64_t timed   = __atomic_load_n(&prog->timedEvaluations, __ATOMIC_RELAXED);
+  uint64_t timedNs = __atomic_load_n(&prog->timedNs, __ATOMIC_RELAXED);
+
+  memset(stats, 0, sizeof(*stats));
+  stats->evaluations = __atomic_load_n(&prog->evaluations, __ATOMIC_RELAXED);
+  stats->rejected    = __atomic_load_n(&prog->rejected, __ATOMIC_RELAXED);
+  if (stats->evaluations) {
+    stats->rejectRatio = (double)stats->rejected / stats->evaluations;
+  }
+  if (elapsed > 0) {
+    stats->evalsPerSec = stats->evaluations / elapsed;
+  }
+  if (timed) {
+    stats->avgEvalNs = (double)timedNs / timed - prog->clockNs;
+    if (stats->avgEvalNs < 0) {
+      stats->avgEvalNs = 0;
+    }
+  }
+}
+
+//======================================================================
+// filterProgResetStats
+//======================================================================
+void filterProgResetStats (FilterProg *prog)
+{
+  prog->evaluations      = 0;
+  prog->rejected         = 0;
+  prog->timedEvaluations = 0;
+  prog->timedNs          = 0;
+  prog->startNs          = nowNs();
+
+  // Cost of reading the clock, which is included in each timed evaluation
+  prog->clockNs = (nowNs() - prog->startNs);
+}
@@ -0,0 +1,140 @@
+/*
+**             Copyright 2017 by Kvaser AB, Molndal, Sweden
+**                        http://www.kvaser.com
+**
+** This software is dual licensed under the following two licenses:
+** BSD-new and GPLv2. You may use either one. See the included
+** COPYING file for details.
+**
+** License: BSD-new
+** ===============================================================================
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of the <organization> nor the
+**       names of its contributors may be used to endorse or promote products
+**       derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+** DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+** DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+** (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+** LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+** ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**
+**
+** License: GPLv2
+** ===============================================================================
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+** ---------------------------------------------------------------------------
+**/
+
+/*  Kvaser Linux Canlib filter programs
+ *
+ *  A filter expression over the id, flags, DLC and payload of a frame is
+ *  compiled into a small bytecode for an accumulator machine. The bytecode
+ *  is verified before use: jumps go forward only and stay inside the
+ *  program, every path ends in a return and all loads are in bounds, so a
+ *  program always terminates and cannot read outside the frame.
+ */
+
+#ifndef FILTERPROG_H
+#define FILTERPROG_H
+
+#include <stdint.h>
+
+#include "canlib.h"
+
+#define FILTERPROG_MAX_INSNS  512
+#define FILTERPROG_MEM_WORDS  16
+#define FILTERPROG_MAX_DATA   64
+
+// Opcodes
+enum {
+  FP_LD_ID,       // A = id
+  FP_LD_EXT,      // A = 1 if extended id, else 0
+  FP_LD_FLAGS,    // A = canMSG_xxx flags
+  FP_LD_DLC,      // A = dlc
+  FP_LD_LEN,      // A = number of data bytes
+  FP_LD_BYTE,     // A = data[k], 0 beyond the data length
+  FP_LD_IMM,      // A = k
+  FP_LD_MEM,      // A = M[k]
+  FP_ST,          // M[k] = A
+  FP_LDX_MEM,     // X = M[k]
+  FP_ALU,         // A = A <alu> (src ? X : k)
+  FP_NOT,         // A = !A
+  FP_JMP,         // pc += (A <jmp> (src ? X : k)) ? jt : jf
+  FP_JA,          // pc += k
+  FP_RET_A,       // Accept if A != 0
+  FP_RET          // Accept if k != 0
+};
+
+// FP_ALU operations, in the alu field
+enum {
+  FP_ADD, FP_SUB, FP_MUL, FP_AND, FP_OR, FP_XOR, FP_LSH, FP_RSH
+};
+
+// FP_JMP conditions, in the alu field
+enum {
+  FP_JEQ, FP_JGT, FP_JGE, FP_JSET
+};
+
+typedef struct {
+  uint8_t  op;
+  uint8_t  alu;
+  uint8_t  src;   // Non-zero to use X instead of k
+  uint16_t jt;
+  uint16_t jf;
+  uint32_t k;
+} FilterInsn;
+
+// The frame a program runs on
+typedef struct {
+  uint32_t      id;
+  uint32_t      ext;
+  uint32_t      flags;
+  uint32_t      dlc;
+  uint32_t      len;
+  const uint8_t *data;
+} FilterFrame;
+
+typedef struct FilterProg {
+  FilterInsn   insn[FILTERPROG_MAX_INSNS];
+  unsigned int nInsns;
+  uint64_t     evaluations;
+  uint64_t     rejected;
+  uint64_t     timedEvaluations;
+  uint64_t     timedNs;
+  int64_t      startNs;
+  int64_t      clockNs;
+} FilterProg;
+
+canStatus filterProgCompile (const char *expr, FilterProg **prog, int *errorPos);
+canStatus filterProgVerify (const FilterInsn *insn, unsigned int nInsns);
+int filterProgRun (const FilterProg *prog, const FilterFrame *frame);
+int filterProgAccept (FilterProg *prog, const FilterFrame *frame);
+void filterProgGetStats (FilterProg *prog, kvFilterProgramStats *stats);
+void filterProgResetStats (FilterProg *prog);
+
+#endif  /* FILTERPROG_H */
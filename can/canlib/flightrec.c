@@ -0,0 +1,604 @@
+/*
+**             Copyright 2017 by Kvaser AB, Molndal, Sweden
+**                        http://www.kvaser.com
+**
+** This software is dual licensed under the following two licenses:
+** BSD-new and GPLv2. You may use either one. See the included
+** COPYING file for details.
+**
+** License: BSD-new
+** ===============================================================================
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of the <organization> nor the
+**       names of its contributors may be used to endorse or promote products
+**       derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+** DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+** DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+** (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+** LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+** ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**
+**
+** License: GPLv2
+** ===============================================================================
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+** ---------------------------------------------------------------------------
+**/
+
+/*  Kvaser Linux Canlib flight recorder */
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#include "flightrec.h"
+#include "apistats.h"
+
+
+// Set to "0" to turn the recorder off, or to a file name to dump the
+// events there if the process crashes
+#define FLIGHTREC_ENV "KVASER_CANLIB_FLIGHTREC"
+
+#define EVENT_MASK (FLIGHTREC_EVENTS - 1)
+
+typedef struct FlightRing {
+  struct FlightRing *next;     // Rings are never freed, see getRing()
+  int               inUse;     // Owned by a live thread
+  int               tid;       // Atomic, read by dumps in other threads
+  uint64_t          head;      // Next event number
+  uint64_t          lastApi;   // Event number + 1 of the last API event
+  FlightRecEvent    event[FLIGHTREC_EVENTS];
+} FlightRing;
+
+int flightRecEnabled = 1;
+
+static FlightRing      *rings = NULL;
+static pthread_mutex_t ringKeyMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t   ringKey;
+static int             ringKeyValid = 0;  // Deleted by flightRecUnload
+
+static __thread FlightRing *threadRing = NULL;
+
+// Dump settings used by the signal handlers
+static const int crashSignals[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+#define CRASH_SIGNALS ((int)(sizeof(crashSignals) / sizeof(crashSignals[0])))
+
+static pthread_mutex_t  dumpMutex = PTHREAD_MUTEX_INITIALIZER;
+static char             dumpPath[2][256]; // Empty for stderr
+static int              dumpPathCur = 0;  // Atomic, the one handlers use
+static int              dumpSignal = 0;
+static struct sigaction dumpSignalOld;
+static int              crashInstalled = 0;
+static struct sigaction crashOld[CRASH_SIGNALS];
+
+
+static int64_t nowNs (void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+//======================================================================
+// Ring ownership
+//======================================================================
+static void ringRelease (void *arg)
+{
+  FlightRing *ring = (FlightRing *)arg;
+
+  // The events are kept until another thread takes over the ring
+  __atomic_store_n(&ring->inUse, 0, __ATOMIC_RELEASE);
+}
+
+// The ring of the calling thread. Rings of exited threads are reused, and
+// no ring is ever unlinked or freed, so a dump can walk the list from a
+// signal handler without locks.
+static FlightRing *getRing (void)
+{
+  FlightRing *ring = threadRing;
+  int        expected;
+
+  if (__builtin_expect(ring != NULL, 1)) {
+    return ring;
+  }
+
+  for (ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring; ring = ring->next) {
+    expected = 0;
+    if (__atomic_compare_exchange_n(&ring->inUse, &expected, 1, 0,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+      break;
+    }
+  }
+
+  if (!ring) {
+    ring = calloc(1, sizeof(*ring));
+    if (!ring) {
+      return NULL;
+    }
+    ring->inUse = 1;
+    ring->next  = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&rings, &ring->next, ring, 0,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+  }
+
+  __atomic_store_n(&ring->tid, (int)syscall(SYS_gettid), __ATOMIC_RELAXED);
+  ring->lastApi = 0;
+  threadRing    = ring;
+
+  pthread_mutex_lock(&ringKeyMutex);
+  if (!ringKeyValid) {
+    ringKeyValid = (pthread_key_create(&ringKey, ringRelease) == 0);
+  }
+  if (ringKeyValid) {
+    pthread_setspecific(ringKey, ring);
+  }
+  pthread_mutex_unlock(&ringKeyMutex);
+
+  return ring;
+}
+
+//======================================================================
+// Seqlock write of event number idx
+//======================================================================
+static FlightRecEvent *beginWrite (FlightRing *ring, uint64_t idx)
+{
+  FlightRecEvent *ev = &ring->event[idx & EVENT_MASK];
+
+  __atomic_store_n(&ev->seq, 2 * idx + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  return ev;
+}
+
+static void endWrite (FlightRecEvent *ev, uint64_t idx)
+{
+  __atomic_store_n(&ev->seq, 2 * idx + 2, __ATOMIC_RELEASE);
+}
+
+//======================================================================
+// flightRecAdd
+//======================================================================
+void flightRecAdd (int type, int code, int handle, uint32_t arg1, uint32_t arg2)
+{
+  FlightRing     *ring = getRing();
+  FlightRecEvent *ev;
+  uint64_t       idx;
+
+  if (!ring) {
+    return;
+  }
+
+  idx = ring->head;
+  ev  = beginWrite(ring, idx);
+  ev->timeNs = nowNs();
+  ev->type   = (uint16_t)type;
+  ev->code   = (uint16_t)code;
+  ev->handle = handle;
+  ev->arg1   = arg1;
+  ev->arg2   = arg2;
+  ev->tid    = ring->tid;
+  endWrite(ev, idx);
+  __atomic_store_n(&ring->head, idx + 1, __ATOMIC_RELEASE);
+}
+
+//======================================================================
+// flightRecApiCall, folds repeated calls of the same function into one
+// event so that a polling loop does not flush the ring. The event keeps
+// the time of the first call; the next event in the ring ends the run.
+//======================================================================
+void flightRecApiCall (int api)
+{
+  FlightRing     *ring = threadRing;
+  FlightRecEvent *ev;
+  uint64_t       idx;
+
+  // A repeat only bumps the count, without reading the clock
+  if (__builtin_expect(ring != NULL, 1) &&
+      ring->lastApi && ring->lastApi == ring->head) {
+    idx = ring->head - 1;
+    ev  = &ring->event[idx & EVENT_MASK];
+    if (ev->code == api) {
+      if (ev->arg1 != UINT32_MAX) {
+        beginWrite(ring, idx);
+        ev->arg1++;
+        endWrite(ev, idx);
+      }
+      return;
+    }
+  }
+
+  ring = getRing();
+  if (!ring) {
+    return;
+  }
+
+  flightRecAdd(FLIGHTREC_API, api, -1, 1, 0);
+  ring->lastApi = ring->head;
+}
+
+//======================================================================
+// Async-signal-safe output
+//======================================================================
+typedef struct {
+  int          fd;
+  unsigned int len;
+  char         buf[512];
+} Out;
+
+static void outFlush (Out *out)
+{
+  unsigned int done = 0;
+  ssize_t      n;
+
+  while (done < out->len) {
+    n = write(out->fd, out->buf + done, out->len - done);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      break;
+    }
+    done += (unsigned int)n;
+  }
+  out->len = 0;
+}
+
+static void outChar (Out *out, char c)
+{
+  if (out->len == sizeof(out->buf)) {
+    outFlush(out);
+  }
+  out->buf[out->len++] = c;
+}
+
+static void outStr (Out *out, const char *s)
+{
+  while (*s) {
+    outChar(out, *s++);
+  }
+}
+
+static void outUnsigned (Out *out, uint64_t v, unsigned int base, int width)
+{
+  char buf[24];
+  int  n = 0;
+
+  do {
+    buf[n++] = "0123456789abcdef"[v % base];
+    v /= base;
+  } while (v);
+  while (n < width) {
+    buf[n++] = '0';
+  }
+  while (n) {
+    outChar(out, buf[--n]);
+  }
+}
+
+static void outInt (Out *out, int64_t v)
+{
+  if (v < 0) {
+    outStr(out, "-");
+    outUnsigned(out, (uint64_t)-v, 10, 0);
+  } else {
+    outUnsigned(out, (uint64_t)v, 10, 0);
+  }
+}
+
+static void outTime (Out *out, int64_t ns)
+{
+  outUnsigned(out, (uint64_t)ns / 1000000000, 10, 0);
+  outStr(out, ".");
+  outUnsigned(out, (uint64_t)ns % 1000000000, 10, 9);
+}
+
+//======================================================================
+// Copy event number idx, returns 0 if it has been overwritten or is being
+// written. Gives up instead of spinning, since the writer may be the
+// thread that runs the dump from a signal handler.
+//======================================================================
+static int readEvent (FlightRing *ring, uint64_t idx, FlightRecEvent *ev)
+{
+  FlightRecEvent *slot = &ring->event[idx & EVENT_MASK];
+  uint64_t       seq;
+  int            tries;
+
+  for (tries = 0; tries < 4; tries++) {
+    seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    *ev = *slot;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (!(seq & 1) && __atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq) {
+      return seq == 2 * idx + 2;
+    }
+  }
+
+  return 0;
+}
+
+static void dumpEvent (Out *out, const FlightRecEvent *ev)
+{
+  outTime(out, ev->timeNs);
+  outStr(out, " tid ");
+  outInt(out, ev->tid);
+
+  switch (ev->type) {
+  case FLIGHTREC_API:
+    outStr(out, " api ");
+    outStr(out, apiStatsName(ev->code));
+    if (ev->arg1 > 1) {
+      outStr(out, " x");
+      outUnsigned(out, ev->arg1, 10, 0);
+    }
+    break;
+
+  case FLIGHTREC_IOCTL_ERROR:
+    outStr(out, " ioctl_error errno ");
+    outUnsigned(out, ev->arg1, 10, 0);
+    outStr(out, " status ");
+    outInt(out, (int32_t)ev->arg2);
+    break;
+
+  case FLIGHTREC_STATUS:
+    outStr(out, " status hnd ");
+    outInt(out, ev->handle);
+    outStr(out, " bus 0x");
+    outUnsigned(out, ev->code, 16, 2);
+    outStr(out, " tx ");
+    outUnsigned(out, ev->arg1, 10, 0);
+    outStr(out, " rx ");
+    outUnsigned(out, ev->arg2, 10, 0);
+    break;
+
+  case FLIGHTREC_TX_OVERFLOW:
+  case FLIGHTREC_RX_OVERRUN:
+    outStr(out, ev->type == FLIGHTREC_TX_OVERFLOW ? " tx_overflow hnd " :
+                                                    " rx_overrun hnd ");
+    outInt(out, ev->handle);
+    outStr(out, " id 0x");
+    outUnsigned(out, ev->arg1, 16, 0);
+    break;
+
+  default:
+    outStr(out, " unknown ");
+    outUnsigned(out, ev->type, 10, 0);
+    break;
+  }
+  outStr(out, "\n");
+}
+
+// Writes the rings one thread at a time, oldest event first. Lines start
+// with the time, so "sort -n" merges the threads.
+static void dumpRings (int fd)
+{
+  Out             out;
+  FlightRing      *ring;
+  FlightRecEvent  ev;
+  struct timespec ts;
+  uint64_t        head, idx;
+
+  out.fd  = fd;
+  out.len = 0;
+
+  outStr(&out, "# canlib flight recorder, monotonic ");
+  outTime(&out, nowNs());
+  clock_gettime(CLOCK_REALTIME, &ts);
+  outStr(&out, " = realtime ");
+  outTime(&out, (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec);
+  outStr(&out, "\n");
+
+  for (ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring; ring = ring->next) {
+    head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    idx  = head > FLIGHTREC_EVENTS ? head - FLIGHTREC_EVENTS : 0;
+
+    outStr(&out, "# ring of tid ");
+    outInt(&out, __atomic_load_n(&ring->tid, __ATOMIC_RELAXED));
+    outStr(&out, __atomic_load_n(&ring->inUse, __ATOMIC_RELAXED) ? "" : " (exited)");
+    outStr(&out, ", ");
+    outUnsigned(&out, head, 10, 0);
+    outStr(&out, " events\n");
+
+    for (; idx < head; idx++) {
+      if (readEvent(ring, idx, &ev)) {
+        dumpEvent(&out, &ev);
+      }
+    }
+  }
+  outFlush(&out);
+}
+
+static canStatus dumpTo (const char *filename)
+{
+  int fd = STDERR_FILENO;
+
+  if (filename && *filename) {
+    fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+      return canERR_HOST_FILE;
+    }
+  }
+  dumpRings(fd);
+  if (fd != STDERR_FILENO) {
+    close(fd);
+  }
+
+  return canOK;
+}
+
+//======================================================================
+// Signal handlers
+//======================================================================
+static const char *currentDumpPath (void)
+{
+  return dumpPath[__atomic_load_n(&dumpPathCur, __ATOMIC_ACQUIRE)];
+}
+
+static void dumpSignalHandler (int sig)
+{
+  int savedErrno = errno;
+
+  (void)sig;
+  dumpTo(currentDumpPath());
+  errno = savedErrno;
+}
+
+// Dumps, then hands the signal to whatever handled it before
+static void crashSignalHandler (int sig)
+{
+  int i;
+
+  dumpTo(currentDumpPath());
+  for (i = 0; i < CRASH_SIGNALS; i++) {
+    if (crashSignals[i] == sig) {
+      sigaction(sig, &crashOld[i], NULL);
+    }
+  }
+  raise(sig);
+}
+
+//======================================================================
+// flightRecInit, reads the environment
+//======================================================================
+void flightRecInit (void)
+{
+  const char *env = getenv(FLIGHTREC_ENV);
+
+  if (!env || !*env) {
+    return;
+  }
+  if (strcmp(env, "0") == 0) {
+    flightRecEnabled = 0;
+  } else {
+    flightRecSetDump(env, 0, 1);
+  }
+}
+
+//======================================================================
+// flightRecDump, to stderr if filename is NULL
+//======================================================================
+canStatus flightRecDump (const char *filename)
+{
+  return dumpTo(filename);
+}
+
+//======================================================================
+// flightRecSetDump
+//======================================================================
+canStatus flightRecSetDump (const char *filename, int sig, int onCrash)
+{
+  struct sigaction sa;
+  int              i;
+  int              next;
+
+  if ((filename && strlen(filename) >= sizeof(dumpPath[0])) ||
+      sig < 0 || sig >= NSIG || sig == SIGKILL || sig == SIGSTOP) {
+    return canERR_PARAM;
+  }
+  for (i = 0; sig && i < CRASH_SIGNALS; i++) {
+    if (crashSignals[i] == sig) {
+      return canERR_PARAM;
+    }
+  }
+
+  pthread_mutex_lock(&dumpMutex);
+
+  // Written aside and then published, a handler may be reading the other
+  next = !dumpPathCur;
+  strcpy(dumpPath[next], filename ? filename : "");
+  __atomic_store_n(&dumpPathCur, next, __ATOMIC_RELEASE);
+
+  memset(&sa, 0, sizeof(sa));
+  sigemptyset(&sa.sa_mask);
+
+  if (dumpSignal && dumpSignal != sig) {
+    sigaction(dumpSignal, &dumpSignalOld, NULL);
+    dumpSignal = 0;
+  }
+  if (sig && sig != dumpSignal) {
+    sa.sa_handler = dumpSignalHandler;
+    sa.sa_flags   = SA_RESTART;
+    sigaction(sig, &sa, &dumpSignalOld);
+    dumpSignal = sig;
+  }
+
+  if (onCrash && !crashInstalled) {
+    sa.sa_handler = crashSignalHandler;
+    sa.sa_flags   = 0;
+    for (i = 0; i < CRASH_SIGNALS; i++) {
+      sigaction(crashSignals[i], &sa, &crashOld[i]);
+    }
+    crashInstalled = 1;
+  } else if (!onCrash && crashInstalled) {
+    for (i = 0; i < CRASH_SIGNALS; i++) {
+      sigaction(crashSignals[i], &crashOld[i], NULL);
+    }
+    crashInstalled = 0;
+  }
+
+  pthread_mutex_unlock(&dumpMutex);
+
+  return canOK;
+}
+
+//======================================================================
+// flightRecUnload, puts back the signal handlers and drops the key, so
+// that nothing is left pointing into the library once it is unloaded.
+// Threads still running keep their rings, but no longer release them.
+//======================================================================
+void flightRecUnload (void)
+{
+  int i;
+
+  pthread_mutex_lock(&dumpMutex);
+  if (dumpSignal) {
+    sigaction(dumpSignal, &dumpSignalOld, NULL);
+    dumpSignal = 0;
+  }
+  if (crashInstalled) {
+    for (i = 0; i < CRASH_SIGNALS; i++) {
+      sigaction(crashSignals[i], &crashOld[i], NULL);
+    }
+    crashInstalled = 0;
+  }
+  pthread_mutex_unlock(&dumpMutex);
+
+  pthread_mutex_lock(&ringKeyMutex);
+  if (ringKeyValid) {
+    pthread_key_delete(ringKey);
+    ringKeyValid = 0;
+  }
+  pthread_mutex_unlock(&ringKeyMutex);
+}
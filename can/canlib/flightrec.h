@@ -0,0 +1,118 @@
+/*
+**             Copyright 2017 by Kvaser AB, Molndal, Sweden
+**                        http://www.kvaser.com
+**
+** This software is dual licensed under the following two licenses:
+** BSD-new and GPLv2. You may use either one. See the included
+** COPYING file for details.
+**
+** License: BSD-new
+** ===============================================================================
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of the <organization> nor the
+**       names of its contributors may be used to endorse or promote products
+**       derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+** DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+** DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+** (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+** LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+** ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**
+**
+** License: GPLv2
+** ===============================================================================
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+** ---------------------------------------------------------------------------
+**/
+
+/*  Kvaser Linux Canlib flight recorder
+ *
+ *  Every thread that calls into the library gets a ring of compact events:
+ *  API calls, failed driver calls, chip state changes and overflows.
+ *  Recording takes no locks; each slot is a seqlock written only by its
+ *  own thread. Rings outlive their threads, so the last events of a thread
+ *  that died are still there when the rings are dumped, and the dump only
+ *  uses async-signal-safe calls so it can run from a signal handler.
+ */
+
+#ifndef FLIGHTREC_H
+#define FLIGHTREC_H
+
+#include <stdint.h>
+
+#include "canlib.h"
+
+// Events per thread, a power of two
+#define FLIGHTREC_EVENTS 1024
+
+enum {
+  FLIGHTREC_API = 1,      // code: API, arg1: calls in a row
+  FLIGHTREC_IOCTL_ERROR,  // arg1: errno, arg2: canStatus
+  FLIGHTREC_STATUS,       // code: bus status, arg1: tx errors, arg2: rx errors
+  FLIGHTREC_TX_OVERFLOW,  // arg1: id
+  FLIGHTREC_RX_OVERRUN,   // arg1: id
+};
+
+// seq is 2 * n + 1 while event number n is written, 2 * n + 2 after
+typedef struct {
+  uint64_t seq;
+  int64_t  timeNs;  // CLOCK_MONOTONIC
+  uint16_t type;
+  uint16_t code;
+  int32_t  handle;  // -1 when not known
+  uint32_t arg1;
+  uint32_t arg2;
+  int32_t  tid;
+  int32_t  reserved;
+} FlightRecEvent;
+
+extern int flightRecEnabled;
+
+void flightRecInit (void);
+void flightRecAdd (int type, int code, int handle, uint32_t arg1, uint32_t arg2);
+void flightRecApiCall (int api);
+canStatus flightRecDump (const char *filename);
+canStatus flightRecSetDump (const char *filename, int dumpSignal, int onCrash);
+void flightRecUnload (void);
+
+static inline void flightRecEvent (int type, int code, int handle,
+                                   uint32_t arg1, uint32_t arg2)
+{
+  if (__builtin_expect(flightRecEnabled, 1)) {
+    flightRecAdd(type, code, handle, arg1, arg2);
+  }
+}
+
+static inline void flightRecApi (int api)
+{
+  if (__builtin_expect(flightRecEnabled, 1)) {
+    flightRecApiCall(api);
+  }
+}
+
+#endif  /* FLIGHTREC_H */
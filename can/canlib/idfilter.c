@@ -0,0 +1,202 @@
+/*
+**             Copyright 2017 by Kvaser AB, Molndal, Sweden
+**                        http://www.kvaser.com
+**
+** This software is dual licensed under the following two licenses:
+** BSD-new and GPLv2. You may use either one. See the included
+** COPYING file for details.
+**
+** License: BSD-new
+** ===============================================================================
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of the <organization> nor the
+**       names of its contributors may be used to endorse or promote products
+**       derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+** DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+** DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+** (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+** LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+** ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**
+**
+** License: GPLv2
+** ===============================================================================
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+** ---------------------------------------------------------------------------
+**/
+
+/*  Kvaser Linux Canlib identifier filtering */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "idfilter.h"
+
+
+#define STD_BITS  11
+#define EXT_BITS  29
+
+static int cmpId (const void *a, const void *b)
+{
+  unsigned int x = *(const unsigned int *)a;
+  unsigned int y = *(const unsigned int *)b;
+
+  return (x > y) - (x < y);
+}
+
+// Sorts and removes duplicates, returns the new count
+static unsigned int sortUnique (unsigned int *ids, unsigned int count)
+{
+  unsigned int i, n = 0;
+
+  qsort(ids, count, sizeof(*ids), cmpId);
+  for (i = 0; i < count; i++) {
+    if (n == 0 || ids[i] != ids[n - 1]) {
+      ids[n++] = ids[i];
+    }
+  }
+
+  return n;
+}
+
+
+//======================================================================
+// idFilterCompile
+//======================================================================
+canStatus idFilterCompile (const unsigned int *ids, unsigned int count,
+                           int is_extended, kvFilterSet *filter)
+{
+  int          bits = is_extended ? EXT_BITS : STD_BITS;
+  uint32_t     all = (1U << bits) - 1;
+  uint32_t     mask = all;
+  unsigned int *sorted;
+  unsigned int i, n;
+  uint64_t     accepted;
+
+  if (ids == NULL || count == 0 || filter == NULL) {
+    return canERR_PARAM;
+  }
+  for (i = 0; i < count; i++) {
+    if (ids[i] > all) {
+      return canERR_PARAM;
+    }
+    // The smallest code/mask containing all ids fixes the bits they share
+    mask &= ~(ids[i] ^ ids[0]);
+  }
+
+  sorted = malloc(count * sizeof(*sorted));
+  if (sorted == NULL) {
+    return canERR_NOMEM;
+  }
+  memcpy(sorted, ids, count * sizeof(*sorted));
+  n = sortUnique(sorted, count);
+  free(sorted);
+
+  accepted = 1ULL << (bits - __builtin_popcount(mask));
+
+  memset(filter, 0, sizeof(*filter));
+  filter->is_extended    = is_extended;
+  filter->code           = ids[0] & mask;
+  filter->mask           = mask;
+  filter->nIds           = n;
+  filter->falsePositives = (unsigned int)(accepted - n);
+  filter->passRatio      = (double)accepted / (double)(1ULL << bits);
+
+  return canOK;
+}
+
+
+//======================================================================
+// idFilterSet
+//======================================================================
+canStatus idFilterSet (IdFilter *f, const unsigned int *ids,
+                       unsigned int count, int is_extended)
+{
+  unsigned int i;
+
+  if (is_extended) {
+    unsigned int *extIds = NULL;
+    unsigned int n = 0;
+
+    if (count) {
+      extIds = malloc(count * sizeof(*extIds));
+      if (extIds == NULL) {
+        return canERR_NOMEM;
+      }
+      for (i = 0; i < count; i++) {
+        if (ids[i] >= (1U << EXT_BITS)) {
+          free(extIds);
+          return canERR_PARAM;
+        }
+        extIds[i] = ids[i];
+      }
+      n = sortUnique(extIds, count);
+    }
+    free(f->extIds);
+    f->extIds   = extIds;
+    f->extCount = n;
+  } else {
+    uint8_t *bitmap = NULL;
+
+    if (count) {
+      bitmap = calloc(1 << (STD_BITS - 3), 1);
+      if (bitmap == NULL) {
+        return canERR_NOMEM;
+      }
+      for (i = 0; i < count; i++) {
+        if (ids[i] >= (1U << STD_BITS)) {
+          free(bitmap);
+          return canERR_PARAM;
+        }
+        bitmap[ids[i] >> 3] |= 1 << (ids[i] & 7);
+      }
+    }
+    free(f->stdBitmap);
+    f->stdBitmap = bitmap;
+  }
+
+  return canOK;
+}
+
+//======================================================================
+// idFilterFree
+//======================================================================
+void idFilterFree (IdFilter *f)
+{
+  free(f->stdBitmap);
+  free(f->extIds);
+  memset(f, 0, sizeof(*f));
+}
+
+//======================================================================
+// idFilterFindExt
+//======================================================================
+int idFilterFindExt (const IdFilter *f, unsigned int id)
+{
+  return bsearch(&id, f->extIds, f->extCount, sizeof(id), cmpId) != NULL;
+}
@@ -0,0 +1,354 @@
+/*
+**             Copyright 2017 by Kvaser AB, Molndal, Sweden
+**                        http://www.kvaser.com
+**
+** This software is dual licensed under the following two licenses:
+** BSD-new and GPLv2. You may use either one. See the included
+** COPYING file for details.
+**
+** License: BSD-new
+** ===============================================================================
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of the <organization> nor the
+**       names of its contributors may be used to endorse or promote products
+**       derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+** DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+** DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+** (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+** LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+** ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**
+**
+** License: GPLv2
+** ===============================================================================
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+** ---------------------------------------------------------------------------
+**/
+
+/*  Kvaser Linux Canlib per-id traffic statistics */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "idstats.h"
+
+
+#define EXT_INITIAL_CAPACITY  256
+
+static uint32_t hashId (uint32_t id)
+{
+  id ^= id >> 16;
+  id *= 0x45d9f3b;
+  id ^= id >> 16;
+
+  return id;
+}
+
+static uint64_t hashPayload (const uint8_t *data, unsigned int len)
+{
+  uint64_t h = 0xcbf29ce484222325ULL ^ len;
+  uint64_t w;
+  unsigned int i;
+
+  for (i = 0; i + 8 <= len; i += 8) {
+    memcpy(&w, &data[i], 8);
+    h = (h ^ w) * 0x100000001b3ULL;
+    h ^= h >> 29;
+  }
+  if (i < len) {
+    w = 0;
+    memcpy(&w, &data[i], len - i);
+    h = (h ^ w) * 0x100000001b3ULL;
+    h ^= h >> 29;
+  }
+
+  return h;
+}
+
+//======================================================================
+// Find or add an extended id, returns NULL if the table is full
+//======================================================================
+static IdStatsEntry *findExt (IdStats *s, uint32_t id, int add)
+{
+  unsigned int i, mask;
+
+  if (s->ext == NULL) {
+    return NULL;
+  }
+
+  mask = s->extCapacity - 1;
+  for (i = hashId(id) & mask; s->ext[i].used; i = (i + 1) & mask) {
+    if (s->ext[i].id == id) {
+      return &s->ext[i];
+    }
+  }
+  if (!add) {
+    return NULL;
+  }
+
+  s->ext[i].used = 1;
+  s->ext[i].id   = id;
+  s->extUsed++;
+
+  return &s->ext[i];
+}
+
+// Double the extended table, keeping it at most 3/4 full
+static int growExt (IdStats *s)
+{
+  IdStatsEntry *old = s->ext;
+  unsigned int oldCapacity = s->extCapacity;
+  unsigned int capacity = oldCapacity ? 2 * oldCapacity : EXT_INITIAL_CAPACITY;
+  unsigned int i;
+
+  s->ext = calloc(capacity, sizeof(IdStatsEntry));
+  if (s->ext == NULL) {
+    s->ext = old;
+    return -1;
+  }
+  s->extCapacity = capacity;
+  s->extUsed     = 0;
+
+  for (i = 0; i < oldCapacity; i++) {
+    if (old[i].used) {
+      *findExt(s, old[i].id, 1) = old[i];
+    }
+  }
+  free(old);
+
+  return 0;
+}
+
+//======================================================================
+// idStatsCreate
+//======================================================================
+IdStats *idStatsCreate (void)
+{
+  IdStats *s = calloc(1, sizeof(IdStats));
+
+  if (s == NULL) {
+    return NULL;
+  }
+  pthread_mutex_init(&s->lock, NULL);
+
+  return s;
+}
+
+//======================================================================
+// idStatsDestroy
+//======================================================================
+void idStatsDestroy (IdStats *s)
+{
+  if (s == NULL) {
+    return;
+  }
+  pthread_mutex_destroy(&s->lock);
+  free(s->ext);
+  free(s);
+}
+
+//======================================================================
+// idStatsEnable, clears the statistics both ways
+//======================================================================
+void idStatsEnable (IdStats *s, int enable)
+{
+  pthread_mutex_lock(&s->lock);
+  memset(s->std, 0, sizeof(s->std));
+  free(s->ext);
+  s->ext         = NULL;
+  s->extCapacity = 0;
+  s->extUsed     = 0;
+  s->dropped     = 0;
+  __atomic_store_n(&s->enabled, enable, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&s->lock);
+}
+
+//======================================================================
+// idStatsUpdate, called for each received frame
+//======================================================================
+void idStatsUpdate (IdStats *s, uint32_t id, int ext, uint64_t timeUs,
+                    unsigned int dlc, const uint8_t *data, unsigned int len)
+{
+  IdStatsEntry *e;
+  uint64_t     hash;
+
+  pthread_mutex_lock(&s->lock);
+  if (!s->enabled) {
+    pthread_mutex_unlock(&s->lock);
+    return;
+  }
+
+  if (!ext) {
+    e = &s->std[id & (IDSTATS_STD_IDS - 1)];
+    e->id = id;
+  } else {
+    if (4 * (s->extUsed + 1) > 3 * s->extCapacity && growExt(s) != 0 &&
+        s->extUsed + 1 >= s->extCapacity) {
+      s->dropped++;
+      pthread_mutex_unlock(&s->lock);
+      return;
+    }
+    e = findExt(s, id, 1);
+  }
+
+  hash = hashPayload(data, len);
+  if (e->count) {
+    if (timeUs >= e->lastUs) {
+      uint64_t period = timeUs - e->lastUs;
+      uint64_t n = ++e->periods;
+      double   d = period - e->meanPeriodUs;
+
+      e->meanPeriodUs += d / n;
+      e->m2PeriodUs   += d * (period - e->meanPeriodUs);
+      if (n == 1 || period < e->minPeriodUs) {
+        e->minPeriodUs = period;
+      }
+      if (period > e->maxPeriodUs) {
+        e->maxPeriodUs = period;
+      }
+    }
+    if (hash != e->payloadHash) {
+      e->payloadChanges++;
+    }
+  }
+  e->used        = 1;
+  e->payloadHash = hash;
+  e->lastUs      = timeUs;
+  e->dlcCount[dlc & 15]++;
+  e->count++;
+
+  pthread_mutex_unlock(&s->lock);
+}
+
+static void fillStats (const IdStatsEntry *e, int ext, kvIdStats *stats)
+{
+  uint64_t periods = e->periods;
+
+  memset(stats, 0, sizeof(*stats));
+  stats->id             = e->id;
+  stats->flags          = ext ? canMSG_EXT : canMSG_STD;
+  stats->count          = e->count;
+  stats->lastSeenUs     = e->lastUs;
+  stats->payloadChanges = e->payloadChanges;
+  if (periods) {
+    stats->meanPeriodUs   = e->meanPeriodUs;
+    stats->minPeriodUs    = (double)e->minPeriodUs;
+    stats->maxPeriodUs    = (double)e->maxPeriodUs;
+    stats->stddevPeriodUs = (periods > 1) ? sqrt(e->m2PeriodUs / (periods - 1)) : 0;
+  }
+  if (e->count > 1) {
+    stats->payloadChangeRate = (double)e->payloadChanges / (e->count - 1);
+  }
+  memcpy(stats->dlcCount, e->dlcCount, sizeof(stats->dlcCount));
+}
+
+static int cmpStats (const void *a, const void *b)
+{
+  const kvIdStats *x = (const kvIdStats *)a;
+  const kvIdStats *y = (const kvIdStats *)b;
+
+  if (x->flags != y->flags) {
+    return (x->flags & canMSG_EXT) ? 1 : -1;
+  }
+  return (x->id > y->id) - (x->id < y->id);
+}
+
+//======================================================================
+// idStatsGet, a snapshot of all ids, standard ids first
+//======================================================================
+canStatus idStatsGet (IdStats *s, kvIdStats *stats, unsigned int *count,
+                      unsigned int *total)
+{
+  unsigned int i, n = 0, all = 0;
+  unsigned int nStd;
+
+  if (count == NULL || (stats == NULL && *count)) {
+    return canERR_PARAM;
+  }
+
+  pthread_mutex_lock(&s->lock);
+  if (!s->enabled) {
+    pthread_mutex_unlock(&s->lock);
+    return canERR_PARAM;
+  }
+  for (i = 0; i < IDSTATS_STD_IDS; i++) {
+    if (s->std[i].used) {
+      if (n < *count) {
+        fillStats(&s->std[i], 0, &stats[n++]);
+      }
+      all++;
+    }
+  }
+  nStd = n;
+  for (i = 0; i < s->extCapacity; i++) {
+    if (s->ext[i].used) {
+      if (n < *count) {
+        fillStats(&s->ext[i], 1, &stats[n++]);
+      }
+      all++;
+    }
+  }
+  pthread_mutex_unlock(&s->lock);
+
+  // The hash table is unordered
+  qsort(&stats[nStd], n - nStd, sizeof(*stats), cmpStats);
+
+  *count = n;
+  if (total) {
+    *total = all;
+  }
+
+  return canOK;
+}
+
+//======================================================================
+// idStatsGetId
+//======================================================================
+canStatus idStatsGetId (IdStats *s, uint32_t id, int ext, kvIdStats *stats)
+{
+  IdStatsEntry *e;
+  canStatus    stat = canOK;
+
+  if (stats == NULL || (!ext && id >= IDSTATS_STD_IDS)) {
+    return canERR_PARAM;
+  }
+
+  pthread_mutex_lock(&s->lock);
+  e = ext ? findExt(s, id, 0) : &s->std[id];
+  if (!s->enabled) {
+    stat = canERR_PARAM;
+  } else if (e == NULL || !e->used) {
+    stat = canERR_NOTFOUND;
+  } else {
+    fillStats(e, ext, stats);
+  }
+  pthread_mutex_unlock(&s->lock);
+
+  return stat;
+}
@@ -0,0 +1,107 @@
+/*
+**             Copyright 2017 by Kvaser AB, Molndal, Sweden
+**                        http://www.kvaser.com
+**
+** This software is dual licensed under the following two licenses:
+** BSD-new and GPLv2. You may use either one. See the included
+** COPYING file for details.
+**
+** License: BSD-new
+** ===============================================================================
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of the <organization> nor the
+**       names of its contributors may be used to endorse or promote products
+**       derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+** DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+** DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+** (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+** LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+** ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**
+**
+** License: GPLv2
+** ===============================================================================
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+** ---------------------------------------------------------------------------
+**/
+
+/*  Kvaser Linux Canlib per-id traffic statistics
+ *
+ *  Standard ids are kept in a flat table indexed by id, extended ids in an
+ *  open-addressing hash table. Period statistics are updated incrementally
+ *  with Welford's method, so each frame costs a table lookup and a few
+ *  arithmetic operations.
+ */
+
+#ifndef IDSTATS_H
+#define IDSTATS_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "canlib.h"
+
+#define IDSTATS_STD_IDS  2048
+
+typedef struct {
+  uint32_t id;
+  uint32_t used;
+  uint64_t count;
+  uint64_t periods;           // Periods in the mean, time going back is not
+  uint64_t lastUs;
+  uint64_t payloadHash;
+  uint64_t payloadChanges;
+  uint64_t minPeriodUs;
+  uint64_t maxPeriodUs;
+  double   meanPeriodUs;
+  double   m2PeriodUs;        // Sum of squared deviations from the mean
+  uint32_t dlcCount[16];
+} IdStatsEntry;
+
+// Created by the first kvIdStatsEnable and kept until the handle is closed,
+// so the read path never sees it freed
+typedef struct IdStats {
+  pthread_mutex_t lock;
+  int             enabled;    // Frames are counted while non-zero
+  IdStatsEntry    std[IDSTATS_STD_IDS];
+  IdStatsEntry    *ext;       // Hash table, capacity is a power of two
+  unsigned int    extCapacity;
+  unsigned int    extUsed;
+  uint64_t        dropped;    // Frames not counted for lack of memory
+} IdStats;
+
+IdStats *idStatsCreate (void);
+void idStatsDestroy (IdStats *s);
+void idStatsEnable (IdStats *s, int enable);
+void idStatsUpdate (IdStats *s, uint32_t id, int ext, uint64_t timeUs,
+                    unsigned int dlc, const uint8_t *data, unsigned int len);
+canStatus idStatsGet (IdStats *s, kvIdStats *stats, unsigned int *count,
+                      unsigned int *total);
+canStatus idStatsGetId (IdStats *s, uint32_t id, int ext, kvIdStats *stats);
+
+#endif  /* IDSTATS_H */
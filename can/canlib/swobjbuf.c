@@ -0,0 +1,661 @@
+/*
+**             Copyright 2017 by Kvaser AB, Molndal, Sweden
+**                        http://www.kvaser.com
+**
+** This software is dual licensed under the following two licenses:
+** BSD-new and GPLv2. You may use either one. See the included
+** COPYING file for details.
+**
+** License: BSD-new
+** ===============================================================================
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of the <organization> nor the
+**       names of its contributors may be used to endorse or promote products
+**       derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+** DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+** DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+** (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+** LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+** ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**
+**
+** License: GPLv2
+** ===============================================================================
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+** ---------------------------------------------------------------------------
+**/
+
+/*  Kvaser Linux Canlib software object buffers */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+
+#include "swobjbuf.h"
+#include "canlib_data.h"
+#include "VCanFuncUtil.h"
+
+
+// Max number of buffers answering a single frame
+#define MAX_RESPONSES 8
+
+// A frame taken out of a buffer, sent with the lock released
+typedef struct {
+  int           idx;
+  long          id;
+  unsigned int  dlc;
+  unsigned int  flags;
+  unsigned char data[64];
+  int64_t       dueNs;      // Scheduled time of a periodic transmit, else 0
+} SwObjBufFrame;
+
+
+static int64_t nowNs (void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Looks up and locks a buffer of the given type, or any type if 0
+static SwObjBuf *lockBuf (HandleData *hData, int idx, int type)
+{
+  SwObjBufs *sw = hData->swObjBufs;
+  SwObjBuf  *b;
+
+  idx -= SWOBJBUF_FIRST;
+  if (sw == NULL || idx < 0 || idx >= SWOBJBUF_MAX) {
+    return NULL;
+  }
+  pthread_mutex_lock(&sw->lock);
+  b = &sw->buf[idx];
+  if (!b->type || (type && b->type != type)) {
+    pthread_mutex_unlock(&sw->lock);
+    return NULL;
+  }
+
+  return b;
+}
+
+static void takeFrame (SwObjBufs *sw, SwObjBuf *b, SwObjBufFrame *frame,
+                       int64_t dueNs)
+{
+  frame->idx   = (int)(b - sw->buf);
+  frame->id    = b->id;
+  frame->dlc   = b->dlc;
+  frame->flags = b->flags;
+  frame->dueNs = dueNs;
+  memcpy(frame->data, b->data, sizeof(frame->data));
+}
+
+static int sendFrame (SwObjBufs *sw, SwObjBufFrame *frame)
+{
+  HandleData *hData = sw->hData;
+
+  return hData->canOps->write(hData, frame->id, frame->data, frame->dlc,
+                              frame->flags) == canOK;
+}
+
+//======================================================================
+// Auto-response lookup. Buffers whose mask covers the 11 low id bits are
+// chained by those bits, the rest are checked one by one.
+//======================================================================
+static unsigned int hashOf (unsigned int id)
+{
+  id &= 0x7ff;
+  return (id ^ (id >> 6)) & (SWOBJBUF_HASH - 1);
+}
+
+static void rebuildResponders (SwObjBufs *sw)
+{
+  SwObjBuf *b;
+  int      i, n = 0;
+  short    *chain;
+
+  for (i = 0; i < SWOBJBUF_HASH; i++) {
+    sw->hash[i] = -1;
+  }
+  sw->wildcard = -1;
+
+  // Backwards, so that each chain is in index order
+  for (i = SWOBJBUF_MAX - 1; i >= 0; i--) {
+    b = &sw->buf[i];
+    if (b->type != canOBJBUF_TYPE_AUTO_RESPONSE || !b->enabled) {
+      continue;
+    }
+    if ((b->mask & 0x7ff) == 0x7ff) {
+      chain = &sw->hash[hashOf(b->code)];
+    } else {
+      chain = &sw->wildcard;
+    }
+    b->hashNext = *chain;
+    *chain      = (short)i;
+    n++;
+  }
+  __atomic_store_n(&sw->nResponders, n, __ATOMIC_RELAXED);
+}
+
+static int responds (SwObjBuf *b, long id, unsigned int flags)
+{
+  if ((b->objFlags & canOBJBUF_AUTO_RESPONSE_RTR_ONLY) && !(flags & canMSG_RTR)) {
+    return 0;
+  }
+
+  return ((unsigned int)id & b->mask) == (b->code & b->mask);
+}
+
+//======================================================================
+// swObjBufReceived, answers a frame read on the handle
+//======================================================================
+void swObjBufReceived (SwObjBufs *sw, long id, unsigned int flags)
+{
+  SwObjBufFrame frame[MAX_RESPONSES];
+  int           ok[MAX_RESPONSES];
+  int64_t       doneNs[MAX_RESPONSES];
+  int64_t       startNs = nowNs();
+  SwObjBuf      *b;
+  int           i, n = 0;
+  short         chain[2];
+  int           c;
+
+  pthread_mutex_lock(&sw->lock);
+  chain[0] = sw->hash[hashOf((unsigned int)id)];
+  chain[1] = sw->wildcard;
+  for (c = 0; c < 2; c++) {
+    for (i = chain[c]; i >= 0 && n < MAX_RESPONSES; i = b->hashNext) {
+      b = &sw->buf[i];
+      if (responds(b, id, flags)) {
+        takeFrame(sw, b, &frame[n++], 0);
+      }
+    }
+  }
+  pthread_mutex_unlock(&sw->lock);
+
+  for (i = 0; i < n; i++) {
+    ok[i]     = sendFrame(sw, &frame[i]);
+    doneNs[i] = nowNs();
+  }
+
+  if (n == 0) {
+    return;
+  }
+
+  pthread_mutex_lock(&sw->lock);
+  for (i = 0; i < n; i++) {
+    b = &sw->buf[frame[i].idx];
+    if (b->type != canOBJBUF_TYPE_AUTO_RESPONSE) {
+      continue;
+    }
+    if (ok[i]) {
+      double us = (doneNs[i] - startNs) / 1e3;
+
+      b->stats.sent++;
+      b->stats.responses++;
+      b->responseSumUs += us;
+      if (us > b->stats.maxResponseUs) {
+        b->stats.maxResponseUs = us;
+      }
+    } else {
+      b->stats.txErrors++;
+    }
+  }
+  pthread_mutex_unlock(&sw->lock);
+}
+
+//======================================================================
+// Timer thread, sends periodic frames and bursts
+//======================================================================
+static void *swObjBufThread (void *arg)
+{
+  SwObjBufs       *sw = (SwObjBufs *)arg;
+  SwObjBufFrame   frame[SWOBJBUF_MAX];
+  int             ok[SWOBJBUF_MAX];
+  int64_t         sentNs[SWOBJBUF_MAX];
+  int64_t         now, next;
+  struct timespec deadline;
+  SwObjBuf        *b;
+  int             i, n;
+
+  pthread_mutex_lock(&sw->lock);
+  while (!sw->stop) {
+    now  = nowNs();
+    next = INT64_MAX;
+    n    = 0;
+
+    for (i = 0; i < SWOBJBUF_MAX; i++) {
+      b = &sw->buf[i];
+      if (b->type != canOBJBUF_TYPE_PERIODIC_TX) {
+        continue;
+      }
+      if (b->burstLeft) {
+        takeFrame(sw, b, &frame[n++], 0);
+        b->burstLeft--;
+        next = now;
+        continue;
+      }
+      if (!b->enabled || !b->periodUs) {
+        continue;
+      }
+      if (now >= b->nextNs) {
+        takeFrame(sw, b, &frame[n++], b->nextNs);
+        b->nextNs += (int64_t)b->periodUs * 1000;
+        // Skip periods that were missed rather than catching up in a burst
+        if (b->nextNs <= now) {
+          b->nextNs = now + (int64_t)b->periodUs * 1000;
+        }
+        if (b->msgCount && ++b->nPeriodic >= b->msgCount) {
+          b->enabled = 0;
+          continue;
+        }
+      }
+      if (b->nextNs < next) {
+        next = b->nextNs;
+      }
+    }
+
+    if (n) {
+      pthread_mutex_unlock(&sw->lock);
+      for (i = 0; i < n; i++) {
+        sentNs[i] = nowNs();
+        ok[i]     = sendFrame(sw, &frame[i]);
+      }
+      pthread_mutex_lock(&sw->lock);
+
+      for (i = 0; i < n; i++) {
+        b = &sw->buf[frame[i].idx];
+        if (b->type != canOBJBUF_TYPE_PERIODIC_TX) {
+          continue;
+        }
+        if (!ok[i]) {
+          b->stats.txErrors++;
+          continue;
+        }
+        b->stats.sent++;
+        if (frame[i].dueNs) {
+          double us = (sentNs[i] - frame[i].dueNs) / 1e3;
+
+          b->nJitter++;
+          b->jitterSumUs += us;
+          if (us > b->stats.maxJitterUs) {
+            b->stats.maxJitterUs = us;
+          }
+        }
+      }
+      continue;
+    }
+
+    if (next == INT64_MAX) {
+      pthread_cond_wait(&sw->cond, &sw->lock);
+    } else {
+      deadline.tv_sec  = next / 1000000000LL;
+      deadline.tv_nsec = next % 1000000000LL;
+      pthread_cond_timedwait(&sw->cond, &sw->lock, &deadline);
+    }
+  }
+  pthread_mutex_unlock(&sw->lock);
+
+  return NULL;
+}
+
+// Called with the lock held
+static canStatus wakeTimer (SwObjBufs *sw)
+{
+  if (!sw->running) {
+    sw->stop = 0;
+    if (vCanCreateThread(&sw->thread, swObjBufThread, sw) != 0) {
+      return canERR_NOMEM;
+    }
+    sw->running = 1;
+  }
+  pthread_cond_signal(&sw->cond);
+
+  return canOK;
+}
+
+//======================================================================
+// swObjBufNoHardware, tells if a failed allocation means that the device
+// has no object buffers
+//======================================================================
+int swObjBufNoHardware (int error)
+{
+  return error == ENOSYS || error == ENOTTY || error == EOPNOTSUPP;
+}
+
+//======================================================================
+// swObjBufAllocate
+//======================================================================
+canStatus swObjBufAllocate (HandleData *hData, int type, int *number)
+{
+  SwObjBufs          *sw = __atomic_load_n(&hData->swObjBufs, __ATOMIC_ACQUIRE);
+  SwObjBufs          *none = NULL;
+  pthread_condattr_t attr;
+  int                i;
+
+  if (type != canOBJBUF_TYPE_AUTO_RESPONSE && type != canOBJBUF_TYPE_PERIODIC_TX) {
+    return canERR_PARAM;
+  }
+
+  if (sw == NULL) {
+    sw = calloc(1, sizeof(SwObjBufs));
+    if (sw == NULL) {
+      return canERR_NOMEM;
+    }
+    sw->hData = hData;
+    pthread_mutex_init(&sw->lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&sw->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    rebuildResponders(sw);
+    // The read path checks the pointer without a lock, and another thread
+    // may have got there first
+    if (!__atomic_compare_exchange_n(&hData->swObjBufs, &none, sw, 0,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      pthread_cond_destroy(&sw->cond);
+      pthread_mutex_destroy(&sw->lock);
+      free(sw);
+      sw = none;
+    }
+  }
+
+  pthread_mutex_lock(&sw->lock);
+  for (i = 0; i < SWOBJBUF_MAX; i++) {
+    if (!sw->buf[i].type) {
+      break;
+    }
+  }
+  if (i == SWOBJBUF_MAX) {
+    pthread_mutex_unlock(&sw->lock);
+    return canERR_NOMEM;
+  }
+  memset(&sw->buf[i], 0, sizeof(SwObjBuf));
+  sw->buf[i].type  = type;
+  sw->buf[i].flags = canMSG_STD;
+  pthread_mutex_unlock(&sw->lock);
+
+  *number = SWOBJBUF_FIRST + i;
+
+  return canOK;
+}
+
+//======================================================================
+// swObjBufFree
+//======================================================================
+canStatus swObjBufFree (HandleData *hData, int idx)
+{
+  SwObjBuf *b = lockBuf(hData, idx, 0);
+
+  if (b == NULL) {
+    return canERR_PARAM;
+  }
+  b->type = 0;
+  rebuildResponders(hData->swObjBufs);
+  pthread_mutex_unlock(&hData->swObjBufs->lock);
+
+  return canOK;
+}
+
+//======================================================================
+// swObjBufFreeAll
+//======================================================================
+canStatus swObjBufFreeAll (HandleData *hData)
+{
+  SwObjBufs *sw = hData->swObjBufs;
+  int       i;
+
+  if (sw == NULL) {
+    return canOK;
+  }
+  pthread_mutex_lock(&sw->lock);
+  for (i = 0; i < SWOBJBUF_MAX; i++) {
+    sw->buf[i].type = 0;
+  }
+  rebuildResponders(sw);
+  pthread_mutex_unlock(&sw->lock);
+
+  return canOK;
+}
+
+//======================================================================
+// swObjBufWrite, stores the frame as given; the caller checks the dlc and
+// flags against the channel with vCanObjbufCheck()
+//======================================================================
+canStatus swObjBufWrite (HandleData *hData, int idx, int id, void *msg,
+                         unsigned int dlc, unsigned int flags)
+{
+  SwObjBuf     *b = lockBuf(hData, idx, 0);
+  unsigned int nbytes;
+
+  if (b == NULL) {
+    return canERR_PARAM;
+  }
+
+  if (flags & canFDMSG_FDF) {
+    nbytes = dlc > 64 ? 64 : dlc;
+  } else {
+    nbytes = dlc > 8 ? 8 : dlc;
+  }
+
+  b->id    = id;
+  b->dlc   = dlc;
+  b->flags = flags & (canMSG_STD | canMSG_EXT | canMSG_RTR | canMSG_SINGLE_SHOT |
+                      canFDMSG_FDF | canFDMSG_BRS);
+  memset(b->data, 0, sizeof(b->data));
+  if (msg) {
+    memcpy(b->data, msg, nbytes);
+  }
+  pthread_mutex_unlock(&hData->swObjBufs->lock);
+
+  return canOK;
+}
+
+//======================================================================
+// swObjBufSetFilter
+//======================================================================
+canStatus swObjBufSetFilter (HandleData *hData, int idx,
+                             unsigned int code, unsigned int mask)
+{
+  SwObjBuf *b = lockBuf(hData, idx, canOBJBUF_TYPE_AUTO_RESPONSE);
+
+  if (b == NULL) {
+    return canERR_PARAM;
+  }
+  b->code = code;
+  b->mask = mask;
+  rebuildResponders(hData->swObjBufs);
+  pthread_mutex_unlock(&hData->swObjBufs->lock);
+
+  return canOK;
+}
+
+//======================================================================
+// swObjBufSetFlags
+//======================================================================
+canStatus swObjBufSetFlags (HandleData *hData, int idx, unsigned int flags)
+{
+  SwObjBuf *b = lockBuf(hData, idx, 0);
+
+  if (b == NULL) {
+    return canERR_PARAM;
+  }
+  b->objFlags = flags;
+  pthread_mutex_unlock(&hData->swObjBufs->lock);
+
+  return canOK;
+}
+
+//======================================================================
+// swObjBufSetPeriod, in us
+//======================================================================
+canStatus swObjBufSetPeriod (HandleData *hData, int idx, unsigned int period)
+{
+  SwObjBuf  *b = lockBuf(hData, idx, canOBJBUF_TYPE_PERIODIC_TX);
+  canStatus stat = canOK;
+
+  if (b == NULL) {
+    return canERR_PARAM;
+  }
+  b->periodUs = period;
+  b->nextNs   = nowNs() + (int64_t)period * 1000;
+  if (b->enabled) {
+    stat = wakeTimer(hData->swObjBufs);
+  }
+  pthread_mutex_unlock(&hData->swObjBufs->lock);
+
+  return stat;
+}
+
+//======================================================================
+// swObjBufSetMsgCount
+//======================================================================
+canStatus swObjBufSetMsgCount (HandleData *hData, int idx, unsigned int count)
+{
+  SwObjBuf *b = lockBuf(hData, idx, canOBJBUF_TYPE_PERIODIC_TX);
+
+  if (b == NULL) {
+    return canERR_PARAM;
+  }
+  b->msgCount  = count;
+  b->nPeriodic = 0;
+  pthread_mutex_unlock(&hData->swObjBufs->lock);
+
+  return canOK;
+}
+
+//======================================================================
+// swObjBufSendBurst
+//======================================================================
+canStatus swObjBufSendBurst (HandleData *hData, int idx, unsigned int burstLen)
+{
+  SwObjBuf  *b = lockBuf(hData, idx, canOBJBUF_TYPE_PERIODIC_TX);
+  canStatus stat;
+
+  if (b == NULL) {
+    return canERR_PARAM;
+  }
+  b->burstLeft = burstLen;
+  stat = wakeTimer(hData->swObjBufs);
+  pthread_mutex_unlock(&hData->swObjBufs->lock);
+
+  return stat;
+}
+
+//======================================================================
+// swObjBufEnable, a periodic buffer sends its first frame right away
+//======================================================================
+canStatus swObjBufEnable (HandleData *hData, int idx)
+{
+  SwObjBuf  *b = lockBuf(hData, idx, 0);
+  canStatus stat = canOK;
+
+  if (b == NULL) {
+    return canERR_PARAM;
+  }
+  b->enabled = 1;
+  if (b->type == canOBJBUF_TYPE_PERIODIC_TX) {
+    b->nextNs    = nowNs();
+    b->nPeriodic = 0;
+    stat = wakeTimer(hData->swObjBufs);
+  } else {
+    rebuildResponders(hData->swObjBufs);
+  }
+  pthread_mutex_unlock(&hData->swObjBufs->lock);
+
+  return stat;
+}
+
+//======================================================================
+// swObjBufDisable
+//======================================================================
+canStatus swObjBufDisable (HandleData *hData, int idx)
+{
+  SwObjBuf *b = lockBuf(hData, idx, 0);
+
+  if (b == NULL) {
+    return canERR_PARAM;
+  }
+  b->enabled = 0;
+  rebuildResponders(hData->swObjBufs);
+  pthread_mutex_unlock(&hData->swObjBufs->lock);
+
+  return canOK;
+}
+
+//======================================================================
+// swObjBufGetStats
+//======================================================================
+canStatus swObjBufGetStats (HandleData *hData, int idx, kvObjBufStats *stats)
+{
+  SwObjBuf *b;
+
+  if (stats == NULL) {
+    return canERR_PARAM;
+  }
+  if (idx >= 0 && idx < SWOBJBUF_FIRST) {
+    // Device buffers are timed by the device
+    return canERR_NOT_SUPPORTED;
+  }
+  b = lockBuf(hData, idx, 0);
+  if (b == NULL) {
+    return canERR_PARAM;
+  }
+  *stats = b->stats;
+  stats->avgJitterUs   = b->nJitter ? b->jitterSumUs / b->nJitter : 0;
+  stats->avgResponseUs = b->stats.responses ?
+                         b->responseSumUs / b->stats.responses : 0;
+  pthread_mutex_unlock(&hData->swObjBufs->lock);
+
+  return canOK;
+}
+
+//======================================================================
+// swObjBufDestroy, stops the timer and frees the buffers
+//======================================================================
+void swObjBufDestroy (HandleData *hData)
+{
+  SwObjBufs *sw = hData->swObjBufs;
+
+  if (sw == NULL) {
+    return;
+  }
+
+  if (sw->running) {
+    pthread_mutex_lock(&sw->lock);
+    sw->stop = 1;
+    pthread_cond_signal(&sw->cond);
+    pthread_mutex_unlock(&sw->lock);
+    pthread_join(sw->thread, NULL);
+  }
+
+  hData->swObjBufs = NULL;
+  pthread_cond_destroy(&sw->cond);
+  pthread_mutex_destroy(&sw->lock);
+  free(sw);
+}
@@ -0,0 +1,129 @@
+/*
+**             Copyright 2017 by Kvaser AB, Molndal, Sweden
+**                        http://www.kvaser.com
+**
+** This software is dual licensed under the following two licenses:
+** BSD-new and GPLv2. You may use either one. See the included
+** COPYING file for details.
+**
+** License: BSD-new
+** ===============================================================================
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of the <organization> nor the
+**       names of its contributors may be used to endorse or promote products
+**       derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+** DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+** DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+** (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+** LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+** ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**
+**
+** License: GPLv2
+** ===============================================================================
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+** ---------------------------------------------------------------------------
+**/
+
+/*  Kvaser Linux Canlib software object buffers
+ *
+ *  Used instead of the object buffers in the device when the driver reports
+ *  that it has none. Periodic transmit and bursts run on a timer thread per
+ *  handle; auto-response buffers are looked up by id, in a hash table, as
+ *  frames are read, and answered from the reading thread.
+ */
+
+#ifndef SWOBJBUF_H
+#define SWOBJBUF_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "canlib.h"
+
+// Software buffer indices start here, to keep them apart from the device's
+#define SWOBJBUF_FIRST   kvOBJBUF_SOFTWARE_INDEX
+#define SWOBJBUF_MAX     128
+#define SWOBJBUF_HASH    64
+
+struct HandleData;
+
+typedef struct {
+  int           type;        // canOBJBUF_TYPE_xxx, 0 when free
+  int           enabled;
+  long          id;
+  unsigned int  dlc;
+  unsigned int  flags;       // canMSG_xxx
+  unsigned char data[64];
+  unsigned int  code;        // Auto-response filter
+  unsigned int  mask;
+  unsigned int  objFlags;    // canOBJBUF_AUTO_RESPONSE_xxx
+  unsigned int  periodUs;    // 0 for no periodic transmit
+  unsigned int  msgCount;    // Stop after this many, 0 for no limit
+  unsigned int  burstLeft;
+  int64_t       nextNs;      // Next periodic transmit
+  unsigned int  nPeriodic;   // Periodic transmits since enabled
+  uint64_t      nJitter;
+  short         hashNext;    // Next auto-response buffer in the chain
+  kvObjBufStats stats;
+  double        jitterSumUs;
+  double        responseSumUs;
+} SwObjBuf;
+
+typedef struct SwObjBufs {
+  struct HandleData *hData;
+  pthread_mutex_t   lock;
+  pthread_cond_t    cond;
+  pthread_t         thread;
+  int               running;
+  int               stop;
+  int               nResponders;   // Enabled auto-response buffers
+  short             hash[SWOBJBUF_HASH];  // Exact id match chains
+  short             wildcard;      // Chain of masked filters
+  SwObjBuf          buf[SWOBJBUF_MAX];
+} SwObjBufs;
+
+int swObjBufNoHardware (int error);
+canStatus swObjBufAllocate (struct HandleData *hData, int type, int *number);
+canStatus swObjBufFree (struct HandleData *hData, int idx);
+canStatus swObjBufFreeAll (struct HandleData *hData);
+canStatus swObjBufWrite (struct HandleData *hData, int idx, int id, void *msg,
+                         unsigned int dlc, unsigned int flags);
+canStatus swObjBufSetFilter (struct HandleData *hData, int idx,
+                             unsigned int code, unsigned int mask);
+canStatus swObjBufSetFlags (struct HandleData *hData, int idx, unsigned int flags);
+canStatus swObjBufSetPeriod (struct HandleData *hData, int idx, unsigned int period);
+canStatus swObjBufSetMsgCount (struct HandleData *hData, int idx, unsigned int count);
+canStatus swObjBufSendBurst (struct HandleData *hData, int idx, unsigned int burstLen);
+canStatus swObjBufEnable (struct HandleData *hData, int idx);
+canStatus swObjBufDisable (struct HandleData *hData, int idx);
+canStatus swObjBufGetStats (struct HandleData *hData, int idx, kvObjBufStats *stats);
+void swObjBufReceived (SwObjBufs *sw, long id, unsigned int flags);
+void swObjBufDestroy (struct HandleData *hData);
+
+#endif  /* SWOBJBUF_H */
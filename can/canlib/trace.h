@@ -0,0 +1,178 @@
+/*
+**             Copyright 2017 by Kvaser AB, Molndal, Sweden
+**                        http://www.kvaser.com
+**
+** This software is dual licensed under the following two licenses:
+** BSD-new and GPLv2. You may use either one. See the included
+** COPYING file for details.
+**
+** License: BSD-new
+** ===============================================================================
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of the <organization> nor the
+**       names of its contributors may be used to endorse or promote products
+**       derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+** DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+** DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+** (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+** LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+** ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**
+**
+** License: GPLv2
+** ===============================================================================
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+** ---------------------------------------------------------------------------
+**/
+
+/*  Kvaser Linux Canlib static tracepoints
+ *
+ *  When <sys/sdt.h> (systemtap-sdt-dev) is available at build time, the
+ *  probes below are compiled in as USDT probes under the provider "canlib".
+ *  A disabled probe is a single nop, so they stay in release builds and can
+ *  be attached to with e.g.
+ *
+ *    bpftrace -e 'usdt:/usr/lib/libcanlib.so:canlib:write_return
+ *                 { @lat = hist(arg3); }'
+ *
+ *  Build with -DCANLIB_NO_TRACE to leave them out.
+ *
+ *  Probe                        Arguments
+ *  ---------------------------  ---------------------------------------------
+ *  read_entry                   handle, ioctl command
+ *  read_return                  handle, status, id, dlc, flags, latency (ns)
+ *  write_entry                  handle, id, dlc, flags
+ *  write_return                 handle, status, id, latency (ns)
+ *  tx_overflow                  handle, id, dlc
+ *  notify_dispatch              handle, events read, latency (ns)
+ *  find_handle                  handle, found (0/1)
+ *  memo_block                   handle, subcommand, bytes, status
+ *  script_block                 handle, slot, bytes, status
+ *
+ *  Ids carry canMSG_EXT in the flags argument, not in the id. Latencies on
+ *  the read and write paths cover the driver call only; frames rejected by a
+ *  parameter check never reach write_entry.
+ *
+ *  Each probe has a USDT semaphore, which tracers raise while attached.
+ *  The clock is only read for a latency while its probe is enabled; a call
+ *  that started before the probe was attached reports a latency of 0.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <time.h>
+
+#if !defined(CANLIB_NO_TRACE) && defined(__has_include)
+#  if __has_include(<sys/sdt.h>)
+#    define _SDT_HAS_SEMAPHORES 1
+#    include <sys/sdt.h>
+#    define CANLIB_TRACE 1
+#  endif
+#endif
+
+#ifdef CANLIB_TRACE
+
+// Defined in the one file that includes this with TRACE_DEFINE_SEMAPHORES
+#ifdef TRACE_DEFINE_SEMAPHORES
+#  define CANLIB_SEMAPHORE(name) \
+  __extension__ unsigned short canlib_##name##_semaphore \
+    __attribute__((unused)) __attribute__((section(".probes")))
+#else
+#  define CANLIB_SEMAPHORE(name) \
+  __extension__ extern unsigned short canlib_##name##_semaphore \
+    __attribute__((unused)) __attribute__((section(".probes")))
+#endif
+
+CANLIB_SEMAPHORE(read_entry);
+CANLIB_SEMAPHORE(read_return);
+CANLIB_SEMAPHORE(write_entry);
+CANLIB_SEMAPHORE(write_return);
+CANLIB_SEMAPHORE(tx_overflow);
+CANLIB_SEMAPHORE(notify_dispatch);
+CANLIB_SEMAPHORE(find_handle);
+CANLIB_SEMAPHORE(memo_block);
+CANLIB_SEMAPHORE(script_block);
+
+// Non-zero while a tracer is attached to the probe
+#define CANLIB_PROBE_ENABLED(name)  __builtin_expect(canlib_##name##_semaphore, 0)
+
+#define CANLIB_PROBE1(name, a)                DTRACE_PROBE1(canlib, name, a)
+#define CANLIB_PROBE2(name, a, b)             DTRACE_PROBE2(canlib, name, a, b)
+#define CANLIB_PROBE3(name, a, b, c)          DTRACE_PROBE3(canlib, name, a, b, c)
+#define CANLIB_PROBE4(name, a, b, c, d)       DTRACE_PROBE4(canlib, name, a, b, c, d)
+#define CANLIB_PROBE5(name, a, b, c, d, e)    DTRACE_PROBE5(canlib, name, a, b, c, d, e)
+#define CANLIB_PROBE6(name, a, b, c, d, e, f) DTRACE_PROBE6(canlib, name, a, b, c, d, e, f)
+
+// Timestamp for probe latencies; a vDSO call, next to an ioctl
+static inline int64_t traceNowNs (void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Start of a probe latency, 0 unless the probe is enabled
+#define TRACE_START(name)  (CANLIB_PROBE_ENABLED(name) ? traceNowNs() : 0)
+
+static inline int64_t traceSinceNs (int64_t start)
+{
+  return start ? traceNowNs() - start : 0;
+}
+
+#else
+
+// Arguments are referenced, so they count as used, but never evaluated
+static inline void traceDiscard (int dummy, ...)
+{
+  (void)dummy;
+}
+
+#define CANLIB_PROBE_OFF(...)  do { if (0) traceDiscard(0, __VA_ARGS__); } while (0)
+
+#define CANLIB_PROBE1(name, a)                CANLIB_PROBE_OFF(a)
+#define CANLIB_PROBE2(name, a, b)             CANLIB_PROBE_OFF(a, b)
+#define CANLIB_PROBE3(name, a, b, c)          CANLIB_PROBE_OFF(a, b, c)
+#define CANLIB_PROBE4(name, a, b, c, d)       CANLIB_PROBE_OFF(a, b, c, d)
+#define CANLIB_PROBE5(name, a, b, c, d, e)    CANLIB_PROBE_OFF(a, b, c, d, e)
+#define CANLIB_PROBE6(name, a, b, c, d, e, f) CANLIB_PROBE_OFF(a, b, c, d, e, f)
+
+#define CANLIB_PROBE_ENABLED(name)  0
+#define TRACE_START(name)           ((int64_t)0)
+
+static inline int64_t traceSinceNs (int64_t start)
+{
+  (void)start;
+  return 0;
+}
+
+#endif
+
+#endif  /* TRACE_H */